@@ -2,20 +2,20 @@ QT       += core gui
 
 greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 
-CONFIG += c++11
-
 # You can make your code fail to compile if it uses deprecated APIs.
 # In order to do so, uncomment the following line.
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
+include(acquisition_core.pri)
+
 SOURCES += \
+    cell_plot_widget.cpp \
     main.cpp \
-    mainwindow.cpp \
-    usb2uis_interface.cpp
+    mainwindow.cpp
 
 HEADERS += \
-    mainwindow.h \
-    usb2uis_interface.h
+    cell_plot_widget.h \
+    mainwindow.h
 
 FORMS += \
     mainwindow.ui
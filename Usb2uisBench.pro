@@ -0,0 +1,19 @@
+# 擷取 hot path benchmark (QtTest QBENCHMARK), 以模擬 AFE chain 當作假 USB2UIS
+#   Usb2uisBench -o bench.xml,xml
+
+QT       += testlib
+QT       -= gui
+
+CONFIG += console
+CONFIG -= app_bundle
+
+TARGET = Usb2uisBench
+
+# 與 Usb2uisApp 在同一目錄 in-source build 時分開 object 檔
+OBJECTS_DIR = obj_bench
+MOC_DIR     = moc_bench
+
+include(acquisition_core.pri)
+
+SOURCES += \
+    bench_acquisition.cpp
@@ -0,0 +1,20 @@
+QT       -= gui
+
+CONFIG += console
+CONFIG -= app_bundle
+
+TARGET = Usb2uisCli
+
+# 與 Usb2uisApp 在同一目錄 in-source build 時分開 object 檔
+OBJECTS_DIR = obj_cli
+MOC_DIR     = moc_cli
+
+include(acquisition_core.pri)
+
+SOURCES += \
+    cli_main.cpp
+
+# Default rules for deployment.
+qnx: target.path = /tmp/$${TARGET}/bin
+else: unix:!android: target.path = /opt/$${TARGET}/bin
+!isEmpty(target.path): INSTALLS += target
@@ -0,0 +1,19 @@
+# 擷取核心的功能測試 (QtTest), 以模擬 AFE chain 當作假 USB2UIS; 不需要硬體
+#   Usb2uisTest -o test.xml,xml
+
+QT       += testlib
+QT       -= gui
+
+CONFIG += console testcase
+CONFIG -= app_bundle
+
+TARGET = Usb2uisTest
+
+# 與 Usb2uisApp 在同一目錄 in-source build 時分開 object 檔
+OBJECTS_DIR = obj_test
+MOC_DIR     = moc_test
+
+include(acquisition_core.pri)
+
+SOURCES += \
+    test_acquisition.cpp
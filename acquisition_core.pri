@@ -0,0 +1,56 @@
+# USB2UIS 擷取核心: 後端, 命令清單, transaction plan, 解碼, 擷取檔
+# Usb2uisApp.pro (GUI) 與 Usb2uisCli.pro (production test) 共用
+
+QT += core
+
+CONFIG += c++17
+
+INCLUDEPATH += $$PWD
+
+SOURCES += \
+    $$PWD/acquisition_worker.cpp \
+    $$PWD/adbms6832.cpp \
+    $$PWD/adbms6832_decoder.cpp \
+    $$PWD/adbms6832_sim_backend.cpp \
+    $$PWD/capture_file.cpp \
+    $$PWD/cell_plot_store.cpp \
+    $$PWD/cell_stats_store.cpp \
+    $$PWD/cmd_library.cpp \
+    $$PWD/cycle_scheduler.cpp \
+    $$PWD/device_manager.cpp \
+    $$PWD/precision_timer.cpp \
+    $$PWD/sequencer.cpp \
+    $$PWD/spi_log.cpp \
+    $$PWD/spi_rate_tuner.cpp \
+    $$PWD/spi_trace.cpp \
+    $$PWD/spi_transaction_plan.cpp \
+    $$PWD/usb2uis_backend.cpp \
+    $$PWD/usb2uis_dll_backend.cpp \
+    $$PWD/usb2uis_interface.cpp \
+    $$PWD/usb2uis_record_backend.cpp \
+    $$PWD/usb2uis_submit_queue.cpp
+
+HEADERS += \
+    $$PWD/acquisition_worker.h \
+    $$PWD/adbms6832.h \
+    $$PWD/adbms6832_decoder.h \
+    $$PWD/adbms6832_sim_backend.h \
+    $$PWD/capture_file.h \
+    $$PWD/cell_plot_store.h \
+    $$PWD/cell_stats_store.h \
+    $$PWD/cmd_library.h \
+    $$PWD/cycle_scheduler.h \
+    $$PWD/device_manager.h \
+    $$PWD/precision_timer.h \
+    $$PWD/sequencer.h \
+    $$PWD/spi_log.h \
+    $$PWD/spi_rate_tuner.h \
+    $$PWD/spi_trace.h \
+    $$PWD/spi_transaction_plan.h \
+    $$PWD/usb2uis_backend.h \
+    $$PWD/usb2uis_dll_backend.h \
+    $$PWD/usb2uis_interface.h \
+    $$PWD/usb2uis_record_backend.h \
+    $$PWD/usb2uis_submit_queue.h
+
+win32: LIBS += -lwinmm
@@ -0,0 +1,533 @@
+#include "acquisition_worker.h"
+
+#include <QDeadlineTimer>
+#include "precision_timer.h"
+
+AcquisitionWorker::AcquisitionWorker(QObject *parent)
+    : QObject(parent), m_chainLength(1), m_chunkBytes(0), m_readSetStep(-1)
+{
+    qRegisterMetaType<SpiReadParams>("SpiReadParams");
+    qRegisterMetaType<SpiReadSetParams>("SpiReadSetParams");
+    qRegisterMetaType<SpiWriteParams>("SpiWriteParams");
+    qRegisterMetaType<SeqRunParams>("SeqRunParams");
+    qRegisterMetaType<SpiRateTuneParams>("SpiRateTuneParams");
+    qRegisterMetaType<SpiRateTuneStep>("SpiRateTuneStep");
+    qRegisterMetaType<SpiRateTuneResult>("SpiRateTuneResult");
+    qRegisterMetaType<AfeChainSample>("AfeChainSample");
+    qRegisterMetaType<BYTE>("BYTE");
+    qRegisterMetaType<DWORD>("DWORD");
+
+    // 閒置時由 event loop 執行; 擷取中 invoke 會排在目前的 run 之後, 實際在 cycle 之間就已處理
+    m_submitQueue.setNotify([this]() {
+        QMetaObject::invokeMethod(this, "drainSubmitQueue", Qt::QueuedConnection);
+    });
+}
+
+AcquisitionWorker::~AcquisitionWorker()
+{
+    closeDevice();
+}
+
+void AcquisitionWorker::cancel()
+{
+    m_cancel.storeRelease(1);
+    QMutexLocker lock(&m_waitMutex);
+    m_waitCond.wakeAll();
+}
+
+void AcquisitionWorker::setPaused(bool paused)
+{
+    m_paused.storeRelease(paused ? 1 : 0);
+    QMutexLocker lock(&m_waitMutex);
+    m_waitCond.wakeAll();
+}
+
+bool AcquisitionWorker::isPaused() const
+{
+    return m_paused.loadAcquire() != 0;
+}
+
+void AcquisitionWorker::updateReadSet(int setId, const QList<QByteArray> &cmds)
+{
+    if (cmds.isEmpty()) return;     // SET 被刪除時維持原本的命令
+
+    QMutexLocker lock(&m_swapMutex);
+    m_swapSetId = setId;
+    m_swapCmds  = cmds;
+    m_swapPending.storeRelease(1);
+}
+
+/* 有待換的命令且屬於 setId 時取出; cycle 之間呼叫 */
+bool AcquisitionWorker::takeReadSet(int setId, QList<QByteArray> &cmds)
+{
+    QMutexLocker lock(&m_swapMutex);
+    m_swapPending.storeRelease(0);
+    if (m_swapSetId != setId) return false;
+    cmds = m_swapCmds;
+    m_swapCmds.clear();
+    return true;
+}
+
+bool AcquisitionWorker::isCancelled() const
+{
+    return m_cancel.loadAcquire() != 0;
+}
+
+void AcquisitionWorker::setRetryPolicy(const SpiRetryPolicy &policy)
+{
+    QMutexLocker lock(&m_policyMutex);
+    m_retryPolicy = policy;
+}
+
+/* 每次擷取開始: 清除 cancel, 套用最新的重試策略並將計數歸零 */
+void AcquisitionWorker::beginRun()
+{
+    m_cancel.storeRelease(0);
+    {
+        QMutexLocker lock(&m_policyMutex);
+        m_executor.setRetryPolicy(m_retryPolicy);
+    }
+    m_executor.recoveryStats().reset();
+    m_executor.setDeadline(0);
+    m_readSetStep.storeRelease(-1);
+}
+
+/*
+ * 有命令重試用完仍失敗的 cycle: 寫入 log 並通知 UI (不中止),
+ * 連續 maxFailedCycles 個 cycle 失敗時回傳 true (停止擷取)
+ */
+bool AcquisitionWorker::cycleFailed(int *failedCycles, const QString &error)
+{
+    reportError(error);
+
+    const int limit = m_executor.retryPolicy().maxFailedCycles;
+    return limit > 0 && ++*failedCycles >= limit;
+}
+
+/* 錯誤寫入 log 並通知 UI */
+void AcquisitionWorker::reportError(const QString &error)
+{
+    if (m_log) {
+        const QByteArray text = error.toUtf8();
+        m_log->append(SPI_LOG_ERROR, (const BYTE*)text.constData(), text.size(), 0, deviceIndex);
+    }
+    emit acquisitionError(error);
+}
+
+void AcquisitionWorker::setTransferConfig(int chainLength, int chunkBytes)
+{
+    m_chainLength.storeRelease(qMax(chainLength, 1));
+    m_chunkBytes.storeRelease(qMax(chunkBytes, 0));
+}
+
+/* 等待 repeat interval; 暫停時持續等待, 被 cancel 時立即返回 false */
+bool AcquisitionWorker::waitRepeatInterval(int ms)
+{
+    QDeadlineTimer deadline(ms > 0 ? ms : 0);
+
+    QMutexLocker lock(&m_waitMutex);
+    while (!isCancelled()) {
+        if (isPaused()) {
+            m_waitCond.wait(&m_waitMutex);
+            continue;
+        }
+        if (deadline.hasExpired()) return true;
+        m_waitCond.wait(&m_waitMutex, deadline);
+    }
+    return false;
+}
+
+/*
+ * 等到絕對時間 deadlineNs: 先在 wait condition 上等 (可被 cancel/pause 喚醒),
+ * 最後一段交給 PrecisionTimer. 暫停過時 *paused = true; 被 cancel 時回傳 false.
+ */
+bool AcquisitionWorker::waitUntilNs(qint64 deadlineNs, bool *paused)
+{
+    {
+        QMutexLocker lock(&m_waitMutex);
+        while (!isCancelled()) {
+            if (isPaused()) {
+                *paused = true;
+                m_waitCond.wait(&m_waitMutex);
+                continue;
+            }
+            const qint64 coarseNs = deadlineNs - PrecisionTimer::nowNs() - PrecisionTimer::sleepOvershootNs();
+            if (coarseNs < 1000000) break;
+            m_waitCond.wait(&m_waitMutex, (unsigned long)(coarseNs / 1000000));
+        }
+        if (isCancelled()) return false;
+    }
+    if (!*paused) PrecisionTimer::waitUntilNs(deadlineNs);
+    return true;
+}
+
+/* ratePeriodNs > 0 時以 CycleScheduler 固定速率重複, 否則沿用 repeatInterval */
+void AcquisitionWorker::startSchedule(qint64 ratePeriodNs, BYTE policy)
+{
+    const qint64 now = PrecisionTimer::nowNs();
+    m_scheduler.start(ratePeriodNs, eTypeCyclePolicy(policy), now);
+    m_scheduler.beginCycle(now);
+}
+
+void AcquisitionWorker::drainSubmitQueue()
+{
+    if (!deviceConnected) {
+        m_submitQueue.cancelAll("Device not open");
+        return;
+    }
+    m_submitQueue.drain(m_executor);
+}
+
+bool AcquisitionWorker::waitNextCycle(int repeatIntervalMs)
+{
+    // submit 的交易在 cycle 之間執行, 耗時計入本 cycle
+    m_submitQueue.drain(m_executor);
+
+    if (m_scheduler.periodNs() <= 0) {
+        m_scheduler.endCycle(PrecisionTimer::nowNs());
+        if (!waitRepeatInterval(repeatIntervalMs)) return false;
+        m_scheduler.beginCycle(PrecisionTimer::nowNs());
+        return true;
+    }
+
+    bool paused = false;
+    if (!waitUntilNs(m_scheduler.endCycle(PrecisionTimer::nowNs()), &paused)) return false;
+
+    // 暫停期間錯過的 slot 不算 miss, 由恢復的時間點重新起算
+    const qint64 now = PrecisionTimer::nowNs();
+    if (paused) m_scheduler.resync(now);
+    m_scheduler.beginCycle(now);
+    return true;
+}
+
+bool AcquisitionWorker::openDevice()
+{
+    if (!deviceConnected) {
+        deviceIndex = Usb2UisInterface::USBIO_OpenDevice();
+        deviceConnected = (deviceIndex != 0xFF);
+        m_executor.setDevice(deviceIndex);
+    }
+    emit deviceOpened(deviceConnected, deviceIndex);
+    return deviceConnected;
+}
+
+void AcquisitionWorker::closeDevice()
+{
+    if (!deviceConnected) return;
+
+    Usb2UisInterface::USBIO_CloseDevice(deviceIndex);
+    deviceConnected = false;
+    deviceIndex = 0xFF;
+    m_submitQueue.cancelAll("Device closed");
+    emit deviceClosed();
+}
+
+/* gpioDir: 1=input, 0=output; IO1(PIN J7-10) 為 South 方向的 CS, 需為 output */
+bool AcquisitionWorker::configureDevice(BYTE index, BYTE configByte, DWORD timeout, BYTE gpioDir, bool *gpioOk)
+{
+    bool ok = Usb2UisInterface::USBIO_SetGPIOConfig(index, gpioDir);
+    if (gpioOk) *gpioOk = ok;
+
+    //Gpio set High (IO1, IO2 一次寫入; 已是 High 時 shadow 不送出)
+    Usb2UisInterface::GPIOUpdate(index, (1 << USB2UIS_GPIO_IO1) | (1 << USB2UIS_GPIO_IO2), 0);
+
+    return Usb2UisInterface::USBIO_SPISetConfig(index, configByte, timeout);
+}
+
+void AcquisitionWorker::applyConfig(BYTE configByte, DWORD timeout, BYTE gpioDir)
+{
+    if (!deviceConnected) return;
+
+    bool gpioOk = false;
+    bool spiOk = configureDevice(deviceIndex, configByte, timeout, gpioDir, &gpioOk);
+    m_executor.reset();
+    emit configApplied(gpioOk, spiOk);
+}
+
+/* cycle 中有 RDxx 命令時送出解碼結果 */
+void AcquisitionWorker::emitSample(AfeChainSample &sample, int setId)
+{
+    if (sample.groupsSeen == 0) return;
+    sample.timeNs  = PrecisionTimer::nowNs();
+    sample.setId   = setId;
+    sample.adapter = deviceIndex;
+    emit afeSample(sample);
+}
+
+/* 由 UI 參數編譯 plan 的共同設定 */
+SpiPlanOptions AcquisitionWorker::planOptions(int dummyCount, int delayMs, bool dirNorth) const
+{
+    SpiPlanOptions opt;
+    opt.dummyCount = dummyCount;
+    opt.cmdDelayMs = delayMs;
+    opt.dirNorth   = dirNorth;
+    opt.readSize   = WORD(adbmsChainBytes(chainLength()));
+    opt.chunkBytes = m_chunkBytes.loadAcquire();
+    return opt;
+}
+
+SpiTransactionPlan AcquisitionWorker::compileReadOne(const SpiReadParams &p) const
+{
+    SpiPlanOptions opt = planOptions(p.dummyCount, p.delayMs, p.dirNorth);
+    opt.wakeGapUs    = 1000;        //Refer AFE Spec.
+    if (p.readSize) opt.readSize = p.readSize;
+    opt.abortOnError = true;
+    opt.adcPoll      = p.adcPoll;
+    opt.adcTimeoutUs = p.adcTimeoutUs;
+    return SpiPlanCompiler::compileRead(QList<QByteArray>() << p.cmd, opt);
+}
+
+/* Read One 每個讀回結果: log, 擷取檔, 解碼 (runSpiRead 與 submitReadOne 共用) */
+void AcquisitionWorker::readOneResult(const SpiReadParams &p, WORD cmdIndex, const BYTE *data, int size, AfeChainSample &sample)
+{
+    if (m_log) m_log->append(SPI_LOG_READ, data, size, cmdIndex, deviceIndex);
+    if (m_capture) m_capture->append(0, (const BYTE*)p.cmd.constData(), p.cmd.size(), data, size, deviceIndex);
+    Adbms6832Decoder::decode((const BYTE*)p.cmd.constData(), p.cmd.size(), data, size, p.dirNorth, sample);
+}
+
+/* callback 在本 worker 的執行緒 (drain / cancelAll) */
+bool AcquisitionWorker::submitReadOne(const SpiReadParams &p)
+{
+    return m_submitQueue.submit(compileReadOne(p), [this, p](const UsbTransactionResult &r) {
+        AfeChainSample sample;
+        for (const QByteArray &data : r.data)
+            readOneResult(p, 0, (const BYTE*)data.constData(), data.size(), sample);
+        if (r.result == USB_TXN_ERROR || r.result == USB_TXN_CANCELLED)
+            reportError(r.error);
+        else
+            emitSample(sample, 0);
+    });
+}
+
+void AcquisitionWorker::runSpiRead(const SpiReadParams &p)
+{
+    if (!deviceConnected) return;
+
+    beginRun();
+    emit acquisitionStarted();
+
+    const SpiTransactionPlan plan = compileReadOne(p);
+
+    int32_t iteration = 0;
+    int failedCycles = 0;
+    AfeChainSample sample;
+    startSchedule(p.repeatEnable ? p.ratePeriodNs : 0, p.ratePolicy);
+
+    while (true)
+    {
+        sample.clear();
+        m_executor.setDeadline(m_scheduler.deadlineNs());
+        eTypeSpiPlanResult r = m_executor.runCycle(plan, [this, &p, &sample](const SpiOp &op, const BYTE *data, int size) {
+            readOneResult(p, op.cmdIndex, data, size, sample);
+            return true;
+        });
+        if (r == SPI_PLAN_ERROR) {
+            if (cycleFailed(&failedCycles, m_executor.lastError())) break;
+        } else {
+            failedCycles = 0;
+            emitSample(sample, 0);
+        }
+
+        iteration++;
+
+        if (!p.repeatEnable || (p.repeatCount > 0 && iteration >= p.repeatCount)) break;
+        if (!waitNextCycle(p.repeatInterval)) break;
+    }
+
+    emit planStats(m_executor.lastUsbCalls(), plan.ops.size());
+    emit acquisitionFinished(iteration);
+}
+
+void AcquisitionWorker::runSpiReadSet(const SpiReadSetParams &p)
+{
+    if (!deviceConnected) return;
+    if (p.cmds.isEmpty()) return;
+
+    beginRun();
+    m_swapPending.storeRelease(0);
+    emit acquisitionStarted();
+
+    // 整個 SET 只編譯一次 (命令被重新載入時才重新編譯)
+    SpiPlanOptions opt = planOptions(p.dummyCount, p.delayMs, p.dirNorth);
+    if (p.readSize) opt.readSize = p.readSize;
+    opt.adcPoll      = p.adcPoll;
+    opt.adcTimeoutUs = p.adcTimeoutUs;
+    QList<QByteArray>  cmds = p.cmds;
+    SpiTransactionPlan plan = SpiPlanCompiler::compileRead(cmds, opt);
+
+    int iteration = 0;
+    int failedCycles = 0;
+    AfeChainSample sample;
+    startSchedule(p.repeatEnable ? p.ratePeriodNs : 0, p.ratePolicy);
+    while (true) {
+        // 只在 cycle 之間換成新的命令, 同一個 cycle 內不會混用新舊命令
+        if (m_swapPending.loadAcquire() && takeReadSet(p.setId, cmds)) {
+            plan = SpiPlanCompiler::compileRead(cmds, opt);
+        }
+
+        sample.clear();
+        m_executor.setDeadline(m_scheduler.deadlineNs());
+        eTypeSpiPlanResult r = m_executor.runCycle(plan, [this, &p, &cmds, &sample](const SpiOp &op, const BYTE *data, int size) {
+            // ListView 指示目前執行第幾條 (UI 以 timer 讀取最新值, 不逐條送 signal)
+            m_readSetStep.storeRelease(op.cmdIndex);
+            if (m_log) m_log->append(SPI_LOG_READ, data, size, op.cmdIndex, deviceIndex);
+
+            const QByteArray &cmd = cmds.at(op.cmdIndex);
+            if (m_capture) m_capture->append(p.setId, (const BYTE*)cmd.constData(), cmd.size(), data, size, deviceIndex);
+            Adbms6832Decoder::decode((const BYTE*)cmd.constData(), cmd.size(), data, size, p.dirNorth, sample);
+
+            // 只在指令之間 (CS HIGH) 回應暫停/取消
+            if (isPaused() && !waitRepeatInterval(0)) return false;
+            return !isCancelled();
+        });
+        if (r != SPI_PLAN_OK) break;
+        // USB 失敗的命令沒有回報, 其餘命令的結果照常送出
+        if (m_executor.lastDropped() == 0) failedCycles = 0;
+        else if (cycleFailed(&failedCycles, m_executor.lastError())) break;
+        emitSample(sample, p.setId);
+
+        ++iteration;
+        if (!p.repeatEnable || (p.repeatCount > 0 && iteration >= p.repeatCount)) break;
+        if (!waitNextCycle(p.repeatInterval)) break;
+    }
+
+    emit planStats(m_executor.lastUsbCalls(), plan.ops.size());
+    emit acquisitionFinished(iteration);
+}
+
+//SPI CMD+寫入
+void AcquisitionWorker::runSpiWrite(const SpiWriteParams &p)
+{
+    if (!deviceConnected) return;
+
+    beginRun();
+    emit acquisitionStarted();
+
+    SpiPlanOptions opt = planOptions(p.dummyCount, p.delayMs, p.dirNorth);
+    opt.abortOnError = true;
+
+    // 每顆 AFE 的資料由同一個 register group 範本產生, 直接填入 buffer
+    QByteArray data = p.data;
+    if (p.replicate && p.data.size() >= ADBMS6832_REG_GROUP_SIZE) {
+        const int devices = chainLength();
+        data.resize(adbmsChainBytes(devices));
+        adbmsBuildChainWrite((BYTE*)data.data(), (const BYTE*)p.data.constData(), devices);
+    }
+    const SpiTransactionPlan plan = SpiPlanCompiler::compileWrite(p.cmd, data, opt);
+
+    int32_t iteration = 0;
+    while (true) {
+        eTypeSpiPlanResult r = m_executor.runCycle(plan, [this](const SpiOp &op, const BYTE *data, int size) {
+            if (m_log) m_log->append(SPI_LOG_WRITE, data, size, op.cmdIndex, deviceIndex);
+            return true;
+        });
+        if (r == SPI_PLAN_ERROR) {
+            emit acquisitionError(m_executor.lastError());
+            break;
+        }
+
+        iteration++;
+
+        if (!p.repeatEnable || (p.repeatCount > 0 && iteration >= p.repeatCount)) break;
+        m_submitQueue.drain(m_executor);
+        if (!waitRepeatInterval(p.repeatInterval)) break;
+    }
+
+    emit planStats(m_executor.lastUsbCalls(), plan.ops.size());
+    emit acquisitionFinished(iteration);
+}
+
+/*
+ * 序列腳本: 每個 step 的 plan 只在開始時編譯一次, 之後由 SeqInterpreter 直接執行.
+ * 每次 emit 視為一個 cycle (scheduler 只統計, 不排程); 暫停/取消在命令之間與 wait 中生效.
+ */
+void AcquisitionWorker::runSequence(const SeqRunParams &p)
+{
+    if (!deviceConnected) return;
+    if (p.program.isEmpty()) return;
+
+    beginRun();
+    emit acquisitionStarted();
+
+    SpiPlanOptions opt = planOptions(p.dummyCount, 0, p.dirNorth);
+    opt.abortOnError = true;
+    opt.adcPoll      = p.adcPoll;
+    opt.adcTimeoutUs = p.adcTimeoutUs;
+    SeqInterpreter seq(m_executor);
+    seq.link(p.program, opt, chainLength());
+
+    SeqHooks hooks;
+    hooks.onResult = [this, &seq](int step, int cmdIndex, const BYTE *data, int size) {
+        const SeqStep &s = seq.program().steps.at(step);
+        if (m_log) m_log->append(s.kind == SEQ_STEP_READ ? SPI_LOG_READ : SPI_LOG_WRITE, data, size, WORD(cmdIndex), deviceIndex);
+        if (m_capture && s.kind == SEQ_STEP_READ) {
+            const QByteArray &cmd = s.cmds.at(cmdIndex);
+            m_capture->append(0, (const BYTE*)cmd.constData(), cmd.size(), data, size, deviceIndex);
+        }
+        if (isPaused() && !waitRepeatInterval(0)) return false;
+        return !isCancelled();
+    };
+    hooks.onEmit = [this](AfeChainSample &sample) {
+        emitSample(sample, 0);
+        const qint64 now = PrecisionTimer::nowNs();
+        m_scheduler.endCycle(now);
+        m_scheduler.beginCycle(now);
+    };
+    hooks.waitUntil = [this](qint64 deadlineNs) {
+        bool paused = false;
+        return waitUntilNs(deadlineNs, &paused);
+    };
+    hooks.keepRunning = [this]() {
+        if (isPaused() && !waitRepeatInterval(0)) return false;
+        return !isCancelled();
+    };
+
+    int iteration = 0;
+    startSchedule(0, CYCLE_POLICY_SKIP);
+    while (true) {
+        const eTypeSeqResult r = seq.run(hooks);
+        if (r == SEQ_RESULT_FAILED || r == SEQ_RESULT_ERROR) emit acquisitionError(seq.lastError());
+        if (r != SEQ_RESULT_DONE) break;
+
+        ++iteration;
+        if (!p.repeatEnable || (p.repeatCount > 0 && iteration >= p.repeatCount)) break;
+        m_submitQueue.drain(m_executor);
+        if (!waitRepeatInterval(p.repeatInterval)) break;
+    }
+
+    emit planStats(seq.usbCalls(), seq.planOps());
+    emit acquisitionFinished(iteration);
+}
+
+/*
+ * SPI clock 掃描: 以目前的 chain 長度/分段設定執行 p.cmds, 結束時裝置停在選定的 rate.
+ * 取消時恢復 p.restoreRate; 暫停在 cycle 之間生效.
+ */
+void AcquisitionWorker::runRateTune(const SpiRateTuneParams &p)
+{
+    if (!deviceConnected) return;
+    if (p.cmds.isEmpty()) return;
+
+    beginRun();
+    emit acquisitionStarted();
+
+    SpiRateTuneParams q = p;
+    const SpiPlanOptions opt = planOptions(p.plan.dummyCount, p.plan.cmdDelayMs, p.plan.dirNorth);
+    q.plan.readSize   = opt.readSize;
+    q.plan.chunkBytes = opt.chunkBytes;
+
+    SpiRateTuneHooks hooks;
+    hooks.onStep = [this](const SpiRateTuneStep &step) {
+        emit rateTuneStep(step);
+    };
+    hooks.keepRunning = [this]() {
+        if (isPaused() && !waitRepeatInterval(0)) return false;
+        return !isCancelled();
+    };
+
+    const SpiRateTuneResult result = SpiRateTuner::run(m_executor, deviceIndex, q, hooks);
+    m_submitQueue.drain(m_executor);
+
+    emit rateTuneFinished(result);
+    emit acquisitionFinished(result.steps.size());
+}
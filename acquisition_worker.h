@@ -0,0 +1,214 @@
+#ifndef ACQUISITION_WORKER_H
+#define ACQUISITION_WORKER_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QList>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QAtomicInt>
+#include "usb2uis_interface.h"
+#include "spi_transaction_plan.h"
+#include "spi_log.h"
+#include "capture_file.h"
+#include "adbms6832_decoder.h"
+#include "cycle_scheduler.h"
+#include "sequencer.h"
+#include "spi_rate_tuner.h"
+#include "usb2uis_submit_queue.h"
+
+typedef  enum{
+    USB2UIS_GPIO_IO1 = 0,
+    USB2UIS_GPIO_IO2,
+    USB2UIS_GPIO_IO3,
+    USB2UIS_GPIO_IO4,
+    USB2UIS_GPIO_IO5,
+    USB2UIS_GPIO_IO6,
+    USB2UIS_GPIO_IO7,
+    USB2UIS_GPIO_IO8,
+}eTypeGPIO_IO_PORT;
+
+/* 單筆 READ (SPI Read One) 參數 */
+struct SpiReadParams {
+    QByteArray cmd;
+    WORD       readSize       = 0;      // 0: chain 長度 x 8 Bytes
+    int        delayMs        = 0;
+    int        dummyCount     = 0;
+    bool       dirNorth       = true;
+    bool       adcPoll        = false;  // ADCV/ADAX 以 poll 等待完成
+    int        adcTimeoutUs   = 10000;
+    bool       repeatEnable   = false;
+    int32_t    repeatCount    = 0;
+    int32_t    repeatInterval = 0;      // ms
+    qint64     ratePeriodNs   = 0;      // > 0: 以固定速率重複 (取代 repeatInterval)
+    BYTE       ratePolicy     = CYCLE_POLICY_SKIP;
+};
+
+/* READ SET (SPI Read Set) 參數, cmds 依原始順序 */
+struct SpiReadSetParams {
+    QList<QByteArray> cmds;
+    quint16    setId          = 0;      // 擷取檔記錄用
+    WORD       readSize       = 0;      // 0: chain 長度 x 8 Bytes
+    int        delayMs        = 0;
+    int        dummyCount     = 0;
+    bool       dirNorth       = true;
+    bool       adcPoll        = false;
+    int        adcTimeoutUs   = 10000;
+    bool       repeatEnable   = false;
+    int32_t    repeatCount    = 0;
+    int32_t    repeatInterval = 0;      // ms
+    qint64     ratePeriodNs   = 0;      // > 0: 以固定速率重複 (取代 repeatInterval)
+    BYTE       ratePolicy     = CYCLE_POLICY_SKIP;
+};
+
+/* CMD + 寫入資料 (SPI Write) 參數 */
+struct SpiWriteParams {
+    QByteArray cmd;
+    QByteArray data;
+    bool       replicate      = false;  // data 前 6 Bytes 為範本, 複製到 chain 上每顆 AFE 並重算 PEC
+    int        delayMs        = 0;
+    int        dummyCount     = 0;
+    bool       dirNorth       = true;
+    bool       repeatEnable   = false;
+    int32_t    repeatCount    = 0;
+    int32_t    repeatInterval = 0;      // ms
+};
+
+/* 序列腳本 (.seq, SeqCompiler 已編譯) 參數 */
+struct SeqRunParams {
+    SeqProgram program;
+    int        dummyCount     = 0;
+    bool       dirNorth       = true;
+    bool       adcPoll        = false;
+    int        adcTimeoutUs   = 10000;
+    bool       repeatEnable   = false;  // 整個腳本重複執行
+    int32_t    repeatCount    = 0;
+    int32_t    repeatInterval = 0;      // ms
+};
+
+Q_DECLARE_METATYPE(SpiReadParams)
+Q_DECLARE_METATYPE(SpiReadSetParams)
+Q_DECLARE_METATYPE(SpiWriteParams)
+Q_DECLARE_METATYPE(SeqRunParams)
+
+/*
+ * AcquisitionWorker
+ *  擁有 USB2UIS 裝置, 於專用 QThread 執行 SPI 讀寫序列.
+ *  讀寫資料寫入 SpiLogSink, 狀態以 queued signal 回報 UI; cancel()/setPaused() 可由任何執行緒直接呼叫.
+ */
+class AcquisitionWorker : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit AcquisitionWorker(QObject *parent = nullptr);
+    ~AcquisitionWorker();
+
+    // Thread-safe, 不經過 event queue, 立即生效
+    void cancel();
+    void setPaused(bool paused);
+    bool isPaused() const;
+
+    // 讀寫結果直接寫入 sink (不經過 event queue); 需在開始擷取前設定
+    void setLogSink(SpiLogSink *sink) { m_log = sink; }
+    // READ 結果另存擷取檔 (writer 未開啟時 append 直接返回)
+    void setCaptureWriter(CaptureWriter *writer) { m_capture = writer; }
+
+    BYTE index() const { return deviceIndex; }     // USBIO_OpenDevice 回傳值, 0xFF = 未連線
+
+    // chain 長度 (自動讀取大小/寫入範本) 與 SPI 分段大小; thread-safe, 下一次擷取生效
+    void setTransferConfig(int chainLength, int chunkBytes);
+    int  chainLength() const { return m_chainLength.loadAcquire(); }
+
+    // 清單檔重新載入: 執行中的 READ SET (setId 相同) 在下一個 cycle 開始前換成新的命令; thread-safe
+    void updateReadSet(int setId, const QList<QByteArray> &cmds);
+
+    // READ SET 最近回報結果的命令, -1 = 尚未開始; 任何執行緒可讀取
+    int readSetStep() const { return m_readSetStep.loadAcquire(); }
+
+    // 固定速率模式的統計, 任何執行緒可讀取
+    const CycleScheduler &scheduler() const { return m_scheduler; }
+
+    // 命令失敗的重試/恢復策略; thread-safe, 下一次擷取生效 (開始時計數歸零)
+    void setRetryPolicy(const SpiRetryPolicy &policy);
+    // 每條命令的錯誤/重試計數, 任何執行緒可讀取
+    const SpiRecoveryStats &recoveryStats() const { return m_executor.recoveryStats(); }
+
+    // 非同步交易: 任何執行緒 submit, 由本 worker 的執行緒執行 (閒置時立即, 擷取中於 cycle 之間)
+    Usb2UisSubmitQueue &submitQueue() { return m_submitQueue; }
+    // Read One 的 plan (runSpiRead 與 submit 共用); thread-safe
+    SpiTransactionPlan compileReadOne(const SpiReadParams &p) const;
+    // Read One 排入 submit queue; 結果與 runSpiRead 相同寫入 log/擷取檔並以 afeSample 送出. 任何執行緒, false = 佇列已滿
+    bool submitReadOne(const SpiReadParams &p);
+
+    // GPIO 方向 + CS idle 電平 + SPI 設定 (applyConfig 與 CLI 共用), 回傳 SPI 設定結果
+    static bool configureDevice(BYTE index, BYTE configByte, DWORD timeout, BYTE gpioDir, bool *gpioOk = nullptr);
+
+public slots:
+    bool openDevice();
+    void closeDevice();
+    void applyConfig(BYTE configByte, DWORD timeout, BYTE gpioDir = 0x00);
+
+    void runSpiRead(const SpiReadParams &p);
+    void runSpiReadSet(const SpiReadSetParams &p);
+    void runSpiWrite(const SpiWriteParams &p);
+    void runSequence(const SeqRunParams &p);
+    void runRateTune(const SpiRateTuneParams &p);
+    void drainSubmitQueue();
+
+signals:
+    void deviceOpened(bool ok, BYTE index);
+    void deviceClosed();
+    void configApplied(bool gpioOk, bool spiOk);
+
+    void acquisitionStarted();
+    void acquisitionFinished(int iterations);
+    void acquisitionError(const QString &msg);
+
+    void afeSample(const AfeChainSample &sample);   // 每個 cycle 有 RDxx 命令時
+    void planStats(int usbCallsPerCycle, int planOps);
+    void rateTuneStep(const SpiRateTuneStep &step);
+    void rateTuneFinished(const SpiRateTuneResult &result);
+
+private:
+    bool deviceConnected = false;
+    BYTE deviceIndex = 0xFF;
+
+    QAtomicInt m_cancel;
+    QAtomicInt m_paused;
+    QAtomicInt m_chainLength;
+    QAtomicInt m_chunkBytes;
+    QAtomicInt m_readSetStep;
+    QMutex         m_waitMutex;
+    QWaitCondition m_waitCond;
+
+    QAtomicInt        m_swapPending;
+    QMutex            m_swapMutex;
+    int               m_swapSetId = -1;
+    QList<QByteArray> m_swapCmds;
+
+    QMutex            m_policyMutex;
+    SpiRetryPolicy    m_retryPolicy;
+
+    SpiPlanExecutor m_executor;
+    CycleScheduler  m_scheduler;
+    Usb2UisSubmitQueue m_submitQueue;
+    SpiLogSink     *m_log = nullptr;
+    CaptureWriter  *m_capture = nullptr;
+
+    void emitSample(AfeChainSample &sample, int setId);
+    SpiPlanOptions planOptions(int dummyCount, int delayMs, bool dirNorth) const;
+
+    bool isCancelled() const;
+    void beginRun();
+    bool cycleFailed(int *failedCycles, const QString &error);
+    void reportError(const QString &error);
+    void readOneResult(const SpiReadParams &p, WORD cmdIndex, const BYTE *data, int size, AfeChainSample &sample);
+    bool takeReadSet(int setId, QList<QByteArray> &cmds);
+    bool waitRepeatInterval(int ms);
+    bool waitUntilNs(qint64 deadlineNs, bool *paused);
+    void startSchedule(qint64 ratePeriodNs, BYTE policy);
+    bool waitNextCycle(int repeatIntervalMs);
+};
+
+#endif // ACQUISITION_WORKER_H
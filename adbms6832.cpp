@@ -0,0 +1,65 @@
+#include "adbms6832.h"
+
+static inline char upper(char c)
+{
+    return (c >= 'a' && c <= 'z') ? char(c - 'a' + 'A') : c;
+}
+
+static bool nameEquals(const char *a, int len, const char *b)
+{
+    int i = 0;
+    for (; i < len; ++i) {
+        if (b[i] == '\0' || upper(a[i]) != b[i]) return false;
+    }
+    return b[i] == '\0';
+}
+
+const AdbmsOpcode *adbmsFindOpcode(const char *name, int len)
+{
+    for (const AdbmsOpcode &op : kAdbmsOpcodes) {
+        if (nameEquals(name, len, op.name)) return &op;
+    }
+    return nullptr;
+}
+
+struct AdbmsOption {
+    BYTE        optSet;
+    const char *name;
+    WORD        bits;
+};
+
+static const AdbmsOption kOptions[] = {
+    { ADBMS_OPT_ADCV, "RD",   ADBMS6832_ADCV_RD   },
+    { ADBMS_OPT_ADCV, "CONT", ADBMS6832_ADCV_CONT },
+    { ADBMS_OPT_ADCV, "DCP",  ADBMS6832_ADCV_DCP  },
+    { ADBMS_OPT_ADCV, "RSTF", ADBMS6832_ADCV_RSTF },
+    { ADBMS_OPT_ADCV, "OW1",  ADBMS6832_ADCV_OW1  },
+    { ADBMS_OPT_ADCV, "OW0",  ADBMS6832_ADCV_OW0  },
+    { ADBMS_OPT_ADAX, "OW",   ADBMS6832_ADAX_OW   },
+    { ADBMS_OPT_ADAX, "PUP",  ADBMS6832_ADAX_PUP  },
+};
+
+bool adbmsFindOption(int optSet, const char *name, int len, WORD *bits)
+{
+    if (optSet == ADBMS_OPT_NONE) return false;
+
+    for (const AdbmsOption &o : kOptions) {
+        if (o.optSet == optSet && nameEquals(name, len, o.name)) {
+            *bits = o.bits;
+            return true;
+        }
+    }
+
+    // ADAX 通道: CH0..CH31
+    if (optSet == ADBMS_OPT_ADAX && len >= 3 && len <= 4 && upper(name[0]) == 'C' && upper(name[1]) == 'H') {
+        int ch = 0;
+        for (int i = 2; i < len; ++i) {
+            if (name[i] < '0' || name[i] > '9') return false;
+            ch = ch * 10 + (name[i] - '0');
+        }
+        if (ch > 31) return false;
+        *bits = ADBMS6832_ADAX_CH(ch);
+        return true;
+    }
+    return false;
+}
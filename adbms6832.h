@@ -0,0 +1,272 @@
+#ifndef ADBMS6832_H
+#define ADBMS6832_H
+
+#include <cstring>
+#include "usb2uis_backend.h"
+
+/* ADBMS6832 命令碼 (11-bit, 以 2 Bytes 大端傳送, 後接 PEC15) */
+#define ADBMS6832_CMD_WRCFGA        0x0001
+#define ADBMS6832_CMD_RDCFGA        0x0002
+#define ADBMS6832_CMD_WRCFGB        0x0024
+#define ADBMS6832_CMD_RDCFGB        0x0026
+#define ADBMS6832_CMD_RDCVA         0x0004
+#define ADBMS6832_CMD_RDCVB         0x0006
+#define ADBMS6832_CMD_RDCVC         0x0008
+#define ADBMS6832_CMD_RDCVD         0x000A
+#define ADBMS6832_CMD_RDCVE         0x0009
+#define ADBMS6832_CMD_RDCVF         0x000B
+#define ADBMS6832_CMD_RDAUXA        0x0019
+#define ADBMS6832_CMD_RDAUXB        0x001A
+#define ADBMS6832_CMD_RDAUXC        0x001B
+#define ADBMS6832_CMD_RDAUXD        0x001F
+#define ADBMS6832_CMD_RDAUXE        0x0036
+#define ADBMS6832_CMD_WRCOMM        0x0721
+#define ADBMS6832_CMD_RDCOMM        0x0722
+#define ADBMS6832_CMD_PLADC         0x0718
+#define ADBMS6832_CMD_PLCADC        0x071C
+#define ADBMS6832_CMD_PLAUX         0x071E
+#define ADBMS6832_CMD_STCOMM        0x0723
+#define ADBMS6832_CMD_CLRCELL       0x0711
+#define ADBMS6832_CMD_CLRAUX        0x0712
+#define ADBMS6832_CMD_SRST          0x0027
+#define ADBMS6832_CMD_RSTCC         0x002E
+#define ADBMS6832_CMD_SNAP          0x002D
+#define ADBMS6832_CMD_UNSNAP        0x002F
+#define ADBMS6832_CMD_RDSID         0x002C
+
+/* ADCV: 0 1 RD CONT 1 1 DCP 0 RSTF OW1 OW0 */
+#define ADBMS6832_CMD_ADCV          0x0260
+#define ADBMS6832_ADCV_MASK         0x0668
+#define ADBMS6832_ADCV_RD           0x0100
+#define ADBMS6832_ADCV_CONT         0x0080
+#define ADBMS6832_ADCV_DCP          0x0010
+#define ADBMS6832_ADCV_RSTF         0x0004
+#define ADBMS6832_ADCV_OW1          0x0002
+#define ADBMS6832_ADCV_OW0          0x0001
+
+/* ADAX: 1 OW 0 PUP CH4 0 1 CH3 CH2 CH1 CH0 */
+#define ADBMS6832_CMD_ADAX          0x0410
+#define ADBMS6832_ADAX_MASK         0x0530
+#define ADBMS6832_ADAX_OW           0x0200
+#define ADBMS6832_ADAX_PUP          0x0080
+#define ADBMS6832_ADAX_CH(n)        WORD((((n) & 0x10) << 2) | ((n) & 0x0F))
+
+#define ADBMS6832_CMD_SIZE          4       // CMD0 CMD1 PEC0 PEC1
+#define ADBMS6832_REG_GROUP_SIZE    6       // 每顆 AFE 每個 register group 6 Bytes
+#define ADBMS6832_FRAME_SIZE        8       // 6 Bytes data + 2 Bytes PEC10
+#define ADBMS6832_CELL_COUNT        16
+#define ADBMS6832_AUX_COUNT         15      // AUXA..AUXE, 每組 3 個
+#define ADBMS6832_CODE_CLEARED      0x8000  // 清除後尚未轉換
+
+/* Cell 電壓換算: V = 1.5V + code * 150uV (code 為 16-bit 有號數) */
+#define ADBMS6832_CV_OFFSET_UV      1500000
+#define ADBMS6832_CV_LSB_UV         150
+
+/* ---------------- PEC 查表 (編譯期產生) ---------------- */
+
+namespace adbms6832_detail {
+
+/* PEC15: 一次處理 8 bit, t[i] = i 在 remainder 高 8 bit 時移位 8 次的結果 */
+struct Pec15Table {
+    WORD t[256];
+    constexpr Pec15Table() : t() {
+        for (int i = 0; i < 256; ++i) {
+            WORD r = WORD(i << 7);
+            for (int bit = 0; bit < 8; ++bit)
+                r = (r & 0x4000) ? WORD((r << 1) ^ 0x4599) : WORD(r << 1);
+            t[i] = WORD(r & 0x7FFF);
+        }
+    }
+};
+
+constexpr WORD pec10Shift(WORD remainder, int bits)
+{
+    for (int i = 0; i < bits; ++i)
+        remainder = (remainder & 0x200) ? WORD((remainder << 1) ^ 0x8F) : WORD(remainder << 1);
+    return WORD(remainder & 0x3FF);
+}
+
+/*
+ * PEC10: 輸入位元只影響 remainder 的高位, 低位移出時不會觸發回授,
+ *   8 bit: r' = t8[(r >> 2) ^ data] ^ ((r & 0x03) << 8)
+ *   6 bit: r' = t6[(r >> 4) ^ cc]   ^ ((r & 0x0F) << 6)
+ */
+struct Pec10Tables {
+    WORD t8[256];
+    WORD t6[64];
+    constexpr Pec10Tables() : t8(), t6() {
+        for (int i = 0; i < 256; ++i) t8[i] = pec10Shift(WORD(i << 2), 8);
+        for (int i = 0; i < 64; ++i)  t6[i] = pec10Shift(WORD(i << 4), 6);
+    }
+};
+
+inline constexpr Pec15Table  kPec15{};
+inline constexpr Pec10Tables kPec10{};
+
+} // namespace adbms6832_detail
+
+/* PEC15 (命令, poly 0x4599, seed 0x0010), 回傳值已左移 1 bit */
+constexpr WORD adbmsPec15(const BYTE *data, int len)
+{
+    WORD remainder = 16;    // PEC seed
+    for (int i = 0; i < len; ++i)
+        remainder = WORD(((remainder << 8) ^ adbms6832_detail::kPec15.t[((remainder >> 7) ^ data[i]) & 0xFF]) & 0x7FFF);
+    return WORD(remainder << 1);
+}
+
+/* 11-bit 命令碼的 PEC15 */
+constexpr WORD adbmsCmdPec(WORD cmd)
+{
+    const BYTE b[2] = { BYTE(cmd >> 8), BYTE(cmd & 0xFF) };
+    return adbmsPec15(b, 2);
+}
+
+/*
+ * PEC10 (資料, poly 0x48F, seed 0x0010)
+ * 計算時會接著 6 bit command counter (寫入時為 0), 與 AFE 相同
+ */
+constexpr WORD adbmsPec10(const BYTE *data, int len, BYTE cmdCounter)
+{
+    WORD remainder = 16;    // PEC seed
+    for (int i = 0; i < len; ++i)
+        remainder = WORD(adbms6832_detail::kPec10.t8[((remainder >> 2) ^ data[i]) & 0xFF] ^ ((remainder & 0x03) << 8));
+
+    // 6-bit command counter 接在資料之後
+    return WORD(adbms6832_detail::kPec10.t6[((remainder >> 4) ^ cmdCounter) & 0x3F] ^ ((remainder & 0x0F) << 6));
+}
+
+/* 依 PEC10 與 command counter 組成 2 Bytes 資料 PEC */
+inline void adbmsPutDataPec(BYTE *out, WORD pec10, BYTE cmdCounter)
+{
+    out[0] = BYTE(((cmdCounter & 0x3F) << 2) | ((pec10 >> 8) & 0x03));
+    out[1] = BYTE(pec10 & 0xFF);
+}
+
+/* 寫入資料: 就地填入 frames 個 8 Bytes frame 的 PEC (command counter = 0), 不配置記憶體 */
+inline void adbmsFillDataPecs(BYTE *data, int frames)
+{
+    for (int i = 0; i < frames; ++i) {
+        BYTE *frame = data + i * ADBMS6832_FRAME_SIZE;
+        adbmsPutDataPec(frame + ADBMS6832_REG_GROUP_SIZE, adbmsPec10(frame, ADBMS6832_REG_GROUP_SIZE, 0), 0);
+    }
+}
+
+/* chain 上每顆 AFE 一個 frame: 讀回大小與寫入資料長度皆為 devices * 8 Bytes */
+inline int adbmsChainBytes(int devices)
+{
+    return devices * ADBMS6832_FRAME_SIZE;
+}
+
+/* 以一個 6 Bytes register group 為範本組出整條 chain 的寫入資料 (含 PEC), out 需 adbmsChainBytes(devices) Bytes */
+inline void adbmsBuildChainWrite(BYTE *out, const BYTE *group, int devices)
+{
+    for (int i = 0; i < devices; ++i)
+        memcpy(out + i * ADBMS6832_FRAME_SIZE, group, ADBMS6832_REG_GROUP_SIZE);
+    adbmsFillDataPecs(out, devices);
+}
+
+/* 組出 4 Bytes 命令 (CMD + PEC15) */
+inline void adbmsBuildCmd(BYTE *out, WORD cmd)
+{
+    const WORD pec = adbmsCmdPec(cmd);
+    out[0] = BYTE(cmd >> 8);
+    out[1] = BYTE(cmd & 0xFF);
+    out[2] = BYTE(pec >> 8);
+    out[3] = BYTE(pec & 0xFF);
+}
+
+/* 檢查一個 8 Bytes 的讀回 frame (6 data + PEC), 成功時回傳 command counter */
+inline bool adbmsCheckFrame(const BYTE *frame, BYTE *cmdCounter = nullptr)
+{
+    const BYTE cc = BYTE(frame[6] >> 2);
+    const WORD pec = adbmsPec10(frame, ADBMS6832_REG_GROUP_SIZE, cc);
+    if (cmdCounter) *cmdCounter = cc;
+    return (frame[6] & 0x03) == (pec >> 8) && frame[7] == (pec & 0xFF);
+}
+
+/* ---------------- 命令表 (編譯期產生 CMD + PEC15) ---------------- */
+
+typedef enum{
+    ADBMS_OPT_NONE = 0,
+    ADBMS_OPT_ADCV,         // RD CONT DCP RSTF OW1 OW0
+    ADBMS_OPT_ADAX,         // OW PUP CH<n>
+}eTypeAdbmsOptSet;
+
+typedef enum{
+    ADBMS_CMD_KIND_ACTION = 0,  // 只有命令
+    ADBMS_CMD_KIND_READ,        // 讀回每顆 AFE 8 Bytes
+    ADBMS_CMD_KIND_WRITE,       // 接著寫入每顆 AFE 8 Bytes
+    ADBMS_CMD_KIND_POLL,        // 讀回轉換狀態
+}eTypeAdbmsCmdKind;
+
+struct AdbmsOpcode {
+    const char *name;
+    WORD        code;
+    BYTE        optSet;
+    BYTE        kind;
+    BYTE        bytes[ADBMS6832_CMD_SIZE];
+};
+
+constexpr AdbmsOpcode adbmsOpcode(const char *name, WORD code, BYTE optSet, BYTE kind)
+{
+    return AdbmsOpcode{ name, code, optSet, kind,
+                        { BYTE(code >> 8), BYTE(code & 0xFF), BYTE(adbmsCmdPec(code) >> 8), BYTE(adbmsCmdPec(code) & 0xFF) } };
+}
+
+inline constexpr AdbmsOpcode kAdbmsOpcodes[] = {
+    adbmsOpcode("WRCFGA",  ADBMS6832_CMD_WRCFGA,  ADBMS_OPT_NONE, ADBMS_CMD_KIND_WRITE),
+    adbmsOpcode("WRCFGB",  ADBMS6832_CMD_WRCFGB,  ADBMS_OPT_NONE, ADBMS_CMD_KIND_WRITE),
+    adbmsOpcode("RDCFGA",  ADBMS6832_CMD_RDCFGA,  ADBMS_OPT_NONE, ADBMS_CMD_KIND_READ),
+    adbmsOpcode("RDCFGB",  ADBMS6832_CMD_RDCFGB,  ADBMS_OPT_NONE, ADBMS_CMD_KIND_READ),
+    adbmsOpcode("RDCVA",   ADBMS6832_CMD_RDCVA,   ADBMS_OPT_NONE, ADBMS_CMD_KIND_READ),
+    adbmsOpcode("RDCVB",   ADBMS6832_CMD_RDCVB,   ADBMS_OPT_NONE, ADBMS_CMD_KIND_READ),
+    adbmsOpcode("RDCVC",   ADBMS6832_CMD_RDCVC,   ADBMS_OPT_NONE, ADBMS_CMD_KIND_READ),
+    adbmsOpcode("RDCVD",   ADBMS6832_CMD_RDCVD,   ADBMS_OPT_NONE, ADBMS_CMD_KIND_READ),
+    adbmsOpcode("RDCVE",   ADBMS6832_CMD_RDCVE,   ADBMS_OPT_NONE, ADBMS_CMD_KIND_READ),
+    adbmsOpcode("RDCVF",   ADBMS6832_CMD_RDCVF,   ADBMS_OPT_NONE, ADBMS_CMD_KIND_READ),
+    adbmsOpcode("RDAUXA",  ADBMS6832_CMD_RDAUXA,  ADBMS_OPT_NONE, ADBMS_CMD_KIND_READ),
+    adbmsOpcode("RDAUXB",  ADBMS6832_CMD_RDAUXB,  ADBMS_OPT_NONE, ADBMS_CMD_KIND_READ),
+    adbmsOpcode("RDAUXC",  ADBMS6832_CMD_RDAUXC,  ADBMS_OPT_NONE, ADBMS_CMD_KIND_READ),
+    adbmsOpcode("RDAUXD",  ADBMS6832_CMD_RDAUXD,  ADBMS_OPT_NONE, ADBMS_CMD_KIND_READ),
+    adbmsOpcode("RDAUXE",  ADBMS6832_CMD_RDAUXE,  ADBMS_OPT_NONE, ADBMS_CMD_KIND_READ),
+    adbmsOpcode("WRCOMM",  ADBMS6832_CMD_WRCOMM,  ADBMS_OPT_NONE, ADBMS_CMD_KIND_WRITE),
+    adbmsOpcode("RDCOMM",  ADBMS6832_CMD_RDCOMM,  ADBMS_OPT_NONE, ADBMS_CMD_KIND_READ),
+    adbmsOpcode("STCOMM",  ADBMS6832_CMD_STCOMM,  ADBMS_OPT_NONE, ADBMS_CMD_KIND_ACTION),
+    adbmsOpcode("ADCV",    ADBMS6832_CMD_ADCV,    ADBMS_OPT_ADCV, ADBMS_CMD_KIND_ACTION),
+    adbmsOpcode("ADAX",    ADBMS6832_CMD_ADAX,    ADBMS_OPT_ADAX, ADBMS_CMD_KIND_ACTION),
+    adbmsOpcode("PLADC",   ADBMS6832_CMD_PLADC,   ADBMS_OPT_NONE, ADBMS_CMD_KIND_POLL),
+    adbmsOpcode("PLCADC",  ADBMS6832_CMD_PLCADC,  ADBMS_OPT_NONE, ADBMS_CMD_KIND_POLL),
+    adbmsOpcode("PLAUX",   ADBMS6832_CMD_PLAUX,   ADBMS_OPT_NONE, ADBMS_CMD_KIND_POLL),
+    adbmsOpcode("CLRCELL", ADBMS6832_CMD_CLRCELL, ADBMS_OPT_NONE, ADBMS_CMD_KIND_ACTION),
+    adbmsOpcode("CLRAUX",  ADBMS6832_CMD_CLRAUX,  ADBMS_OPT_NONE, ADBMS_CMD_KIND_ACTION),
+    adbmsOpcode("SRST",    ADBMS6832_CMD_SRST,    ADBMS_OPT_NONE, ADBMS_CMD_KIND_ACTION),
+    adbmsOpcode("RSTCC",   ADBMS6832_CMD_RSTCC,   ADBMS_OPT_NONE, ADBMS_CMD_KIND_ACTION),
+    adbmsOpcode("SNAP",    ADBMS6832_CMD_SNAP,    ADBMS_OPT_NONE, ADBMS_CMD_KIND_ACTION),
+    adbmsOpcode("UNSNAP",  ADBMS6832_CMD_UNSNAP,  ADBMS_OPT_NONE, ADBMS_CMD_KIND_ACTION),
+    adbmsOpcode("RDSID",   ADBMS6832_CMD_RDSID,   ADBMS_OPT_NONE, ADBMS_CMD_KIND_READ),
+};
+
+inline constexpr int kAdbmsOpcodeCount = int(sizeof(kAdbmsOpcodes) / sizeof(kAdbmsOpcodes[0]));
+
+// 與原本清單檔中已驗證過的 PEC 對照
+static_assert(adbmsCmdPec(ADBMS6832_CMD_RDCFGA) == 0x2B0A, "PEC15 table");
+static_assert(adbmsCmdPec(ADBMS6832_CMD_RDCVB)  == 0x9A94, "PEC15 table");
+static_assert(adbmsCmdPec(ADBMS6832_CMD_WRCOMM) == 0x24B2, "PEC15 table");
+
+/* 名稱查詢 (不分大小寫), 找不到回傳 nullptr */
+const AdbmsOpcode *adbmsFindOpcode(const char *name, int len);
+/* 命令選項, 例如 ADCV 的 "CONT", ADAX 的 "CH3"; 成功時回傳要 OR 進命令碼的 bits */
+bool adbmsFindOption(int optSet, const char *name, int len, WORD *bits);
+
+/* 讀回 register group (每顆 AFE 一個帶 PEC10 的 frame) 的命令 */
+constexpr bool adbmsIsRegisterRead(WORD cmd)
+{
+    for (const AdbmsOpcode &op : kAdbmsOpcodes)
+        if (op.code == (cmd & 0x07FF)) return op.kind == ADBMS_CMD_KIND_READ;
+    return false;
+}
+
+inline bool adbmsIsAdcv(WORD cmd) { return (cmd & ADBMS6832_ADCV_MASK) == ADBMS6832_CMD_ADCV; }
+inline bool adbmsIsAdax(WORD cmd) { return (cmd & ADBMS6832_ADAX_MASK) == ADBMS6832_CMD_ADAX; }
+
+#endif // ADBMS6832_H
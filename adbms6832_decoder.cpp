@@ -0,0 +1,147 @@
+#include "adbms6832_decoder.h"
+
+#include <cstring>
+
+typedef enum{
+    GROUP_KIND_NONE = 0,
+    GROUP_KIND_CELL,
+    GROUP_KIND_AUX,
+    GROUP_KIND_CFGA,
+    GROUP_KIND_CFGB,
+    GROUP_KIND_COMM,
+}eTypeGroupKind;
+
+/* 依 eTypeAdbmsGroup 排列: 種類, 第一個 cell/aux, 個數 */
+struct GroupLayout {
+    BYTE        kind;
+    BYTE        first;
+    BYTE        count;
+    const char *name;
+};
+
+static const GroupLayout kGroupLayout[ADBMS_GROUP_COUNT] = {
+    { GROUP_KIND_NONE, 0,  0, "-"     },
+    { GROUP_KIND_CFGA, 0,  0, "CFGA"  },
+    { GROUP_KIND_CFGB, 0,  0, "CFGB"  },
+    { GROUP_KIND_COMM, 0,  0, "COMM"  },
+    { GROUP_KIND_CELL, 0,  3, "CVA"   },
+    { GROUP_KIND_CELL, 3,  3, "CVB"   },
+    { GROUP_KIND_CELL, 6,  3, "CVC"   },
+    { GROUP_KIND_CELL, 9,  3, "CVD"   },
+    { GROUP_KIND_CELL, 12, 3, "CVE"   },
+    { GROUP_KIND_CELL, 15, 1, "CVF"   },
+    { GROUP_KIND_AUX,  0,  3, "AUXA"  },
+    { GROUP_KIND_AUX,  3,  3, "AUXB"  },
+    { GROUP_KIND_AUX,  6,  3, "AUXC"  },
+    { GROUP_KIND_AUX,  9,  3, "AUXD"  },
+    { GROUP_KIND_AUX,  12, 3, "AUXE"  },
+};
+
+AfeDeviceSample::AfeDeviceSample()
+{
+    memset(cellUv, 0, sizeof(cellUv));
+    memset(auxUv, 0, sizeof(auxUv));
+    memset(cfga, 0, sizeof(cfga));
+    memset(cfgb, 0, sizeof(cfgb));
+    memset(comm, 0, sizeof(comm));
+}
+
+void AfeChainSample::clear()
+{
+    timeNs     = 0;
+    groupsSeen = 0;
+    framesOk   = 0;
+    framesBad  = 0;
+    // 保留 devices 容量, 只重置內容
+    for (AfeDeviceSample &d : devices) d = AfeDeviceSample();
+}
+
+eTypeAdbmsGroup Adbms6832Decoder::groupOf(WORD cmd)
+{
+    switch (cmd & 0x07FF) {
+    case ADBMS6832_CMD_RDCFGA: return ADBMS_GROUP_CFGA;
+    case ADBMS6832_CMD_RDCFGB: return ADBMS_GROUP_CFGB;
+    case ADBMS6832_CMD_RDCOMM: return ADBMS_GROUP_COMM;
+    case ADBMS6832_CMD_RDCVA:  return ADBMS_GROUP_CVA;
+    case ADBMS6832_CMD_RDCVB:  return ADBMS_GROUP_CVB;
+    case ADBMS6832_CMD_RDCVC:  return ADBMS_GROUP_CVC;
+    case ADBMS6832_CMD_RDCVD:  return ADBMS_GROUP_CVD;
+    case ADBMS6832_CMD_RDCVE:  return ADBMS_GROUP_CVE;
+    case ADBMS6832_CMD_RDCVF:  return ADBMS_GROUP_CVF;
+    case ADBMS6832_CMD_RDAUXA: return ADBMS_GROUP_AUXA;
+    case ADBMS6832_CMD_RDAUXB: return ADBMS_GROUP_AUXB;
+    case ADBMS6832_CMD_RDAUXC: return ADBMS_GROUP_AUXC;
+    case ADBMS6832_CMD_RDAUXD: return ADBMS_GROUP_AUXD;
+    case ADBMS6832_CMD_RDAUXE: return ADBMS_GROUP_AUXE;
+    default:                   return ADBMS_GROUP_NONE;
+    }
+}
+
+const char *Adbms6832Decoder::groupName(int group)
+{
+    return (group > 0 && group < ADBMS_GROUP_COUNT) ? kGroupLayout[group].name : "-";
+}
+
+/* 3 個 little-endian code → uV, 回傳有效位元 (清除值視為無效) */
+static inline quint32 putCodes(const BYTE *data, int count, qint32 *uv)
+{
+    quint32 valid = 0;
+    for (int i = 0; i < count; ++i) {
+        const quint16 code = quint16(data[i * 2] | (data[i * 2 + 1] << 8));
+        uv[i] = Adbms6832Decoder::codeToUv(code);
+        if (code != ADBMS6832_CODE_CLEARED) valid |= (1u << i);
+    }
+    return valid;
+}
+
+int Adbms6832Decoder::decode(const BYTE *cmd, int cmdSize, const BYTE *rx, int size, bool dirNorth,
+                             AfeChainSample &sample)
+{
+    if (cmdSize < 2) return -1;
+    const eTypeAdbmsGroup group = groupOf(WORD((cmd[0] << 8) | cmd[1]));
+    if (group == ADBMS_GROUP_NONE) return -1;
+
+    const GroupLayout &g = kGroupLayout[group];
+    const int frames = size / ADBMS6832_FRAME_SIZE;
+    if (sample.devices.size() < frames) sample.devices.resize(frames);
+
+    const quint32 groupBit = 1u << group;
+    const quint32 fieldMask = ((1u << g.count) - 1) << g.first;
+    int errors = 0;
+
+    for (int i = 0; i < frames; ++i) {
+        // North: 第一個 frame 為 device 0; South 相反
+        AfeDeviceSample &d = sample.devices[dirNorth ? i : frames - 1 - i];
+        const BYTE *frame = rx + i * ADBMS6832_FRAME_SIZE;
+
+        BYTE cc;
+        if (!adbmsCheckFrame(frame, &cc)) {
+            ++d.pecErrors;
+            ++errors;
+            d.groupValid &= ~groupBit;
+            if (g.kind == GROUP_KIND_CELL) d.cellValid &= ~fieldMask;
+            if (g.kind == GROUP_KIND_AUX)  d.auxValid  &= ~fieldMask;
+            continue;
+        }
+
+        d.cmdCounter = cc;
+        d.groupValid |= groupBit;
+
+        switch (g.kind) {
+        case GROUP_KIND_CELL:
+            d.cellValid = (d.cellValid & ~fieldMask) | (putCodes(frame, g.count, d.cellUv + g.first) << g.first);
+            break;
+        case GROUP_KIND_AUX:
+            d.auxValid = (d.auxValid & ~fieldMask) | (putCodes(frame, g.count, d.auxUv + g.first) << g.first);
+            break;
+        case GROUP_KIND_CFGA: memcpy(d.cfga, frame, ADBMS6832_REG_GROUP_SIZE); break;
+        case GROUP_KIND_CFGB: memcpy(d.cfgb, frame, ADBMS6832_REG_GROUP_SIZE); break;
+        case GROUP_KIND_COMM: memcpy(d.comm, frame, ADBMS6832_REG_GROUP_SIZE); break;
+        }
+    }
+
+    sample.groupsSeen |= groupBit;
+    sample.framesOk   += quint32(frames - errors);
+    sample.framesBad  += quint32(errors);
+    return errors;
+}
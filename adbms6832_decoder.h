@@ -0,0 +1,79 @@
+#ifndef ADBMS6832_DECODER_H
+#define ADBMS6832_DECODER_H
+
+#include <QMetaType>
+#include <QVector>
+#include "adbms6832.h"
+
+typedef enum{
+    ADBMS_GROUP_NONE = 0,
+    ADBMS_GROUP_CFGA,
+    ADBMS_GROUP_CFGB,
+    ADBMS_GROUP_COMM,
+    ADBMS_GROUP_CVA,
+    ADBMS_GROUP_CVB,
+    ADBMS_GROUP_CVC,
+    ADBMS_GROUP_CVD,
+    ADBMS_GROUP_CVE,
+    ADBMS_GROUP_CVF,
+    ADBMS_GROUP_AUXA,
+    ADBMS_GROUP_AUXB,
+    ADBMS_GROUP_AUXC,
+    ADBMS_GROUP_AUXD,
+    ADBMS_GROUP_AUXE,
+    ADBMS_GROUP_COUNT,
+}eTypeAdbmsGroup;
+
+/* 單顆 AFE 的解碼結果; valid mask 的 bit n 對應 cell/aux n (PEC 正確且非清除值) */
+struct AfeDeviceSample {
+    qint32  cellUv[ADBMS6832_CELL_COUNT];
+    qint32  auxUv[ADBMS6832_AUX_COUNT];
+    quint32 cellValid = 0;
+    quint32 auxValid  = 0;
+    BYTE    cfga[ADBMS6832_REG_GROUP_SIZE];
+    BYTE    cfgb[ADBMS6832_REG_GROUP_SIZE];
+    BYTE    comm[ADBMS6832_REG_GROUP_SIZE];
+    quint32 groupValid = 0;     // bit = eTypeAdbmsGroup
+    BYTE    cmdCounter = 0;     // 最後一個正確 frame 的 command counter
+    quint32 pecErrors  = 0;
+
+    AfeDeviceSample();
+};
+
+/* 一個 cycle (Read One 或整個 READ SET) 的整條 chain 結果 */
+struct AfeChainSample {
+    qint64  timeNs     = 0;     // PrecisionTimer::nowNs()
+    int     setId      = 0;
+    int     adapter    = 0;     // USB2UIS index (DeviceManager 合併多台時區分來源)
+    quint32 groupsSeen = 0;     // bit = eTypeAdbmsGroup
+    quint32 framesOk   = 0;
+    quint32 framesBad  = 0;
+    QVector<AfeDeviceSample> devices;
+
+    void clear();
+};
+
+Q_DECLARE_METATYPE(AfeChainSample)
+
+/*
+ * Adbms6832Decoder
+ *  將 RDxx 讀回的 N 個 8 Bytes frame 依 chain 方向對應到裝置, 逐 frame 驗證 PEC10
+ *  並換算成 uV. 群組與欄位位置以查表處理, 無動態配置 (裝置數不變時).
+ */
+class Adbms6832Decoder
+{
+public:
+    static eTypeAdbmsGroup groupOf(WORD cmd);
+    static const char *groupName(int group);
+
+    // cmd: 4 Bytes 命令 (CMD + PEC15); 回傳該次讀回的 PEC 錯誤數, 非讀取命令回傳 -1
+    static int decode(const BYTE *cmd, int cmdSize, const BYTE *rx, int size, bool dirNorth,
+                      AfeChainSample &sample);
+
+    static inline qint32 codeToUv(quint16 code)
+    {
+        return ADBMS6832_CV_OFFSET_UV + qint32(qint16(code)) * ADBMS6832_CV_LSB_UV;
+    }
+};
+
+#endif // ADBMS6832_DECODER_H
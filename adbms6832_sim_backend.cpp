@@ -0,0 +1,487 @@
+#include "adbms6832_sim_backend.h"
+#include "adbms6832.h"
+#include "precision_timer.h"
+
+#include <QtMath>
+#include <cstring>
+
+static qint64 simNowNs()
+{
+    return PrecisionTimer::nowNs();
+}
+
+static void simBusyWaitNs(qint64 ns)
+{
+    if (ns <= 0) return;
+    PrecisionTimer::waitUntilNs(simNowNs() + ns);
+}
+
+Adbms6832SimBackend::Adbms6832SimBackend(const Adbms6832SimConfig &cfg)
+    : m_cfg(cfg)
+{
+    if (m_cfg.adapterCount < 1) m_cfg.adapterCount = 1;
+    if (m_cfg.deviceCount < 1) m_cfg.deviceCount = 1;
+
+    for (int i = 0; i < m_cfg.adapterCount; ++i) {
+        SimAdapter *a = new SimAdapter;
+        a->devices.resize(m_cfg.deviceCount);
+        resetDevices(a);
+        m_adapters.append(a);
+    }
+}
+
+Adbms6832SimBackend::~Adbms6832SimBackend()
+{
+    qDeleteAll(m_adapters);
+}
+
+qint32 Adbms6832SimBackend::modelCellUv(int device, int cell, qint64 nowNs)
+{
+    // 3.6V 基準 + 每顆/每 cell 固定偏移 + 10 秒週期的小幅漂移
+    double t = double(nowNs) / 1e9;
+    double ripple = 500.0 * qSin(2.0 * M_PI * t / 10.0 + device + cell * 0.25);
+    return qint32(3600000 + device * 10000 + cell * 2000 + ripple);
+}
+
+Adbms6832SimBackend::SimAdapter *Adbms6832SimBackend::adapter(BYTE index) const
+{
+    if (index >= m_adapters.size()) return nullptr;
+    SimAdapter *a = m_adapters[index];
+    return a->open ? a : nullptr;
+}
+
+void Adbms6832SimBackend::resetDevices(SimAdapter *a)
+{
+    static const BYTE kCfgaDefault[6] = { 0x01, 0x00, 0x00, 0xFF, 0x03, 0x00 };
+    static const BYTE kCfgbDefault[6] = { 0x00, 0xF8, 0x7F, 0x00, 0x00, 0x00 };
+
+    for (SimDevice &d : a->devices) {
+        memcpy(d.cfga, kCfgaDefault, 6);
+        memcpy(d.cfgb, kCfgbDefault, 6);
+        memset(d.comm, 0xFF, 6);
+        for (qint16 &v : d.cv) v = qint16(0x8000);
+        for (qint16 &v : d.aux) v = qint16(0x8000);
+        d.cc = 0;
+        d.pecError = false;
+    }
+    a->cellCont = false;
+    a->cellPending = false;
+    a->auxPending = false;
+}
+
+/* 每次 DLL 呼叫: 固定延遲 + (選配) SPI 傳輸時間 */
+void Adbms6832SimBackend::callDelay(const SimAdapter *a, int bytes) const
+{
+    qint64 ns = qint64(m_cfg.callLatencyUs) * 1000;
+    if (m_cfg.modelBusTime && bytes > 0) {
+        ns += qint64(bytes) * 8 * 1000000 / usb2uisSpiRateKHz(a->rate & 0x0F);
+    }
+    simBusyWaitNs(ns);
+}
+
+/* 超過 errorAboveKHz 時, 讀回的每個 Byte 以 byteErrorRate x (clock / errorAboveKHz - 1) 的機率翻轉一個 bit */
+void Adbms6832SimBackend::injectErrors(SimAdapter *a, BYTE *buffer, int size) const
+{
+    if (m_cfg.errorAboveKHz <= 0 || size <= 0) return;
+    const int khz = usb2uisSpiRateKHz(a->rate & 0x0F);
+    if (khz <= m_cfg.errorAboveKHz) return;
+
+    const double p = qMin(1.0, m_cfg.byteErrorRate * (double(khz) / m_cfg.errorAboveKHz - 1.0));
+    const quint32 threshold = quint32(p * 4294967295.0);
+    for (int i = 0; i < size; ++i) {
+        // xorshift32
+        a->noise ^= a->noise << 13;
+        a->noise ^= a->noise >> 17;
+        a->noise ^= a->noise << 5;
+        if (a->noise < threshold) buffer[i] ^= BYTE(1 << (a->noise & 7));
+    }
+}
+
+/* callFailRate 的機率讓這次 SPI 呼叫失敗 (a->lock 內呼叫) */
+bool Adbms6832SimBackend::failCall(SimAdapter *a) const
+{
+    if (m_cfg.callFailRate <= 0) return false;
+    a->noise ^= a->noise << 13;
+    a->noise ^= a->noise >> 17;
+    a->noise ^= a->noise << 5;
+    return a->noise < quint32(qMin(1.0, m_cfg.callFailRate) * 4294967295.0);
+}
+
+BYTE Adbms6832SimBackend::openDevice()
+{
+    for (int i = 0; i < m_adapters.size(); ++i) {
+        SimAdapter *a = m_adapters[i];
+        QMutexLocker lock(&a->lock);
+        if (a->open) continue;
+
+        a->open = true;
+        a->gpioDir = 0xFF;
+        a->gpioOut = 0xFF;
+        a->ce = true;
+        a->port = PortNone;
+        return BYTE(i);
+    }
+    return 0xFF;
+}
+
+bool Adbms6832SimBackend::closeDevice(BYTE index)
+{
+    SimAdapter *a = adapter(index);
+    if (!a) return false;
+
+    QMutexLocker lock(&a->lock);
+    a->open = false;
+    return true;
+}
+
+bool Adbms6832SimBackend::spiSetConfig(BYTE index, BYTE rate, DWORD timeout)
+{
+    Q_UNUSED(timeout);
+
+    SimAdapter *a = adapter(index);
+    if (!a) return false;
+
+    {
+        QMutexLocker lock(&a->lock);
+        a->rate = rate;
+    }
+    callDelay(a, 0);
+    return true;
+}
+
+bool Adbms6832SimBackend::spiRead(BYTE index, BYTE* cmd, BYTE cmdSize, BYTE* buffer, WORD size)
+{
+    SimAdapter *a = adapter(index);
+    if (!a || (size > 0 && !buffer)) return false;
+
+    {
+        QMutexLocker lock(&a->lock);
+        if (failCall(a)) return false;
+        const qint64 now = simNowNs();
+
+        if (cmd && cmdSize > 0) {
+            QByteArray discard(cmdSize, 0);
+            clockBytes(a, cmd, (BYTE*)discard.data(), cmdSize, now);
+        }
+
+        QByteArray mosi(size, char(0xFF));
+        clockBytes(a, (const BYTE*)mosi.constData(), buffer, size, now);
+        injectErrors(a, buffer, size);
+    }
+    callDelay(a, cmdSize + size);
+    return true;
+}
+
+bool Adbms6832SimBackend::spiWrite(BYTE index, BYTE* cmd, BYTE cmdSize, BYTE* buffer, WORD size)
+{
+    SimAdapter *a = adapter(index);
+    if (!a) return false;
+
+    {
+        QMutexLocker lock(&a->lock);
+        if (failCall(a)) return false;
+        const qint64 now = simNowNs();
+        QByteArray discard(qMax<int>(cmdSize, size), 0);
+
+        if (cmd && cmdSize > 0)
+            clockBytes(a, cmd, (BYTE*)discard.data(), cmdSize, now);
+        if (buffer && size > 0)
+            clockBytes(a, buffer, (BYTE*)discard.data(), size, now);
+    }
+    callDelay(a, cmdSize + size);
+    return true;
+}
+
+bool Adbms6832SimBackend::setCE(BYTE index, bool high)
+{
+    SimAdapter *a = adapter(index);
+    if (!a) return false;
+
+    {
+        QMutexLocker lock(&a->lock);
+        a->ce = high;
+        updatePort(a, simNowNs());
+    }
+    callDelay(a, 0);
+    return true;
+}
+
+bool Adbms6832SimBackend::getGPIOConfig(BYTE index, BYTE *dirByte)
+{
+    SimAdapter *a = adapter(index);
+    if (!a || !dirByte) return false;
+
+    {
+        QMutexLocker lock(&a->lock);
+        *dirByte = a->gpioDir;
+    }
+    callDelay(a, 0);
+    return true;
+}
+
+bool Adbms6832SimBackend::setGPIOConfig(BYTE index, BYTE dirByte)
+{
+    SimAdapter *a = adapter(index);
+    if (!a) return false;
+
+    {
+        QMutexLocker lock(&a->lock);
+        a->gpioDir = dirByte;
+        updatePort(a, simNowNs());
+    }
+    callDelay(a, 0);
+    return true;
+}
+
+bool Adbms6832SimBackend::gpioRead(BYTE index, BYTE *valueByte)
+{
+    SimAdapter *a = adapter(index);
+    if (!a || !valueByte) return false;
+
+    {
+        QMutexLocker lock(&a->lock);
+        // 輸入腳位視為 pull-high
+        *valueByte = BYTE((a->gpioOut & ~a->gpioDir) | a->gpioDir);
+    }
+    callDelay(a, 0);
+    return true;
+}
+
+bool Adbms6832SimBackend::gpioWrite(BYTE index, BYTE valueByte, BYTE maskByte)
+{
+    SimAdapter *a = adapter(index);
+    if (!a) return false;
+
+    {
+        QMutexLocker lock(&a->lock);
+        // maskbit=1 的腳位不變
+        a->gpioOut = BYTE((a->gpioOut & maskByte) | (valueByte & ~maskByte));
+        updatePort(a, simNowNs());
+    }
+    callDelay(a, 0);
+    return true;
+}
+
+/* North: CE 當 CS; South: IO1 (output) 當 CS, CE 保持 High */
+void Adbms6832SimBackend::updatePort(SimAdapter *a, qint64 nowNs)
+{
+    int port = PortNone;
+    if (!a->ce)
+        port = PortNorth;
+    else if (!(a->gpioDir & 0x01) && !(a->gpioOut & 0x01))
+        port = PortSouth;
+
+    if (port == a->port) return;
+
+    if (a->port != PortNone) frameEnd(a);
+    a->port = port;
+    if (port != PortNone) frameBegin(a, port, nowNs);
+
+    a->lastActivityNs = nowNs;
+}
+
+void Adbms6832SimBackend::frameBegin(SimAdapter *a, int port, qint64 nowNs)
+{
+    Q_UNUSED(port);
+
+    const qint64 idleNs = nowNs - a->lastActivityNs;
+
+    // 超過 tSLEEP: core sleep, register 回到預設值
+    if (idleNs > qint64(m_cfg.sleepTimeoutMs) * 1000000)
+        resetDevices(a);
+
+    // 超過 tIDLE: 這次 CS 下降緣只負責喚醒 chain
+    if (idleNs > qint64(m_cfg.idleTimeoutUs) * 1000)
+        a->readyAtNs = nowNs + (qint64(m_cfg.wakeupUs) + qint64(m_cfg.readyPerDeviceUs) * a->devices.size()) * 1000;
+
+    a->frameBytes = 0;
+    a->frameLost = (nowNs < a->readyAtNs);
+    a->cmdValid = false;
+    a->response.clear();
+    a->writeData.clear();
+}
+
+void Adbms6832SimBackend::frameEnd(SimAdapter *a)
+{
+    if (!a->cmdValid) return;
+
+    const int n = a->devices.size();
+    if (a->writeData.size() < n * ADBMS6832_FRAME_SIZE) return;
+
+    // North 第一筆資料推到最遠的 AFE; South 相反
+    for (int k = 0; k < n; ++k) {
+        int dev = (a->port == PortNorth) ? (n - 1 - k) : k;
+        const BYTE *frame = (const BYTE*)a->writeData.constData() + k * ADBMS6832_FRAME_SIZE;
+        SimDevice &d = a->devices[dev];
+
+        WORD pec = WORD(((frame[6] & 0x03) << 8) | frame[7]);
+        if (pec != adbmsPec10(frame, ADBMS6832_REG_GROUP_SIZE, 0)) {
+            d.pecError = true;
+            continue;
+        }
+        writeGroup(d, a->cmd, frame);
+    }
+}
+
+void Adbms6832SimBackend::clockBytes(SimAdapter *a, const BYTE *mosi, BYTE *miso, int n, qint64 nowNs)
+{
+    if (a->port == PortNone || a->frameLost) {
+        memset(miso, 0xFF, n);
+        if (a->port != PortNone) a->lastActivityNs = nowNs;
+        return;
+    }
+
+    a->lastActivityNs = nowNs;
+
+    for (int i = 0; i < n; ++i) {
+        const int pos = a->frameBytes++;
+
+        if (pos < ADBMS6832_CMD_SIZE) {
+            a->frameCmd[pos] = mosi[i];
+            miso[i] = 0xFF;
+            if (pos == ADBMS6832_CMD_SIZE - 1) decodeCommand(a, nowNs);
+            continue;
+        }
+
+        if (!a->cmdValid) {
+            miso[i] = 0xFF;
+            continue;
+        }
+
+        const int dataPos = pos - ADBMS6832_CMD_SIZE;
+        const WORD cmd = a->cmd;
+
+        if (cmd == ADBMS6832_CMD_PLCADC || cmd == ADBMS6832_CMD_PLAUX || cmd == ADBMS6832_CMD_PLADC) {
+            // 轉換中 SDO 保持 Low, 完成後 High
+            updateConversions(a, nowNs);
+            bool busy = false;
+            if (cmd != ADBMS6832_CMD_PLAUX) busy |= a->cellPending;
+            if (cmd != ADBMS6832_CMD_PLCADC) busy |= a->auxPending;
+            miso[i] = busy ? 0x00 : 0xFF;
+        } else if (!a->response.isEmpty()) {
+            miso[i] = dataPos < a->response.size() ? BYTE(a->response[dataPos]) : 0xFF;
+        } else {
+            a->writeData.append(char(mosi[i]));
+            miso[i] = 0xFF;
+        }
+    }
+}
+
+void Adbms6832SimBackend::decodeCommand(SimAdapter *a, qint64 nowNs)
+{
+    const WORD pec = WORD((a->frameCmd[2] << 8) | a->frameCmd[3]);
+    if (pec != adbmsPec15(a->frameCmd, 2)) return;     // PEC 錯誤, 命令忽略
+
+    const WORD cmd = WORD(((a->frameCmd[0] << 8) | a->frameCmd[1]) & 0x07FF);
+    a->cmd = cmd;
+    a->cmdValid = true;
+
+    updateConversions(a, nowNs);
+
+    const int n = a->devices.size();
+    BYTE group[ADBMS6832_REG_GROUP_SIZE];
+
+    // Read 命令: 先準備整條 chain 的回應 (North 由最近的 AFE 開始)
+    if (readGroup(a->devices[0], cmd, group)) {
+        a->response.resize(n * ADBMS6832_FRAME_SIZE);
+        for (int k = 0; k < n; ++k) {
+            int dev = (a->port == PortNorth) ? k : (n - 1 - k);
+            const SimDevice &d = a->devices[dev];
+            BYTE *out = (BYTE*)a->response.data() + k * ADBMS6832_FRAME_SIZE;
+            readGroup(d, cmd, out);
+            adbmsPutDataPec(out + ADBMS6832_REG_GROUP_SIZE,
+                            adbmsPec10(out, ADBMS6832_REG_GROUP_SIZE, d.cc), d.cc);
+        }
+        return;
+    }
+
+    if (cmd == ADBMS6832_CMD_PLCADC || cmd == ADBMS6832_CMD_PLAUX || cmd == ADBMS6832_CMD_PLADC)
+        return;
+
+    // 其餘命令 (write / ADC) 會增加 command counter
+    for (SimDevice &d : a->devices)
+        d.cc = BYTE(d.cc >= 63 ? 1 : d.cc + 1);
+
+    if (adbmsIsAdcv(cmd)) {
+        a->cellCont = (cmd & ADBMS6832_ADCV_CONT) != 0;
+        a->cellPending = true;
+        a->cellStartNs = nowNs;
+        a->cellDoneNs = nowNs + qint64(m_cfg.cellAdcUs) * 1000;
+    } else if (adbmsIsAdax(cmd)) {
+        a->auxPending = true;
+        a->auxDoneNs = nowNs + qint64(m_cfg.auxAdcUs) * 1000;
+    }
+}
+
+/* 依經過時間更新 ADC 結果 */
+void Adbms6832SimBackend::updateConversions(SimAdapter *a, qint64 nowNs)
+{
+    const int n = a->devices.size();
+
+    bool cellUpdate = false;
+    if (a->cellPending && nowNs >= a->cellDoneNs) {
+        a->cellPending = false;
+        cellUpdate = true;
+    } else if (a->cellCont && !a->cellPending) {
+        cellUpdate = true;      // 連續轉換: 每次讀取都是最新結果
+    }
+
+    if (cellUpdate) {
+        for (int dev = 0; dev < n; ++dev) {
+            for (int c = 0; c < ADBMS6832_CELL_COUNT; ++c) {
+                qint32 uv = modelCellUv(dev, c, nowNs);
+                a->devices[dev].cv[c] = qint16((uv - ADBMS6832_CV_OFFSET_UV) / ADBMS6832_CV_LSB_UV);
+            }
+        }
+    }
+
+    if (a->auxPending && nowNs >= a->auxDoneNs) {
+        a->auxPending = false;
+        for (int dev = 0; dev < n; ++dev) {
+            for (int i = 0; i < 15; ++i) {
+                qint32 uv = 1200000 + dev * 1000 + i * 500;
+                a->devices[dev].aux[i] = qint16((uv - ADBMS6832_CV_OFFSET_UV) / ADBMS6832_CV_LSB_UV);
+            }
+        }
+    }
+}
+
+static void putCodes(BYTE *out, const qint16 *codes, int count)
+{
+    for (int i = 0; i < 3; ++i) {
+        quint16 v = (i < count) ? quint16(codes[i]) : 0xFFFF;
+        out[i * 2]     = BYTE(v & 0xFF);
+        out[i * 2 + 1] = BYTE(v >> 8);
+    }
+}
+
+bool Adbms6832SimBackend::readGroup(const SimDevice &d, WORD cmd, BYTE *out) const
+{
+    switch (cmd) {
+    case ADBMS6832_CMD_RDCFGA: memcpy(out, d.cfga, 6); return true;
+    case ADBMS6832_CMD_RDCFGB: memcpy(out, d.cfgb, 6); return true;
+    case ADBMS6832_CMD_RDCOMM: memcpy(out, d.comm, 6); return true;
+    case ADBMS6832_CMD_RDCVA:  putCodes(out, d.cv + 0, 3);  return true;
+    case ADBMS6832_CMD_RDCVB:  putCodes(out, d.cv + 3, 3);  return true;
+    case ADBMS6832_CMD_RDCVC:  putCodes(out, d.cv + 6, 3);  return true;
+    case ADBMS6832_CMD_RDCVD:  putCodes(out, d.cv + 9, 3);  return true;
+    case ADBMS6832_CMD_RDCVE:  putCodes(out, d.cv + 12, 3); return true;
+    case ADBMS6832_CMD_RDCVF:  putCodes(out, d.cv + 15, 1); return true;
+    case ADBMS6832_CMD_RDAUXA: putCodes(out, d.aux + 0, 3);  return true;
+    case ADBMS6832_CMD_RDAUXB: putCodes(out, d.aux + 3, 3);  return true;
+    case ADBMS6832_CMD_RDAUXC: putCodes(out, d.aux + 6, 3);  return true;
+    case ADBMS6832_CMD_RDAUXD: putCodes(out, d.aux + 9, 3);  return true;
+    case ADBMS6832_CMD_RDAUXE: putCodes(out, d.aux + 12, 3); return true;
+    default: return false;
+    }
+}
+
+bool Adbms6832SimBackend::writeGroup(SimDevice &d, WORD cmd, const BYTE *in)
+{
+    switch (cmd) {
+    case ADBMS6832_CMD_WRCFGA: memcpy(d.cfga, in, 6); return true;
+    case ADBMS6832_CMD_WRCFGB: memcpy(d.cfgb, in, 6); return true;
+    case ADBMS6832_CMD_WRCOMM: memcpy(d.comm, in, 6); return true;
+    default: return false;
+    }
+}
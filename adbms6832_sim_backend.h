@@ -0,0 +1,121 @@
+#ifndef ADBMS6832_SIM_BACKEND_H
+#define ADBMS6832_SIM_BACKEND_H
+
+#include <QByteArray>
+#include <QMutex>
+#include <QVector>
+#include "usb2uis_backend.h"
+
+/* 模擬參數 (時間單位皆為 us, 除非另外註明) */
+struct Adbms6832SimConfig {
+    int     adapterCount      = 1;      // USB2UIS 數量
+    int     deviceCount       = 1;      // daisy chain 上的 AFE 數量
+    int     callLatencyUs     = 0;      // 每次 DLL 呼叫額外延遲 (模擬 USB round-trip)
+    bool    modelBusTime      = true;   // 依 SPI clock 加上傳輸時間
+    int     idleTimeoutUs     = 4300;   // isoSPI 閒置後需重新 wake-up (tIDLE)
+    int     wakeupUs          = 400;    // wake-up 時間 (tWAKE)
+    int     readyPerDeviceUs  = 10;     // 每顆 AFE 的 tREADY
+    int     sleepTimeoutMs    = 1800;   // core 進入 sleep, register 回復預設 (tSLEEP)
+    int     cellAdcUs         = 1000;   // ADCV 轉換時間
+    int     auxAdcUs          = 2000;   // ADAX 轉換時間
+    int     errorAboveKHz     = 0;      // > 0: SPI clock 超過此值時讀回資料隨機翻轉 bit (isoSPI 邊際不足)
+    double  byteErrorRate     = 1e-3;   // 每個讀回 Byte 的錯誤機率, 以 (clock / errorAboveKHz - 1) 縮放
+    double  callFailRate      = 0;      // USBIO_SPIRead/SPIWrite 回傳失敗 (未送到 chain) 的機率
+};
+
+/*
+ * Adbms6832SimBackend
+ *  行程內模擬 N 顆 ADBMS6832 的 isoSPI daisy chain:
+ *  register group + PEC15/PEC10, wake-up/idle 時序, ADC 轉換時間, poll 命令,
+ *  以及 North (CE 當 CS) / South (GPIO IO1 當 CS, CE 保持 High) 兩個方向.
+ */
+class Adbms6832SimBackend : public Usb2UisBackend
+{
+public:
+    explicit Adbms6832SimBackend(const Adbms6832SimConfig &cfg = Adbms6832SimConfig());
+    ~Adbms6832SimBackend() override;
+
+    const Adbms6832SimConfig &config() const { return m_cfg; }
+
+    QString name() const override { return "sim"; }
+
+    BYTE openDevice() override;
+    bool closeDevice(BYTE index) override;
+    bool spiSetConfig(BYTE index, BYTE rate, DWORD timeout) override;
+    bool spiRead(BYTE index, BYTE* cmd, BYTE cmdSize, BYTE* buffer, WORD size) override;
+    bool spiWrite(BYTE index, BYTE* cmd, BYTE cmdSize, BYTE* buffer, WORD size) override;
+    bool setCE(BYTE index, bool high) override;
+
+    bool getGPIOConfig(BYTE index, BYTE *dirByte) override;
+    bool setGPIOConfig(BYTE index, BYTE  dirByte) override;
+    bool gpioRead     (BYTE index, BYTE *valueByte) override;
+    bool gpioWrite    (BYTE index, BYTE  valueByte, BYTE  maskByte) override;
+
+    // 模擬的 cell 電壓 (uV), 讀值與 decoder 比對用
+    static qint32 modelCellUv(int device, int cell, qint64 nowNs);
+
+private:
+    enum SimPort { PortNone = -1, PortNorth = 0, PortSouth = 1 };
+
+    struct SimDevice {
+        BYTE   cfga[6];
+        BYTE   cfgb[6];
+        BYTE   comm[6];
+        qint16 cv[16];
+        qint16 aux[15];
+        BYTE   cc;                  // 6-bit command counter
+        bool   pecError;
+    };
+
+    struct SimAdapter {
+        QMutex lock;
+        bool   open = false;
+        BYTE   rate = 0;
+        BYTE   gpioDir = 0xFF;      // 1=input, 0=output
+        BYTE   gpioOut = 0xFF;
+        bool   ce = true;
+        int    port = PortNone;
+
+        qint64 lastActivityNs = 0;
+        qint64 readyAtNs = 0;
+
+        // 目前 CS LOW frame 狀態
+        int        frameBytes = 0;
+        BYTE       frameCmd[4];
+        bool       frameLost = false;
+        bool       cmdValid = false;
+        WORD       cmd = 0;
+        QByteArray response;        // read 命令要送出的資料
+        QByteArray writeData;       // write 命令收到的資料
+
+        // ADC 狀態
+        bool   cellCont = false;
+        bool   cellPending = false;
+        qint64 cellStartNs = 0;
+        qint64 cellDoneNs = 0;
+        bool   auxPending = false;
+        qint64 auxDoneNs = 0;
+
+        QVector<SimDevice> devices;
+        quint32 noise = 0x2545F491; // bit error 的亂數狀態, 固定種子可重現
+    };
+
+    Adbms6832SimConfig   m_cfg;
+    QVector<SimAdapter*> m_adapters;
+
+    SimAdapter *adapter(BYTE index) const;
+    void resetDevices(SimAdapter *a);
+    void updatePort(SimAdapter *a, qint64 nowNs);
+    void frameBegin(SimAdapter *a, int port, qint64 nowNs);
+    void frameEnd(SimAdapter *a);
+    void clockBytes(SimAdapter *a, const BYTE *mosi, BYTE *miso, int n, qint64 nowNs);
+    void decodeCommand(SimAdapter *a, qint64 nowNs);
+    void updateConversions(SimAdapter *a, qint64 nowNs);
+    bool readGroup(const SimDevice &d, WORD cmd, BYTE *out) const;
+    bool writeGroup(SimDevice &d, WORD cmd, const BYTE *in);
+    void callDelay(const SimAdapter *a, int bytes) const;
+    void injectErrors(SimAdapter *a, BYTE *buffer, int size) const;
+    bool failCall(SimAdapter *a) const;
+};
+
+#endif // ADBMS6832_SIM_BACKEND_H
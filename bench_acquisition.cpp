@@ -0,0 +1,512 @@
+/*
+ * Usb2uisBench
+ *  擷取 hot path 的 QtTest benchmark, 以 Adbms6832SimBackend 當作可設定延遲的假 USB2UIS.
+ *
+ *  機器可讀結果 (CI 比較用):
+ *    Usb2uisBench -o bench.xml,xml          QtTest XML, 每筆 <BenchmarkResult>
+ *    Usb2uisBench -o bench.csv,csv
+ *  時間量測預設為 walltime; 可加 -iterations N / -minimumvalue N 調整.
+ *
+ *  環境變數:
+ *    USB2UIS_BENCH_LATENCY_US   逗號分隔的每次 DLL 呼叫延遲 (預設 "0,100,500")
+ *    USB2UIS_BENCH_DEVICES      chain 上的 AFE 數量 (預設 4)
+ *    USB2UIS_BENCH_LIST_LINES   大型清單檔的 READ_LIST 行數 (預設 20000)
+ */
+#include <QtTest>
+#include <QTemporaryDir>
+#include <QFile>
+
+#include "usb2uis_interface.h"
+#include "adbms6832.h"
+#include "adbms6832_decoder.h"
+#include "adbms6832_sim_backend.h"
+#include "capture_file.h"
+#include "cell_plot_store.h"
+#include "cell_stats_store.h"
+#include "cmd_library.h"
+#include "sequencer.h"
+#include "spi_log.h"
+#include "spi_transaction_plan.h"
+
+static int envInt(const char *name, int def)
+{
+    bool ok = false;
+    const int v = qEnvironmentVariable(name).toInt(&ok);
+    return ok ? v : def;
+}
+
+static QList<int> benchLatencies()
+{
+    QList<int> out;
+    const QString text = qEnvironmentVariable("USB2UIS_BENCH_LATENCY_US", "0,100,500");
+    for (const QString &s : text.split(','))
+        if (!s.trimmed().isEmpty()) out << s.trimmed().toInt();
+    return out;
+}
+
+/* 第一個 READ SET (RDCFGA..RDAUXE) 的命令 */
+static QList<QByteArray> readSetCmds()
+{
+    static const WORD kCodes[] = {
+        ADBMS6832_CMD_RDCFGA, ADBMS6832_CMD_RDCFGB,
+        ADBMS6832_CMD_RDCVA, ADBMS6832_CMD_RDCVB, ADBMS6832_CMD_RDCVC,
+        ADBMS6832_CMD_RDCVD, ADBMS6832_CMD_RDCVE, ADBMS6832_CMD_RDCVF,
+        ADBMS6832_CMD_RDAUXA, ADBMS6832_CMD_RDAUXB, ADBMS6832_CMD_RDAUXC,
+        ADBMS6832_CMD_RDAUXD, ADBMS6832_CMD_RDAUXE,
+    };
+    QList<QByteArray> cmds;
+    for (WORD code : kCodes) {
+        BYTE cmd[4];
+        adbmsBuildCmd(cmd, code);
+        cmds << QByteArray((const char*)cmd, 4);
+    }
+    return cmds;
+}
+
+class AcquisitionBench : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+
+    void parseCmdText_data();
+    void parseCmdText();
+    void formatRecord_data();
+    void formatRecord();
+    void loadCmdLibrary_data();
+    void loadCmdLibrary();
+    void decodeGroup();
+    void logAppend();
+    void captureAppend();
+    void plotAppend();
+    void plotQuery();
+    void statsAppend();
+    void statsQuery();
+
+    void transaction_data();
+    void transaction();
+    void readSetCycle_data();
+    void readSetCycle();
+    void sequenceCycle_data();
+    void sequenceCycle();
+    void readSetRecovery_data();
+    void readSetRecovery();
+
+private:
+    QTemporaryDir m_listDir;
+    int           m_devices = 4;
+
+    BYTE openSim(int latencyUs, bool busTime, double callFailRate = 0);
+    void closeSim(BYTE index);
+    void writeLargeLists(int lines);
+};
+
+void AcquisitionBench::initTestCase()
+{
+    m_devices = qBound(1, envInt("USB2UIS_BENCH_DEVICES", 4), 64);
+    QVERIFY(m_listDir.isValid());
+    writeLargeLists(envInt("USB2UIS_BENCH_LIST_LINES", 20000));
+}
+
+void AcquisitionBench::cleanupTestCase()
+{
+    Usb2UisInterface::setBackend(nullptr);
+}
+
+/* 假 USB2UIS: 每次呼叫固定延遲 (+ 選配的 SPI 傳輸時間) */
+BYTE AcquisitionBench::openSim(int latencyUs, bool busTime, double callFailRate)
+{
+    Adbms6832SimConfig cfg;
+    cfg.deviceCount   = m_devices;
+    cfg.callLatencyUs = latencyUs;
+    cfg.modelBusTime  = busTime;
+    cfg.callFailRate  = callFailRate;
+    Usb2UisInterface::setBackend(new Adbms6832SimBackend(cfg));
+
+    const BYTE index = Usb2UisInterface::USBIO_OpenDevice();
+    Usb2UisInterface::USBIO_SetGPIOConfig(index, 0x00);
+    Usb2UisInterface::USBIO_SPISetConfig(index, 0x08, (100 << 16) | 100);     // 12MHz
+    return index;
+}
+
+void AcquisitionBench::closeSim(BYTE index)
+{
+    Usb2UisInterface::USBIO_CloseDevice(index);
+    Usb2UisInterface::setBackend(nullptr);
+}
+
+/* 清單檔格式與實際檔案相同, READ_LIST 以 13 條為一個 SET */
+void AcquisitionBench::writeLargeLists(int lines)
+{
+    const QList<QByteArray> cmds = readSetCmds();
+    const int sets = qMax(1, lines / cmds.size());
+
+    QByteArray setText, listText, oneText;
+    for (int s = 1; s <= sets; ++s) {
+        setText += "1," + QByteArray::number(s) + ",\"Bench set " + QByteArray::number(s) + "\"\n";
+        for (const QByteArray &c : cmds) {
+            const QByteArray hex = CmdLibrary::formatHex((const BYTE*)c.constData(), c.size()).toLatin1();
+            listText += "1," + QByteArray::number(s) + ",\"CMD\"," + hex + "\n";
+        }
+    }
+    for (const QByteArray &c : cmds)
+        oneText += "1,\"CMD\"," + CmdLibrary::formatHex((const BYTE*)c.constData(), c.size()).toLatin1() + "\n";
+
+    const QByteArray data = "1,\"WRCFGA\",0x81 0x00 0x00 0xFF 0x03 0x00 PEC\n";
+    const QByteArray texts[CMD_FILE_COUNT] = { setText, listText, oneText, "1,\"WRCFGA\",WRCFGA\n", data };
+    for (int i = 0; i < CMD_FILE_COUNT; ++i) {
+        QFile f(m_listDir.filePath(CmdLibrary::fileName(i)));
+        QVERIFY(f.open(QIODevice::WriteOnly));
+        f.write(texts[i]);
+    }
+}
+
+void AcquisitionBench::parseCmdText_data()
+{
+    QTest::addColumn<QByteArray>("text");
+    QTest::newRow("hex-4")   << QByteArray("0x00 0x02 0x2B 0x0A");
+    QTest::newRow("hex-32")  << QByteArray("0x81 0x00 0x00 0xFF 0x03 0x00 0x02 0x8E 0x81 0x00 0x00 0xFF 0x03 0x00 0x02 0x8E "
+                                           "0x81 0x00 0x00 0xFF 0x03 0x00 0x02 0x8E 0x81 0x00 0x00 0xFF 0x03 0x00 0x02 0x8E");
+    QTest::newRow("opcode")  << QByteArray("ADCV CONT RD");
+    QTest::newRow("pec10")   << QByteArray("0x81 0x00 0x00 0xFF 0x03 0x00 PEC");
+}
+
+void AcquisitionBench::parseCmdText()
+{
+    QFETCH(QByteArray, text);
+    QByteArray out;
+    QVERIFY(CmdLibrary::parseCmdText(text.constData(), text.size(), out));
+    QBENCHMARK {
+        out.resize(0);
+        CmdLibrary::parseCmdText(text.constData(), text.size(), out);
+    }
+}
+
+void AcquisitionBench::formatRecord_data()
+{
+    QTest::addColumn<int>("size");
+    QTest::newRow("8")   << 8;
+    QTest::newRow("64")  << 64;
+    QTest::newRow("512") << 512;
+}
+
+void AcquisitionBench::formatRecord()
+{
+    QFETCH(int, size);
+    QByteArray data(size, '\0');
+    for (int i = 0; i < size; ++i) data[i] = char(i * 7);
+    SpiLogRecord rec;
+    rec.size = quint32(size);
+
+    QString line;
+    QBENCHMARK {
+        line = SpiLogModel::formatRecord(rec, (const BYTE*)data.constData(), size, 45296789);
+    }
+    QVERIFY(!line.isEmpty());
+}
+
+void AcquisitionBench::loadCmdLibrary_data()
+{
+    QTest::addColumn<bool>("cached");
+    QTest::newRow("parse") << false;
+    QTest::newRow("cache") << true;
+}
+
+/* parse: 每次刪除 cache 重新解析文字檔; cache: 只 map cache 檔 */
+void AcquisitionBench::loadCmdLibrary()
+{
+    QFETCH(bool, cached);
+    const QString dir = m_listDir.path();
+    const QString cacheFile = m_listDir.filePath("SPI_CMD_LIBRARY.cache");
+
+    {
+        CmdLibrary warm;
+        QVERIFY(warm.load(dir));
+        QVERIFY(warm.count(CMD_FILE_READ_LIST) > 0);
+    }
+
+    QBENCHMARK {
+        if (!cached) QFile::remove(cacheFile);
+        CmdLibrary lib;
+        lib.load(dir);
+    }
+}
+
+void AcquisitionBench::decodeGroup()
+{
+    const int size = m_devices * ADBMS6832_FRAME_SIZE;
+    QByteArray rx(size, '\0');
+    for (int d = 0; d < m_devices; ++d) {
+        BYTE *frame = (BYTE*)rx.data() + d * ADBMS6832_FRAME_SIZE;
+        for (int i = 0; i < ADBMS6832_REG_GROUP_SIZE; ++i) frame[i] = BYTE(0x10 + d + i);
+    }
+    adbmsFillDataPecs((BYTE*)rx.data(), m_devices);
+
+    BYTE cmd[4];
+    adbmsBuildCmd(cmd, ADBMS6832_CMD_RDCVA);
+    AfeChainSample sample;
+    QCOMPARE(Adbms6832Decoder::decode(cmd, 4, (const BYTE*)rx.constData(), size, true, sample), 0);
+
+    QBENCHMARK {
+        Adbms6832Decoder::decode(cmd, 4, (const BYTE*)rx.constData(), size, true, sample);
+    }
+}
+
+void AcquisitionBench::logAppend()
+{
+    SpiLogSink sink;
+    const QByteArray data(m_devices * ADBMS6832_FRAME_SIZE, char(0x5A));
+    QBENCHMARK {
+        sink.append(SPI_LOG_READ, (const BYTE*)data.constData(), data.size(), 3);
+    }
+}
+
+void AcquisitionBench::captureAppend()
+{
+    QTemporaryDir dir;
+    CaptureWriter writer;
+    QVERIFY(writer.open(dir.filePath("bench.u2cap")));
+
+    BYTE cmd[4];
+    adbmsBuildCmd(cmd, ADBMS6832_CMD_RDCVA);
+    const QByteArray data(m_devices * ADBMS6832_FRAME_SIZE, char(0x5A));
+    QBENCHMARK {
+        writer.append(1, cmd, 4, (const BYTE*)data.constData(), data.size());
+    }
+    writer.close();
+}
+
+/* 一個 chain 樣本 (m_devices 顆 AFE x 16 cell) 加入 Cell Plot pyramid */
+static void fillPlotSample(AfeChainSample &sample, int devices, int i)
+{
+    sample.devices.resize(devices);
+    sample.timeNs = 1000000000LL + qint64(i) * 10000000;     // 100 Hz
+    for (int d = 0; d < devices; ++d) {
+        AfeDeviceSample &dev = sample.devices[d];
+        dev.cellValid = 0xFFFF;
+        for (int c = 0; c < ADBMS6832_CELL_COUNT; ++c)
+            dev.cellUv[c] = 3600000 + ((i % 1000) - 500) * ADBMS6832_CV_LSB_UV + c * ADBMS6832_CV_LSB_UV;
+    }
+}
+
+void AcquisitionBench::plotAppend()
+{
+    CellPlotStore store;
+    AfeChainSample sample;
+    int i = 0;
+    QBENCHMARK {
+        fillPlotSample(sample, m_devices, i++);
+        store.append(sample);
+    }
+}
+
+/* 10 分鐘 @ 100 Hz 之後, 以 2000 個 bucket 查詢全部通道 (相當於一次重繪) */
+void AcquisitionBench::plotQuery()
+{
+    CellPlotStore store;
+    AfeChainSample sample;
+    const int samples = 60000;
+    for (int i = 0; i < samples; ++i) {
+        fillPlotSample(sample, m_devices, i);
+        store.append(sample);
+    }
+
+    QVector<CellPlotStore::Bucket> out;
+    const qint64 t1 = store.lastTimeNs();
+    const qint64 t0 = t1 - qint64(samples) * 10000000;
+    QBENCHMARK {
+        for (int t = 0; t < store.trackCount(); ++t)
+            for (int c = 0; c < ADBMS6832_CELL_COUNT; ++c)
+                store.query(t, c, t0, t1, 2000, out);
+    }
+    QVERIFY(!out.isEmpty() && out.size() <= 2000 + CELL_PLOT_LEVELS * CELL_PLOT_FANOUT);
+}
+
+void AcquisitionBench::statsAppend()
+{
+    CellStatsStore store;
+    AfeChainSample sample;
+    int i = 0;
+    QBENCHMARK {
+        fillPlotSample(sample, m_devices, i++);
+        store.append(sample);
+    }
+}
+
+/* 10 分鐘 @ 100 Hz 之後查詢全部通道的最近 1 分鐘/1 小時/1 天, 成本與樣本數無關 */
+void AcquisitionBench::statsQuery()
+{
+    CellStatsStore store;
+    AfeChainSample sample;
+    const int samples = 60000;
+    for (int i = 0; i < samples; ++i) {
+        fillPlotSample(sample, m_devices, i);
+        store.append(sample);
+    }
+
+    quint64 count = 0;
+    QBENCHMARK {
+        for (int t = 0; t < store.trackCount(); ++t)
+            for (int c = 0; c < ADBMS6832_CELL_COUNT; ++c)
+                for (qint64 span : {CELL_STATS_MINUTE_NS, CELL_STATS_HOUR_NS, CELL_STATS_DAY_NS})
+                    count = store.recent(t, c, span).count;
+    }
+    QCOMPARE(count, quint64(samples));
+}
+
+void AcquisitionBench::transaction_data()
+{
+    QTest::addColumn<int>("latencyUs");
+    QTest::addColumn<bool>("busTime");
+    for (int us : benchLatencies())
+        QTest::newRow(qPrintable(QString("usb-%1us").arg(us))) << us << false;
+    QTest::newRow("usb-100us+bus") << 100 << true;
+}
+
+/* 單一 RDCVA 交易 (wake 已略過): CS LOW + SPIRead + CS HIGH */
+void AcquisitionBench::transaction()
+{
+    QFETCH(int, latencyUs);
+    QFETCH(bool, busTime);
+    const BYTE index = openSim(latencyUs, busTime);
+    QVERIFY(index != 0xFF);
+
+    SpiPlanOptions opt;
+    opt.readSize = WORD(m_devices * ADBMS6832_FRAME_SIZE);
+    const SpiTransactionPlan plan = SpiPlanCompiler::compileRead(QList<QByteArray>() << readSetCmds().at(2), opt);   // RDCVA
+
+    BYTE cmd[4];
+    adbmsBuildCmd(cmd, ADBMS6832_CMD_RDCVA);
+    SpiPlanExecutor executor(index);
+    AfeChainSample sample;
+    int bad = 0;
+    const SpiPlanExecutor::ResultFn onResult = [&](const SpiOp &, const BYTE *data, int size) {
+        bad += qMax(0, Adbms6832Decoder::decode(cmd, 4, data, size, true, sample));
+        return true;
+    };
+    QCOMPARE(executor.runCycle(plan, onResult), SPI_PLAN_OK);
+
+    QBENCHMARK {
+        executor.runCycle(plan, onResult);
+    }
+    QCOMPARE(bad, 0);
+    closeSim(index);
+}
+
+void AcquisitionBench::readSetCycle_data()
+{
+    transaction_data();
+}
+
+/* on_btnSpiRead2_clicked 的一個 cycle: 13 條 RDxx + 解碼; 1 / 平均時間 = sets per second */
+void AcquisitionBench::readSetCycle()
+{
+    QFETCH(int, latencyUs);
+    QFETCH(bool, busTime);
+    const BYTE index = openSim(latencyUs, busTime);
+    QVERIFY(index != 0xFF);
+
+    const QList<QByteArray> cmds = readSetCmds();
+    SpiPlanOptions opt;
+    opt.readSize = WORD(m_devices * ADBMS6832_FRAME_SIZE);
+    const SpiTransactionPlan plan = SpiPlanCompiler::compileRead(cmds, opt);
+
+    SpiPlanExecutor executor(index);
+    AfeChainSample sample;
+    int bad = 0;
+    const SpiPlanExecutor::ResultFn onResult = [&](const SpiOp &op, const BYTE *data, int size) {
+        const QByteArray &cmd = cmds.at(op.cmdIndex);
+        bad += qMax(0, Adbms6832Decoder::decode((const BYTE*)cmd.constData(), cmd.size(), data, size, true, sample));
+        return true;
+    };
+    QCOMPARE(executor.runCycle(plan, onResult), SPI_PLAN_OK);
+
+    QBENCHMARK {
+        sample.clear();
+        executor.runCycle(plan, onResult);
+    }
+    QCOMPARE(bad, 0);
+    closeSim(index);
+}
+
+void AcquisitionBench::sequenceCycle_data()
+{
+    transaction_data();
+}
+
+/* 與 readSetCycle 相同的 13 條 RDxx 加一個條件判斷, 經由 SeqInterpreter 執行; 兩者差值即為直譯的成本 */
+void AcquisitionBench::sequenceCycle()
+{
+    QFETCH(int, latencyUs);
+    QFETCH(bool, busTime);
+
+    CmdLibrary lib;
+    QVERIFY(lib.load(m_listDir.path()));
+    SeqProgram program;
+    QString err;
+    QVERIFY2(SeqCompiler::compile("readset 1\nif pecerr > 0\n    fail \"pec\"\nend\n", lib, program, &err),
+             qPrintable(err));
+
+    const BYTE index = openSim(latencyUs, busTime);
+    QVERIFY(index != 0xFF);
+
+    SpiPlanOptions opt;
+    opt.readSize = WORD(m_devices * ADBMS6832_FRAME_SIZE);
+    SpiPlanExecutor executor(index);
+    SeqInterpreter seq(executor);
+    seq.link(program, opt, m_devices);
+    const SeqHooks hooks;
+    QCOMPARE(seq.run(hooks), SEQ_RESULT_DONE);
+
+    QBENCHMARK {
+        seq.run(hooks);
+    }
+    QCOMPARE(seq.run(hooks), SEQ_RESULT_DONE);
+    closeSim(index);
+}
+
+void AcquisitionBench::readSetRecovery_data()
+{
+    transaction_data();
+}
+
+/* readSetCycle 加上 1% 的 SPI 呼叫失敗, 每條命令最多重送 2 次; 與 readSetCycle 的差值即為恢復的成本 */
+void AcquisitionBench::readSetRecovery()
+{
+    QFETCH(int, latencyUs);
+    QFETCH(bool, busTime);
+    const BYTE index = openSim(latencyUs, busTime, 0.01);
+    QVERIFY(index != 0xFF);
+
+    const QList<QByteArray> cmds = readSetCmds();
+    SpiPlanOptions opt;
+    opt.readSize = WORD(m_devices * ADBMS6832_FRAME_SIZE);
+    const SpiTransactionPlan plan = SpiPlanCompiler::compileRead(cmds, opt);
+
+    SpiRetryPolicy policy;
+    policy.maxRetries = 2;
+    policy.backoffUs  = 0;
+    policy.budgetUs   = 1000000;
+    SpiPlanExecutor executor(index);
+    executor.setRetryPolicy(policy);
+    AfeChainSample sample;
+    int bad = 0;
+    const SpiPlanExecutor::ResultFn onResult = [&](const SpiOp &op, const BYTE *data, int size) {
+        const QByteArray &cmd = cmds.at(op.cmdIndex);
+        bad += qMax(0, Adbms6832Decoder::decode((const BYTE*)cmd.constData(), cmd.size(), data, size, true, sample));
+        return true;
+    };
+
+    QBENCHMARK {
+        sample.clear();
+        executor.runCycle(plan, onResult);
+    }
+    QCOMPARE(bad, 0);       // 恢復的行為由 Usb2uisTest 的 retry* 驗證
+    closeSim(index);
+}
+
+QTEST_GUILESS_MAIN(AcquisitionBench)
+
+#include "bench_acquisition.moc"
@@ -0,0 +1,498 @@
+#include "capture_file.h"
+#include "precision_timer.h"
+
+#include <QDateTime>
+#include <QDebug>
+#include <cstring>
+
+#define CAPTURE_WAKE_BYTES      (64 * 1024)     // 待寫資料超過此量才喚醒背景執行緒
+#define CAPTURE_IDLE_MS         100
+
+static QByteArray deltaKey(int adapter, quint16 setId, const char *cmd, int cmdSize)
+{
+    QByteArray key;
+    key.reserve(3 + cmdSize);
+    key.append(char(adapter));
+    key.append(char(setId & 0xFF));
+    key.append(char(setId >> 8));
+    key.append(cmd, cmdSize);
+    return key;
+}
+
+/* ---------------- Delta (XOR + zero-run) ---------------- */
+
+int CaptureWriter::encodeDelta(const BYTE *prev, const BYTE *cur, int size, BYTE *out, int outMax)
+{
+    int o = 0;
+    int i = 0;
+
+    while (i < size) {
+        if ((prev[i] ^ cur[i]) == 0) {
+            int run = 1;
+            while (i + run < size && run < 128 && (prev[i + run] ^ cur[i + run]) == 0) ++run;
+            if (o + 1 > outMax) return -1;
+            out[o++] = BYTE(0x80 | (run - 1));
+            i += run;
+        } else {
+            int run = 1;
+            while (i + run < size && run < 128 && (prev[i + run] ^ cur[i + run]) != 0) ++run;
+            if (o + 1 + run > outMax) return -1;
+            out[o++] = BYTE(run - 1);
+            for (int k = 0; k < run; ++k) out[o++] = BYTE(prev[i + k] ^ cur[i + k]);
+            i += run;
+        }
+    }
+    return o;
+}
+
+bool CaptureWriter::decodeDelta(const BYTE *prev, const BYTE *in, int inSize, BYTE *out, int size)
+{
+    int i = 0;
+    int o = 0;
+
+    while (i < inSize) {
+        const BYTE c = in[i++];
+        const int run = (c & 0x7F) + 1;
+        if (o + run > size) return false;
+        if (c & 0x80) {
+            memcpy(out + o, prev + o, size_t(run));
+        } else {
+            if (i + run > inSize) return false;
+            for (int k = 0; k < run; ++k) out[o + k] = BYTE(prev[o + k] ^ in[i + k]);
+            i += run;
+        }
+        o += run;
+    }
+    return o == size;
+}
+
+/* ---------------- Writer ---------------- */
+
+CaptureWriter::CaptureWriter(QObject *parent)
+    : QThread(parent)
+{
+    setObjectName("CaptureWriter");
+}
+
+CaptureWriter::~CaptureWriter()
+{
+    close();
+}
+
+void CaptureWriter::setSegmentLimits(int records, int ms)
+{
+    QMutexLocker lock(&m_mutex);
+    if (m_open) return;
+    m_segRecords = qMax(records, 1);
+    m_segNs      = qint64(qMax(ms, 1)) * 1000000;
+}
+
+void CaptureWriter::setMaxPendingBytes(int bytes)
+{
+    QMutexLocker lock(&m_mutex);
+    m_maxPending = qMax(bytes, CAPTURE_WAKE_BYTES);
+}
+
+bool CaptureWriter::isOpen() const
+{
+    QMutexLocker lock(&m_mutex);
+    return m_open;
+}
+
+QString CaptureWriter::fileName() const
+{
+    QMutexLocker lock(&m_mutex);
+    return m_file.fileName();
+}
+
+CaptureWriter::Stats CaptureWriter::stats() const
+{
+    QMutexLocker lock(&m_mutex);
+    return m_stats;
+}
+
+bool CaptureWriter::open(const QString &path, QString *errorMsg)
+{
+    close();
+
+    m_file.setFileName(path);
+    if (!m_file.open(QIODevice::WriteOnly)) {
+        if (errorMsg) *errorMsg = m_file.errorString();
+        return false;
+    }
+
+    CaptureFileHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, CAPTURE_FILE_MAGIC, sizeof(h.magic));
+    h.version     = CAPTURE_FILE_VERSION;
+    h.headerSize  = sizeof(h);
+    h.startWallMs = QDateTime::currentMSecsSinceEpoch();
+    h.startNs     = PrecisionTimer::nowNs();
+
+    if (m_file.write((const char*)&h, sizeof(h)) != qint64(sizeof(h))) {
+        if (errorMsg) *errorMsg = m_file.errorString();
+        m_file.close();
+        return false;
+    }
+
+    m_out.clear();
+    m_prev.clear();
+    m_pos        = sizeof(h);
+    m_prevIndex  = -1;
+    m_segOffset  = m_pos;
+    m_segCount   = 0;
+
+    {
+        QMutexLocker lock(&m_mutex);
+        m_pending.clear();
+        m_stats   = Stats();
+        m_stats.fileBytes = quint64(m_pos);
+        m_startNs = h.startNs;
+        m_stop    = false;
+        m_open    = true;
+    }
+
+    start(QThread::LowPriority);
+    return true;
+}
+
+void CaptureWriter::close()
+{
+    {
+        QMutexLocker lock(&m_mutex);
+        if (!m_open) return;
+        m_open = false;
+        m_stop = true;
+        m_cond.wakeAll();
+    }
+    wait();
+}
+
+void CaptureWriter::append(quint16 setId, const BYTE *cmd, int cmdSize, const BYTE *payload, int size, int adapter)
+{
+    const qint64 now = PrecisionTimer::nowNs();
+    cmdSize = qBound(0, cmdSize, 255);
+    size    = qBound(0, size, 0xFFFF);
+
+    QMutexLocker lock(&m_mutex);
+    if (!m_open) return;
+
+    const int need = int(sizeof(CaptureRecordHeader)) + cmdSize + size;
+    if (m_pending.size() + need > m_maxPending) {
+        ++m_stats.dropped;
+        return;
+    }
+
+    CaptureRecordHeader rh;
+    rh.timeNs  = now - m_startNs;
+    rh.type    = quint8(qBound(0, adapter, CAPTURE_MAX_ADAPTERS - 1) << 4);
+    rh.cmdSize = quint8(cmdSize);
+    rh.setId   = setId;
+    rh.rawSize = quint16(size);
+    rh.encSize = quint16(size);
+
+    const bool wasBelow = m_pending.size() < CAPTURE_WAKE_BYTES;
+    m_pending.append((const char*)&rh, sizeof(rh));
+    m_pending.append((const char*)cmd, cmdSize);
+    m_pending.append((const char*)payload, size);
+
+    if (wasBelow && m_pending.size() >= CAPTURE_WAKE_BYTES) m_cond.wakeOne();
+}
+
+void CaptureWriter::run()
+{
+    QByteArray batch;
+
+    while (true) {
+        bool stop;
+        {
+            QMutexLocker lock(&m_mutex);
+            if (m_pending.isEmpty() && !m_stop)
+                m_cond.wait(&m_mutex, CAPTURE_IDLE_MS);
+            batch.swap(m_pending);
+            m_pending.clear();
+            stop = m_stop;
+        }
+
+        if (!batch.isEmpty()) writeBatch(batch);
+        batch.clear();
+
+        if (stop) break;
+    }
+
+    if (m_segCount > 0) writeIndex();
+    writeEnd();
+    flushOut();
+    m_file.close();
+}
+
+void CaptureWriter::writeBatch(const QByteArray &batch)
+{
+    const char *p   = batch.constData();
+    const char *end = p + batch.size();
+    quint64 records = 0;
+    quint64 raw = 0;
+    QByteArray enc;
+
+    while (p + sizeof(CaptureRecordHeader) <= end) {
+        CaptureRecordHeader rh;
+        memcpy(&rh, p, sizeof(rh));
+        const char *cmd     = p + sizeof(rh);
+        const char *payload = cmd + rh.cmdSize;
+        p = payload + rh.rawSize;
+
+        // segment 切換: 寫 INDEX 並重置 delta 狀態
+        if (m_segCount > 0 && (m_segCount >= quint32(m_segRecords) || rh.timeNs - m_segFirstNs >= m_segNs))
+            writeIndex();
+        if (m_segCount == 0) {
+            m_segOffset  = m_pos;
+            m_segFirstNs = rh.timeNs;
+        }
+
+        const quint8 adapterBits = rh.type & 0xF0;
+        const QByteArray key = deltaKey(CAPTURE_REC_ADAPTER(rh.type), rh.setId, cmd, rh.cmdSize);
+        QByteArray &prev = m_prev[key];
+
+        rh.type    = adapterBits | CAPTURE_REC_DATA_RAW;
+        rh.encSize = rh.rawSize;
+        const char *body = payload;
+
+        if (prev.size() == rh.rawSize && rh.rawSize > 0) {
+            enc.resize(rh.rawSize);
+            const int n = encodeDelta((const BYTE*)prev.constData(), (const BYTE*)payload, rh.rawSize,
+                                      (BYTE*)enc.data(), rh.rawSize - 1);
+            if (n >= 0) {
+                rh.type    = adapterBits | CAPTURE_REC_DATA_DELTA;
+                rh.encSize = quint16(n);
+                body       = enc.constData();
+            }
+        }
+        prev = QByteArray(payload, rh.rawSize);
+
+        m_out.append((const char*)&rh, sizeof(rh));
+        m_out.append(cmd, rh.cmdSize);
+        m_out.append(body, rh.encSize);
+        m_pos += qint64(sizeof(rh)) + rh.cmdSize + rh.encSize;
+
+        m_segLastNs = rh.timeNs;
+        ++m_segCount;
+        ++records;
+        raw += rh.rawSize;
+    }
+
+    flushOut();
+
+    QMutexLocker lock(&m_mutex);
+    m_stats.records  += records;
+    m_stats.rawBytes += raw;
+    m_stats.fileBytes = quint64(m_pos);
+}
+
+void CaptureWriter::writeIndex()
+{
+    CaptureIndexBlock ib;
+    memset(&ib, 0, sizeof(ib));
+    ib.prevIndexOffset = m_prevIndex;
+    ib.segmentOffset   = m_segOffset;
+    ib.firstTimeNs     = m_segFirstNs;
+    ib.lastTimeNs      = m_segLastNs;
+    ib.recordCount     = m_segCount;
+
+    CaptureRecordHeader rh;
+    memset(&rh, 0, sizeof(rh));
+    rh.timeNs  = m_segLastNs;
+    rh.type    = CAPTURE_REC_INDEX;
+    rh.rawSize = sizeof(ib);
+    rh.encSize = sizeof(ib);
+
+    m_prevIndex = m_pos;
+    m_out.append((const char*)&rh, sizeof(rh));
+    m_out.append((const char*)&ib, sizeof(ib));
+    m_pos += qint64(sizeof(rh) + sizeof(ib));
+
+    m_prev.clear();
+    m_segCount = 0;
+}
+
+void CaptureWriter::writeEnd()
+{
+    CaptureRecordHeader rh;
+    memset(&rh, 0, sizeof(rh));
+    rh.timeNs  = m_segLastNs;
+    rh.type    = CAPTURE_REC_END;
+    rh.rawSize = sizeof(qint64);
+    rh.encSize = sizeof(qint64);
+
+    m_out.append((const char*)&rh, sizeof(rh));
+    m_out.append((const char*)&m_prevIndex, sizeof(qint64));
+    m_pos += qint64(sizeof(rh) + sizeof(qint64));
+}
+
+void CaptureWriter::flushOut()
+{
+    if (m_out.isEmpty()) return;
+    if (m_file.write(m_out) != m_out.size())
+        qDebug() << "[ERROR] Capture write failed:" << m_file.errorString();
+    m_file.flush();
+    m_out.clear();
+}
+
+/* ---------------- Reader ---------------- */
+
+bool CaptureReader::open(const QString &path, QString *errorMsg)
+{
+    close();
+
+    m_file.setFileName(path);
+    if (!m_file.open(QIODevice::ReadOnly)) {
+        if (errorMsg) *errorMsg = m_file.errorString();
+        return false;
+    }
+    if (m_file.read((char*)&m_header, sizeof(m_header)) != qint64(sizeof(m_header))
+        || memcmp(m_header.magic, CAPTURE_FILE_MAGIC, sizeof(m_header.magic)) != 0
+        || m_header.version < 1 || m_header.version > CAPTURE_FILE_VERSION) {
+        if (errorMsg) *errorMsg = "Not a capture file";
+        m_file.close();
+        return false;
+    }
+
+    if (!loadIndexChain()) scanIndex();
+    m_file.seek(m_header.headerSize);
+    return true;
+}
+
+void CaptureReader::close()
+{
+    if (m_file.isOpen()) m_file.close();
+    m_segments.clear();
+    m_prev.clear();
+}
+
+/* 由 END 往回追 INDEX 串列 */
+bool CaptureReader::loadIndexChain()
+{
+    const qint64 endSize = qint64(sizeof(CaptureRecordHeader) + sizeof(qint64));
+    if (m_file.size() < qint64(m_header.headerSize) + endSize) return false;
+
+    CaptureRecordHeader rh;
+    qint64 offset = -1;
+    m_file.seek(m_file.size() - endSize);
+    if (m_file.read((char*)&rh, sizeof(rh)) != qint64(sizeof(rh)) || rh.type != CAPTURE_REC_END) return false;
+    if (m_file.read((char*)&offset, sizeof(offset)) != qint64(sizeof(offset))) return false;
+
+    QVector<CaptureIndexBlock> chain;
+    while (offset >= qint64(m_header.headerSize)) {
+        CaptureIndexBlock ib;
+        m_file.seek(offset);
+        if (m_file.read((char*)&rh, sizeof(rh)) != qint64(sizeof(rh)) || rh.type != CAPTURE_REC_INDEX) return false;
+        if (m_file.read((char*)&ib, sizeof(ib)) != qint64(sizeof(ib))) return false;
+        if (ib.prevIndexOffset >= offset) return false;
+        chain.append(ib);
+        offset = ib.prevIndexOffset;
+    }
+
+    m_segments.clear();
+    for (int i = chain.size() - 1; i >= 0; --i) m_segments.append(chain[i]);
+    return true;
+}
+
+/* 沒有 END: 順序掃描紀錄頭, 自行建立 segment 範圍 */
+void CaptureReader::scanIndex()
+{
+    m_segments.clear();
+    m_file.seek(m_header.headerSize);
+
+    CaptureIndexBlock seg;
+    memset(&seg, 0, sizeof(seg));
+    seg.prevIndexOffset = -1;
+
+    CaptureRecordHeader rh;
+    qint64 pos = m_header.headerSize;
+    while (m_file.read((char*)&rh, sizeof(rh)) == qint64(sizeof(rh))) {
+        const qint64 bodyEnd = pos + qint64(sizeof(rh)) + rh.cmdSize + rh.encSize;
+        if (bodyEnd > m_file.size()) break;
+
+        const int type = CAPTURE_REC_TYPE(rh.type);
+        if (type == CAPTURE_REC_INDEX) {
+            CaptureIndexBlock ib;
+            if (m_file.read((char*)&ib, sizeof(ib)) != qint64(sizeof(ib))) break;
+            m_segments.append(ib);
+            seg.recordCount = 0;
+        } else if (type == CAPTURE_REC_DATA_RAW || type == CAPTURE_REC_DATA_DELTA) {
+            if (seg.recordCount == 0) {
+                seg.segmentOffset = pos;
+                seg.firstTimeNs   = rh.timeNs;
+            }
+            seg.lastTimeNs = rh.timeNs;
+            ++seg.recordCount;
+        }
+        pos = bodyEnd;
+        m_file.seek(pos);
+    }
+
+    // 最後一段沒有 INDEX
+    if (seg.recordCount > 0) m_segments.append(seg);
+}
+
+bool CaptureReader::seek(qint64 timeNs)
+{
+    if (!m_file.isOpen()) return false;
+
+    // segments 依時間排序, 二分搜尋第一個 lastTimeNs >= timeNs
+    int lo = 0, hi = m_segments.size();
+    while (lo < hi) {
+        const int mid = (lo + hi) / 2;
+        if (m_segments[mid].lastTimeNs < timeNs) lo = mid + 1;
+        else hi = mid;
+    }
+    if (lo >= m_segments.size()) return false;
+
+    m_prev.clear();
+    return m_file.seek(m_segments[lo].segmentOffset);
+}
+
+bool CaptureReader::next(Record &rec)
+{
+    CaptureRecordHeader rh;
+
+    while (m_file.read((char*)&rh, sizeof(rh)) == qint64(sizeof(rh))) {
+        QByteArray cmd  = m_file.read(rh.cmdSize);
+        QByteArray body = m_file.read(rh.encSize);
+        if (cmd.size() != rh.cmdSize || body.size() != rh.encSize) return false;
+
+        const int type    = CAPTURE_REC_TYPE(rh.type);
+        const int adapter = CAPTURE_REC_ADAPTER(rh.type);
+        switch (type) {
+        case CAPTURE_REC_INDEX:
+            m_prev.clear();
+            continue;
+        case CAPTURE_REC_END:
+            return false;
+        case CAPTURE_REC_DATA_RAW:
+        case CAPTURE_REC_DATA_DELTA:
+            break;
+        default:
+            return false;
+        }
+
+        QByteArray &prev = m_prev[deltaKey(adapter, rh.setId, cmd.constData(), cmd.size())];
+        if (type == CAPTURE_REC_DATA_DELTA) {
+            if (prev.size() != rh.rawSize) return false;    // 從 segment 中間開始讀
+            QByteArray out(rh.rawSize, '\0');
+            if (!CaptureWriter::decodeDelta((const BYTE*)prev.constData(), (const BYTE*)body.constData(),
+                                            body.size(), (BYTE*)out.data(), out.size()))
+                return false;
+            prev = out;
+        } else {
+            prev = body;
+        }
+
+        rec.timeNs  = rh.timeNs;
+        rec.setId   = rh.setId;
+        rec.adapter = adapter;
+        rec.cmd     = cmd;
+        rec.payload = prev;
+        return true;
+    }
+    return false;
+}
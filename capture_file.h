@@ -0,0 +1,175 @@
+#ifndef CAPTURE_FILE_H
+#define CAPTURE_FILE_H
+
+#include <QByteArray>
+#include <QFile>
+#include <QHash>
+#include <QMutex>
+#include <QString>
+#include <QThread>
+#include <QVector>
+#include <QWaitCondition>
+#include "usb2uis_backend.h"
+
+/*
+ * 擷取檔格式 (*.u2cap, little-endian, append-only)
+ *
+ *   CaptureFileHeader
+ *   { CaptureRecordHeader, cmd[cmdSize], body[encSize] } ...
+ *
+ *   DATA_RAW   : body = payload
+ *   DATA_DELTA : body = (payload XOR 同一 adapter+setId+cmd 的上一筆 payload) 的 zero-run 編碼
+ *                控制碼 c < 0x80 → 後面 c+1 個 literal; c >= 0x80 → (c & 0x7F)+1 個 0x00
+ *   INDEX      : body = CaptureIndexBlock, 結束一個 segment; 下一筆起 delta 狀態重置,
+ *                因此可以從任何 segment 開頭開始解碼
+ *   END        : body = 最後一個 INDEX 的 offset (qint64), 正常關閉時寫入
+ *
+ *  timeNs 為相對於 header.startNs 的單調時間.
+ *  type 的 bit3..0 為 eTypeCaptureRecord, bit7..4 為 adapter 編號 (version 2 起; version 1 恆為 0).
+ */
+
+#define CAPTURE_FILE_MAGIC      "U2UCAP01"
+#define CAPTURE_FILE_VERSION    2
+
+typedef enum{
+    CAPTURE_REC_DATA_RAW = 1,
+    CAPTURE_REC_DATA_DELTA,
+    CAPTURE_REC_INDEX,
+    CAPTURE_REC_END,
+}eTypeCaptureRecord;
+
+#define CAPTURE_REC_TYPE(t)         ((t) & 0x0F)
+#define CAPTURE_REC_ADAPTER(t)      (((t) >> 4) & 0x0F)
+#define CAPTURE_MAX_ADAPTERS        16
+
+struct CaptureFileHeader {
+    char    magic[8];
+    quint32 version;
+    quint32 headerSize;
+    qint64  startWallMs;        // ms since epoch (UTC)
+    qint64  startNs;            // PrecisionTimer::nowNs() 基準
+};
+
+struct CaptureRecordHeader {
+    qint64  timeNs;
+    quint8  type;               // CAPTURE_REC_TYPE / CAPTURE_REC_ADAPTER
+    quint8  cmdSize;
+    quint16 setId;
+    quint16 rawSize;            // 還原後的 payload 大小
+    quint16 encSize;            // 檔案中 body 大小
+};
+
+struct CaptureIndexBlock {
+    qint64  prevIndexOffset;    // 上一個 INDEX, 沒有則 -1
+    qint64  segmentOffset;      // 本 segment 第一筆紀錄
+    qint64  firstTimeNs;
+    qint64  lastTimeNs;
+    quint32 recordCount;
+    quint32 reserved;
+};
+
+static_assert(sizeof(CaptureFileHeader) == 32, "capture header layout");
+static_assert(sizeof(CaptureRecordHeader) == 16, "capture record layout");
+static_assert(sizeof(CaptureIndexBlock) == 40, "capture index layout");
+
+/*
+ * CaptureWriter
+ *  acquisition 執行緒呼叫 append() 只把原始紀錄複製到待寫緩衝;
+ *  delta 編碼與磁碟 I/O 都在背景執行緒. 緩衝超過上限時丟棄並計數, 不會阻塞 SPI 迴圈.
+ */
+class CaptureWriter : public QThread
+{
+public:
+    struct Stats {
+        quint64 records   = 0;
+        quint64 rawBytes  = 0;      // payload 原始大小
+        quint64 fileBytes = 0;
+        quint64 dropped   = 0;
+    };
+
+    explicit CaptureWriter(QObject *parent = nullptr);
+    ~CaptureWriter();
+
+    bool open(const QString &path, QString *errorMsg = nullptr);
+    void close();                   // 寫完剩餘資料與 INDEX/END 後返回
+    bool isOpen() const;
+    QString fileName() const;
+
+    void setSegmentLimits(int records, int ms);     // 預設 4096 筆 / 1000 ms
+    void setMaxPendingBytes(int bytes);             // 預設 8 MiB
+
+    // Thread-safe; adapter 0..15
+    void  append(quint16 setId, const BYTE *cmd, int cmdSize, const BYTE *payload, int size, int adapter = 0);
+    Stats stats() const;
+
+    static int encodeDelta(const BYTE *prev, const BYTE *cur, int size, BYTE *out, int outMax);
+    static bool decodeDelta(const BYTE *prev, const BYTE *in, int inSize, BYTE *out, int size);
+
+protected:
+    void run() override;
+
+private:
+    mutable QMutex m_mutex;
+    QWaitCondition m_cond;
+    QByteArray     m_pending;       // CaptureRecordHeader(type=0) + cmd + payload
+    bool           m_open = false;
+    bool           m_stop = false;
+    int            m_maxPending = 8 * 1024 * 1024;
+    qint64         m_startNs = 0;
+    Stats          m_stats;
+
+    // 以下只在背景執行緒使用
+    QFile       m_file;
+    QByteArray  m_out;
+    QHash<QByteArray, QByteArray> m_prev;   // adapter+setId+cmd → 上一筆 payload
+    int         m_segRecords = 4096;
+    qint64      m_segNs = 1000000000LL;
+    qint64      m_pos = 0;
+    qint64      m_prevIndex = -1;
+    qint64      m_segOffset = 0;
+    qint64      m_segFirstNs = 0;
+    qint64      m_segLastNs = 0;
+    quint32     m_segCount = 0;
+
+    void writeBatch(const QByteArray &batch);
+    void writeIndex();
+    void writeEnd();
+    void flushOut();
+};
+
+/*
+ * CaptureReader
+ *  依序讀取並還原 delta; seek() 以 INDEX 跳到包含指定時間的 segment 開頭.
+ *  沒有 END 的檔案 (程式中斷) 會改用順序掃描建立 index.
+ */
+class CaptureReader
+{
+public:
+    struct Record {
+        qint64     timeNs  = 0;
+        quint16    setId   = 0;
+        int        adapter = 0;
+        QByteArray cmd;
+        QByteArray payload;
+    };
+
+    bool open(const QString &path, QString *errorMsg = nullptr);
+    void close();
+
+    const CaptureFileHeader &header() const { return m_header; }
+    const QVector<CaptureIndexBlock> &segments() const { return m_segments; }
+
+    bool next(Record &rec);         // false = 檔尾或資料損毀
+    bool seek(qint64 timeNs);       // 相對時間
+
+private:
+    QFile             m_file;
+    CaptureFileHeader m_header;
+    QVector<CaptureIndexBlock>    m_segments;
+    QHash<QByteArray, QByteArray> m_prev;
+
+    bool loadIndexChain();
+    void scanIndex();
+};
+
+#endif // CAPTURE_FILE_H
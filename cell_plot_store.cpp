@@ -0,0 +1,201 @@
+#include "cell_plot_store.h"
+
+#include <cstring>
+
+#define CELL_PLOT_EMPTY_MIN     qint16(0x7FFF)      // 無有效樣本: min > max
+#define CELL_PLOT_EMPTY_MAX     qint16(-0x8000)
+
+struct CellPlotStore::Level {
+    QVector<qint64> startNs;        // CELL_PLOT_CAPACITY
+    QVector<qint64> endNs;
+    QVector<qint16> mins;           // CELL_PLOT_CAPACITY * ADBMS6832_CELL_COUNT
+    QVector<qint16> maxs;
+    int head = 0;                   // 下一個寫入位置
+    int size = 0;
+
+    // 累積中的上一層 bucket (已收到 accCount 個本層 bucket)
+    qint16 accMin[ADBMS6832_CELL_COUNT];
+    qint16 accMax[ADBMS6832_CELL_COUNT];
+    qint64 accStartNs = 0;
+    qint64 accEndNs = 0;
+    int    accCount = 0;
+
+    Level()
+        : startNs(CELL_PLOT_CAPACITY), endNs(CELL_PLOT_CAPACITY),
+          mins(CELL_PLOT_CAPACITY * ADBMS6832_CELL_COUNT), maxs(CELL_PLOT_CAPACITY * ADBMS6832_CELL_COUNT)
+    {
+    }
+
+    int slot(int i) const { return (head - size + i) & (CELL_PLOT_CAPACITY - 1); }    // i = 0: 最舊
+
+    // 第一個 startNs >= ns 的邏輯位置
+    int lowerBound(qint64 ns) const
+    {
+        int lo = 0, hi = size;
+        while (lo < hi) {
+            const int mid = (lo + hi) / 2;
+            if (startNs[slot(mid)] < ns) lo = mid + 1;
+            else hi = mid;
+        }
+        return lo;
+    }
+};
+
+struct CellPlotStore::Track {
+    int   adapter = 0;
+    int   device = 0;
+    Level levels[CELL_PLOT_LEVELS];
+};
+
+CellPlotStore::CellPlotStore()
+{
+}
+
+CellPlotStore::~CellPlotStore()
+{
+    clear();
+}
+
+void CellPlotStore::clear()
+{
+    qDeleteAll(m_tracks);
+    m_tracks.clear();
+    m_trackIndex.clear();
+    m_firstNs = 0;
+    m_lastNs = 0;
+    ++m_generation;
+}
+
+qint64 CellPlotStore::trackBytes()
+{
+    return qint64(CELL_PLOT_LEVELS) * CELL_PLOT_CAPACITY * (2 * sizeof(qint64) + 2 * sizeof(qint16) * ADBMS6832_CELL_COUNT);
+}
+
+QString CellPlotStore::trackName(int track) const
+{
+    if (track < 0 || track >= m_tracks.size()) return QString();
+    return QString("U%1 AFE %2").arg(m_tracks[track]->adapter).arg(m_tracks[track]->device + 1);
+}
+
+/* 超過 CELL_PLOT_MAX_TRACKS 時回傳 nullptr, 該 AFE 不繪製 */
+CellPlotStore::Track *CellPlotStore::track(int adapter, int device)
+{
+    const int key = (adapter << 8) | device;
+    const auto it = m_trackIndex.constFind(key);
+    if (it != m_trackIndex.constEnd()) return m_tracks[it.value()];
+    if (m_tracks.size() >= CELL_PLOT_MAX_TRACKS) return nullptr;
+
+    Track *t = new Track;
+    t->adapter = adapter;
+    t->device = device;
+    m_trackIndex.insert(key, m_tracks.size());
+    m_tracks.append(t);
+    return t;
+}
+
+/* 寫入一個 bucket, 每累積 CELL_PLOT_FANOUT 個再合併成上一層的一個 bucket */
+void CellPlotStore::push(Track &t, int level, qint64 startNs, qint64 endNs, const qint16 *mins, const qint16 *maxs)
+{
+    Level &L = t.levels[level];
+    const int s = L.head;
+    L.startNs[s] = startNs;
+    L.endNs[s] = endNs;
+    memcpy(L.mins.data() + s * ADBMS6832_CELL_COUNT, mins, sizeof(qint16) * ADBMS6832_CELL_COUNT);
+    memcpy(L.maxs.data() + s * ADBMS6832_CELL_COUNT, maxs, sizeof(qint16) * ADBMS6832_CELL_COUNT);
+    L.head = (L.head + 1) & (CELL_PLOT_CAPACITY - 1);
+    if (L.size < CELL_PLOT_CAPACITY) ++L.size;
+
+    if (level + 1 >= CELL_PLOT_LEVELS) return;
+
+    if (L.accCount == 0) {
+        L.accStartNs = startNs;
+        memcpy(L.accMin, mins, sizeof(L.accMin));
+        memcpy(L.accMax, maxs, sizeof(L.accMax));
+    } else {
+        for (int c = 0; c < ADBMS6832_CELL_COUNT; ++c) {
+            L.accMin[c] = qMin(L.accMin[c], mins[c]);
+            L.accMax[c] = qMax(L.accMax[c], maxs[c]);
+        }
+    }
+    L.accEndNs = endNs;
+
+    if (++L.accCount == CELL_PLOT_FANOUT) {
+        L.accCount = 0;
+        push(t, level + 1, L.accStartNs, L.accEndNs, L.accMin, L.accMax);
+    }
+}
+
+void CellPlotStore::append(const AfeChainSample &sample)
+{
+    qint16 mins[ADBMS6832_CELL_COUNT];
+    qint16 maxs[ADBMS6832_CELL_COUNT];
+    bool any = false;
+
+    for (int d = 0; d < sample.devices.size(); ++d) {
+        const AfeDeviceSample &dev = sample.devices[d];
+        if (dev.cellValid == 0) continue;
+        Track *t = track(sample.adapter, d);
+        if (!t) continue;
+
+        for (int c = 0; c < ADBMS6832_CELL_COUNT; ++c) {
+            if ((dev.cellValid >> c) & 1) {
+                mins[c] = maxs[c] = qint16((dev.cellUv[c] - ADBMS6832_CV_OFFSET_UV) / ADBMS6832_CV_LSB_UV);
+            } else {
+                mins[c] = CELL_PLOT_EMPTY_MIN;
+                maxs[c] = CELL_PLOT_EMPTY_MAX;
+            }
+        }
+        push(*t, 0, sample.timeNs, sample.timeNs, mins, maxs);
+        any = true;
+    }
+
+    if (!any) return;
+    if (m_firstNs == 0) m_firstNs = sample.timeNs;
+    m_lastNs = qMax(m_lastNs, sample.timeNs);
+    ++m_generation;
+}
+
+/*
+ * 1. 由最細的層級開始, 找第一個 (a) 仍保留 t0 且 (b) 範圍內 bucket 數 <= maxBuckets 的層級
+ * 2. 粗層級最後一個 bucket 之後的資料還在下層累積中, 依序以較細的層級補上尾端
+ */
+int CellPlotStore::query(int track, int cell, qint64 t0Ns, qint64 t1Ns, int maxBuckets, QVector<Bucket> &out) const
+{
+    out.clear();
+    if (track < 0 || track >= m_tracks.size() || cell < 0 || cell >= ADBMS6832_CELL_COUNT || t1Ns < t0Ns)
+        return -1;
+
+    const Track &t = *m_tracks[track];
+    int pick = -1;
+    for (int l = 0; l < CELL_PLOT_LEVELS; ++l) {
+        const Level &L = t.levels[l];
+        if (L.size == 0) break;
+        pick = l;
+        const bool coversStart = L.size < CELL_PLOT_CAPACITY || L.startNs[L.slot(0)] <= t0Ns;
+        const int count = L.lowerBound(t1Ns + 1) - L.lowerBound(t0Ns);
+        if (coversStart && count <= maxBuckets) break;
+    }
+    if (pick < 0) return -1;
+
+    qint64 cursor = t0Ns;
+    for (int l = pick; l >= 0; --l) {
+        const Level &L = t.levels[l];
+        bool emitted = false;
+        qint64 lastEnd = 0;
+        for (int i = L.lowerBound(cursor); i < L.size; ++i) {
+            const int s = L.slot(i);
+            if (L.startNs[s] > t1Ns) break;
+            lastEnd = L.endNs[s];
+            emitted = true;
+
+            const qint16 lo = L.mins[s * ADBMS6832_CELL_COUNT + cell];
+            const qint16 hi = L.maxs[s * ADBMS6832_CELL_COUNT + cell];
+            if (hi < lo) continue;
+            out.append(Bucket{L.startNs[s],
+                              ADBMS6832_CV_OFFSET_UV + qint32(lo) * ADBMS6832_CV_LSB_UV,
+                              ADBMS6832_CV_OFFSET_UV + qint32(hi) * ADBMS6832_CV_LSB_UV});
+        }
+        if (emitted) cursor = lastEnd + 1;
+    }
+    return pick;
+}
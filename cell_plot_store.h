@@ -0,0 +1,63 @@
+#ifndef CELL_PLOT_STORE_H
+#define CELL_PLOT_STORE_H
+
+#include <QHash>
+#include <QString>
+#include <QVector>
+#include "adbms6832_decoder.h"
+
+// Pyramid: level n 的每個 bucket 涵蓋 4^n 筆樣本, 每層固定 2048 個 bucket (ring)
+// 100 Hz 時 level 0 約 20 秒原始資料, level 7 約 93 小時
+#define CELL_PLOT_LEVELS            8
+#define CELL_PLOT_FANOUT            4
+#define CELL_PLOT_CAPACITY_BITS     11
+#define CELL_PLOT_CAPACITY          (1 << CELL_PLOT_CAPACITY_BITS)
+#define CELL_PLOT_MAX_TRACKS        64      // adapter x AFE, 每個約 1.3 MB (trackBytes)
+
+/*
+ * CellPlotStore
+ *  每顆 AFE (track) 16 個 cell 的 min/max decimation pyramid, 記憶體固定.
+ *  cell 電壓以 16-bit ADC code 存放 (無效值不列入 min/max).
+ *  append/query 都在 UI 執行緒 (mergedSample 為 queued signal), acquisition 執行緒不會等待畫面.
+ */
+class CellPlotStore
+{
+public:
+    struct Bucket {
+        qint64 timeNs;          // bucket 第一筆樣本的時間
+        qint32 minUv;
+        qint32 maxUv;
+    };
+
+    CellPlotStore();
+    ~CellPlotStore();
+
+    void append(const AfeChainSample &sample);
+    void clear();
+
+    int     trackCount() const          { return m_tracks.size(); }
+    QString trackName(int track) const;
+    qint64  firstTimeNs() const         { return m_firstNs; }
+    qint64  lastTimeNs() const          { return m_lastNs; }
+    quint64 generation() const          { return m_generation; }   // 每次 append 遞增, 畫面判斷是否需重繪
+
+    // [t0Ns, t1Ns] 內的 bucket (時間遞增), 選擇數量不超過 maxBuckets 的最細層級; 回傳使用的層級
+    int query(int track, int cell, qint64 t0Ns, qint64 t1Ns, int maxBuckets, QVector<Bucket> &out) const;
+
+    static qint64 trackBytes();
+
+private:
+    struct Level;
+    struct Track;
+
+    QVector<Track*> m_tracks;
+    QHash<int, int> m_trackIndex;           // adapter << 8 | device → m_tracks index
+    qint64  m_firstNs = 0;
+    qint64  m_lastNs = 0;
+    quint64 m_generation = 0;
+
+    Track *track(int adapter, int device);
+    static void push(Track &t, int level, qint64 startNs, qint64 endNs, const qint16 *mins, const qint16 *maxs);
+};
+
+#endif // CELL_PLOT_STORE_H
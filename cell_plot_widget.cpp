@@ -0,0 +1,192 @@
+#include "cell_plot_widget.h"
+#include "precision_timer.h"
+#include "spi_trace.h"
+
+#include <QPainter>
+#include <QPaintEvent>
+#include <QWheelEvent>
+#include <QMouseEvent>
+#include <QtMath>
+#include <climits>
+
+CellPlotWidget::CellPlotWidget(const CellPlotStore *store, QWidget *parent)
+    : QWidget(parent), m_store(store)
+{
+    setAttribute(Qt::WA_OpaquePaintEvent);
+    setMouseTracking(false);
+}
+
+void CellPlotWidget::setTrack(int track)
+{
+    if (track == m_track) return;
+    m_track = track;
+    update();
+}
+
+void CellPlotWidget::refresh()
+{
+    if (isVisible() && m_store->generation() != m_drawnGeneration) update();
+}
+
+QRect CellPlotWidget::plotArea() const
+{
+    return rect().adjusted(70, 24, -10, -24);
+}
+
+qint64 CellPlotWidget::viewEndNs() const
+{
+    return m_follow ? m_store->lastTimeNs() : m_endNs;
+}
+
+/*
+ * 1. 每個通道向 store 查詢約 2 x 寬度個 bucket, 合併到像素欄的 min/max
+ * 2. 全部通道的範圍決定 Y 軸
+ * 3. 每欄畫 (x, min) → (x, max), 相鄰欄相連; 沒有資料的欄中斷線段
+ */
+void CellPlotWidget::paintEvent(QPaintEvent *event)
+{
+    Q_UNUSED(event);
+    const qint64 tDraw = PrecisionTimer::nowNs();
+
+    QPainter p(this);
+    p.fillRect(rect(), palette().base());
+    const QRect area = plotArea();
+    m_drawnGeneration = m_store->generation();
+
+    const int tracks = m_store->trackCount();
+    if (tracks == 0 || area.width() < 2 || area.height() < 2) {
+        p.setPen(palette().text().color());
+        p.drawText(rect(), Qt::AlignCenter, "No sample");
+        return;
+    }
+
+    const qint64 t1 = viewEndNs();
+    const qint64 t0 = t1 - m_spanNs;
+    const int columns = area.width();
+    const int firstTrack = m_track < 0 ? 0 : qMin(m_track, tracks - 1);
+    const int trackSpan = m_track < 0 ? tracks : 1;
+    const int channels = trackSpan * ADBMS6832_CELL_COUNT;
+
+    m_colMin.fill(INT_MAX, channels * columns);
+    m_colMax.fill(INT_MIN, channels * columns);
+    qint32 yMin = INT_MAX, yMax = INT_MIN;
+    int level = 0;
+
+    for (int ch = 0; ch < channels; ++ch) {
+        const int track = firstTrack + ch / ADBMS6832_CELL_COUNT;
+        const int cell = ch % ADBMS6832_CELL_COUNT;
+        level = qMax(level, m_store->query(track, cell, t0, t1, columns * 2, m_buckets));
+
+        qint32 *colMin = m_colMin.data() + ch * columns;
+        qint32 *colMax = m_colMax.data() + ch * columns;
+        for (const CellPlotStore::Bucket &b : m_buckets) {
+            const int x = int((b.timeNs - t0) * columns / m_spanNs);
+            if (x < 0 || x >= columns) continue;
+            colMin[x] = qMin(colMin[x], b.minUv);
+            colMax[x] = qMax(colMax[x], b.maxUv);
+            yMin = qMin(yMin, b.minUv);
+            yMax = qMax(yMax, b.maxUv);
+        }
+    }
+
+    p.setPen(palette().mid().color());
+    p.drawRect(area.adjusted(0, 0, -1, -1));
+    p.setPen(palette().text().color());
+    const double firstS = m_store->firstTimeNs() / 1e9;
+    p.drawText(QRect(area.left(), area.bottom() + 4, 120, 18), Qt::AlignLeft,
+               QString("%1 s").arg(t0 / 1e9 - firstS, 0, 'f', 2));
+    p.drawText(QRect(area.right() - 120, area.bottom() + 4, 120, 18), Qt::AlignRight,
+               QString("%1 s%2").arg(t1 / 1e9 - firstS, 0, 'f', 2).arg(m_follow ? " (live)" : ""));
+
+    if (yMin > yMax) {
+        p.drawText(area, Qt::AlignCenter, "No sample in view");
+        return;
+    }
+
+    // 最小顯示範圍 1 mV, 上下各留 5%
+    if (yMax - yMin < 1000) {
+        const qint32 mid = yMin + (yMax - yMin) / 2;
+        yMin = mid - 500;
+        yMax = mid + 500;
+    }
+    const qint32 pad = (yMax - yMin) / 20;
+    yMin -= pad;
+    yMax += pad;
+    const double yScale = area.height() / double(yMax - yMin);
+    auto yOf = [&](qint32 uv) { return area.bottom() - (uv - yMin) * yScale; };
+
+    p.drawText(QRect(0, area.top() - 8, area.left() - 6, 16), Qt::AlignRight | Qt::AlignVCenter,
+               QString::number(yMax / 1e6, 'f', 4));
+    p.drawText(QRect(0, area.bottom() - 8, area.left() - 6, 16), Qt::AlignRight | Qt::AlignVCenter,
+               QString::number(yMin / 1e6, 'f', 4));
+
+    p.setClipRect(area);
+    for (int ch = 0; ch < channels; ++ch) {
+        p.setPen(QColor::fromHsv((ch % ADBMS6832_CELL_COUNT) * 360 / ADBMS6832_CELL_COUNT, 220, 200));
+        const qint32 *colMin = m_colMin.constData() + ch * columns;
+        const qint32 *colMax = m_colMax.constData() + ch * columns;
+
+        m_poly.clear();
+        for (int x = 0; x <= columns; ++x) {
+            if (x == columns || colMin[x] > colMax[x]) {
+                if (m_poly.size() > 1) p.drawPolyline(m_poly);
+                else if (m_poly.size() == 1) p.drawPoint(m_poly.first());
+                m_poly.clear();
+                continue;
+            }
+            const double px = area.left() + x;
+            m_poly << QPointF(px, yOf(colMin[x]));
+            if (colMax[x] != colMin[x]) m_poly << QPointF(px, yOf(colMax[x]));
+        }
+    }
+    p.setClipping(false);
+
+    const QString what = m_track < 0 ? QString("All AFEs (%1)").arg(tracks) : m_store->trackName(firstTrack);
+    p.drawText(QRect(area.left(), 2, area.width(), 20), Qt::AlignLeft | Qt::AlignVCenter,
+               QString("%1   span %2 s   level %3 (x%4)   wheel: zoom  drag: pan  double-click: live")
+               .arg(what).arg(m_spanNs / 1e9, 0, 'f', 2).arg(level)
+               .arg(qint64(qPow(CELL_PLOT_FANOUT, level))));
+
+    SpiTrace::record(SPI_PHASE_UI_PLOT, SPI_TRACE_UI_THREAD, tDraw, PrecisionTimer::nowNs());
+}
+
+/* 以游標位置為中心縮放; 跟隨中時右邊界保持在最新樣本 */
+void CellPlotWidget::wheelEvent(QWheelEvent *event)
+{
+    const double steps = event->angleDelta().y() / 120.0;
+    if (steps == 0) return;
+
+    const QRect area = plotArea();
+    const double frac = qBound(0.0, (event->position().x() - area.left()) / double(qMax(area.width(), 1)), 1.0);
+    const qint64 anchor = viewEndNs() - m_spanNs + qint64(frac * m_spanNs);
+    const qint64 span = qBound<qint64>(CELL_PLOT_MIN_SPAN_NS, qint64(m_spanNs * qPow(0.8, steps)), CELL_PLOT_MAX_SPAN_NS);
+
+    if (!m_follow) m_endNs = anchor + qint64((1.0 - frac) * span);
+    m_spanNs = span;
+    event->accept();
+    update();
+}
+
+void CellPlotWidget::mousePressEvent(QMouseEvent *event)
+{
+    m_dragX = event->pos().x();
+    m_dragEndNs = viewEndNs();
+}
+
+void CellPlotWidget::mouseMoveEvent(QMouseEvent *event)
+{
+    if (!(event->buttons() & Qt::LeftButton)) return;
+
+    const int dx = event->pos().x() - m_dragX;
+    m_endNs = m_dragEndNs - qint64(double(dx) * m_spanNs / qMax(plotArea().width(), 1));
+    m_follow = (m_endNs >= m_store->lastTimeNs());     // 拖到最新樣本之後 → 恢復跟隨
+    update();
+}
+
+void CellPlotWidget::mouseDoubleClickEvent(QMouseEvent *event)
+{
+    Q_UNUSED(event);
+    m_follow = true;
+    m_spanNs = CELL_PLOT_DEFAULT_SPAN_NS;
+    update();
+}
@@ -0,0 +1,60 @@
+#ifndef CELL_PLOT_WIDGET_H
+#define CELL_PLOT_WIDGET_H
+
+#include <QWidget>
+#include <QVector>
+#include <QPolygonF>
+#include "cell_plot_store.h"
+
+#define CELL_PLOT_DEFAULT_SPAN_NS   (60LL * 1000000000LL)      // 預設顯示最近 60 秒
+#define CELL_PLOT_MIN_SPAN_NS       (10LL * 1000000LL)          // 縮放範圍 10 ms ~ 7 天
+#define CELL_PLOT_MAX_SPAN_NS       (7LL * 24 * 3600 * 1000000000LL)
+
+/*
+ * CellPlotWidget
+ *  以 CellPlotStore 的 min/max pyramid 繪製 cell 電壓, 每個像素欄只畫該欄的 min~max,
+ *  繪圖成本與樣本數無關 (只與寬度 x 通道數有關).
+ *  滾輪: 以游標為中心縮放時間軸; 拖曳: 平移 (停止跟隨); 雙擊: 回到即時跟隨.
+ */
+class CellPlotWidget : public QWidget
+{
+    Q_OBJECT
+
+public:
+    explicit CellPlotWidget(const CellPlotStore *store, QWidget *parent = nullptr);
+
+    void setTrack(int track);           // -1 = 全部 AFE
+    int  track() const { return m_track; }
+
+public slots:
+    void refresh();                     // 有新資料且可見時才重繪 (由 timer 呼叫)
+
+protected:
+    void paintEvent(QPaintEvent *event) override;
+    void wheelEvent(QWheelEvent *event) override;
+    void mousePressEvent(QMouseEvent *event) override;
+    void mouseMoveEvent(QMouseEvent *event) override;
+    void mouseDoubleClickEvent(QMouseEvent *event) override;
+
+private:
+    const CellPlotStore *m_store;
+    int     m_track = -1;
+    quint64 m_drawnGeneration = 0;
+
+    bool    m_follow = true;            // 右邊界跟隨最新樣本
+    qint64  m_spanNs = CELL_PLOT_DEFAULT_SPAN_NS;
+    qint64  m_endNs = 0;                // 不跟隨時的右邊界
+    int     m_dragX = 0;
+    qint64  m_dragEndNs = 0;
+
+    // 每個通道每個像素欄的 min/max (uV), 重複使用避免每次配置
+    QVector<qint32> m_colMin;
+    QVector<qint32> m_colMax;
+    QVector<CellPlotStore::Bucket> m_buckets;
+    QPolygonF       m_poly;
+
+    QRect  plotArea() const;
+    qint64 viewEndNs() const;
+};
+
+#endif // CELL_PLOT_WIDGET_H
@@ -0,0 +1,268 @@
+#include "cell_stats_store.h"
+
+#include <QFile>
+#include <cmath>
+
+#define CELL_STATS_EMPTY_MIN    qint16(0x7FFF)      // 無有效樣本: min > max
+#define CELL_STATS_EMPTY_MAX    qint16(-0x8000)
+
+static const qint64 kTierNs[CELL_STATS_TIERS] = {
+    1000000000LL, 10000000000LL, 60000000000LL, 600000000000LL, 3600000000000LL, 86400000000000LL,
+};
+static const int kTierSlots[CELL_STATS_TIERS] = {
+    CELL_STATS_SLOTS, CELL_STATS_SLOTS, CELL_STATS_SLOTS, CELL_STATS_SLOTS, CELL_STATS_SLOTS, CELL_STATS_TOP_SLOTS,
+};
+
+struct CellStatsStore::Tier {
+    int              slotCount = 0; // kTierSlots, 2 的次方
+    QVector<qint64>  bucket;        // slotCount: 該 slot 目前的 bucket 編號 (時間 / kTierNs), -1 = 空
+    QVector<quint32> count;         // slotCount * ADBMS6832_CELL_COUNT, [cell * slotCount + slot]
+    QVector<qint16>  mins;
+    QVector<qint16>  maxs;
+    QVector<qint64>  sums;
+    QVector<qint64>  sumSqs;
+
+    void allocate(int n)
+    {
+        slotCount = n;
+        bucket = QVector<qint64>(n, -1);
+        count  = QVector<quint32>(n * ADBMS6832_CELL_COUNT);
+        mins   = QVector<qint16>(n * ADBMS6832_CELL_COUNT);
+        maxs   = QVector<qint16>(n * ADBMS6832_CELL_COUNT);
+        sums   = QVector<qint64>(n * ADBMS6832_CELL_COUNT);
+        sumSqs = QVector<qint64>(n * ADBMS6832_CELL_COUNT);
+    }
+
+    // slot 換成新的 bucket b 時清除所有通道
+    void reset(int s, qint64 b)
+    {
+        bucket[s] = b;
+        for (int c = 0; c < ADBMS6832_CELL_COUNT; ++c) {
+            const int i = c * slotCount + s;
+            count[i] = 0;
+            mins[i] = CELL_STATS_EMPTY_MIN;
+            maxs[i] = CELL_STATS_EMPTY_MAX;
+            sums[i] = 0;
+            sumSqs[i] = 0;
+        }
+    }
+};
+
+struct CellStatsStore::Track {
+    int    adapter = 0;
+    int    device = 0;
+    qint64 firstNs = -1;
+    qint64 lastNs = 0;
+    Tier   tiers[CELL_STATS_TIERS];
+
+    Track()
+    {
+        for (int k = 0; k < CELL_STATS_TIERS; ++k) tiers[k].allocate(kTierSlots[k]);
+    }
+};
+
+CellStatsStore::CellStatsStore()
+{
+}
+
+CellStatsStore::~CellStatsStore()
+{
+    clear();
+}
+
+void CellStatsStore::clear()
+{
+    qDeleteAll(m_tracks);
+    m_tracks.clear();
+    m_trackIndex.clear();
+    m_firstNs = 0;
+    m_lastNs = 0;
+    ++m_generation;
+}
+
+qint64 CellStatsStore::trackBytes()
+{
+    qint64 slotTotal = 0;
+    for (int k = 0; k < CELL_STATS_TIERS; ++k) slotTotal += kTierSlots[k];
+    return slotTotal * (sizeof(qint64) + (sizeof(quint32) + 2 * sizeof(qint16) + 2 * sizeof(qint64)) * ADBMS6832_CELL_COUNT);
+}
+
+QString CellStatsStore::trackName(int track) const
+{
+    if (track < 0 || track >= m_tracks.size()) return QString();
+    return QString("U%1 AFE %2").arg(m_tracks[track]->adapter).arg(m_tracks[track]->device + 1);
+}
+
+QString CellStatsStore::spanName(qint64 spanNs)
+{
+    if (spanNs % CELL_STATS_DAY_NS == 0)    return QString("%1d").arg(spanNs / CELL_STATS_DAY_NS);
+    if (spanNs % CELL_STATS_HOUR_NS == 0)   return QString("%1h").arg(spanNs / CELL_STATS_HOUR_NS);
+    if (spanNs % CELL_STATS_MINUTE_NS == 0) return QString("%1min").arg(spanNs / CELL_STATS_MINUTE_NS);
+    return QString("%1s").arg(spanNs / 1e9);
+}
+
+/* 超過 CELL_STATS_MAX_TRACKS 時回傳 nullptr, 該 AFE 不統計 */
+CellStatsStore::Track *CellStatsStore::track(int adapter, int device)
+{
+    const int key = (adapter << 8) | device;
+    const auto it = m_trackIndex.constFind(key);
+    if (it != m_trackIndex.constEnd()) return m_tracks[it.value()];
+    if (m_tracks.size() >= CELL_STATS_MAX_TRACKS) return nullptr;
+
+    Track *t = new Track;
+    t->adapter = adapter;
+    t->device = device;
+    m_trackIndex.insert(key, m_tracks.size());
+    m_tracks.append(t);
+    return t;
+}
+
+/* 每一層累加到 timeNs 所屬的 bucket; 該 slot 仍是較舊的 bucket 時先清除 (ring 覆蓋) */
+void CellStatsStore::append(const AfeChainSample &sample)
+{
+    if (sample.timeNs < 0) return;
+    qint16 codes[ADBMS6832_CELL_COUNT];
+    bool any = false;
+
+    for (int d = 0; d < sample.devices.size(); ++d) {
+        const AfeDeviceSample &dev = sample.devices[d];
+        if (dev.cellValid == 0) continue;
+        Track *t = track(sample.adapter, d);
+        if (!t) continue;
+
+        for (int c = 0; c < ADBMS6832_CELL_COUNT; ++c)
+            codes[c] = qint16((dev.cellUv[c] - ADBMS6832_CV_OFFSET_UV) / ADBMS6832_CV_LSB_UV);
+
+        for (int k = 0; k < CELL_STATS_TIERS; ++k) {
+            Tier &T = t->tiers[k];
+            const qint64 b = sample.timeNs / kTierNs[k];
+            const int s = int(b & (T.slotCount - 1));
+            if (T.bucket[s] > b) continue;          // 比保留範圍舊
+            if (T.bucket[s] != b) T.reset(s, b);
+
+            for (int c = 0; c < ADBMS6832_CELL_COUNT; ++c) {
+                if (!((dev.cellValid >> c) & 1)) continue;
+                const int i = c * T.slotCount + s;
+                const qint16 v = codes[c];
+                ++T.count[i];
+                T.mins[i] = qMin(T.mins[i], v);
+                T.maxs[i] = qMax(T.maxs[i], v);
+                T.sums[i] += v;
+                T.sumSqs[i] += qint64(v) * v;
+            }
+        }
+        if (t->firstNs < 0) t->firstNs = sample.timeNs;
+        t->lastNs = qMax(t->lastNs, sample.timeNs);
+        any = true;
+    }
+
+    if (!any) return;
+    if (m_firstNs == 0) m_firstNs = sample.timeNs;
+    m_lastNs = qMax(m_lastNs, sample.timeNs);
+    ++m_generation;
+}
+
+/*
+ * 1. 起點對齊到仍保留 t0 的最細層級 kL (更細的層級已被覆蓋);
+ *    終點對齊到 t1 所在的上一層區塊仍完整保留的最細層級 kH (<= kL), 拆解時不會讀到已被覆蓋的 bucket
+ * 2. 以 1 s 為單位的 [lo, hi) 由細到粗拆解: 每層先取兩端未對齊上一層的 bucket, 剩下的交給上一層
+ *    每層最多 2 x (fanout - 1) 個, 合計 2 x (9 + 5 + 9 + 5 + 23) = 102 個;
+ *    最粗層 (1 d) 取剩下的全部, 只保留 16 個 bucket 所以最多 16 個
+ */
+CellStatsStore::Stats CellStatsStore::stats(int track, int cell, qint64 t0Ns, qint64 t1Ns) const
+{
+    Stats st;
+    if (track < 0 || track >= m_tracks.size() || cell < 0 || cell >= ADBMS6832_CELL_COUNT) return st;
+    const Track &t = *m_tracks[track];
+    if (t.firstNs < 0) return st;
+
+    t0Ns = qMax(t0Ns, t.firstNs);
+    t1Ns = qMin(t1Ns, t.lastNs);
+    if (t1Ns < t0Ns) return st;
+
+    // 層級 k 仍保留的最舊時間 (更舊的 bucket 已被 ring 覆蓋)
+    auto oldestNs = [&t](int k) { return (t.lastNs / kTierNs[k] - kTierSlots[k] + 1) * kTierNs[k]; };
+
+    int kL = 0;
+    while (kL + 1 < CELL_STATS_TIERS && t0Ns < oldestNs(kL)) ++kL;
+    t0Ns = qMax(t0Ns, oldestNs(kL));
+    if (t1Ns < t0Ns) return st;
+    int kH = 0;
+    while (kH < kL && t1Ns / kTierNs[kH + 1] * kTierNs[kH + 1] < oldestNs(kH)) ++kH;
+
+    qint64 lo = t0Ns / kTierNs[kL] * (kTierNs[kL] / kTierNs[0]);
+    qint64 hi = (t1Ns / kTierNs[kH] + 1) * (kTierNs[kH] / kTierNs[0]);
+    st.fromNs = qMax(lo * kTierNs[0], t.firstNs);
+    st.toNs   = qMin(hi * kTierNs[0] - 1, t.lastNs);
+
+    qint64 sum = 0, sumSq = 0;
+    qint16 lowest = CELL_STATS_EMPTY_MIN, highest = CELL_STATS_EMPTY_MAX;
+    auto add = [&](int k, qint64 b) {
+        const Tier &T = t.tiers[k];
+        const int s = int(b & (T.slotCount - 1));
+        if (T.bucket[s] != b) return;               // 該區間沒有樣本
+        const int i = cell * T.slotCount + s;
+        if (T.count[i] == 0) return;
+        st.count += T.count[i];
+        sum      += T.sums[i];
+        sumSq    += T.sumSqs[i];
+        lowest    = qMin(lowest, T.mins[i]);
+        highest   = qMax(highest, T.maxs[i]);
+    };
+
+    for (int k = 0; k + 1 < CELL_STATS_TIERS; ++k) {
+        const qint64 fanout = kTierNs[k + 1] / kTierNs[k];
+        while (lo < hi && lo % fanout) add(k, lo++);
+        while (lo < hi && hi % fanout) add(k, --hi);
+        lo /= fanout;
+        hi /= fanout;
+    }
+    for (qint64 b = lo; b < hi; ++b) add(CELL_STATS_TIERS - 1, b);
+
+    if (st.count == 0) return st;
+    const double n = double(st.count);
+    const double mean = double(sum) / n;
+    st.minUv    = ADBMS6832_CV_OFFSET_UV + qint32(lowest) * ADBMS6832_CV_LSB_UV;
+    st.maxUv    = ADBMS6832_CV_OFFSET_UV + qint32(highest) * ADBMS6832_CV_LSB_UV;
+    st.meanUv   = ADBMS6832_CV_OFFSET_UV + mean * ADBMS6832_CV_LSB_UV;
+    st.stddevUv = std::sqrt(qMax(0.0, double(sumSq) / n - mean * mean)) * ADBMS6832_CV_LSB_UV;
+    return st;
+}
+
+CellStatsStore::Stats CellStatsStore::recent(int track, int cell, qint64 spanNs) const
+{
+    if (track < 0 || track >= m_tracks.size()) return Stats();
+    const qint64 lastNs = m_tracks[track]->lastNs;
+    return stats(track, cell, lastNs - spanNs + 1, lastNs);
+}
+
+bool CellStatsStore::writeCsv(const QString &path, const QVector<qint64> &spansNs, QString *errorMsg) const
+{
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        if (errorMsg) *errorMsg = QString("Cannot create %1: %2").arg(path, file.errorString());
+        return false;
+    }
+
+    QByteArray out = "afe,cell,window,samples,min_v,max_v,mean_v,stddev_mv,from_s,to_s\n";
+    for (int t = 0; t < m_tracks.size(); ++t) {
+        for (int c = 0; c < ADBMS6832_CELL_COUNT; ++c) {
+            for (qint64 span : spansNs) {
+                const Stats st = recent(t, c, span);
+                if (st.count == 0) continue;
+                out += QString("%1,%2,%3,%4,%5,%6,%7,%8,%9,%10\n")
+                        .arg(trackName(t)).arg(c + 1).arg(spanName(span)).arg(st.count)
+                        .arg(st.minUv / 1e6, 0, 'f', 6).arg(st.maxUv / 1e6, 0, 'f', 6)
+                        .arg(st.meanUv / 1e6, 0, 'f', 6).arg(st.stddevUv / 1e3, 0, 'f', 3)
+                        .arg((st.fromNs - m_firstNs) / 1e9, 0, 'f', 3).arg((st.toNs - m_firstNs) / 1e9, 0, 'f', 3)
+                        .toUtf8();
+            }
+        }
+    }
+
+    if (file.write(out) != out.size()) {
+        if (errorMsg) *errorMsg = QString("Cannot write %1: %2").arg(path, file.errorString());
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,79 @@
+#ifndef CELL_STATS_STORE_H
+#define CELL_STATS_STORE_H
+
+#include <QHash>
+#include <QString>
+#include <QVector>
+#include "adbms6832_decoder.h"
+
+// 層級 bucket 長度 1 s / 10 s / 1 min / 10 min / 1 h / 1 d, 前 5 層各 256 個 bucket (ring), 最粗層 16 個
+// 保留時間: 4 分鐘 / 42 分鐘 / 4.2 小時 / 42 小時 / 10 天 / 16 天
+#define CELL_STATS_TIERS            6
+#define CELL_STATS_SLOTS_BITS       8
+#define CELL_STATS_SLOTS            (1 << CELL_STATS_SLOTS_BITS)
+#define CELL_STATS_TOP_SLOTS        16      // 最粗層只留 16 天: 查詢最多讀 16 個 (< 2 x fanout 24)
+#define CELL_STATS_MAX_TRACKS       64      // adapter x AFE, 每個約 0.5 MB
+
+#define CELL_STATS_MINUTE_NS        60000000000LL
+#define CELL_STATS_HOUR_NS          3600000000000LL
+#define CELL_STATS_DAY_NS           86400000000000LL
+
+/*
+ * CellStatsStore
+ *  每顆 AFE (track) 16 個 cell 的 count/min/max/sum/sum² 聚合, 記憶體固定.
+ *  欄位式存放: 每層每個欄位一個陣列, 以 [cell][slot] 排列 (每個通道連續).
+ *  樣本直接累加到每一層所屬的 bucket (時間 / bucket 長度), 較舊的 bucket 被 ring 覆蓋即為捨棄.
+ *  視窗查詢由細到粗組合對齊的 bucket, 每層最多 2 x fanout 個 (合計 <= 2 x 51 + 16 = 118);
+ *  成本與樣本數及視窗長度無關.
+ *  cell 電壓以 16-bit ADC code 存放 (無效值不列入); 與 CellPlotStore 相同在 UI 執行緒使用.
+ */
+class CellStatsStore
+{
+public:
+    struct Stats {
+        quint64 count = 0;
+        qint32  minUv = 0;
+        qint32  maxUv = 0;
+        double  meanUv = 0;
+        double  stddevUv = 0;
+        qint64  fromNs = 0;     // 實際涵蓋的範圍: 兩端各自對齊到仍保留該時間的最細層級
+        qint64  toNs = 0;
+    };
+
+    CellStatsStore();
+    ~CellStatsStore();
+
+    void append(const AfeChainSample &sample);
+    void clear();
+
+    int     trackCount() const          { return m_tracks.size(); }
+    QString trackName(int track) const;
+    qint64  firstTimeNs() const         { return m_firstNs; }
+    qint64  lastTimeNs() const          { return m_lastNs; }
+    quint64 generation() const          { return m_generation; }
+
+    // [t0Ns, t1Ns] 內的統計; 超出保留範圍的部分不計入 (見 fromNs)
+    Stats stats(int track, int cell, qint64 t0Ns, qint64 t1Ns) const;
+    // 最後一筆樣本之前 spanNs 內
+    Stats recent(int track, int cell, qint64 spanNs) const;
+
+    // 每個 track x cell x span 一列
+    bool writeCsv(const QString &path, const QVector<qint64> &spansNs, QString *errorMsg = nullptr) const;
+
+    static QString spanName(qint64 spanNs);
+    static qint64  trackBytes();
+
+private:
+    struct Tier;
+    struct Track;
+
+    QVector<Track*> m_tracks;
+    QHash<int, int> m_trackIndex;           // adapter << 8 | device → m_tracks index
+    qint64  m_firstNs = 0;
+    qint64  m_lastNs = 0;
+    quint64 m_generation = 0;
+
+    Track *track(int adapter, int device);
+};
+
+#endif // CELL_STATS_STORE_H
@@ -0,0 +1,516 @@
+/*
+ * Usb2uisCli
+ *  無 GUI 的 production test 執行檔, 與 Usb2uisApp 共用擷取核心 (acquisition_core.pri).
+ *  執行 READ SET / Read One / Write 命令或序列腳本 (.seq) N 次或一段時間, 結果輸出 CSV 或擷取檔 (.u2cap).
+ *
+ *  Usb2uisCli --set 1 --count 1000 --rate 100 --output result.csv
+ *  Usb2uisCli --read RDCVA --duration 10 --format bin --output run.u2cap
+ *  Usb2uisCli --write WRCFGA --data "0x81 0x00 0x00 0xFF 0x03 0x00 PEC"
+ *  Usb2uisCli --set 1 --duration 5 --phases --trace run.json
+ *  Usb2uisCli --set 1 --chain 16 --chunk 64 --backend sim --sim-devices 16
+ *  Usb2uisCli --seq SPI_SEQ_CELL_SCAN.seq --chain 16 --count 10
+ *  Usb2uisCli --set 1 --count 100 --record field.u2rec                     (實機呼叫存檔)
+ *  Usb2uisCli --set 1 --count 100 --backend replay --replay-file field.u2rec --replay-speed 0
+ *  Usb2uisCli --set 1 --chain 16 --tune --tune-save                        (SPI speed 掃描, 結果存 usb2uis_tune.ini)
+ *  Usb2uisCli --set 1 --duration 3600 --rate 10 --retries 2 --failover     (無人值守: 失敗的命令重送)
+ *  Usb2uisCli --set 1 --duration 86400 --rate 10 --output - --stats cells.csv   (各 cell 最近 1 分鐘/1 小時/1 天統計)
+ */
+#include "usb2uis_interface.h"
+#include "usb2uis_record_backend.h"
+#include "acquisition_worker.h"
+#include "adbms6832_decoder.h"
+#include "capture_file.h"
+#include "cell_stats_store.h"
+#include "cmd_library.h"
+#include "cycle_scheduler.h"
+#include "precision_timer.h"
+#include "sequencer.h"
+#include "spi_rate_tuner.h"
+#include "spi_trace.h"
+#include "spi_transaction_plan.h"
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDir>
+#include <QSettings>
+#include <csignal>
+#include <cstdio>
+
+typedef enum{
+    CLI_EXIT_OK = 0,
+    CLI_EXIT_USAGE,         // 參數或命令清單錯誤
+    CLI_EXIT_DEVICE,        // 無法開啟/設定 USB2UIS
+    CLI_EXIT_TRANSFER,      // USB 傳輸失敗
+    CLI_EXIT_PEC,           // 讀回資料 PEC 錯誤
+    CLI_EXIT_SEQUENCE,      // 序列腳本執行到 fail
+}eTypeCliExit;
+
+typedef enum{
+    CLI_FORMAT_CSV = 0,
+    CLI_FORMAT_BIN,
+}eTypeCliFormat;
+
+static volatile std::sig_atomic_t g_stop = 0;
+
+static void onSignal(int)
+{
+    g_stop = 1;
+}
+
+static int fail(eTypeCliExit code, const QString &msg)
+{
+    fprintf(stderr, "Usb2uisCli: %s\n", msg.toLocal8Bit().constData());
+    return code;
+}
+
+/* 清單檔 label 或命令文字 ("RDCVA", "0x00 0x04 0x07 0xC2") */
+static bool resolveCmd(const CmdLibrary &lib, int file, const QString &text, QByteArray &out, QString *err)
+{
+    const int i = lib.findLabel(file, text);
+    if (i >= 0) {
+        out = lib.bytes(lib.entry(file, i));
+        return true;
+    }
+    const QByteArray latin = text.toLatin1();
+    return CmdLibrary::parseCmdText(latin.constData(), latin.size(), out, err);
+}
+
+/* SET 編號或描述 */
+static int resolveSet(const CmdLibrary &lib, const QString &text)
+{
+    bool ok = false;
+    const int id = text.toInt(&ok);
+    for (const auto &set : lib.sets())
+        if ((ok && set.first == id) || (!ok && set.second == text)) return set.first;
+    return -1;
+}
+
+/* CSV: 一行一筆, bytes 以連續 HEX 輸出, 以大緩衝一次寫出 */
+class CsvOutput
+{
+public:
+    explicit CsvOutput(FILE *fp) : m_fp(fp) { m_line.reserve(4096); }
+
+    void header()
+    {
+        fputs("time_us,cycle,kind,set,cmd_index,cmd,pec_errors,data\n", m_fp);
+    }
+
+    void record(qint64 timeNs, int cycle, char kind, int setId, int cmdIndex,
+                const QByteArray &cmd, int pecErrors, const BYTE *data, int size)
+    {
+        static const char kHex[] = "0123456789ABCDEF";
+        char num[96];
+        const int n = snprintf(num, sizeof(num), "%lld,%d,%c,%d,%d,",
+                               (long long)(timeNs / 1000), cycle, kind, setId, cmdIndex);
+        m_line.resize(0);
+        m_line.append(num, n);
+        for (int i = 0; i < cmd.size(); ++i) {
+            m_line.append(kHex[BYTE(cmd[i]) >> 4]);
+            m_line.append(kHex[BYTE(cmd[i]) & 0x0F]);
+        }
+        m_line.append(',');
+        if (pecErrors >= 0) m_line.append(QByteArray::number(pecErrors));
+        m_line.append(',');
+        for (int i = 0; i < size; ++i) {
+            m_line.append(kHex[data[i] >> 4]);
+            m_line.append(kHex[data[i] & 0x0F]);
+        }
+        m_line.append('\n');
+        fwrite(m_line.constData(), 1, size_t(m_line.size()), m_fp);
+    }
+
+private:
+    FILE      *m_fp;
+    QByteArray m_line;
+};
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("Usb2uisCli");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("USB2UIS headless runner");
+    parser.addHelpOption();
+    parser.addOptions({
+        {"set",       "Run READ SET <id|description>.", "set"},
+        {"read",      "Run one read command <label|hex> (SPI_READ_ONE_CMD_LIST).", "cmd"},
+        {"write",     "Run write command <label|hex> (SPI_WRITE_CMD_LIST).", "cmd"},
+        {"data",      "Write data <label|hex> (SPI_WRITE_DATA_LIST).", "data"},
+        {"seq",       "Run a sequence script <file> (relative to --lists); one run per cycle.", "file"},
+        {"count",     "Number of cycles (default 1 unless --duration).", "n"},
+        {"duration",  "Run for <s> seconds.", "s"},
+        {"rate",      "Target cycle rate in Hz (0 = back-to-back).", "hz", "0"},
+        {"policy",    "On overrun with --rate: skip|catchup.", "policy", "skip"},
+        {"chain",     "AFEs in the daisy chain.", "n", "1"},
+        {"read-size", "Bytes read per command (auto = chain x 8).", "n", "auto"},
+        {"chunk",     "Split SPI transfers larger than <n> bytes (0 = off).", "n", "0"},
+        {"replicate", "Build the write data for every AFE from its first 6 bytes."},
+        {"dummy",     "Dummy 0xFF count for wake-up.", "n", "2"},
+        {"delay-ms",  "Delay after each command.", "ms", "0"},
+        {"adc-poll",  "Poll PLCADC/PLAUX after ADCV/ADAX instead of the fixed delay."},
+        {"adc-timeout-us", "Upper bound for one ADC poll.", "us", "10000"},
+        {"south",     "South direction (GPIO IO1 as CS)."},
+        {"speed",     "SPI speed index 0..8 (200KHz..12MHz).", "i", "0"},
+        {"mode",      "SPI mode 0..3.", "m", "0"},
+        {"timeout",   "Read/write timeout.", "ms", "100"},
+        {"gpio-dir",  "GPIO direction byte (1=input).", "dir", "0x00"},
+        {"format",    "Output format: csv|bin.", "fmt", "csv"},
+        {"output",    "Output file (- = stdout, bin requires a file).", "file", "-"},
+        {"lists",     "Directory of the SPI_*.txt command lists.", "dir"},
+        {"calibrate", "Calibrate sleep overshoot before running (adds ~50ms)."},
+        {"quiet",     "No summary on stderr."},
+        {"no-shadow", "Send every GPIO/CE write even if the level is unchanged."},
+        {"phases",    "Print per-phase latency (p50/p99/max) with the summary."},
+        {"trace",     "Write a Chrome trace JSON of the run (last ring-buffer window).", "file"},
+        {"stats",     "Write per-cell min/max/mean/stddev over the last minute, hour and day as CSV.", "file"},
+        {"retries",     "Re-issue a command that failed (USB error or PEC mismatch) up to <n> times.", "n", "0"},
+        {"retry-budget-us", "Time per cycle spent on retries including back-off (also capped by --rate).", "us", "20000"},
+        {"failover",    "On the last retry read the register group from the other end of the chain."},
+        {"tune",        "Sweep --speed..8 with the --set commands and pick the slowest rate within the PEC budget "
+                        "whose cycle time is within " + QString::number(SPI_RATE_TUNE_MIN_GAIN * 100) + "% of the best."},
+        {"tune-cycles", "Cycles measured per rate.", "n", QString::number(SPI_RATE_TUNE_CYCLES)},
+        {"tune-budget", "Allowed fraction of frames with PEC errors.", "x", QString::number(SPI_RATE_TUNE_BUDGET)},
+        {"tune-margin", "Measured error rate x margin must stay within the budget.", "x", QString::number(SPI_RATE_TUNE_MARGIN)},
+        {"tune-save",   "Store the chosen rate in " SPI_RATE_TUNE_SETTINGS " next to the executable."},
+        // 由 Usb2UisBackend::fromArguments 處理
+        {"backend",        "Transport backend: dll|sim|replay.", "name"},
+        {"sim-devices",    "Simulated AFEs per chain.", "n"},
+        {"sim-adapters",   "Simulated USB2UIS adapters.", "n"},
+        {"sim-latency-us", "Simulated per-call latency.", "us"},
+        {"sim-error-khz",  "Simulated bit errors above this SPI clock.", "khz"},
+        {"sim-byte-error", "Simulated per-byte error probability at twice --sim-error-khz.", "x"},
+        {"sim-call-fail",  "Simulated probability that an SPI read/write call fails.", "x"},
+        {"replay-file",    "USB call record to serve with --backend replay.", "file"},
+        {"replay-speed",   "Replay timing: 1 = original, 2 = twice as fast, 0 = no waits.", "x"},
+        {"record",         "Record every USB call (arguments, data, timing) to a file.", "file"},
+    });
+    parser.process(app);
+
+    const int modes = int(parser.isSet("set")) + int(parser.isSet("read")) + int(parser.isSet("write"))
+                    + int(parser.isSet("seq"));
+    if (modes != 1) return fail(CLI_EXIT_USAGE, "exactly one of --set, --read, --write, --seq is required");
+    if (parser.isSet("tune") && !parser.isSet("set")) return fail(CLI_EXIT_USAGE, "--tune needs --set");
+
+    const QString fmtText = parser.value("format");
+    if (fmtText != "csv" && fmtText != "bin") return fail(CLI_EXIT_USAGE, "unknown format: " + fmtText);
+    const eTypeCliFormat format = (fmtText == "bin") ? CLI_FORMAT_BIN : CLI_FORMAT_CSV;
+    const QString outPath = parser.value("output");
+    if (format == CLI_FORMAT_BIN && outPath == "-") return fail(CLI_EXIT_USAGE, "--format bin needs --output <file>");
+
+    const int     count    = parser.value("count").toInt();
+    const double  duration = parser.value("duration").toDouble();
+    const double  rate     = parser.value("rate").toDouble();
+    const int     cycles   = (count > 0 || duration > 0) ? count : 1;      // 0 = 不限次數
+
+    SpiRetryPolicy retry;
+    retry.maxRetries = parser.value("retries").toInt();
+    retry.budgetUs   = parser.value("retry-budget-us").toInt();
+    retry.failover   = parser.isSet("failover");
+    if (retry.maxRetries < 0 || retry.budgetUs < 0) return fail(CLI_EXIT_USAGE, "--retries and --retry-budget-us must be >= 0");
+
+    // ① 命令清單 (有 cache 時只 map 一個檔)
+    CmdLibrary lib;
+    const QString listDir = parser.isSet("lists") ? parser.value("lists") : QCoreApplication::applicationDirPath();
+    if (!lib.load(listDir)) return fail(CLI_EXIT_USAGE, "cannot load command lists from " + listDir);
+
+    SpiPlanOptions opt;
+    opt.dummyCount   = parser.value("dummy").toInt();
+    opt.cmdDelayMs   = parser.value("delay-ms").toInt();
+    opt.dirNorth     = !parser.isSet("south");
+    const int chain  = parser.value("chain").toInt();
+    if (chain < 1 || chain > 256) return fail(CLI_EXIT_USAGE, "--chain must be 1..256");
+    opt.readSize     = parser.value("read-size") == "auto" ? WORD(adbmsChainBytes(chain))
+                                                          : WORD(parser.value("read-size").toUInt());
+    opt.chunkBytes   = parser.value("chunk").toInt();
+    opt.abortOnError = true;
+    opt.adcPoll      = parser.isSet("adc-poll");
+    opt.adcTimeoutUs = parser.value("adc-timeout-us").toInt();
+
+    QList<QByteArray> cmds;
+    SpiTransactionPlan plan;
+    SeqProgram program;
+    int  setId = 0;
+    char kind  = 'R';
+    QString err;
+
+    if (parser.isSet("set")) {
+        setId = resolveSet(lib, parser.value("set"));
+        int first = 0, n = 0;
+        if (setId < 0 || !lib.setRange(setId, &first, &n) || n == 0)
+            return fail(CLI_EXIT_USAGE, "unknown or empty READ SET: " + parser.value("set"));
+        for (int i = first; i < first + n; ++i)
+            cmds << lib.bytes(lib.entry(CMD_FILE_READ_LIST, i));
+        plan = SpiPlanCompiler::compileRead(cmds, opt);
+    } else if (parser.isSet("read")) {
+        QByteArray cmd;
+        if (!resolveCmd(lib, CMD_FILE_READ_ONE, parser.value("read"), cmd, &err) || cmd.size() != 4)
+            return fail(CLI_EXIT_USAGE, "invalid read command: " + parser.value("read") + " " + err);
+        cmds << cmd;
+        opt.wakeGapUs = 1000;       //Refer AFE Spec.
+        plan = SpiPlanCompiler::compileRead(cmds, opt);
+    } else if (parser.isSet("seq")) {
+        const QString path = QDir(listDir).filePath(parser.value("seq"));
+        if (!SeqCompiler::compileFile(path, lib, program, &err))
+            return fail(CLI_EXIT_USAGE, "invalid sequence " + path + ": " + err);
+        kind = 'S';
+    } else {
+        QByteArray cmd, data;
+        if (!resolveCmd(lib, CMD_FILE_WRITE_CMD, parser.value("write"), cmd, &err) || cmd.size() != 4)
+            return fail(CLI_EXIT_USAGE, "invalid write command: " + parser.value("write") + " " + err);
+        if (!resolveCmd(lib, CMD_FILE_WRITE_DATA, parser.value("data"), data, &err))
+            return fail(CLI_EXIT_USAGE, "invalid write data: " + parser.value("data") + " " + err);
+        if (parser.isSet("replicate") && data.size() >= ADBMS6832_REG_GROUP_SIZE) {
+            const QByteArray group = data.left(ADBMS6832_REG_GROUP_SIZE);
+            data.resize(adbmsChainBytes(chain));
+            adbmsBuildChainWrite((BYTE*)data.data(), (const BYTE*)group.constData(), chain);
+        }
+        cmds << cmd;
+        kind = 'W';
+        plan = SpiPlanCompiler::compileWrite(cmd, data, opt);
+    }
+
+    // ② 後端與裝置
+    QString backendError;
+    Usb2UisBackend *backend = Usb2UisBackend::fromArguments(app.arguments(), &backendError);
+    if (!backendError.isEmpty()) return fail(CLI_EXIT_USAGE, backendError);
+    if (backend) {
+        Usb2UisInterface::setBackend(backend);
+    } else if (!Usb2UisInterface::init(QDir(QCoreApplication::applicationDirPath()).filePath("usb2uis.dll"))) {
+        return fail(CLI_EXIT_DEVICE, "cannot load usb2uis.dll");
+    }
+
+    Usb2UisInterface::setShadowEnabled(!parser.isSet("no-shadow"));
+    const BYTE index = Usb2UisInterface::USBIO_OpenDevice();
+    if (index == 0xFF) return fail(CLI_EXIT_DEVICE, "no USB2UIS device");
+
+    bool dirOk = false;
+    const uint gpioDir = parser.value("gpio-dir").toUInt(&dirOk, 0);
+    const BYTE configByte = BYTE(((parser.value("mode").toInt() & 0x03) << 4) | (parser.value("speed").toInt() & 0x0F));
+    const DWORD timeout = (DWORD(parser.value("timeout").toUShort()) << 16) | parser.value("timeout").toUShort();
+    bool gpioOk = false;
+    if (!dirOk || gpioDir > 0xFF
+        || !AcquisitionWorker::configureDevice(index, configByte, timeout, BYTE(gpioDir), &gpioOk) || !gpioOk) {
+        Usb2UisInterface::USBIO_CloseDevice(index);
+        return fail(CLI_EXIT_DEVICE, "device configuration failed");
+    }
+
+    // SPI speed 掃描: 結果一行一個 rate 輸出到 stdout, 裝置停在選定的 rate
+    if (parser.isSet("tune")) {
+        SpiRateTuneParams tp;
+        tp.cmds        = cmds;
+        tp.setId       = quint16(setId);
+        tp.plan        = opt;
+        tp.mode        = BYTE(parser.value("mode").toInt() & 0x03);
+        tp.timeout     = timeout;
+        tp.restoreRate = BYTE(configByte & 0x0F);
+        tp.minRate     = configByte & 0x0F;
+        tp.cycles      = qMax(1, parser.value("tune-cycles").toInt());
+        tp.errorBudget = parser.value("tune-budget").toDouble();
+        tp.margin      = parser.value("tune-margin").toDouble();
+
+        std::signal(SIGINT, onSignal);
+        std::signal(SIGTERM, onSignal);
+        SpiPlanExecutor executor(index);
+        SpiRateTuneHooks hooks;
+        hooks.onStep = [](const SpiRateTuneStep &step) {
+            printf("rate=%d khz=%d cycles=%d frames=%llu pec_errors=%llu transfer_errors=%llu cycle_us_mean=%lld"
+                   " cycle_us_p99=%lld qualified=%d\n",
+                   int(step.rate), step.kHz, step.cycles, (unsigned long long)step.frames,
+                   (unsigned long long)step.pecErrors, (unsigned long long)step.transferFailures,
+                   (long long)step.cycleMeanNs / 1000, (long long)step.cycleP99Ns / 1000, int(step.qualified));
+            fflush(stdout);
+        };
+        hooks.keepRunning = []() { return !g_stop; };
+        const SpiRateTuneResult result = SpiRateTuner::run(executor, index, tp, hooks);
+        Usb2UisInterface::USBIO_CloseDevice(index);
+
+        if (!parser.isSet("quiet")) fprintf(stderr, "%s\n", SpiRateTuner::summary(result).toLocal8Bit().constData());
+        if (parser.isSet("tune-save") && result.chosen >= 0) {
+            const QString adapter = QString("%1-%2").arg(Usb2UisInterface::backend() ? Usb2UisInterface::backend()->name() : "dll")
+                                                    .arg(int(index));
+            QSettings settings(QDir(QCoreApplication::applicationDirPath()).filePath(SPI_RATE_TUNE_SETTINGS), QSettings::IniFormat);
+            SpiRateTuner::save(settings, SpiRateTuner::settingsKey(adapter, chain, tp.mode, opt.dirNorth), result);
+        }
+        if (result.cancelled) return CLI_EXIT_OK;
+        return result.chosen >= 0 ? CLI_EXIT_OK : CLI_EXIT_PEC;
+    }
+
+    // ③ 輸出
+    FILE *fp = nullptr;
+    CaptureWriter capture;
+    if (format == CLI_FORMAT_BIN) {
+        if (!capture.open(outPath, &err)) {
+            Usb2UisInterface::USBIO_CloseDevice(index);
+            return fail(CLI_EXIT_USAGE, "cannot create " + outPath + ": " + err);
+        }
+    } else {
+        fp = (outPath == "-") ? stdout : fopen(outPath.toLocal8Bit().constData(), "wb");
+        if (!fp) {
+            Usb2UisInterface::USBIO_CloseDevice(index);
+            return fail(CLI_EXIT_USAGE, "cannot create " + outPath);
+        }
+        setvbuf(fp, nullptr, _IOFBF, 1 << 20);
+    }
+    CsvOutput csv(fp);
+    if (fp) csv.header();
+
+    if (parser.isSet("calibrate")) PrecisionTimer::calibrate();
+    std::signal(SIGINT, onSignal);
+    std::signal(SIGTERM, onSignal);
+
+    // ④ 執行: 以絕對 deadline 維持速率 (CycleScheduler), 落後時依 --policy 跳過或補跑
+    SpiPlanExecutor executor(index);
+    executor.setRetryPolicy(retry);
+    SeqInterpreter seq(executor);
+    if (kind == 'S') seq.link(program, opt, chain);
+    AfeChainSample sample;
+    CellStatsStore stats;
+    const bool keepStats = parser.isSet("stats");
+    const qint64 startNs  = PrecisionTimer::nowNs();
+    const qint64 endNs    = duration > 0 ? startNs + qint64(duration * 1e9) : 0;
+    const qint64 periodNs = rate > 0 ? qint64(1e9 / rate) : 0;
+    CycleScheduler scheduler;
+    scheduler.start(periodNs, parser.value("policy") == "catchup" ? CYCLE_POLICY_CATCH_UP : CYCLE_POLICY_SKIP,
+                    startNs);
+
+    int cycle = 0;
+    quint64 transferErrors = 0, pecErrors = 0, seqFailures = 0;
+
+    // 序列腳本: set 欄位為 step 編號, R = 讀取, W = 命令/寫入
+    SeqHooks hooks;
+    hooks.onResult = [&](int step, int cmdIndex, const BYTE *data, int size) {
+        const SeqStep &s = program.steps.at(step);
+        const QByteArray &cmd = s.cmds.at(s.kind == SEQ_STEP_WRITE ? 0 : cmdIndex);
+        const qint64 now = PrecisionTimer::nowNs();
+        int pec = -1;
+        if (s.kind == SEQ_STEP_READ) {
+            pec = Adbms6832Decoder::decode((const BYTE*)cmd.constData(), cmd.size(), data, size, opt.dirNorth, sample);
+            if (pec > 0) pecErrors += quint64(pec);
+        }
+        if (fp) csv.record(now - startNs, cycle, s.kind == SEQ_STEP_READ ? 'R' : 'W', step, cmdIndex, cmd, pec, data, size);
+        else if (s.kind == SEQ_STEP_READ)
+            capture.append(quint16(step), (const BYTE*)cmd.constData(), cmd.size(), data, size, index);
+        return !g_stop;
+    };
+    hooks.keepRunning = [&]() { return !g_stop; };
+
+    for (; (cycles == 0 || cycle < cycles) && !g_stop; ++cycle) {
+        const qint64 cycleNs = PrecisionTimer::nowNs();
+        if (endNs && cycleNs >= endNs) break;
+        scheduler.beginCycle(cycleNs);
+        executor.setDeadline(scheduler.deadlineNs());
+
+        if (kind == 'S') {
+            sample.clear();
+            const eTypeSeqResult r = seq.run(hooks);
+            if (r == SEQ_RESULT_FAILED) {
+                ++seqFailures;
+                fprintf(stderr, "Usb2uisCli: cycle %d: %s\n", cycle, seq.lastError().toLocal8Bit().constData());
+            } else if (r == SEQ_RESULT_ERROR) {
+                ++transferErrors;
+                fprintf(stderr, "Usb2uisCli: cycle %d: %s\n", cycle, seq.lastError().toLocal8Bit().constData());
+                executor.reset();
+            }
+            if (keepStats) {
+                sample.timeNs = PrecisionTimer::nowNs();
+                stats.append(sample);
+            }
+            const qint64 nextNs = scheduler.endCycle(PrecisionTimer::nowNs());
+            if (periodNs) PrecisionTimer::waitUntilNs(endNs ? qMin(nextNs, endNs) : nextNs);
+            continue;
+        }
+
+        sample.clear();
+        const eTypeSpiPlanResult r = executor.runCycle(plan, [&](const SpiOp &op, const BYTE *data, int size) {
+            const QByteArray &cmd = cmds.at(kind == 'W' ? 0 : op.cmdIndex);
+            const qint64 now = PrecisionTimer::nowNs();
+            int pec = -1;
+            if (kind == 'R') {
+                pec = Adbms6832Decoder::decode((const BYTE*)cmd.constData(), cmd.size(), data, size, opt.dirNorth, sample);
+                if (pec > 0) pecErrors += quint64(pec);
+            }
+            if (fp) csv.record(now - startNs, cycle, kind, setId, op.cmdIndex, cmd, pec, data, size);
+            else capture.append(quint16(setId), (const BYTE*)cmd.constData(), cmd.size(), data, size, index);
+            return true;
+        });
+        if (r == SPI_PLAN_ERROR) {
+            ++transferErrors;
+            fprintf(stderr, "Usb2uisCli: cycle %d: %s\n", cycle, executor.lastError().toLocal8Bit().constData());
+            executor.reset();
+        }
+        if (keepStats && kind == 'R') {
+            sample.timeNs = PrecisionTimer::nowNs();
+            stats.append(sample);
+        }
+
+        const qint64 nextNs = scheduler.endCycle(PrecisionTimer::nowNs());
+        if (periodNs) PrecisionTimer::waitUntilNs(endNs ? qMin(nextNs, endNs) : nextNs);
+    }
+    const qint64 elapsedNs = PrecisionTimer::nowNs() - startNs;
+
+    if (fp) {
+        fflush(fp);
+        if (fp != stdout) fclose(fp);
+    }
+    capture.close();
+    Usb2UisInterface::USBIO_CloseDevice(index);
+
+    if (!parser.isSet("quiet")) {
+        const Usb2UisShadowStats shadow = Usb2UisInterface::shadowStats(index);
+        const CycleScheduler::Stats sched = scheduler.stats();
+        fprintf(stderr, "cycles=%d elapsed_ms=%.1f rate_hz=%.1f transfer_errors=%llu pec_errors=%llu overruns=%lld"
+                        " skipped_slots=%lld cycle_us_p50=%lld cycle_us_p99=%lld cycle_us_max=%lld start_late_us_max=%lld"
+                        " gpio_ce_writes=%llu gpio_ce_skipped=%llu\n",
+                cycle, elapsedNs / 1e6, elapsedNs > 0 ? cycle * 1e9 / elapsedNs : 0.0,
+                (unsigned long long)transferErrors, (unsigned long long)pecErrors, (long long)sched.missed,
+                (long long)sched.skippedSlots, (long long)sched.cycleTime.p50Ns / 1000,
+                (long long)sched.cycleTime.p99Ns / 1000, (long long)sched.cycleTime.maxNs / 1000,
+                (long long)sched.startLate.maxNs / 1000,
+                (unsigned long long)(shadow.gpioIssued + shadow.ceIssued), (unsigned long long)shadow.skipped());
+        const QList<CycleMiss> misses = scheduler.recentMisses();
+        for (int i = qMax(0, misses.size() - 10); i < misses.size(); ++i) {
+            const CycleMiss &m = misses.at(i);
+            fprintf(stderr, "overrun cycle=%d time_ms=%.3f late_us=%lld\n", m.cycle, m.timeNs / 1e6, (long long)m.lateNs / 1000);
+        }
+        const SpiRecoveryStats &rs = executor.recoveryStats();
+        const SpiCmdErrorCounts total = rs.total();
+        if (retry.maxRetries > 0 || total.errors())
+            fprintf(stderr, "retries=%llu recovered=%llu failed=%llu forced_wakes=%llu failovers=%llu budget_exhausted=%llu\n",
+                    (unsigned long long)total.retries, (unsigned long long)total.recovered,
+                    (unsigned long long)total.failed, (unsigned long long)rs.forcedWakes(),
+                    (unsigned long long)rs.failovers(), (unsigned long long)rs.budgetOut());
+        for (int i = 0; i < rs.cmdCount(); ++i) {
+            const SpiCmdErrorCounts c = rs.cmd(i);
+            if (c.errors() == 0) continue;
+            fprintf(stderr, "cmd=%d pec_errors=%llu transfer_errors=%llu retries=%llu recovered=%llu failed=%llu\n", i,
+                    (unsigned long long)c.pecErrors, (unsigned long long)c.transferErrors,
+                    (unsigned long long)c.retries, (unsigned long long)c.recovered, (unsigned long long)c.failed);
+        }
+        if (kind == 'S')
+            fprintf(stderr, "sequence=%s steps=%d plan_ops=%d seq_failures=%llu\n",
+                    program.name.toLocal8Bit().constData(), program.steps.size(), seq.planOps(),
+                    (unsigned long long)seqFailures);
+        if (const Usb2UisReplayBackend *replay = dynamic_cast<Usb2UisReplayBackend*>(Usb2UisInterface::backend())) {
+            const Usb2UisReplayBackend::Stats rs = replay->stats();
+            fprintf(stderr, "replay records=%d matched=%llu skipped=%llu missing=%llu write_mismatch=%llu\n",
+                    replay->recordCount(), (unsigned long long)rs.matched, (unsigned long long)rs.skipped,
+                    (unsigned long long)rs.missing, (unsigned long long)rs.writeMismatch);
+        }
+        if (const Usb2UisRecordBackend *rec = dynamic_cast<Usb2UisRecordBackend*>(Usb2UisInterface::backend()))
+            fprintf(stderr, "recorded calls=%llu\n", (unsigned long long)rec->records());
+        if (parser.isSet("phases"))
+            fprintf(stderr, "%s", SpiTrace::statsText().toLocal8Bit().constData());
+    }
+
+    if (parser.isSet("trace") && SpiTrace::exportChromeTrace(parser.value("trace"), 0) < 0)
+        fprintf(stderr, "Usb2uisCli: cannot write trace file %s\n", parser.value("trace").toLocal8Bit().constData());
+    if (keepStats && !stats.writeCsv(parser.value("stats"), {CELL_STATS_MINUTE_NS, CELL_STATS_HOUR_NS, CELL_STATS_DAY_NS}, &err))
+        fprintf(stderr, "Usb2uisCli: %s\n", err.toLocal8Bit().constData());
+
+    if (transferErrors) return CLI_EXIT_TRANSFER;
+    if (pecErrors)      return CLI_EXIT_PEC;
+    if (seqFailures)    return CLI_EXIT_SEQUENCE;
+    return CLI_EXIT_OK;
+}
@@ -0,0 +1,634 @@
+#include "cmd_library.h"
+#include "adbms6832.h"
+
+#include <QDateTime>
+#include <QDebug>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QVector>
+#include <algorithm>
+#include <cstring>
+
+#define CMD_CACHE_FILE_NAME     "SPI_CMD_LIBRARY.cache"
+#define CMD_CACHE_VERSION       2
+
+static const char kCacheMagic[8] = { 'U', '2', 'U', 'C', 'M', 'D', 'L', 'B' };
+
+/* cache 檔頭, 之後接 entries[], strings, bytes */
+struct CmdCacheHeader {
+    char    magic[8];
+    quint32 version;
+    quint32 entryCount;
+    quint32 stringsSize;
+    quint32 bytesSize;
+    quint32 fileStart[CMD_FILE_COUNT + 1];
+    qint64  srcSize[CMD_FILE_COUNT];
+    qint64  srcMtimeMs[CMD_FILE_COUNT];
+};
+
+static const char *const kFileNames[CMD_FILE_COUNT] = {
+    "SPI_READ_CMD_SET.txt",
+    "SPI_READ_CMD_LIST.txt",
+    "SPI_READ_ONE_CMD_LIST.txt",
+    "SPI_WRITE_CMD_LIST.txt",
+    "SPI_WRITE_DATA_LIST.txt",
+};
+
+CmdLibrary::CmdLibrary()
+{
+    memset(m_stamp, 0, sizeof(m_stamp));
+    memset(m_fileStart, 0, sizeof(m_fileStart));
+}
+
+CmdLibrary::~CmdLibrary()
+{
+    unload();
+}
+
+const char *CmdLibrary::fileName(int file)
+{
+    return (file >= 0 && file < CMD_FILE_COUNT) ? kFileNames[file] : "";
+}
+
+void CmdLibrary::unload()
+{
+    m_warnings.clear();
+    m_setIndex.clear();
+    for (int i = 0; i < CMD_FILE_COUNT; ++i) m_labelIndex[i].clear();
+
+    m_entries = nullptr;
+    m_strings = nullptr;
+    m_bytes   = nullptr;
+    memset(m_fileStart, 0, sizeof(m_fileStart));
+
+    if (m_map) {
+        m_cacheFile.unmap(m_map);
+        m_map = nullptr;
+    }
+    if (m_cacheFile.isOpen()) m_cacheFile.close();
+    m_image.clear();
+    m_fromCache = false;
+}
+
+void CmdLibrary::readStamps(SourceStamp *out) const
+{
+    for (int i = 0; i < CMD_FILE_COUNT; ++i) {
+        QFileInfo fi(m_dir + "/" + kFileNames[i]);
+        if (fi.exists()) {
+            out[i].size    = fi.size();
+            out[i].mtimeMs = fi.lastModified().toMSecsSinceEpoch();
+        } else {
+            out[i].size    = -1;
+            out[i].mtimeMs = -1;
+        }
+    }
+}
+
+bool CmdLibrary::load(const QString &dir)
+{
+    SourceStamp stamp[CMD_FILE_COUNT];
+    const QString prevDir = m_dir;
+    m_dir = dir;
+    readStamps(stamp);
+
+    // 檔案未變更 → 不需要任何動作
+    if (isLoaded() && prevDir == dir && memcmp(stamp, m_stamp, sizeof(stamp)) == 0)
+        return true;
+
+    quint32 changed = 0;
+    for (int i = 0; i < CMD_FILE_COUNT; ++i) {
+        if (!isLoaded() || prevDir != dir || stamp[i].size != m_stamp[i].size || stamp[i].mtimeMs != m_stamp[i].mtimeMs)
+            changed |= 1u << i;
+    }
+
+    // 未變更的檔案沿用目前的 entries; unload 會釋放 map, 先複製一份影像
+    const QByteArray previous = (isLoaded() && prevDir == dir) ? imageCopy() : QByteArray();
+
+    unload();
+    memcpy(m_stamp, stamp, sizeof(stamp));
+    m_changed = changed;
+    ++m_generation;
+
+    bool anySource = false;
+    for (int i = 0; i < CMD_FILE_COUNT; ++i)
+        if (stamp[i].size >= 0) anySource = true;
+
+    // ① 有效的 cache → 直接 map
+    m_cacheFile.setFileName(dir + "/" + CMD_CACHE_FILE_NAME);
+    if (m_cacheFile.open(QIODevice::ReadOnly)) {
+        const qint64 size = m_cacheFile.size();
+        m_map = size > 0 ? m_cacheFile.map(0, size) : nullptr;
+        if (m_map && attach(m_map, size, true)) {
+            m_fromCache = true;
+            buildIndex();
+            validate();
+            return anySource;
+        }
+        if (m_map) m_cacheFile.unmap(m_map);
+        m_map = nullptr;
+        m_cacheFile.close();
+    }
+
+    // ② 重新解析文字檔並更新 cache
+    QByteArray image;
+    buildImage(image, previous, changed);
+
+    if (anySource) {
+        QSaveFile out(m_cacheFile.fileName());
+        if (!out.open(QIODevice::WriteOnly) || out.write(image) != image.size() || !out.commit())
+            qDebug() << "[WARN] Cannot write command cache:" << m_cacheFile.fileName();
+    }
+
+    m_image = image;
+    attach((const uchar*)m_image.constData(), m_image.size(), false);
+    buildIndex();
+    validate();
+    return anySource;
+}
+
+/* 目前載入的影像 (header + entries + strings + bytes) */
+QByteArray CmdLibrary::imageCopy() const
+{
+    if (!m_entries) return QByteArray();
+
+    const char *base = (const char*)m_entries - sizeof(CmdCacheHeader);
+    CmdCacheHeader h;
+    memcpy(&h, base, sizeof(h));
+    return QByteArray(base, int(sizeof(h) + h.entryCount * sizeof(CmdEntry) + h.stringsSize + h.bytesSize));
+}
+
+bool CmdLibrary::attach(const uchar *image, qint64 size, bool checkStamp)
+{
+    if (size < qint64(sizeof(CmdCacheHeader))) return false;
+
+    CmdCacheHeader h;
+    memcpy(&h, image, sizeof(h));
+    if (memcmp(h.magic, kCacheMagic, sizeof(kCacheMagic)) != 0) return false;
+    if (h.version != CMD_CACHE_VERSION) return false;
+
+    const qint64 need = qint64(sizeof(CmdCacheHeader)) + qint64(h.entryCount) * sizeof(CmdEntry)
+                      + h.stringsSize + h.bytesSize;
+    if (need != size) return false;
+    if (h.fileStart[0] != 0 || h.fileStart[CMD_FILE_COUNT] != h.entryCount) return false;
+    for (int i = 0; i < CMD_FILE_COUNT; ++i)
+        if (h.fileStart[i] > h.fileStart[i + 1]) return false;
+
+    if (checkStamp) {
+        for (int i = 0; i < CMD_FILE_COUNT; ++i) {
+            if (h.srcSize[i] != m_stamp[i].size || h.srcMtimeMs[i] != m_stamp[i].mtimeMs)
+                return false;
+        }
+    }
+
+    const CmdEntry *entries = (const CmdEntry*)(image + sizeof(CmdCacheHeader));
+    const char     *strings = (const char*)(entries + h.entryCount);
+    const BYTE     *bytes   = (const BYTE*)(strings + h.stringsSize);
+
+    // 範圍檢查, 避免損毀的 cache 造成越界
+    for (quint32 i = 0; i < h.entryCount; ++i) {
+        const CmdEntry &e = entries[i];
+        if (qint64(e.labelOffset) + e.labelSize > h.stringsSize) return false;
+        if (qint64(e.bytesOffset) + e.bytesSize > h.bytesSize) return false;
+    }
+
+    m_entries = entries;
+    m_strings = strings;
+    m_bytes   = bytes;
+    memcpy(m_fileStart, h.fileStart, sizeof(m_fileStart));
+    return true;
+}
+
+void CmdLibrary::buildIndex()
+{
+    for (int f = 0; f < CMD_FILE_COUNT; ++f) {
+        const int n = count(f);
+        m_labelIndex[f].reserve(n);
+        for (int i = 0; i < n; ++i) {
+            const CmdEntry &e = entry(f, i);
+            const QByteArray key(m_strings + e.labelOffset, int(e.labelSize));
+            if (!m_labelIndex[f].contains(key)) m_labelIndex[f].insert(key, i);
+        }
+    }
+
+    // READ_LIST 已依 setId 排序 → 每個 SET 一段連續範圍
+    const int n = count(CMD_FILE_READ_LIST);
+    for (int i = 0; i < n; ) {
+        const qint32 id = entry(CMD_FILE_READ_LIST, i).setId;
+        int j = i + 1;
+        while (j < n && entry(CMD_FILE_READ_LIST, j).setId == id) ++j;
+        m_setIndex.insert(id, qMakePair(i, j - i));
+        i = j;
+    }
+}
+
+/* ---------------- 文字檔解析 (不使用 regex) ---------------- */
+
+static inline bool isSpace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '\v' || c == '\f';
+}
+
+static inline const char *skipSpace(const char *p, const char *end)
+{
+    while (p < end && isSpace(*p)) ++p;
+    return p;
+}
+
+static inline int hexNibble(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+/* 單一 HEX token: 可有 0x 前綴, 1~2 位數 */
+static bool hexToken(const char *tok, int n, BYTE *value)
+{
+    if (n >= 2 && tok[0] == '0' && (tok[1] == 'x' || tok[1] == 'X')) {
+        tok += 2;
+        n -= 2;
+    }
+    if (n < 1 || n > 2) return false;
+
+    int v = hexNibble(tok[0]);
+    if (v < 0) return false;
+    if (n == 2) {
+        const int lo = hexNibble(tok[1]);
+        if (lo < 0) return false;
+        v = (v << 4) | lo;
+    }
+    *value = BYTE(v);
+    return true;
+}
+
+bool CmdLibrary::parseHex(const char *p, int len, QByteArray &out)
+{
+    out.clear();
+    const char *end = p + len;
+
+    while (true) {
+        p = skipSpace(p, end);
+        if (p >= end) break;
+
+        const char *tok = p;
+        while (p < end && !isSpace(*p)) ++p;
+
+        BYTE value;
+        if (!hexToken(tok, int(p - tok), &value)) return false;
+        out.append(char(value));
+    }
+    return true;
+}
+
+static inline bool isNameStart(char c)
+{
+    return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z');
+}
+
+bool CmdLibrary::parseCmdText(const char *p, int len, QByteArray &out, QString *errorMsg)
+{
+    out.clear();
+    const char *end = p + len;
+    int mark = 0;                       // 上一個 PEC/命令之後的位置
+    const AdbmsOpcode *op = nullptr;    // 正在收集選項的命令
+    WORD code = 0;
+
+    auto flushOp = [&]() {
+        if (!op) return;
+        BYTE cmd[ADBMS6832_CMD_SIZE];
+        adbmsBuildCmd(cmd, code);
+        out.append((const char*)cmd, ADBMS6832_CMD_SIZE);
+        mark = out.size();
+        op = nullptr;
+    };
+    auto fail = [&](const char *tok, int n, const char *why) {
+        if (errorMsg) *errorMsg = QString("%1: %2").arg(QString::fromLatin1(tok, n), QLatin1String(why));
+        return false;
+    };
+
+    while (true) {
+        p = skipSpace(p, end);
+        if (p >= end) break;
+
+        const char *tok = p;
+        while (p < end && !isSpace(*p)) ++p;
+        const int n = int(p - tok);
+
+        BYTE value;
+        WORD bits;
+        if (op && adbmsFindOption(op->optSet, tok, n, &bits)) {
+            code = WORD(code | bits);
+            continue;
+        }
+        flushOp();
+
+        if (hexToken(tok, n, &value)) {
+            out.append(char(value));
+        } else if (n == 3 && (tok[0] | 0x20) == 'p' && (tok[1] | 0x20) == 'e' && (tok[2] | 0x20) == 'c') {
+            const BYTE *seg = (const BYTE*)out.constData() + mark;
+            const int segSize = out.size() - mark;
+            BYTE pecBytes[2];
+            if (segSize == 2) {
+                const WORD pec = adbmsPec15(seg, 2);
+                pecBytes[0] = BYTE(pec >> 8);
+                pecBytes[1] = BYTE(pec & 0xFF);
+            } else if (segSize == ADBMS6832_REG_GROUP_SIZE) {
+                adbmsPutDataPec(pecBytes, adbmsPec10(seg, ADBMS6832_REG_GROUP_SIZE, 0), 0);
+            } else {
+                return fail(tok, n, "PEC needs 2 or 6 bytes before it");
+            }
+            out.append((const char*)pecBytes, 2);
+            mark = out.size();
+        } else if (isNameStart(tok[0]) && (op = adbmsFindOpcode(tok, n)) != nullptr) {
+            code = op->code;
+        } else {
+            return fail(tok, n, "unknown token");
+        }
+    }
+    flushOp();
+    return true;
+}
+
+QString CmdLibrary::formatHex(const BYTE *data, int size)
+{
+    static const char digits[] = "0123456789ABCDEF";
+
+    if (size <= 0) return QString();
+
+    QByteArray text(size * 5 - 1, ' ');
+    char *o = text.data();
+    for (int i = 0; i < size; ++i) {
+        if (i) ++o;
+        *o++ = '0';
+        *o++ = 'x';
+        *o++ = digits[data[i] >> 4];
+        *o++ = digits[data[i] & 0x0F];
+    }
+    return QString::fromLatin1(text);
+}
+
+struct ParsedEntry {
+    qint32     setId;
+    int        order;
+    QByteArray label;
+    QByteArray bytes;
+};
+
+/*
+ * 解析一行: en , [setId ,] "label" [, hex]
+ * en 只取一位數字且必須為 1, 與原本的 regex 規則相同.
+ */
+static bool parseLine(const char *p, const char *end, int file, ParsedEntry &e)
+{
+    const bool hasSet = (file == CMD_FILE_READ_SET || file == CMD_FILE_READ_LIST);
+    const bool hasHex = (file != CMD_FILE_READ_SET);
+
+    p = skipSpace(p, end);
+    if (p >= end || *p != '1') return false;
+    ++p;
+    p = skipSpace(p, end);
+    if (p >= end || *p != ',') return false;
+    ++p;
+
+    e.setId = -1;
+    if (hasSet) {
+        p = skipSpace(p, end);
+        if (p >= end || *p < '0' || *p > '9') return false;
+        qint64 id = 0;
+        while (p < end && *p >= '0' && *p <= '9') {
+            id = id * 10 + (*p - '0');
+            if (id > 0x7FFFFFFF) return false;
+            ++p;
+        }
+        e.setId = qint32(id);
+        p = skipSpace(p, end);
+        if (p >= end || *p != ',') return false;
+        ++p;
+    }
+
+    p = skipSpace(p, end);
+    if (p >= end || *p != '"') return false;
+    const char *label = ++p;
+    while (p < end && *p != '"') ++p;
+    if (p >= end) return false;
+    e.label = QByteArray(label, int(p - label));
+    ++p;
+    if (e.label.isEmpty() && file != CMD_FILE_READ_LIST) return false;
+
+    p = skipSpace(p, end);
+    if (!hasHex) return p == end;
+
+    if (p >= end || *p != ',') return false;
+    ++p;
+    p = skipSpace(p, end);
+    if (p >= end) return false;
+
+    return CmdLibrary::parseCmdText(p, int(end - p), e.bytes);
+}
+
+/* previous (imageCopy) 中某個檔案的 entries, READ_LIST 已依 setId 排序 */
+static void reuseEntries(const QByteArray &previous, int file, QVector<ParsedEntry> &out,
+                         int &stringsSize, int &bytesSize)
+{
+    CmdCacheHeader h;
+    memcpy(&h, previous.constData(), sizeof(h));
+    const CmdEntry *entries = (const CmdEntry*)(previous.constData() + sizeof(h));
+    const char     *strings = (const char*)(entries + h.entryCount);
+    const char     *bytes   = strings + h.stringsSize;
+
+    out.reserve(int(h.fileStart[file + 1] - h.fileStart[file]));
+    for (quint32 i = h.fileStart[file]; i < h.fileStart[file + 1]; ++i) {
+        const CmdEntry &e = entries[i];
+        ParsedEntry pe;
+        pe.setId = e.setId;
+        pe.order = out.size();
+        pe.label = QByteArray(strings + e.labelOffset, int(e.labelSize));
+        pe.bytes = QByteArray(bytes + e.bytesOffset, int(e.bytesSize));
+        stringsSize += pe.label.size();
+        bytesSize   += pe.bytes.size();
+        out.append(pe);
+    }
+}
+
+/* changed 的 bit 為 0 且有 previous 時, 該檔案直接取用 previous 的 entries */
+bool CmdLibrary::buildImage(QByteArray &image, const QByteArray &previous, quint32 changed) const
+{
+    QVector<ParsedEntry> parsed[CMD_FILE_COUNT];
+    int stringsSize = 0;
+    int bytesSize = 0;
+
+    for (int f = 0; f < CMD_FILE_COUNT; ++f) {
+        if (!previous.isEmpty() && !(changed & (1u << f))) {
+            reuseEntries(previous, f, parsed[f], stringsSize, bytesSize);
+            continue;
+        }
+
+        QFile in(m_dir + "/" + kFileNames[f]);
+        if (!in.open(QIODevice::ReadOnly)) continue;
+
+        const QByteArray text = in.readAll();
+        const char *p   = text.constData();
+        const char *end = p + text.size();
+        int lineNo = 0;
+
+        while (p < end) {
+            const char *eol = (const char*)memchr(p, '\n', size_t(end - p));
+            if (!eol) eol = end;
+            ++lineNo;
+
+            ParsedEntry e;
+            if (parseLine(p, eol, f, e)) {
+                e.order = parsed[f].size();
+                stringsSize += e.label.size();
+                bytesSize   += e.bytes.size();
+                parsed[f].append(e);
+            } else if (skipSpace(p, eol) != eol && *skipSpace(p, eol) == '1') {
+                qDebug() << "[WARN]" << kFileNames[f] << "line" << lineNo << "ignored";
+            }
+            p = eol + 1;
+        }
+    }
+
+    // 同一 SET 的命令排在一起, SET 內維持檔案順序
+    std::stable_sort(parsed[CMD_FILE_READ_LIST].begin(), parsed[CMD_FILE_READ_LIST].end(),
+                     [](const ParsedEntry &a, const ParsedEntry &b) { return a.setId < b.setId; });
+
+    CmdCacheHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, kCacheMagic, sizeof(kCacheMagic));
+    h.version = CMD_CACHE_VERSION;
+    for (int f = 0; f < CMD_FILE_COUNT; ++f) {
+        h.fileStart[f + 1] = h.fileStart[f] + quint32(parsed[f].size());
+        h.srcSize[f]    = m_stamp[f].size;
+        h.srcMtimeMs[f] = m_stamp[f].mtimeMs;
+    }
+    h.entryCount  = h.fileStart[CMD_FILE_COUNT];
+    h.stringsSize = quint32(stringsSize);
+    h.bytesSize   = quint32(bytesSize);
+
+    image.resize(int(sizeof(h) + h.entryCount * sizeof(CmdEntry)) + stringsSize + bytesSize);
+    char *base = image.data();
+    memcpy(base, &h, sizeof(h));
+
+    CmdEntry *entries = (CmdEntry*)(base + sizeof(h));
+    char     *strings = (char*)(entries + h.entryCount);
+    char     *bytes   = strings + stringsSize;
+    quint32   so = 0, bo = 0;
+
+    CmdEntry *e = entries;
+    for (int f = 0; f < CMD_FILE_COUNT; ++f) {
+        for (const ParsedEntry &pe : parsed[f]) {
+            e->file        = quint16(f);
+            e->reserved    = 0;
+            e->setId       = pe.setId;
+            e->labelOffset = so;
+            e->labelSize   = quint32(pe.label.size());
+            e->bytesOffset = bo;
+            e->bytesSize   = quint32(pe.bytes.size());
+            memcpy(strings + so, pe.label.constData(), size_t(pe.label.size()));
+            memcpy(bytes + bo, pe.bytes.constData(), size_t(pe.bytes.size()));
+            so += e->labelSize;
+            bo += e->bytesSize;
+            ++e;
+        }
+    }
+    return true;
+}
+
+/* ---------------- 查詢 ---------------- */
+
+int CmdLibrary::count(int file) const
+{
+    if (!m_entries || file < 0 || file >= CMD_FILE_COUNT) return 0;
+    return int(m_fileStart[file + 1] - m_fileStart[file]);
+}
+
+const CmdEntry &CmdLibrary::entry(int file, int i) const
+{
+    return m_entries[m_fileStart[file] + quint32(i)];
+}
+
+QString CmdLibrary::label(const CmdEntry &e) const
+{
+    return QString::fromUtf8(m_strings + e.labelOffset, int(e.labelSize));
+}
+
+QString CmdLibrary::hexText(const CmdEntry &e) const
+{
+    return formatHex(data(e), int(e.bytesSize));
+}
+
+QList<QPair<int, QString>> CmdLibrary::sets() const
+{
+    QList<QPair<int, QString>> list;
+    const int n = count(CMD_FILE_READ_SET);
+    for (int i = 0; i < n; ++i) {
+        const CmdEntry &e = entry(CMD_FILE_READ_SET, i);
+        list.append(qMakePair(int(e.setId), label(e)));
+    }
+    return list;
+}
+
+bool CmdLibrary::setRange(int setId, int *first, int *count) const
+{
+    auto it = m_setIndex.constFind(setId);
+    if (it == m_setIndex.constEnd()) {
+        if (first) *first = 0;
+        if (count) *count = 0;
+        return false;
+    }
+    if (first) *first = it.value().first;
+    if (count) *count = it.value().second;
+    return true;
+}
+
+/*
+ * 手寫 PEC 檢查: 命令清單的 4 Bytes 命令驗證 PEC15,
+ * 寫入資料為 8 Bytes 倍數時逐 frame 驗證 PEC10 (command counter 0)
+ */
+void CmdLibrary::validate()
+{
+    m_warnings.clear();
+
+    for (int f = CMD_FILE_READ_LIST; f < CMD_FILE_COUNT; ++f) {
+        const int n = count(f);
+        for (int i = 0; i < n; ++i) {
+            const CmdEntry &e = entry(f, i);
+            const BYTE *d = data(e);
+
+            if (f != CMD_FILE_WRITE_DATA) {
+                if (e.bytesSize != ADBMS6832_CMD_SIZE) continue;
+                const WORD pec = adbmsPec15(d, 2);
+                const WORD got = WORD((d[2] << 8) | d[3]);
+                if (pec != got) {
+                    m_warnings << QString("%1 \"%2\": PEC 0x%3 should be 0x%4")
+                                  .arg(QLatin1String(kFileNames[f]), label(e))
+                                  .arg(got, 4, 16, QChar('0')).arg(pec, 4, 16, QChar('0'));
+                }
+                continue;
+            }
+
+            if (e.bytesSize == 0 || e.bytesSize % ADBMS6832_FRAME_SIZE) continue;
+            for (quint32 k = 0; k < e.bytesSize / ADBMS6832_FRAME_SIZE; ++k) {
+                const BYTE *frame = d + k * ADBMS6832_FRAME_SIZE;
+                BYTE expect[2];
+                adbmsPutDataPec(expect, adbmsPec10(frame, ADBMS6832_REG_GROUP_SIZE, 0), 0);
+                if (frame[6] != expect[0] || frame[7] != expect[1]) {
+                    m_warnings << QString("%1 \"%2\" frame %3: PEC 0x%4 should be 0x%5")
+                                  .arg(QLatin1String(kFileNames[f]), label(e)).arg(k + 1)
+                                  .arg((frame[6] << 8) | frame[7], 4, 16, QChar('0'))
+                                  .arg((expect[0] << 8) | expect[1], 4, 16, QChar('0'));
+                }
+            }
+        }
+    }
+
+    for (const QString &w : m_warnings) qDebug() << "[WARN]" << w;
+}
+
+int CmdLibrary::findLabel(int file, const QString &label) const
+{
+    if (file < 0 || file >= CMD_FILE_COUNT) return -1;
+    return m_labelIndex[file].value(label.toUtf8(), -1);
+}
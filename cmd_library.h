@@ -0,0 +1,120 @@
+#ifndef CMD_LIBRARY_H
+#define CMD_LIBRARY_H
+
+#include <QByteArray>
+#include <QFile>
+#include <QHash>
+#include <QList>
+#include <QPair>
+#include <QString>
+#include <QStringList>
+#include "usb2uis_backend.h"
+
+typedef enum{
+    CMD_FILE_READ_SET = 0,      // SPI_READ_CMD_SET.txt       en,setId,"desc"
+    CMD_FILE_READ_LIST,         // SPI_READ_CMD_LIST.txt      en,setId,"label",hex
+    CMD_FILE_READ_ONE,          // SPI_READ_ONE_CMD_LIST.txt  en,"label",hex
+    CMD_FILE_WRITE_CMD,         // SPI_WRITE_CMD_LIST.txt     en,"label",hex
+    CMD_FILE_WRITE_DATA,        // SPI_WRITE_DATA_LIST.txt    en,"label",hex
+    CMD_FILE_COUNT,
+}eTypeCmdFile;
+
+/* 固定格式, 直接存放在 cache 檔中 (little-endian) */
+struct CmdEntry {
+    quint16 file;
+    quint16 reserved;
+    qint32  setId;              // READ_SET / READ_LIST 才有, 其餘 -1
+    quint32 labelOffset;        // strings 區 (UTF-8)
+    quint32 labelSize;
+    quint32 bytesOffset;        // bytes 區
+    quint32 bytesSize;
+};
+
+/*
+ * CmdLibrary
+ *  一次解析 5 個命令清單檔, 命令存成連續 byte 陣列, 以 set ID / label 建立索引.
+ *  結果寫入 SPI_CMD_LIBRARY.cache, 之後以 QFile::map 直接使用;
+ *  任一文字檔的大小或修改時間改變時才重新載入, 且只重新解析變更的檔案 (其餘沿用目前的 entries).
+ *  READ_LIST 的 entry 依 setId 穩定排序, 每個 SET 是一段連續範圍.
+ *  HEX 欄位可使用命令名稱 (見 parseCmdText), PEC 於載入時產生; 手寫的 PEC 會被檢查.
+ */
+class CmdLibrary
+{
+public:
+    CmdLibrary();
+    ~CmdLibrary();
+
+    static const char *fileName(int file);
+
+    // 載入 dir 下的清單檔; 已載入且檔案未變更時直接返回
+    bool load(const QString &dir);
+    bool isLoaded() const { return m_entries != nullptr; }
+    bool loadedFromCache() const { return m_fromCache; }
+    int  generation() const { return m_generation; }      // 每次實際重新載入 +1
+    quint32 changedFiles() const { return m_changed; }    // 最近一次重新載入時變更的檔案 (bit = eTypeCmdFile)
+
+    int count(int file) const;
+    const CmdEntry &entry(int file, int i) const;
+
+    QString    label(const CmdEntry &e) const;
+    const BYTE *data(const CmdEntry &e) const { return m_bytes + e.bytesOffset; }
+    QByteArray bytes(const CmdEntry &e) const { return QByteArray((const char*)data(e), int(e.bytesSize)); }
+    QString    hexText(const CmdEntry &e) const;
+
+    // READ_SET 的 (setId, 描述), 依檔案順序
+    QList<QPair<int, QString>> sets() const;
+    // READ_LIST 中某個 SET 的範圍 [first, first+count)
+    bool setRange(int setId, int *first, int *count) const;
+    // 依 label 尋找 (第一筆), 找不到回傳 -1
+    int findLabel(int file, const QString &label) const;
+
+    // 載入時的 PEC 檢查結果 (每筆一行)
+    const QStringList &warnings() const { return m_warnings; }
+
+    // 快速 HEX 解析: "0x00 0x02 2B 0A"
+    static bool parseHex(const char *p, int len, QByteArray &out);
+    /*
+     * 命令文字: HEX byte, 命令名稱 (自動加 PEC15) 與 PEC 記號可混用
+     *   "RDCVA"                     → 0x00 0x04 0x07 0xC2
+     *   "ADCV CONT RD"              → 命令名稱後接選項
+     *   "0x81 0x00 0x00 0xFF 0x03 0x00 PEC" → PEC 套用到上一個 PEC/命令之後的 bytes:
+     *                                 2 Bytes 用 PEC15, 6 Bytes 用 PEC10 (command counter 0)
+     */
+    static bool parseCmdText(const char *p, int len, QByteArray &out, QString *errorMsg = nullptr);
+    static QString formatHex(const BYTE *data, int size);
+
+private:
+    struct SourceStamp {
+        qint64 size;
+        qint64 mtimeMs;
+    };
+
+    QString     m_dir;
+    SourceStamp m_stamp[CMD_FILE_COUNT];
+
+    QFile       m_cacheFile;
+    uchar      *m_map = nullptr;
+    QByteArray  m_image;            // cache 無法 map 時使用記憶體內影像
+    bool        m_fromCache = false;
+    int         m_generation = 0;
+    quint32     m_changed = 0;
+
+    const CmdEntry *m_entries = nullptr;
+    const char     *m_strings = nullptr;
+    const BYTE     *m_bytes = nullptr;
+    quint32         m_fileStart[CMD_FILE_COUNT + 1];
+
+    QHash<int, QPair<int, int>> m_setIndex;             // setId → (first, count) in READ_LIST
+    QHash<QByteArray, int>      m_labelIndex[CMD_FILE_COUNT];
+    QStringList                 m_warnings;
+
+    void unload();
+    void readStamps(SourceStamp *out) const;
+    bool attach(const uchar *image, qint64 size, bool checkStamp);
+    QByteArray imageCopy() const;
+    bool buildImage(QByteArray &image, const QByteArray &previous, quint32 changed) const;
+    void buildIndex();
+    void validate();
+};
+
+#endif // CMD_LIBRARY_H
@@ -0,0 +1,110 @@
+#include "cycle_scheduler.h"
+
+CycleScheduler::CycleScheduler()
+    : m_periodNs(0), m_cycles(0), m_missed(0), m_skipped(0), m_firstStartNs(0), m_lastStartNs(0)
+{
+}
+
+void CycleScheduler::start(qint64 periodNs, eTypeCyclePolicy policy, qint64 nowNs)
+{
+    m_policy = policy;
+    m_startNs = nowNs;
+    m_nextNs = nowNs;
+    m_cycleStartNs = nowNs;
+    m_cycle = 0;
+
+    m_cycles.store(0);
+    m_missed.store(0);
+    m_skipped.store(0);
+    m_firstStartNs.store(0);
+    m_lastStartNs.store(0);
+    m_cycleTime.reset();
+    m_startLate.reset();
+    {
+        QMutexLocker lock(&m_missLock);
+        m_misses.clear();
+    }
+    m_periodNs.store(qMax<qint64>(periodNs, 0));
+}
+
+void CycleScheduler::beginCycle(qint64 nowNs)
+{
+    m_cycleStartNs = nowNs;
+    if (periodNs() > 0) m_startLate.record(qMax<qint64>(nowNs - m_nextNs, 0));
+
+    if (m_cycles.fetch_add(1, std::memory_order_relaxed) == 0)
+        m_firstStartNs.store(nowNs, std::memory_order_relaxed);
+    m_lastStartNs.store(nowNs, std::memory_order_relaxed);
+}
+
+/*
+ * 下一個 slot = 目前 slot + period.
+ * cycle 結束時已超過該 slot → 記錄 miss; SKIP 跳到 nowNs 之後的第一個 slot,
+ * CATCH_UP 立即開始下一個 cycle (落後太多時同 SKIP).
+ */
+qint64 CycleScheduler::endCycle(qint64 nowNs)
+{
+    const qint64 period = periodNs();
+    m_cycleTime.record(nowNs - m_cycleStartNs);
+
+    qint64 next = m_nextNs + period;
+    if (period > 0 && nowNs > next) {
+        const qint64 lateNs = nowNs - next;
+        m_missed.fetch_add(1, std::memory_order_relaxed);
+        {
+            QMutexLocker lock(&m_missLock);
+            if (m_misses.size() >= CYCLE_SCHEDULER_MISS_HISTORY) m_misses.removeFirst();
+            m_misses.append(CycleMiss{m_cycle, nowNs - m_startNs, lateNs});
+        }
+
+        const qint64 behind = lateNs / period + 1;       // 已經錯過的 slot 數
+        if (m_policy == CYCLE_POLICY_SKIP || behind > CYCLE_SCHEDULER_MAX_CATCH_UP) {
+            next += behind * period;
+            m_skipped.fetch_add(behind, std::memory_order_relaxed);
+        }
+    }
+
+    m_nextNs = next;
+    ++m_cycle;
+    return next;
+}
+
+void CycleScheduler::resync(qint64 nowNs)
+{
+    m_nextNs = nowNs;
+}
+
+CycleScheduler::Stats CycleScheduler::stats() const
+{
+    Stats s;
+    s.periodNs     = periodNs();
+    s.cycles       = m_cycles.load(std::memory_order_relaxed);
+    s.missed       = m_missed.load(std::memory_order_relaxed);
+    s.skippedSlots = m_skipped.load(std::memory_order_relaxed);
+
+    const qint64 spanNs = m_lastStartNs.load(std::memory_order_relaxed) - m_firstStartNs.load(std::memory_order_relaxed);
+    s.achievedHz = (s.cycles > 1 && spanNs > 0) ? (s.cycles - 1) * 1e9 / spanNs : 0.0;
+    s.cycleTime  = m_cycleTime.stats();
+    s.startLate  = m_startLate.stats();
+    return s;
+}
+
+QList<CycleMiss> CycleScheduler::recentMisses() const
+{
+    QMutexLocker lock(&m_missLock);
+    return m_misses;
+}
+
+/* 例: "99.98/100 Hz  cycle 4.1/6.3/9.8 ms  late 0.02/0.3 ms  missed 2 skipped 2" */
+QString CycleScheduler::statsText() const
+{
+    const Stats s = stats();
+    if (s.cycles == 0) return QString();
+
+    return QString("%1/%2 Hz  cycle %3/%4/%5 ms  late %6/%7 ms  missed %8 skipped %9")
+            .arg(s.achievedHz, 0, 'f', 2).arg(s.periodNs > 0 ? 1e9 / s.periodNs : 0.0, 0, 'f', 1)
+            .arg(s.cycleTime.p50Ns / 1e6, 0, 'f', 2).arg(s.cycleTime.p99Ns / 1e6, 0, 'f', 2)
+            .arg(s.cycleTime.maxNs / 1e6, 0, 'f', 2)
+            .arg(s.startLate.p99Ns / 1e6, 0, 'f', 2).arg(s.startLate.maxNs / 1e6, 0, 'f', 2)
+            .arg(s.missed).arg(s.skippedSlots);
+}
@@ -0,0 +1,77 @@
+#ifndef CYCLE_SCHEDULER_H
+#define CYCLE_SCHEDULER_H
+
+#include <QList>
+#include <QMutex>
+#include <QString>
+#include <atomic>
+#include "spi_trace.h"
+
+typedef enum{
+    CYCLE_POLICY_SKIP = 0,      // 落後時跳過錯過的 slot, 下一個 cycle 對齊原本的相位
+    CYCLE_POLICY_CATCH_UP,      // 落後時立即接著執行, 直到追上 (最多 CYCLE_SCHEDULER_MAX_CATCH_UP 個 slot)
+}eTypeCyclePolicy;
+
+#define CYCLE_SCHEDULER_MAX_CATCH_UP    10      // 超過此數量時放棄補跑, 改為跳過
+#define CYCLE_SCHEDULER_MISS_HISTORY    64      // 保留最近幾筆 deadline miss
+
+/* 一次 deadline miss: cycle 結束時已超過下一個 slot */
+struct CycleMiss {
+    int    cycle;
+    qint64 timeNs;          // 相對於 start()
+    qint64 lateNs;          // 超過下一個 slot 的時間
+};
+
+/*
+ * CycleScheduler
+ *  固定速率的 cycle 排程: 第 n 個 slot = start + n * period, 以絕對時間計算, 不會累積漂移.
+ *  由 acquisition 執行緒呼叫 beginCycle()/endCycle(), 統計值為 atomic, 任何執行緒可讀取.
+ */
+class CycleScheduler
+{
+public:
+    CycleScheduler();
+
+    struct Stats {
+        qint64 periodNs;
+        qint64 cycles;
+        qint64 missed;              // deadline miss 次數
+        qint64 skippedSlots;        // SKIP (或補跑過多) 放棄的 slot
+        double achievedHz;
+        SpiPhaseHistogram::Stats cycleTime;     // beginCycle → endCycle
+        SpiPhaseHistogram::Stats startLate;     // 實際開始 - slot 時間
+    };
+
+    void   start(qint64 periodNs, eTypeCyclePolicy policy, qint64 nowNs);     // periodNs = 0: 只統計, 不排程
+    qint64 periodNs() const { return m_periodNs.load(std::memory_order_relaxed); }
+
+    void   beginCycle(qint64 nowNs);
+    qint64 endCycle(qint64 nowNs);          // 回傳下一個 cycle 的開始時間
+    void   resync(qint64 nowNs);            // 暫停後: 由 nowNs 重新起算相位, 不計為 miss
+    qint64 deadlineNs() const { return periodNs() > 0 ? m_nextNs + periodNs() : 0; }   // 目前 cycle 的下一個 slot, 0 = 不排程
+
+    Stats  stats() const;
+    QList<CycleMiss> recentMisses() const;
+    QString statsText() const;
+
+private:
+    eTypeCyclePolicy m_policy = CYCLE_POLICY_SKIP;
+    qint64 m_startNs = 0;
+    qint64 m_nextNs = 0;                    // 目前 cycle 的 slot
+    qint64 m_cycleStartNs = 0;
+    int    m_cycle = 0;
+
+    std::atomic<qint64> m_periodNs;
+    std::atomic<qint64> m_cycles;
+    std::atomic<qint64> m_missed;
+    std::atomic<qint64> m_skipped;
+    std::atomic<qint64> m_firstStartNs;
+    std::atomic<qint64> m_lastStartNs;
+    SpiPhaseHistogram   m_cycleTime;
+    SpiPhaseHistogram   m_startLate;
+
+    mutable QMutex   m_missLock;
+    QList<CycleMiss> m_misses;
+};
+
+#endif // CYCLE_SCHEDULER_H
@@ -0,0 +1,298 @@
+#include "device_manager.h"
+
+DeviceManager::DeviceManager(QObject *parent)
+    : QObject(parent)
+{
+}
+
+DeviceManager::~DeviceManager()
+{
+    closeAll();
+}
+
+void DeviceManager::setLogSink(SpiLogSink *sink)
+{
+    m_log = sink;
+    for (Slot &s : m_slots) s.worker->setLogSink(sink);
+}
+
+void DeviceManager::setCaptureWriter(CaptureWriter *writer)
+{
+    m_capture = writer;
+    for (Slot &s : m_slots) s.worker->setCaptureWriter(writer);
+}
+
+void DeviceManager::setAlignWindowMs(int ms)
+{
+    m_alignWindowNs = qint64(qMax(0, ms)) * 1000000LL;
+}
+
+/*
+ * 依序開啟直到 USBIO_OpenDevice 回傳 0xFF.
+ * 開啟動作在各自的執行緒內執行 (之後的 SPI 呼叫也在同一執行緒), 但一次只開一台.
+ */
+int DeviceManager::openAll(int maxAdapters)
+{
+    maxAdapters = qBound(1, maxAdapters, DEVICE_MANAGER_MAX_ADAPTERS);
+
+    while (m_slots.size() < maxAdapters) {
+        const int slot = m_slots.size();
+
+        Slot s;
+        s.thread = new QThread;
+        s.thread->setObjectName(QString("AcquisitionThread%1").arg(slot));
+        s.worker = new AcquisitionWorker;
+        s.worker->setLogSink(m_log);
+        s.worker->setCaptureWriter(m_capture);
+        s.worker->moveToThread(s.thread);
+        connect(s.thread, &QThread::finished, s.worker, &QObject::deleteLater);
+        s.thread->start(QThread::TimeCriticalPriority);
+
+        bool ok = false;
+        QMetaObject::invokeMethod(s.worker, "openDevice", Qt::BlockingQueuedConnection,
+                                  Q_RETURN_ARG(bool, ok));
+        if (!ok) {
+            s.thread->quit();
+            s.thread->wait();
+            delete s.thread;
+            break;
+        }
+        s.index = s.worker->index();
+
+        AcquisitionWorker *w = s.worker;
+        connect(w, &AcquisitionWorker::configApplied, this, [this, slot](bool gpioOk, bool spiOk) {
+            emit configApplied(slot, gpioOk, spiOk);
+        });
+        connect(w, &AcquisitionWorker::acquisitionStarted, this, [this, slot]() {
+            onWorkerStarted(slot);
+        });
+        connect(w, &AcquisitionWorker::acquisitionFinished, this, [this, slot](int iterations) {
+            onWorkerFinished(slot, iterations);
+        });
+        connect(w, &AcquisitionWorker::acquisitionError, this, [this, slot](const QString &msg) {
+            emit acquisitionError(slot, msg);
+        });
+        connect(w, &AcquisitionWorker::planStats, this, [this](int usbCalls, int planOps) {
+            m_usbCalls += usbCalls;
+            m_planOps  += planOps;
+        });
+        connect(w, &AcquisitionWorker::rateTuneStep, this, [this, slot](const SpiRateTuneStep &step) {
+            emit rateTuneStep(slot, step);
+        });
+        connect(w, &AcquisitionWorker::rateTuneFinished, this, [this, slot](const SpiRateTuneResult &result) {
+            if (result.chosen >= 0 && slot < m_slots.size()) {
+                DeviceConfig &cfg = m_slots[slot].config;
+                cfg.spiConfig = BYTE((cfg.spiConfig & 0xF0) | result.chosen);
+            }
+            emit rateTuneFinished(slot, result);
+        });
+        connect(w, &AcquisitionWorker::afeSample, this, [this, slot](const AfeChainSample &sample) {
+            onWorkerSample(slot, sample);
+        });
+
+        m_slots.append(s);
+    }
+    return m_slots.size();
+}
+
+void DeviceManager::closeAll()
+{
+    cancel();
+    setPaused(false);
+
+    for (Slot &s : m_slots) {
+        QMetaObject::invokeMethod(s.worker, "closeDevice", Qt::BlockingQueuedConnection);
+        s.thread->quit();
+        s.thread->wait();
+        delete s.thread;
+    }
+    m_slots.clear();
+    m_running = 0;
+    m_latestNs = 0;
+}
+
+BYTE DeviceManager::deviceIndex(int slot) const
+{
+    return (slot >= 0 && slot < m_slots.size()) ? m_slots[slot].index : BYTE(0xFF);
+}
+
+const DeviceConfig &DeviceManager::config(int slot) const
+{
+    static const DeviceConfig kDefault;
+    return (slot >= 0 && slot < m_slots.size()) ? m_slots[slot].config : kDefault;
+}
+
+const CycleScheduler *DeviceManager::scheduler(int slot) const
+{
+    return (slot >= 0 && slot < m_slots.size()) ? &m_slots[slot].worker->scheduler() : nullptr;
+}
+
+Usb2UisSubmitQueue *DeviceManager::submitQueue(int slot) const
+{
+    return (slot >= 0 && slot < m_slots.size()) ? &m_slots[slot].worker->submitQueue() : nullptr;
+}
+
+int DeviceManager::readSetStep(int slot) const
+{
+    return (slot >= 0 && slot < m_slots.size()) ? m_slots[slot].worker->readSetStep() : -1;
+}
+
+const SpiRecoveryStats *DeviceManager::recoveryStats(int slot) const
+{
+    return (slot >= 0 && slot < m_slots.size()) ? &m_slots[slot].worker->recoveryStats() : nullptr;
+}
+
+template <typename Fn>
+void DeviceManager::forSlots(int slot, Fn fn)
+{
+    for (int i = 0; i < m_slots.size(); ++i)
+        if (slot == DEVICE_ALL || slot == i) fn(m_slots[i]);
+}
+
+void DeviceManager::applyConfig(int slot, const DeviceConfig &cfg)
+{
+    forSlots(slot, [&cfg](Slot &s) {
+        s.config = cfg;
+        s.worker->setTransferConfig(cfg.chainLength, cfg.chunkBytes);
+        s.worker->setRetryPolicy(cfg.retry);
+        QMetaObject::invokeMethod(s.worker, "applyConfig", Qt::QueuedConnection,
+                                  Q_ARG(BYTE, cfg.spiConfig), Q_ARG(DWORD, cfg.timeout), Q_ARG(BYTE, cfg.gpioDir));
+    });
+}
+
+void DeviceManager::runSpiRead(int slot, const SpiReadParams &p)
+{
+    forSlots(slot, [&p](Slot &s) {
+        QMetaObject::invokeMethod(s.worker, "runSpiRead", Qt::QueuedConnection, Q_ARG(SpiReadParams, p));
+    });
+}
+
+void DeviceManager::runSpiReadSet(int slot, const SpiReadSetParams &p)
+{
+    forSlots(slot, [&p](Slot &s) {
+        QMetaObject::invokeMethod(s.worker, "runSpiReadSet", Qt::QueuedConnection, Q_ARG(SpiReadSetParams, p));
+    });
+}
+
+void DeviceManager::runSpiWrite(int slot, const SpiWriteParams &p)
+{
+    forSlots(slot, [&p](Slot &s) {
+        QMetaObject::invokeMethod(s.worker, "runSpiWrite", Qt::QueuedConnection, Q_ARG(SpiWriteParams, p));
+    });
+}
+
+void DeviceManager::runSequence(int slot, const SeqRunParams &p)
+{
+    forSlots(slot, [&p](Slot &s) {
+        QMetaObject::invokeMethod(s.worker, "runSequence", Qt::QueuedConnection, Q_ARG(SeqRunParams, p));
+    });
+}
+
+void DeviceManager::runRateTune(int slot, const SpiRateTuneParams &p)
+{
+    forSlots(slot, [&p](Slot &s) {
+        SpiRateTuneParams q = p;
+        q.mode        = BYTE((s.config.spiConfig >> 4) & 0x03);
+        q.timeout     = s.config.timeout;
+        q.restoreRate = BYTE(s.config.spiConfig & 0x0F);
+        QMetaObject::invokeMethod(s.worker, "runRateTune", Qt::QueuedConnection, Q_ARG(SpiRateTuneParams, q));
+    });
+}
+
+int DeviceManager::submitReadOne(int slot, const SpiReadParams &p)
+{
+    int accepted = 0;
+    forSlots(slot, [&p, &accepted](Slot &s) {
+        if (s.worker->submitReadOne(p)) ++accepted;
+    });
+    return accepted;
+}
+
+void DeviceManager::cancel()
+{
+    for (Slot &s : m_slots) s.worker->cancel();
+}
+
+void DeviceManager::setPaused(bool paused)
+{
+    for (Slot &s : m_slots) s.worker->setPaused(paused);
+}
+
+void DeviceManager::updateReadSet(int setId, const QList<QByteArray> &cmds)
+{
+    for (Slot &s : m_slots) s.worker->updateReadSet(setId, cmds);
+}
+
+void DeviceManager::onWorkerStarted(int slot)
+{
+    if (slot >= m_slots.size()) return;     // closeAll 之後才送達的 queued signal
+    Slot &s = m_slots[slot];
+    if (s.running) return;
+    s.running = true;
+
+    if (m_running++ == 0) {
+        m_iterations = 0;
+        m_usbCalls   = 0;
+        m_planOps    = 0;
+        emit acquisitionStarted();
+    }
+}
+
+void DeviceManager::onWorkerFinished(int slot, int iterations)
+{
+    if (slot >= m_slots.size()) return;
+    Slot &s = m_slots[slot];
+    if (!s.running) return;
+    s.running = false;
+    m_iterations += iterations;
+
+    // 結束的裝置不再參與對齊, 其餘樣本可能因此可以送出
+    drainMerged(false);
+
+    if (--m_running == 0) {
+        drainMerged(true);
+        emit planStats(m_usbCalls, m_planOps);
+        emit acquisitionFinished(m_iterations);
+    }
+}
+
+void DeviceManager::onWorkerSample(int slot, const AfeChainSample &sample)
+{
+    if (slot >= m_slots.size()) return;
+    // 單台時不需排序
+    if (m_slots.size() == 1) {
+        emit mergedSample(sample);
+        return;
+    }
+
+    m_slots[slot].pending.enqueue(sample);
+    if (sample.timeNs > m_latestNs) m_latestNs = sample.timeNs;
+    drainMerged(false);
+}
+
+/*
+ * k-way merge: 各 queue 內已依時間排序, 每次取最舊的 head.
+ * 執行中但 queue 為空的裝置會擋住輸出, 直到最舊的 head 超過 alignWindow (flush 時全部送出).
+ */
+void DeviceManager::drainMerged(bool flush)
+{
+    while (true) {
+        int oldest = -1;
+        bool blocked = false;
+        for (int i = 0; i < m_slots.size(); ++i) {
+            const Slot &s = m_slots[i];
+            if (s.pending.isEmpty()) {
+                if (s.running) blocked = true;
+                continue;
+            }
+            if (oldest < 0 || s.pending.head().timeNs < m_slots[oldest].pending.head().timeNs)
+                oldest = i;
+        }
+        if (oldest < 0) return;
+
+        const qint64 headNs = m_slots[oldest].pending.head().timeNs;
+        if (blocked && !flush && m_latestNs - headNs < m_alignWindowNs) return;
+
+        emit mergedSample(m_slots[oldest].pending.dequeue());
+    }
+}
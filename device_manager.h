@@ -0,0 +1,111 @@
+#ifndef DEVICE_MANAGER_H
+#define DEVICE_MANAGER_H
+
+#include <QObject>
+#include <QQueue>
+#include <QThread>
+#include <QVector>
+#include "acquisition_worker.h"
+
+#define DEVICE_MANAGER_MAX_ADAPTERS     16      // 與擷取檔 adapter 欄位 (4 bits) 一致
+#define DEVICE_ALL                      -1      // slot 參數: 所有裝置
+
+/* 每台 USB2UIS 各自的設定 */
+struct DeviceConfig {
+    BYTE  spiConfig = 0;        // bit5~4 mode, bit3~0 speed
+    DWORD timeout   = (100 << 16) | 100;        // write << 16 | read (ms)
+    BYTE  gpioDir   = 0x00;     // 1=input, 0=output
+    int   chainLength = 1;      // daisy chain 上的 AFE 數
+    int   chunkBytes  = 0;      // SPI 分段大小, 0 = 不分段
+    SpiRetryPolicy retry;       // 命令失敗時的重試/恢復
+};
+
+/*
+ * DeviceManager
+ *  開啟所有連接的 USB2UIS, 每台一個 AcquisitionWorker + 專用 QThread, 設定與命令可個別或同時下達.
+ *  各 worker 的 afeSample 依 timeNs 合併成單一遞增的 mergedSample 串流:
+ *  每台執行中的裝置都有待送樣本時送出最舊的一筆; 較慢的裝置最多延遲 alignWindowMs.
+ *  slot 為 0..count()-1 的管理編號, 與 USBIO_OpenDevice 回傳的 index 不一定相同.
+ */
+class DeviceManager : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit DeviceManager(QObject *parent = nullptr);
+    ~DeviceManager();
+
+    // 開始擷取前設定, 套用到現有與之後開啟的 worker
+    void setLogSink(SpiLogSink *sink);
+    void setCaptureWriter(CaptureWriter *writer);
+    void setAlignWindowMs(int ms);
+
+    int  openAll(int maxAdapters = DEVICE_MANAGER_MAX_ADAPTERS);    // 回傳開啟的數量
+    void closeAll();
+
+    int  count() const { return m_slots.size(); }
+    BYTE deviceIndex(int slot) const;
+    const DeviceConfig &config(int slot) const;
+    const CycleScheduler *scheduler(int slot) const;       // 該裝置最近一次重複擷取的速率統計
+    Usb2UisSubmitQueue *submitQueue(int slot) const;        // 該裝置的非同步交易佇列
+    const SpiRecoveryStats *recoveryStats(int slot) const;  // 該裝置最近一次擷取的錯誤/重試計數
+    int  readSetStep(int slot) const;                       // READ SET 目前的命令 (-1 = 無), 由 UI timer 輪詢
+
+    bool isRunning() const { return m_running > 0; }
+
+    void applyConfig(int slot, const DeviceConfig &cfg);
+    void runSpiRead(int slot, const SpiReadParams &p);
+    void runSpiReadSet(int slot, const SpiReadSetParams &p);
+    void runSpiWrite(int slot, const SpiWriteParams &p);
+    void runSequence(int slot, const SeqRunParams &p);
+    // SPI clock 掃描; 選定的 rate 同時記入該裝置的 DeviceConfig
+    void runRateTune(int slot, const SpiRateTuneParams &p);
+    // 單次讀取經由 submit queue 執行 (擷取中於 cycle 之間), 結果與 runSpiRead 相同; 回傳接受的台數
+    int  submitReadOne(int slot, const SpiReadParams &p);
+
+    // Thread-safe, 作用於所有裝置
+    void cancel();
+    void setPaused(bool paused);
+    void updateReadSet(int setId, const QList<QByteArray> &cmds);     // 執行中的 READ SET 換成新命令
+
+signals:
+    void configApplied(int slot, bool gpioOk, bool spiOk);
+
+    void acquisitionStarted();                      // 第一台開始
+    void acquisitionFinished(int iterations);       // 最後一台結束, iterations 為各台總和
+    void acquisitionError(int slot, const QString &msg);
+
+    void planStats(int usbCallsPerCycle, int planOps);      // 各台總和
+    void rateTuneStep(int slot, const SpiRateTuneStep &step);
+    void rateTuneFinished(int slot, const SpiRateTuneResult &result);
+    void mergedSample(const AfeChainSample &sample);
+
+private:
+    struct Slot {
+        QThread               *thread = nullptr;
+        AcquisitionWorker     *worker = nullptr;
+        BYTE                   index  = 0xFF;
+        DeviceConfig           config;
+        bool                   running = false;
+        QQueue<AfeChainSample> pending;
+    };
+
+    QVector<Slot>  m_slots;
+    SpiLogSink    *m_log = nullptr;
+    CaptureWriter *m_capture = nullptr;
+    qint64         m_alignWindowNs = 50000000LL;
+    qint64         m_latestNs = 0;
+
+    int m_running = 0;
+    int m_iterations = 0;
+    int m_usbCalls = 0;
+    int m_planOps = 0;
+
+    template <typename Fn> void forSlots(int slot, Fn fn);
+    void onWorkerStarted(int slot);
+    void onWorkerSample(int slot, const AfeChainSample &sample);
+    void onWorkerFinished(int slot, int iterations);
+    void drainMerged(bool flush);
+};
+
+#endif // DEVICE_MANAGER_H
@@ -1,10 +1,26 @@
 #include "mainwindow.h"
+#include "usb2uis_interface.h"
+#include "precision_timer.h"
 
 #include <QApplication>
+#include <QMessageBox>
 
 int main(int argc, char *argv[])
 {
     QApplication a(argc, argv);
+
+    // 量測平台 sleep overshoot, 供 hybrid sleep-then-spin 使用
+    PrecisionTimer::calibrate();
+
+    // --backend sim 時改用模擬 AFE chain, 否則由 MainWindow 載入 usb2uis.dll
+    QString backendError;
+    Usb2UisBackend *backend = Usb2UisBackend::fromArguments(a.arguments(), &backendError);
+    if (!backendError.isEmpty()) {
+        QMessageBox::critical(nullptr, "錯誤", backendError);
+        return 1;
+    }
+    if (backend) Usb2UisInterface::setBackend(backend);
+
     MainWindow w;
     w.show();
     return a.exec();
@@ -1,6 +1,10 @@
 #include "mainwindow.h"
 #include "ui_mainwindow.h"
 #include "usb2uis_interface.h"
+#include "precision_timer.h"
+#include "spi_trace.h"
+#include "cmd_library.h"
+#include "cell_plot_widget.h"
 
 #include <QMessageBox>
 #include <QThread>
@@ -8,15 +12,26 @@
 #include <QTimer>
 #include <QTime>
 #include <QFile>
-#include <QTextStream>
 #include <QDir>
 #include <QDebug>
-#include <QRegularExpression>
+#include <QComboBox>
+#include <QScrollBar>
+#include <QDateTime>
+#include <QSignalBlocker>
+#include <QTableWidget>
+#include <QHeaderView>
+#include <QPushButton>
+#include <QBoxLayout>
+#include <QFileInfo>
+#include <QSettings>
 
 
 #define USB2UIS_APP_NAME_STR         QString("Usb2uisApp")
 #define USB2UIS_APP_VERSION_STR      QString("V1.2")
 
+#define USB2UIS_TRACE_EXPORT_SECONDS     10      // Export Trace 輸出最近幾秒
+#define USB2UIS_CMD_RELOAD_DEBOUNCE_MS   300     // 編輯器存檔常分成數次寫入, 最後一次變更後才重新載入
+
 #define USB2UIS_GPIO_IO1_MASKBIT         (~0x01)
 #define USB2UIS_GPIO_IO2_MASKBIT         (~0x02)
 #define USB2UIS_GPIO_IO3_MASKBIT         (~0x04)
@@ -26,133 +41,223 @@
 #define USB2UIS_GPIO_IO7_MASKBIT         (~0x40)
 #define USB2UIS_GPIO_IO8_MASKBIT         (~0x80)
 
-BYTE deviceIndex = 0;
-
-/* 讀檔並回傳 <顯示文字, HEX字串> 清單，只取第一欄=1 的行 */
-static QList<QPair<QString, QString>> loadCmdFile(const QString &fileName)
+/* HEX 字串 → bytes, 規則與清單檔相同 ("0x00 0x02 2B", "RDCVA", "... PEC") */
+static bool parseHexString(const QString& input, QByteArray& output)
 {
-    QList<QPair<QString, QString>> list;
-
-    // 使用程式執行檔所在目錄為 base path
-    QString fullPath = QCoreApplication::applicationDirPath() + QDir::separator() + fileName;
+    const QByteArray text = input.toLatin1();
+    return CmdLibrary::parseCmdText(text.constData(), text.size(), output);
+}
 
-    qDebug() << "[DEBUG] Try to load file:" << fullPath;
+/* 清單檔只在內容變更時重新解析, 否則直接使用 cache */
+bool MainWindow::loadCmdLibrary()
+{
+    const QString dir = QCoreApplication::applicationDirPath();
+    if (!cmdLibrary.load(dir)) {
+        qDebug() << "[ERROR] Cannot load command lists from:" << dir;
+        return false;
+    }
 
-    QFile f(fullPath);
-    if (!f.open(QIODevice::ReadOnly | QIODevice::Text)) {
-        qDebug() << "[ERROR] Cannot open file:" << fullPath;
-        return list;
+    // 手寫 PEC 錯誤: 每次重新載入只提示一次
+    if (cmdLibrary.generation() != cmdWarnGeneration) {
+        cmdWarnGeneration = cmdLibrary.generation();
+        if (!cmdLibrary.warnings().isEmpty())
+            QMessageBox::warning(this, "PEC", cmdLibrary.warnings().join("\n"));
     }
+    return true;
+}
 
-    QTextStream ts(&f);
-    const QRegularExpression re("^\\s*(\\d)\\s*,\\s*\"([^\"]+)\"\\s*,\\s*(.+)$");
+/* 將某個清單檔的 <label, HEX字串> 填入 combo (HEX 存在 item data), 回傳第一筆的 HEX */
+static QString fillCmdCombo(QComboBox *combo, const CmdLibrary &lib, int file)
+{
+    QSignalBlocker block(combo);
+    combo->clear();
 
-    while (!ts.atEnd()) {
-        const QString line = ts.readLine();
-        auto m = re.match(line);
-        if (!m.hasMatch()) continue;
-        if (m.captured(1) != "1") continue;
+    const int n = lib.count(file);
+    for (int i = 0; i < n; ++i) {
+        const CmdEntry &e = lib.entry(file, i);
+        combo->addItem(lib.label(e), lib.hexText(e));
+    }
+    combo->setCurrentIndex(n > 0 ? 0 : -1);
+    return combo->currentData().toString();
+}
 
-        const QString label = m.captured(2);
-        const QString hex = m.captured(3).trimmed();
+/*
+ * 兩份清單的最小連續差異: 共同前綴/後綴之外, old 的 [first, first+removed) 換成 now 的 [first, first+inserted).
+ * 清單檔通常一次只改幾行, 其餘列 (與選擇) 維持不動.
+ */
+struct ListEdit {
+    int first;
+    int removed;
+    int inserted;
+};
+
+static ListEdit diffLists(const QStringList &old, const QStringList &now)
+{
+    int first = 0;
+    while (first < old.size() && first < now.size() && old[first] == now[first]) ++first;
+    int tail = 0;
+    while (tail < old.size() - first && tail < now.size() - first
+           && old[old.size() - 1 - tail] == now[now.size() - 1 - tail]) ++tail;
+    return { first, old.size() - first - tail, now.size() - first - tail };
+}
 
-        list.append({label, hex});
+/* combo 就地更新成 <labels, data>, 不發出選擇變更; 選擇的項目被移除時以 label 找回. 回傳變更的列數 */
+static int syncCombo(QComboBox *combo, const QStringList &labels, const QVariantList &data)
+{
+    QStringList oldKeys, newKeys;
+    for (int i = 0; i < combo->count(); ++i)
+        oldKeys << combo->itemText(i) + '\t' + combo->itemData(i).toString();
+    for (int i = 0; i < labels.size(); ++i)
+        newKeys << labels[i] + '\t' + data[i].toString();
+
+    const ListEdit d = diffLists(oldKeys, newKeys);
+    if (d.removed == 0 && d.inserted == 0) return 0;
+
+    const QString current = combo->currentText();
+    QSignalBlocker block(combo);
+    const int common = qMin(d.removed, d.inserted);
+    for (int i = d.first; i < d.first + common; ++i) {
+        combo->setItemText(i, labels[i]);
+        combo->setItemData(i, data[i]);
+    }
+    for (int i = common; i < d.removed; ++i)
+        combo->removeItem(d.first + common);
+    for (int i = d.first + common; i < d.first + d.inserted; ++i)
+        combo->insertItem(i, labels[i], data[i]);
+
+    if (combo->currentText() != current) {
+        const int index = combo->findText(current);
+        if (index >= 0) combo->setCurrentIndex(index);
     }
+    return qMax(d.removed, d.inserted);
+}
 
-    return list;
+static int syncCmdCombo(QComboBox *combo, const CmdLibrary &lib, int file)
+{
+    QStringList labels;
+    QVariantList hexList;
+    const int n = lib.count(file);
+    for (int i = 0; i < n; ++i) {
+        const CmdEntry &e = lib.entry(file, i);
+        labels  << lib.label(e);
+        hexList << lib.hexText(e);
+    }
+    return syncCombo(combo, labels, hexList);
 }
 
 void MainWindow::loadReadCmdSet()
 {
-    mapSetDescription.clear();
     ui->comboReadCmdSet->clear();
+    if (!loadCmdLibrary()) return;
 
-    QFile f(QCoreApplication::applicationDirPath() + "/SPI_READ_CMD_SET.txt");
-    if (!f.open(QIODevice::ReadOnly | QIODevice::Text)) return;
-
-    QTextStream ts(&f);
-    while (!ts.atEnd()) {
-        const QString line = ts.readLine();
-        QRegularExpression re("^\\s*(\\d)\\s*,\\s*(\\d+)\\s*,\\s*\"([^\"]+)\"\\s*$");
-        auto m = re.match(line);
-        if (m.hasMatch() && m.captured(1) == "1") {
-            int setId = m.captured(2).toInt();
-            QString desc = m.captured(3);
-            mapSetDescription[setId] = desc;
-            ui->comboReadCmdSet->addItem(desc, setId);
-        }
-    }
+    for (const auto &set : cmdLibrary.sets())
+        ui->comboReadCmdSet->addItem(set.second, set.first);
 }
 
-void MainWindow::loadReadCmdList()
+/* 監看 5 個清單檔與所在目錄; 編輯器以新檔取代原檔時 watcher 會失去該檔, 每次重新載入後再加入 */
+void MainWindow::watchCmdLists()
 {
-    listSetCmdsOrdered.clear();
-
-    QFile f(QCoreApplication::applicationDirPath() + "/SPI_READ_CMD_LIST.txt");
-    if (!f.open(QIODevice::ReadOnly | QIODevice::Text)) return;
+    const QString dir = QCoreApplication::applicationDirPath();
+    const QStringList watched = cmdWatcher.files();
 
-    QTextStream ts(&f);
-    while (!ts.atEnd()) {
-        const QString line = ts.readLine();
-        QRegularExpression re("^\\s*(\\d)\\s*,\\s*(\\d+)\\s*,\\s*\"[^\"]*\"\\s*,\\s*(.+)$");
-        auto m = re.match(line);
-        if (m.hasMatch() && m.captured(1) == "1") {
-            int setId = m.captured(2).toInt();
-            QString hex = m.captured(3).trimmed();
-            listSetCmdsOrdered.append(qMakePair(setId, hex));
-        }
+    QStringList paths;
+    for (int f = 0; f < CMD_FILE_COUNT; ++f) {
+        const QString path = dir + "/" + CmdLibrary::fileName(f);
+        if (!watched.contains(path) && QFileInfo::exists(path)) paths << path;
     }
+    if (!cmdWatcher.directories().contains(dir)) paths << dir;
+    if (!paths.isEmpty()) cmdWatcher.addPaths(paths);
 }
 
-void MainWindow::GpioSet(eTypeGPIO_IO_PORT eGpio)
+/*
+ * 清單檔被修改: 只重新解析變更的檔案, 已載入的 combo / ListView 就地更新 (保留選擇),
+ * 執行中的 READ SET 於 cycle 之間換成新命令, 不停止擷取.
+ */
+void MainWindow::reloadCmdLists()
 {
-    BYTE value;         // 1=High, 0 = Low
-    BYTE mask;
-
-    if (!deviceConnected) return;
+    watchCmdLists();
+    if (!cmdLibrary.isLoaded()) return;         // 尚未按過任何 Load, 之後按 Load 時才載入
+
+    const int generation = cmdLibrary.generation();
+    if (!loadCmdLibrary() || cmdLibrary.generation() == generation) return;
+
+    const quint32 changed = cmdLibrary.changedFiles();
+    int rows = 0;
+
+    // 尚未按 Load 的 combo 維持空白; 選擇的命令內容變更時同步更新輸入欄
+    auto syncHex = [&](QComboBox *combo, int file, const std::function<void(const QString &)> &show) {
+        if (!(changed & (1u << file)) || combo->count() == 0) return;
+        const QString before = combo->currentData().toString();
+        rows += syncCmdCombo(combo, cmdLibrary, file);
+        const QString hex = combo->currentData().toString();
+        if (hex != before && !hex.isEmpty()) show(hex);
+    };
+    syncHex(ui->comboReadCmdList, CMD_FILE_READ_ONE, [this](const QString &hex) { ui->lineReadCmd->setText(hex); });
+    syncHex(ui->comboWriteCmdList, CMD_FILE_WRITE_CMD, [this](const QString &hex) { ui->lineWriteCmd->setText(hex); });
+    syncHex(ui->comboWriteDataList, CMD_FILE_WRITE_DATA, [this](const QString &hex) { ui->textWriteData->setPlainText(hex); });
+
+    const quint32 setFiles = (1u << CMD_FILE_READ_SET) | (1u << CMD_FILE_READ_LIST);
+    if ((changed & setFiles) && ui->comboReadCmdSet->count() > 0) {
+        QStringList labels;
+        QVariantList ids;
+        for (const auto &set : cmdLibrary.sets()) {
+            labels << set.second;
+            ids    << set.first;
+        }
+        rows += syncCombo(ui->comboReadCmdSet, labels, ids);
+        const int index = ui->comboReadCmdSet->currentIndex();
+        rows += showReadSetCmds(index >= 0 ? ui->comboReadCmdSet->itemData(index).toInt() : -1);
+    }
 
-    value = 0;
-    value |=(1<<eGpio);
-    mask = (~value);
+    // 執行中的 READ SET: worker 在下一個 cycle 開始前換成新命令
+    if (acquisitionRunning && runningSetId >= 0 && (changed & (1u << CMD_FILE_READ_LIST)))
+        devices.updateReadSet(runningSetId, readSetCmds(runningSetId));
 
-    Usb2UisInterface::USBIO_GPIOWrite(deviceIndex, value, mask);
+    QStringList files;
+    for (int f = 0; f < CMD_FILE_COUNT; ++f)
+        if (changed & (1u << f)) files << CmdLibrary::fileName(f);
+    ui->statusbar->showMessage(QString("Command lists reloaded: %1 (%2 rows changed)").arg(files.join(", ")).arg(rows));
 }
 
-void MainWindow::SpiDirectionHighLow(bool bDirNorth, bool bHigh){
-    if(bDirNorth == true)
-    {
-        GpioSet(USB2UIS_GPIO_IO1);
-        Usb2UisInterface::USBIO_SetCE(deviceIndex, bHigh);
-    }
-    else
-    {
-        Usb2UisInterface::USBIO_SetCE(deviceIndex, true);
-        if(bHigh == true)
-        {
-            GpioSet(USB2UIS_GPIO_IO1);
-        }
-        else
-        {
-            GpioClear(USB2UIS_GPIO_IO1);
-        }
-    }
+/* READ_LIST 中某個 SET 的命令 bytes (清單載入時已解析) */
+QList<QByteArray> MainWindow::readSetCmds(int setId) const
+{
+    QList<QByteArray> cmds;
+    int first = 0, count = 0;
+    cmdLibrary.setRange(setId, &first, &count);
+    for (int i = first; i < first + count; ++i)
+        cmds << cmdLibrary.bytes(cmdLibrary.entry(CMD_FILE_READ_LIST, i));
+    return cmds;
 }
 
-void MainWindow::GpioClear(eTypeGPIO_IO_PORT eGpio)
+/* ListView 就地更新成 SET 的命令 (目前列由 model 維持), 回傳變更的列數 */
+int MainWindow::showReadSetCmds(int setId)
 {
-    BYTE value;         // 1=High, 0 = Low
-    BYTE mask;
-
-    if (!deviceConnected) return;
-
-    value = 0;
-    value |=(1<<eGpio);
-    mask = (~value);
+    QStringList cmdList;
+    int first = 0, count = 0;
+    if (setId >= 0) cmdLibrary.setRange(setId, &first, &count);
+    for (int i = first; i < first + count; ++i)
+        cmdList << cmdLibrary.hexText(cmdLibrary.entry(CMD_FILE_READ_LIST, i));
+
+    if (!cmdListModel) {
+        cmdListModel = new QStringListModel(this);
+        ui->listViewReadCmds->setModel(cmdListModel);
+    }
 
-    Usb2UisInterface::USBIO_GPIOWrite(deviceIndex, ~value, mask);
+    const ListEdit d = diffLists(cmdListModel->stringList(), cmdList);
+    const int common = qMin(d.removed, d.inserted);
+    for (int i = d.first; i < d.first + common; ++i)
+        cmdListModel->setData(cmdListModel->index(i), cmdList[i]);
+    if (d.removed > common)
+        cmdListModel->removeRows(d.first + common, d.removed - common);
+    if (d.inserted > common) {
+        cmdListModel->insertRows(d.first + common, d.inserted - common);
+        for (int i = d.first + common; i < d.first + d.inserted; ++i)
+            cmdListModel->setData(cmdListModel->index(i), cmdList[i]);
+    }
+    return qMax(d.removed, d.inserted);
 }
 
-
 MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent)
     , ui(new Ui::MainWindow)
@@ -160,19 +265,29 @@ MainWindow::MainWindow(QWidget *parent)
     ui->setupUi(this);
 
     setWindowTitle(USB2UIS_APP_NAME_STR + " " + USB2UIS_APP_VERSION_STR);
+    if (Usb2UisInterface::backend() && Usb2UisInterface::backend()->name() != "dll")
+        setWindowTitle(windowTitle() + " [" + Usb2UisInterface::backend()->name() + "]");
 
-    // 初始化DLL
-    if (!Usb2UisInterface::init()) {
+    // 初始化DLL (已指定其他後端時略過)
+    if (!Usb2UisInterface::backend() && !Usb2UisInterface::init()) {
         QMessageBox::critical(this, "錯誤", "無法載入 usb2uis.dll");
     }
 
     // 初始化界面元件
     ui->comboSpiSpeed->addItems({"200KHz", "400KHz", "600KHz", "800KHz", "1MHz", "2MHz", "4MHz", "6MHz", "12MHz"});
     ui->comboSpiMode->addItems({"Mode0 (00)", "Mode1 (01)", "Mode2 (10)", "Mode3 (11)"});
+    ui->comboRatePolicy->addItem("Overrun: skip slots", CYCLE_POLICY_SKIP);         // 順序無關, 以 itemData 為準
+    ui->comboRatePolicy->addItem("Overrun: catch up", CYCLE_POLICY_CATCH_UP);
 
     // 預設 timeout 值
     ui->lineReadTimeout->setText("100");
     ui->lineWriteTimeout->setText("100");
+    ui->lineGpioDir->setText("0x00");     // IO1(PIN J7-10) 為 South CS, 需為 output
+    ui->lineChainLength->setText("1");
+    ui->lineChainLength->setValidator(new QIntValidator(1, 256, this));
+    ui->lineChunkBytes->setText("0");
+    ui->lineChunkBytes->setValidator(new QIntValidator(0, 65535, this));
+    updateDeviceCombo();
     ui->lineSpiDelayMs->setText("0");     //Base delay time= 56us + Set(ms)
 
     // 預設顯示第1個分頁（索引從0開始）
@@ -183,6 +298,11 @@ MainWindow::MainWindow(QWidget *parent)
     ui->lineReadCmd->setText("0x00 0x02 0x2B 0x0A");
     ui->lineWriteCmd->setText("0x00 0x01 0x3D 0x6E");
     ui->lineReadBytes->setText("8");
+    ui->lineReadBytes->setEnabled(!ui->chkAutoReadSize->isChecked());
+    connect(ui->chkAutoReadSize, &QCheckBox::toggled, this, [this](bool on) {
+        ui->lineReadBytes->setEnabled(!on);
+        if (on) ui->lineReadBytes->setText(QString::number(adbmsChainBytes(ui->lineChainLength->text().toInt())));
+    });
     ui->textWriteData->setPlainText("0x81 0x00 0x00 0xFF 0x03 0x00 0x02 0x8E");
     //--------------------------------------
 
@@ -214,43 +334,203 @@ MainWindow::MainWindow(QWidget *parent)
     connect(ui->comboWriteDataList, &QComboBox::currentTextChanged,
             this, &MainWindow::onWriteDataChosen);
 
+    // 序列腳本: 執行檔目錄的 *.seq, 選擇時編譯並顯示結果
+    loadSeqScripts(false);
+    connect(ui->comboSeqScript, QOverload<int>::of(&QComboBox::currentIndexChanged), this, [this]() {
+        compileSeqScript();
+    });
+
     connect(ui->btnLoadReadCmdSet, &QPushButton::clicked, this, &MainWindow::on_btnLoadReadCmdSet_clicked);
     connect(ui->comboReadCmdSet, QOverload<int>::of(&QComboBox::currentIndexChanged), this, &MainWindow::on_comboReadCmdSet_currentIndexChanged);
 
+    // 清單檔被編輯時自動重新載入
+    cmdReloadTimer.setSingleShot(true);
+    cmdReloadTimer.setInterval(USB2UIS_CMD_RELOAD_DEBOUNCE_MS);
+    connect(&cmdReloadTimer, &QTimer::timeout, this, &MainWindow::reloadCmdLists);
+    connect(&cmdWatcher, &QFileSystemWatcher::fileChanged, &cmdReloadTimer, QOverload<>::of(&QTimer::start));
+    connect(&cmdWatcher, &QFileSystemWatcher::directoryChanged, &cmdReloadTimer, QOverload<>::of(&QTimer::start));
+    watchCmdLists();
+
+    // 結果 Log: 只格式化畫面上看得到的列, 最多 20 次/秒更新
+    logModel = new SpiLogModel(&logSink, this);
+    ui->listSpiResult->setModel(logModel);
+    ui->listSpiResult->setUniformItemSizes(true);
+    connect(logModel, &QAbstractItemModel::rowsAboutToBeInserted, this, [this]() {
+        QScrollBar *bar = ui->listSpiResult->verticalScrollBar();
+        logFollowTail = (bar->value() >= bar->maximum());
+    });
+    connect(logModel, &QAbstractItemModel::rowsInserted, this, [this]() {
+        if (logFollowTail) ui->listSpiResult->scrollToBottom();
+    });
+
+    // AFE 解碼表: 最多 5 次/秒更新
+    connect(&afeTimer, &QTimer::timeout, this, &MainWindow::refreshAfeTable);
+    connect(&afeTimer, &QTimer::timeout, this, &MainWindow::refreshReadSetStep);
+    afeTimer.start(200);
+
+    setupPlotTab();
+    setupStatsTab();
+
+    // 各 phase 耗時 p50/p99/max (us): 狀態列右側常駐, 每 0.5 秒更新
+    labelPhaseStats = new QLabel(this);
+    ui->statusbar->addPermanentWidget(labelPhaseStats);
+    labelCycleStats = new QLabel(this);
+    ui->statusbar->addPermanentWidget(labelCycleStats);
+    connect(&phaseStatsTimer, &QTimer::timeout, this, [this]() {
+        labelPhaseStats->setText(SpiTrace::statusText());
+        labelCycleStats->setText(cycleStatsText());
+    });
+    phaseStatsTimer.start(500);
+
+    // 擷取檔: 勾選時在執行檔目錄建立新檔, 取消時關閉
+    connect(ui->chkCapture, &QCheckBox::toggled, this, &MainWindow::onCaptureToggled);
+
     //預設為北向
     ui->rdoNorth->setChecked(true);
     bDirNorth = true;
+
+    // SPI 讀寫序列在各裝置的 AcquisitionWorker 執行緒執行, UI 只接收 queued signal
+    devices.setLogSink(&logSink);
+    devices.setCaptureWriter(&capture);
+
+    connect(&devices, &DeviceManager::configApplied,       this, &MainWindow::onConfigApplied);
+    connect(&devices, &DeviceManager::acquisitionStarted,  this, &MainWindow::onAcquisitionStarted);
+    connect(&devices, &DeviceManager::acquisitionFinished, this, &MainWindow::onAcquisitionFinished);
+    connect(&devices, &DeviceManager::acquisitionError,    this, &MainWindow::onAcquisitionError);
+    connect(&devices, &DeviceManager::planStats,           this, &MainWindow::onPlanStats);
+    connect(&devices, &DeviceManager::mergedSample,        this, &MainWindow::onAfeSample);
+    connect(&devices, &DeviceManager::rateTuneStep,        this, &MainWindow::onRateTuneStep);
+    connect(&devices, &DeviceManager::rateTuneFinished,    this, &MainWindow::onRateTuneFinished);
+    connect(ui->comboDevice, QOverload<int>::of(&QComboBox::currentIndexChanged), this, &MainWindow::onDeviceChosen);
+
+    // 取消勾選 Repeat → 立即停止
+    connect(ui->chkReadRepeatEnable, &QCheckBox::toggled, this, [this](bool checked) {
+        if (!checked && acquisitionRunning) devices.cancel();
+    });
+    connect(ui->chkWriteRepeatEnable, &QCheckBox::toggled, this, [this](bool checked) {
+        if (!checked && acquisitionRunning) devices.cancel();
+    });
+
+    ui->btnSpiStop->setEnabled(false);
+    ui->btnSpiPause->setEnabled(false);
 }
 
 MainWindow::~MainWindow()
 {
-    if (deviceConnected)
-        Usb2UisInterface::USBIO_CloseDevice(deviceIndex);
+    devices.closeAll();
+
+    ui->listSpiResult->setModel(nullptr);
+    delete logModel;
+    capture.close();
 
     delete ui;
 }
 
 void MainWindow::on_btnConnect_clicked()
 {
+    if (acquisitionRunning) return;
+
     if (!deviceConnected) {
-        deviceIndex = Usb2UisInterface::USBIO_OpenDevice();
-        if (deviceIndex == 0xFF) {
+        // 開啟所有連接的 USB2UIS
+        if (devices.openAll() == 0) {
             QMessageBox::warning(this, "錯誤", "無法連接USB裝置");
             return;
         }
         deviceConnected = true;
         ui->btnConnect->setText("Disconnect");
     } else {
-        Usb2UisInterface::USBIO_CloseDevice(deviceIndex);
+        devices.closeAll();
         deviceConnected = false;
-        deviceIndex = 0xFF;
         ui->btnConnect->setText("Connect");
     }
+    updateDeviceCombo();
+    logModel->setShowAdapter(devices.count() > 1);
+    afeLatest.clear();
+}
+
+/* "All" + 每台一項, itemData 為 slot */
+void MainWindow::updateDeviceCombo()
+{
+    QSignalBlocker block(ui->comboDevice);
+    ui->comboDevice->clear();
+    if (devices.count() != 1) ui->comboDevice->addItem("All devices", DEVICE_ALL);
+    for (int slot = 0; slot < devices.count(); ++slot)
+        ui->comboDevice->addItem(QString("USB %1").arg(int(devices.deviceIndex(slot))), slot);
+    ui->comboDevice->setCurrentIndex(0);
+    onDeviceChosen(0);
+}
+
+int MainWindow::targetSlot() const
+{
+    const QVariant v = ui->comboDevice->currentData();
+    return v.isValid() ? v.toInt() : DEVICE_ALL;
+}
+
+/* 顯示所選裝置目前的設定 (All 時顯示第一台) */
+void MainWindow::onDeviceChosen(int index)
+{
+    Q_UNUSED(index);
+    if (devices.count() == 0) return;
+    const DeviceConfig &cfg = devices.config(qMax(0, targetSlot()));
+
+    ui->comboSpiSpeed->setCurrentIndex(cfg.spiConfig & 0x0F);
+    ui->comboSpiMode->setCurrentIndex((cfg.spiConfig >> 4) & 0x03);
+    ui->lineReadTimeout->setText(QString::number(cfg.timeout & 0xFFFF));
+    ui->lineWriteTimeout->setText(QString::number(cfg.timeout >> 16));
+    ui->lineGpioDir->setText("0x" + QString("%1").arg(cfg.gpioDir, 2, 16, QChar('0')).toUpper());
+    ui->lineChainLength->setText(QString::number(cfg.chainLength));
+    ui->lineChunkBytes->setText(QString::number(cfg.chunkBytes));
+    ui->lineRetryCount->setText(QString::number(cfg.retry.maxRetries));
+    ui->lineRetryBudgetUs->setText(QString::number(cfg.retry.budgetUs));
+    ui->chkFailover->setChecked(cfg.retry.failover);
+    if (ui->chkAutoReadSize->isChecked()) ui->lineReadBytes->setText(QString::number(adbmsChainBytes(cfg.chainLength)));
+
+    // 此 adapter + chain 設定之前 Auto Tune 的結果
+    QSettings settings(QDir(QCoreApplication::applicationDirPath()).filePath(SPI_RATE_TUNE_SETTINGS), QSettings::IniFormat);
+    QDateTime tuned;
+    const int rate = SpiRateTuner::load(settings, rateTuneKey(qMax(0, targetSlot())), &tuned);
+    ui->labelAutoTune->setText(rate < 0 ? QString()
+                               : QString("Tuned: %1 (%2)").arg(ui->comboSpiSpeed->itemText(rate))
+                                 .arg(tuned.toString("yyyy-MM-dd hh:mm")));
+}
+
+QString MainWindow::rateTuneKey(int slot) const
+{
+    const DeviceConfig &cfg = devices.config(slot);
+    const QString adapter = QString("%1-%2").arg(Usb2UisInterface::backend() ? Usb2UisInterface::backend()->name() : "dll")
+                                            .arg(int(devices.deviceIndex(slot)));
+    return SpiRateTuner::settingsKey(adapter, cfg.chainLength, BYTE((cfg.spiConfig >> 4) & 0x03), bDirNorth);
+}
+
+/* 以選擇的 READ SET 掃描 SPI speed; 各裝置使用目前套用的 mode/timeout/chain 長度 */
+void MainWindow::on_btnAutoTune_clicked()
+{
+    if (!deviceConnected || acquisitionRunning) return;
+
+    const int setIndex = ui->comboReadCmdSet->currentIndex();
+    if (setIndex < 0) {
+        QMessageBox::warning(this, "錯誤", "請先選擇 SPI READ CMD SET");
+        return;
+    }
+
+    SpiRateTuneParams p;
+    p.setId = quint16(ui->comboReadCmdSet->itemData(setIndex).toInt());
+    p.cmds  = readSetCmds(p.setId);
+    if (p.cmds.isEmpty()) return;
+
+    p.plan.dummyCount   = ui->lineDummyCount->text().toInt();
+    p.plan.cmdDelayMs   = ui->lineSpiDelayMs->text().toInt();
+    p.plan.dirNorth     = bDirNorth;
+    p.plan.adcPoll      = ui->chkAdcPoll->isChecked();
+    p.plan.adcTimeoutUs = ui->lineAdcTimeoutUs->text().toInt();
+
+    ui->labelAutoTune->setText("Auto tune running...");
+    devices.runRateTune(targetSlot(), p);
 }
 
 void MainWindow::on_btnApplyConfig_clicked()
 {
-    if (!deviceConnected) return;
+    if (!deviceConnected || acquisitionRunning) return;
 
     int speedIndex = ui->comboSpiSpeed->currentIndex();     // bit3~0
     int modeIndex = ui->comboSpiMode->currentIndex();       // bit5~4
@@ -259,121 +539,104 @@ void MainWindow::on_btnApplyConfig_clicked()
     DWORD timeout = (ui->lineWriteTimeout->text().toUShort() << 16) |
             ui->lineReadTimeout->text().toUShort();
 
+    bool ok = false;
+    const uint dir = ui->lineGpioDir->text().trimmed().toUInt(&ok, 0);
+    if (!ok || dir > 0xFF) {
+        QMessageBox::warning(this, "錯誤", "GPIO Dir 請輸入 0x00 ~ 0xFF");
+        return;
+    }
+
+    const int chain = ui->lineChainLength->text().toInt();
+    if (chain < 1 || chain > 256) {
+        QMessageBox::warning(this, "錯誤", "AFE chain length 請輸入 1 ~ 256");
+        return;
+    }
 
-    BYTE dir = 0b00000000;     // IO1(PIN J7-10)   bit1/0 = 0(output), 其餘1(input)
-    if(!Usb2UisInterface::USBIO_SetGPIOConfig(deviceIndex, dir)){
-        QMessageBox::warning(this, "GPIO", "GPIO 設定Fail");
+    const int retries = ui->lineRetryCount->text().toInt(&ok);
+    if (!ok || retries < 0 || retries > 10) {
+        QMessageBox::warning(this, "錯誤", "Retries 請輸入 0 ~ 10");
+        return;
     }
 
-    //Gpio set High
-    GpioSet(USB2UIS_GPIO_IO1);
-    GpioSet(USB2UIS_GPIO_IO2);
+    DeviceConfig cfg;
+    cfg.spiConfig = configByte;
+    cfg.timeout   = timeout;
+    cfg.gpioDir   = BYTE(dir);
+    cfg.chainLength = chain;
+    cfg.chunkBytes  = ui->lineChunkBytes->text().toInt();
+    cfg.retry.maxRetries = retries;
+    cfg.retry.budgetUs   = qMax(ui->lineRetryBudgetUs->text().toInt(), 0);
+    cfg.retry.failover   = ui->chkFailover->isChecked();
+    if (ui->chkAutoReadSize->isChecked()) ui->lineReadBytes->setText(QString::number(adbmsChainBytes(chain)));
+
+    const int slot = targetSlot();
+    configPending = (slot == DEVICE_ALL) ? devices.count() : 1;
+    configFailures.clear();
+    devices.applyConfig(slot, cfg);
+}
+
+/* 所有目標裝置都回報後只顯示一次結果 */
+void MainWindow::onConfigApplied(int slot, bool gpioOk, bool spiOk)
+{
+    const QString name = QString("USB %1").arg(int(devices.deviceIndex(slot)));
+    if (!gpioOk) configFailures << name + ": GPIO 設定Fail";
+    if (!spiOk)  configFailures << name + ": Device 設定失敗";
+
+    if (configPending <= 0 || --configPending > 0) return;
 
-    if (!Usb2UisInterface::USBIO_SPISetConfig(deviceIndex, configByte, timeout)) {
-        QMessageBox::warning(this, "錯誤", "Device 設定失敗");
+    if (!configFailures.isEmpty()) {
+        QMessageBox::warning(this, "錯誤", configFailures.join("\n"));
     } else {
         QMessageBox::information(this, "成功", "Device 設定成功");
     }
-
 }
 
 void MainWindow::on_btnSpiRead_clicked()
 {
     if (!deviceConnected) return;
 
-    QByteArray cmd, recvBuffer;
-    WORD readSize = ui->lineReadBytes->text().toUShort();
-
-    if (!parseHexString(ui->lineReadCmd->text(), cmd) || cmd.size() != 4) {
+    SpiReadParams p;
+    if (!parseHexString(ui->lineReadCmd->text(), p.cmd) || p.cmd.size() != 4) {
         QMessageBox::warning(this, "錯誤", "請輸入有效4Bytes的HEX指令");
         return;
     }
 
-    int delayMs = ui->lineSpiDelayMs->text().toInt();
-    int dummyCount = ui->lineDummyCount->text().toInt();      // 預先 Dummy 0xFF 個數
+    p.readSize       = ui->chkAutoReadSize->isChecked() ? 0 : ui->lineReadBytes->text().toUShort();     // 0: 依 chain 長度
+    p.delayMs        = ui->lineSpiDelayMs->text().toInt();
+    p.dummyCount     = ui->lineDummyCount->text().toInt();      // 預先 Dummy 0xFF 個數
+    p.dirNorth       = bDirNorth;
+    p.adcPoll        = ui->chkAdcPoll->isChecked();
+    p.adcTimeoutUs   = ui->lineAdcTimeoutUs->text().toInt();
+
+    // 擷取中: 單次讀取排入 submit queue, 在 cycle 之間執行, 不中斷目前的擷取
+    if (acquisitionRunning) {
+        if (devices.submitReadOne(targetSlot(), p) == 0)
+            ui->statusbar->showMessage("Read One: submit queue full");
+        return;
+    }
 
     // 重複次數與間隔
-    bool      repeatEnable   = ui->chkReadRepeatEnable->isChecked();
-    int32_t   repeatCount    = ui->lineReadRepeatCount->text().toInt();
-    int32_t   repeatInterval = ui->lineReadRepeatInterval->text().toInt();
-
-    int32_t iteration = 0;
+    p.repeatEnable   = ui->chkReadRepeatEnable->isChecked();
+    p.repeatCount    = ui->lineReadRepeatCount->text().toInt();
+    p.repeatInterval = ui->lineReadRepeatInterval->text().toInt();
+    p.ratePeriodNs   = fixedRatePeriodNs();
+    p.ratePolicy     = BYTE(ui->comboRatePolicy->currentData().toInt());
 
-    while (true)
-    {
-
-        // Step 1: 傳送 Dummy 0xFF
-        //------------------------------------------------------------------------------------
-        // ✅ 拉 LOW: 啟動傳輸階段
-        SpiDirectionHighLow(bDirNorth, false); //Low
-
-        if (dummyCount > 0) {
-            QByteArray dummy(dummyCount, char(0xFF));
-            if (!Usb2UisInterface::USBIO_SPIWrite(deviceIndex, nullptr, 0, (BYTE*)dummy.data(), dummy.size()))
-            {
-                QMessageBox::warning(this, "錯誤", "Dummy Bytes 傳送失敗");
-                SpiDirectionHighLow(bDirNorth, true); //High
-                return;
-            }
-        }
-
-        delayBlockingUs(500);
-        SpiDirectionHighLow(bDirNorth, true); //High
-        delayBlockingMs(1);            //Refer AFE Spec.
-        //+-----------------------------------------------------------------------------------
-
-
-        // Step 2: 傳送命令後延遲
-        //------------------------------------------------------------------------------------
-        // ✅ 拉 LOW: 啟動傳輸階段
-        SpiDirectionHighLow(bDirNorth, false); //Low
-
-        QByteArray dummyBuffer;
-        Usb2UisInterface::USBIO_SPIWrite(deviceIndex,(BYTE*)cmd.data(), cmd.size(), nullptr, 0);
-
-        // 延遲（保持 CS LOW）
-        if (delayMs > 0)
-        {
-            // 阻塞延遲
-            delayBlockingMs(delayMs);
-        }
-
-        recvBuffer.resize(readSize);
-        if (!Usb2UisInterface::USBIO_SPIRead(deviceIndex,
-                                             nullptr, 0, (BYTE*)recvBuffer.data(), readSize)) {
-            QMessageBox::warning(this, "錯誤", "SPI讀取失敗");
-            SpiDirectionHighLow(bDirNorth, true); //High
-            return;
-        }
-        //------------------------------------------------------------------------------------
-
-        // ✅ 拉 HIGH: 結束傳輸階段
-        SpiDirectionHighLow(bDirNorth, true); //High
-
-        QString result;
-        for (BYTE b : recvBuffer)
-            result += QString("0x%1 ").arg(b, 2, 16, QChar('0')).toUpper();
-
-        result.replace("X","x");
-
-        QString timeStr = QTime::currentTime().toString("HH:mm:ss.zzz");
-        ui->textSpiReadResult->appendPlainText(QString("[%1] Read : %2").arg(timeStr, result.trimmed()));
-
-        iteration++;
-
-        if (!repeatEnable || (repeatCount > 0 && iteration >= repeatCount)) break;
+    devices.runSpiRead(targetSlot(), p);
+}
 
-        QCoreApplication::processEvents(); // allow checkbox to be unchecked during loop
-        if (!ui->chkReadRepeatEnable->isChecked()) break;
-        QThread::msleep(repeatInterval);
-    }
 
+/* Fixed rate 勾選時的週期 (ns), 否則 0 (沿用 repeat interval) */
+qint64 MainWindow::fixedRatePeriodNs() const
+{
+    if (!ui->chkFixedRate->isChecked()) return 0;
+    const double hz = ui->lineFixedRateHz->text().toDouble();
+    return hz > 0 ? qint64(1e9 / hz) : 0;
 }
 
-
 void MainWindow::on_btnSpiRead2_clicked()
 {
-    if (!deviceConnected) return;
+    if (!deviceConnected || acquisitionRunning) return;
 
     int setIndex = ui->comboReadCmdSet->currentIndex();
     if (setIndex < 0) {
@@ -382,332 +645,557 @@ void MainWindow::on_btnSpiRead2_clicked()
     }
 
     int setId = ui->comboReadCmdSet->itemData(setIndex).toInt();
-    QStringList cmdList;
 
-    for (const auto& pair : listSetCmdsOrdered) {
-        if (pair.first == setId)
-            cmdList << pair.second;
-    }
+    // 命令在載入清單時已解析成 bytes, 這裡只取 SET 的連續範圍
+    SpiReadSetParams p;
+    p.setId = quint16(setId);
+    p.cmds  = readSetCmds(setId);
 
-    if (cmdList.isEmpty()) return;
+    if (p.cmds.isEmpty()) return;
+    runningSetId = setId;
 
-    int repeatCount = ui->lineReadRepeatCount->text().toInt();
-    bool repeatEnable = ui->chkReadRepeatEnable->isChecked();
-    int repeatInterval = ui->lineReadRepeatInterval->text().toInt();
+    p.repeatCount    = ui->lineReadRepeatCount->text().toInt();
+    p.repeatEnable   = ui->chkReadRepeatEnable->isChecked();
+    p.repeatInterval = ui->lineReadRepeatInterval->text().toInt();
+    p.ratePeriodNs   = fixedRatePeriodNs();
+    p.ratePolicy     = BYTE(ui->comboRatePolicy->currentData().toInt());
 
-    int delayMs = ui->lineSpiDelayMs->text().toInt();
-    int dummyCount = ui->lineDummyCount->text().toInt();
-    int readSize = ui->lineReadBytes->text().toInt();
+    p.delayMs        = ui->lineSpiDelayMs->text().toInt();
+    p.dummyCount     = ui->lineDummyCount->text().toInt();
+    p.readSize       = ui->chkAutoReadSize->isChecked() ? 0 : ui->lineReadBytes->text().toUShort();     // 0: 依 chain 長度
+    p.dirNorth       = bDirNorth;
+    p.adcPoll        = ui->chkAdcPoll->isChecked();
+    p.adcTimeoutUs   = ui->lineAdcTimeoutUs->text().toInt();
 
-    int iteration = 0;
-    while (true) {
-        for (int i = 0; i < cmdList.size(); ++i) {
-            QString hex = cmdList[i];
-            QByteArray cmd;
-            if (!parseHexString(hex, cmd)) continue;
-
-            // ListView 指示目前執行第幾條
-            if (cmdListModel) {
-                QModelIndex index = cmdListModel->index(i);
-                ui->listViewReadCmds->setCurrentIndex(index);
-            }
+    devices.runSpiReadSet(targetSlot(), p);
+}
 
-            // Dummy
-            SpiDirectionHighLow(bDirNorth, false); //Low
-            if (dummyCount > 0) {
-                QByteArray dummy(dummyCount, char(0xFF));
-                Usb2UisInterface::USBIO_SPIWrite(deviceIndex, nullptr, 0, (BYTE*)dummy.data(), dummyCount);
-            }
 
-            delayBlockingUs(500);
-            SpiDirectionHighLow(bDirNorth, true); //High
-            delayBlockingUs(500);
+//SPI CMD+寫入
+void MainWindow::on_btnSpiWrite_clicked()
+{
+    if (!deviceConnected || acquisitionRunning) return;
 
-            // 指令傳送
-            SpiDirectionHighLow(bDirNorth, false); //Low
-            Usb2UisInterface::USBIO_SPIWrite(deviceIndex, (BYTE*)cmd.data(), cmd.size(), nullptr, 0);
-            if (delayMs > 0) delayBlockingMs(delayMs);
+    SpiWriteParams p;
+    if (!parseHexString(ui->lineWriteCmd->text(), p.cmd) || p.cmd.size() != 4) {
+        QMessageBox::warning(this, "錯誤", "請輸入有效4Bytes的HEX指令");
+        return;
+    }
 
-            QByteArray recv;
-            recv.resize(readSize);
-            Usb2UisInterface::USBIO_SPIRead(deviceIndex, nullptr, 0, (BYTE*)recv.data(), readSize);
-            SpiDirectionHighLow(bDirNorth, true); //High
+    if (!parseHexString(ui->textWriteData->toPlainText(), p.data)) {
+        QMessageBox::warning(this, "錯誤", "請輸入正確 HEX 格式資料");
+        return;
+    }
 
-            QString result;
-            for (BYTE b : recv)
-                result += QString("0x%1 ").arg(b, 2, 16, QChar('0')).toUpper();
+    p.delayMs        = ui->lineSpiDelayMs->text().toInt();
+    p.dummyCount     = ui->lineDummyCount_2->text().toInt();      // 預先 Dummy 0xFF 個數
+    p.dirNorth       = bDirNorth;
+    p.replicate      = ui->chkWriteReplicate->isChecked();
 
-            result.replace("X","x");
+    // 重複次數與間隔
+    p.repeatEnable   = ui->chkWriteRepeatEnable->isChecked();
+    p.repeatCount    = ui->lineWriteRepeatCount->text().toInt();
+    p.repeatInterval = ui->lineWriteRepeatInterval->text().toInt();
 
-            ui->textSpiReadResult->appendPlainText(QString("[%1] Read : %2")
-                                                   .arg(QTime::currentTime().toString("HH:mm:ss.zzz")).arg(result.trimmed()));
+    devices.runSpiWrite(targetSlot(), p);
+}
 
+/* 與 SPI_*.txt 同目錄的 *.seq; compile = false 時只列出檔案 (啟動時不載入清單) */
+void MainWindow::loadSeqScripts(bool compile)
+{
+    const QString current = ui->comboSeqScript->currentText();
+    const QStringList files = QDir(QCoreApplication::applicationDirPath())
+                              .entryList(QStringList() << "*.seq", QDir::Files, QDir::Name);
+    {
+        QSignalBlocker block(ui->comboSeqScript);
+        ui->comboSeqScript->clear();
+        ui->comboSeqScript->addItems(files);
+        ui->comboSeqScript->setCurrentIndex(qMax(files.indexOf(current), 0));
+    }
 
-            //QCoreApplication::processEvents();
-            //QThread::msleep(1);
-        }
+    if (compile) compileSeqScript();
+    else ui->labelSeqInfo->setText(QString("%1 script(s)").arg(files.size()));
+}
 
-        ++iteration;
-        if (!repeatEnable || (repeatCount > 0 && iteration >= repeatCount)) break;
-        QCoreApplication::processEvents();
-        if (!ui->chkReadRepeatEnable->isChecked()) break;
-        QThread::msleep(repeatInterval);
+/* 編譯目前選擇的腳本, 結果或錯誤 (含行號) 顯示在 labelSeqInfo */
+bool MainWindow::compileSeqScript()
+{
+    seqProgram = SeqProgram();
+    const QString name = ui->comboSeqScript->currentText();
+    if (name.isEmpty()) {
+        ui->labelSeqInfo->setText("No *.seq script next to the command lists");
+        return false;
+    }
+    if (!loadCmdLibrary()) {
+        ui->labelSeqInfo->setText("Cannot load command lists");
+        return false;
     }
 
+    QString err;
+    const QString path = QDir(QCoreApplication::applicationDirPath()).filePath(name);
+    if (!SeqCompiler::compileFile(path, cmdLibrary, seqProgram, &err)) {
+        ui->labelSeqInfo->setText(name + ": " + err);
+        return false;
+    }
+    ui->labelSeqInfo->setText(QString("%1: %2 steps, %3 instructions")
+                              .arg(name).arg(seqProgram.steps.size()).arg(seqProgram.code.size()));
+    return true;
 }
 
-
-//SPI CMD+寫入
-void MainWindow::on_btnSpiWrite_clicked()
+void MainWindow::on_btnLoadSeq_clicked()
 {
-    if (!deviceConnected) return;
+    loadSeqScripts(true);
+}
 
-    QByteArray cmd, data;
-    if (!parseHexString(ui->lineWriteCmd->text(), cmd) || cmd.size() != 4) {
-        QMessageBox::warning(this, "錯誤", "請輸入有效4Bytes的HEX指令");
-        return;
-    }
+/* 腳本每次執行前重新編譯 (編輯後直接生效); Dummy/方向/ADC poll/Repeat 沿用 READ 的設定 */
+void MainWindow::on_btnRunSeq_clicked()
+{
+    if (!deviceConnected || acquisitionRunning) return;
 
-    if (!parseHexString(ui->textWriteData->toPlainText(), data)) {
-        QMessageBox::warning(this, "錯誤", "請輸入正確 HEX 格式資料");
+    if (!compileSeqScript()) {
+        QMessageBox::warning(this, "錯誤", ui->labelSeqInfo->text());
         return;
     }
 
-    int delayMs = ui->lineSpiDelayMs->text().toInt();
-    int dummyCount = ui->lineDummyCount_2->text().toInt();      // 預先 Dummy 0xFF 個數
-
-    // 重複次數與間隔
-    bool     repeatEnable   = ui->chkWriteRepeatEnable->isChecked();
-    int32_t  repeatCount    = ui->lineWriteRepeatCount->text().toInt();
-    int32_t  repeatInterval = ui->lineWriteRepeatInterval->text().toInt();
-
-    int32_t iteration = 0;
-    while (true) {
-
-        // Step 1: 傳送 Dummy 0xFF
-        //------------------------------------------------------------------------------------
-        // ✅ 拉 LOW: 啟動傳輸階段
-        SpiDirectionHighLow(bDirNorth, false); //Low
-
-        if (dummyCount > 0) {
-            QByteArray dummy(dummyCount, char(0xFF));
-            if (!Usb2UisInterface::USBIO_SPIWrite(deviceIndex, nullptr, 0, (BYTE*)dummy.data(), dummy.size()))
-            {
-                QMessageBox::warning(this, "錯誤", "Dummy Bytes 傳送失敗");
-                SpiDirectionHighLow(bDirNorth, true); //High
-                return;
-            }
-        }
+    SeqRunParams p;
+    p.program        = seqProgram;
+    p.dummyCount     = ui->lineDummyCount->text().toInt();
+    p.dirNorth       = bDirNorth;
+    p.adcPoll        = ui->chkAdcPoll->isChecked();
+    p.adcTimeoutUs   = ui->lineAdcTimeoutUs->text().toInt();
+    p.repeatEnable   = ui->chkReadRepeatEnable->isChecked();
+    p.repeatCount    = ui->lineReadRepeatCount->text().toInt();
+    p.repeatInterval = ui->lineReadRepeatInterval->text().toInt();
+
+    devices.runSequence(targetSlot(), p);
+}
 
-        delayBlockingUs(500);
-        SpiDirectionHighLow(bDirNorth, true); //High
-        delayBlockingUs(500);                //Refer AFE Spec.
-        //+-----------------------------------------------------------------------------------
+void MainWindow::on_btnSpiStop_clicked()
+{
+    devices.cancel();
+}
 
-        // Step 2: 傳送命令後延遲
-        //------------------------------------------------------------------------------------
-        // ✅ 拉 LOW: 啟動傳輸階段
-        SpiDirectionHighLow(bDirNorth, false); //Low
-        delayBlockingUs(500);
+void MainWindow::on_btnSpiPause_toggled(bool checked)
+{
+    devices.setPaused(checked);
+    ui->btnSpiPause->setText(checked ? "Resume" : "Pause");
+}
 
-        Usb2UisInterface::USBIO_SPIWrite(deviceIndex,
-                                         (BYTE*)cmd.data(), cmd.size(), nullptr, 0);
+void MainWindow::onAcquisitionStarted()
+{
+    PrecisionTimer::resetSiteStats();
+    SpiTrace::resetStats();
+    shadowSkippedAtStart = Usb2UisInterface::shadowStatsTotal().skipped();
+    lastAcquisitionError.clear();
+
+    acquisitionRunning = true;
+    ui->btnSpiRead2->setEnabled(false);
+    ui->btnSpiWrite->setEnabled(false);
+    ui->btnRunSeq->setEnabled(false);
+    ui->btnConnect->setEnabled(false);
+    ui->btnApplyConfig->setEnabled(false);
+    ui->btnAutoTune->setEnabled(false);
+    ui->comboDevice->setEnabled(false);
+    ui->btnSpiStop->setEnabled(true);
+    ui->btnSpiPause->setEnabled(true);
+}
 
+void MainWindow::onAcquisitionFinished(int iterations)
+{
+    acquisitionRunning = false;
+    runningSetId = -1;
+    ui->btnSpiRead2->setEnabled(true);
+    ui->btnSpiWrite->setEnabled(true);
+    ui->btnRunSeq->setEnabled(true);
+    ui->btnConnect->setEnabled(true);
+    ui->btnApplyConfig->setEnabled(true);
+    ui->btnAutoTune->setEnabled(true);
+    ui->comboDevice->setEnabled(true);
+    ui->btnSpiStop->setEnabled(false);
+    ui->btnSpiPause->setChecked(false);
+    ui->btnSpiPause->setEnabled(false);
+
+    // 各等待點 jitter (平均/最大)
+    QString msg = QString("Iterations: %1   USB calls/cycle: %2   GPIO/CE skipped: %3   Wait jitter: %4")
+                  .arg(iterations).arg(usbCallsPerCycle)
+                  .arg(Usb2UisInterface::shadowStatsTotal().skipped() - shadowSkippedAtStart)
+                  .arg(PrecisionTimer::siteStatsText());
+    for (int slot = 0; slot < devices.count(); ++slot) {
+        const SpiCmdErrorCounts e = devices.recoveryStats(slot)->total();
+        if (e.errors() == 0) continue;
+        msg += QString("   USB %1 errors: pec %2 usb %3, recovered %4, failed %5 (%6)").arg(int(devices.deviceIndex(slot)))
+               .arg(e.pecErrors).arg(e.transferErrors).arg(e.recovered).arg(e.failed)
+               .arg(devices.recoveryStats(slot)->text(3));
+    }
+    if (!lastAcquisitionError.isEmpty()) msg += "   Last error: " + lastAcquisitionError;
+    if (capture.isOpen()) {
+        const CaptureWriter::Stats st = capture.stats();
+        msg += QString("   Capture: %1 rec, %2 KB (raw %3 KB), dropped %4")
+               .arg(st.records).arg(st.fileBytes / 1024).arg(st.rawBytes / 1024).arg(st.dropped);
+    }
+    for (int slot = 0; slot < devices.count(); ++slot) {
+        const QList<CycleMiss> misses = devices.scheduler(slot)->recentMisses();
+        if (misses.isEmpty()) continue;
+        const CycleMiss &last = misses.last();
+        msg += QString("   USB %1 last miss: cycle %2 at %3 s (+%4 ms)").arg(int(devices.deviceIndex(slot)))
+               .arg(last.cycle).arg(last.timeNs / 1e9, 0, 'f', 3).arg(last.lateNs / 1e6, 0, 'f', 2);
+    }
+    ui->statusbar->showMessage(msg);
+}
 
-        delayBlockingUs(500);
+/* 各裝置的達成速率, cycle time p50/p99/max 與 deadline miss (只有固定速率時有 miss) */
+QString MainWindow::cycleStatsText() const
+{
+    QStringList parts;
+    for (int slot = 0; slot < devices.count(); ++slot) {
+        QString text = devices.scheduler(slot)->statsText();
+        const Usb2UisSubmitQueue::Stats q = devices.submitQueue(slot)->stats();
+        if (q.submitted)
+            text += QString(" queue %1/%2 wait p99 %3 us").arg(q.depth).arg(q.maxDepth).arg(q.wait.p99Ns / 1000);
+        const SpiCmdErrorCounts e = devices.recoveryStats(slot)->total();
+        if (e.errors())
+            text += QString(" retry %1 ok %2 fail %3").arg(e.retries).arg(e.recovered).arg(e.failed);
+        text = text.trimmed();
+        if (text.isEmpty()) continue;
+        parts << (devices.count() > 1 ? QString("U%1 ").arg(int(devices.deviceIndex(slot))) + text : text);
+    }
+    return parts.join("  |  ");
+}
 
-        // 延遲（保持 CS LOW）
-        if (delayMs > 0)
-        {
-            // 阻塞延遲
-            delayBlockingMs(delayMs);
-        }
+void MainWindow::onAcquisitionError(int slot, const QString &msg)
+{
+    QString text = msg;
+    if (devices.count() > 1) text = QString("USB %1: ").arg(int(devices.deviceIndex(slot))) + msg;
+    // 擷取繼續執行 (重試用完的命令另記在 log), 不以對話框中斷
+    lastAcquisitionError = text;
+    ui->statusbar->showMessage("錯誤: " + text, 5000);
+}
 
-        delayBlockingUs(500); //必須先阻塞時間， 傳送時序問題延遲500us以上
-        if (!Usb2UisInterface::USBIO_SPIWrite(deviceIndex,
-                                              nullptr, 0, (BYTE*)data.data(), data.size()))
-        {
-            QMessageBox::warning(this, "錯誤", "SPI資料寫入失敗");
-            SpiDirectionHighLow(bDirNorth, true); //High
-            return;
-        }
+void MainWindow::onPlanStats(int usbCalls, int planOps)
+{
+    Q_UNUSED(planOps);
+    usbCallsPerCycle = usbCalls;
+}
 
-        delayBlockingMs(2); //注意~~~MUST 必須先阻塞時間， 傳送時序問題延遲500us以上(寫入資料太多時，請加長時間)
+void MainWindow::onAfeSample(const AfeChainSample &sample)
+{
+    afeLatest[sample.adapter] = sample;
+    afeDirty = true;
+    plotStore.append(sample);
+    statsStore.append(sample);
+}
 
-        // ✅ 拉 HIGH: 結束傳輸階段
-        SpiDirectionHighLow(bDirNorth, true); //High
-        //------------------------------------------------------------------------------------
+void MainWindow::onRateTuneStep(int slot, const SpiRateTuneStep &step)
+{
+    ui->labelAutoTune->setText(QString("USB %1  %2").arg(int(devices.deviceIndex(slot))).arg(SpiRateTuner::stepText(step)));
+}
 
-        // 顯示寫入資料 HEX 字串到 textSpiReadResult
-        QString result;
-        for (BYTE b : data)
-            result += QString("0x%1 ").arg(b, 2, 16, QChar('0')).toUpper();
+/* 結果存在執行檔目錄的 ini (每個 adapter + chain 設定一筆), 裝置已停在選定的 speed */
+void MainWindow::onRateTuneFinished(int slot, const SpiRateTuneResult &result)
+{
+    QSettings settings(QDir(QCoreApplication::applicationDirPath()).filePath(SPI_RATE_TUNE_SETTINGS), QSettings::IniFormat);
+    SpiRateTuner::save(settings, rateTuneKey(slot), result);
+
+    QStringList lines;
+    for (const SpiRateTuneStep &step : result.steps) lines << SpiRateTuner::stepText(step);
+    const QString name = QString("USB %1").arg(int(devices.deviceIndex(slot)));
+    ui->labelAutoTune->setText(name + "  " + SpiRateTuner::summary(result));
+    ui->labelAutoTune->setToolTip(lines.join("\n"));
+
+    if (targetSlot() == slot || (targetSlot() == DEVICE_ALL && slot == 0)) {
+        QSignalBlocker block(ui->comboSpiSpeed);
+        ui->comboSpiSpeed->setCurrentIndex(devices.config(slot).spiConfig & 0x0F);
+    }
+}
 
-        result.replace("X","x");
+/* Cell Plot 分頁: 樣本累積在 plotStore, 畫面最多 20 次/秒重繪 (只在可見且有新資料時) */
+void MainWindow::setupPlotTab()
+{
+    QWidget *page = new QWidget(ui->tabWidget);
+    comboPlotTrack = new QComboBox(page);
+    comboPlotTrack->addItem("All AFEs", -1);
+    comboPlotTrack->setMinimumWidth(140);
+    QPushButton *btnClear = new QPushButton("Clear", page);
+    QLabel *labelMemory = new QLabel(QString("Memory: %1 MB per AFE (max %2 AFEs)")
+                                     .arg(CellPlotStore::trackBytes() / 1048576.0, 0, 'f', 1)
+                                     .arg(CELL_PLOT_MAX_TRACKS), page);
+    plotWidget = new CellPlotWidget(&plotStore, page);
+
+    QHBoxLayout *bar = new QHBoxLayout;
+    bar->addWidget(new QLabel("AFE", page));
+    bar->addWidget(comboPlotTrack);
+    bar->addWidget(btnClear);
+    bar->addWidget(labelMemory);
+    bar->addStretch();
+    QVBoxLayout *layout = new QVBoxLayout(page);
+    layout->addLayout(bar);
+    layout->addWidget(plotWidget, 1);
+    ui->tabWidget->addTab(page, "Cell Plot");
+
+    connect(comboPlotTrack, QOverload<int>::of(&QComboBox::currentIndexChanged), this, [this](int) {
+        plotWidget->setTrack(comboPlotTrack->currentData().toInt());
+    });
+    connect(btnClear, &QPushButton::clicked, this, [this]() {
+        plotStore.clear();
+        updatePlotTracks();
+        plotWidget->update();
+    });
+    connect(&plotTimer, &QTimer::timeout, this, [this]() {
+        updatePlotTracks();
+        plotWidget->refresh();
+    });
+    plotTimer.start(50);
+}
 
-        QString timeStr = QTime::currentTime().toString("HH:mm:ss.zzz");
-        ui->textSpiReadResult->appendPlainText(QString("[%1] Wrote: %2").arg(timeStr, result.trimmed()));
+/* 有新的 AFE 出現 (或清除後) 才重建選單 */
+void MainWindow::updatePlotTracks()
+{
+    if (comboPlotTrack->count() - 1 == plotStore.trackCount()) return;
+
+    const QSignalBlocker block(comboPlotTrack);
+    const int current = comboPlotTrack->currentData().toInt();
+    comboPlotTrack->clear();
+    comboPlotTrack->addItem("All AFEs", -1);
+    for (int i = 0; i < plotStore.trackCount(); ++i)
+        comboPlotTrack->addItem(plotStore.trackName(i), i);
+    comboPlotTrack->setCurrentIndex(qMax(comboPlotTrack->findData(current), 0));
+    plotWidget->setTrack(comboPlotTrack->currentData().toInt());
+}
 
-        iteration++;
+/* Cell Stats 分頁: 每個 AFE x cell 一列, 顯示選擇的視窗; 可見時每秒更新一次 */
+void MainWindow::setupStatsTab()
+{
+    QWidget *page = new QWidget(ui->tabWidget);
+    comboStatsWindow = new QComboBox(page);
+    comboStatsWindow->addItem("Last minute", qlonglong(CELL_STATS_MINUTE_NS));
+    comboStatsWindow->addItem("Last hour",   qlonglong(CELL_STATS_HOUR_NS));
+    comboStatsWindow->addItem("Last day",    qlonglong(CELL_STATS_DAY_NS));
+    QPushButton *btnExport = new QPushButton("Export CSV", page);
+    QPushButton *btnClear = new QPushButton("Clear", page);
+    QLabel *labelMemory = new QLabel(QString("Memory: %1 KB per AFE (max %2 AFEs)")
+                                     .arg(CellStatsStore::trackBytes() / 1024)
+                                     .arg(CELL_STATS_MAX_TRACKS), page);
+
+    tableStats = new QTableWidget(0, 8, page);
+    tableStats->setHorizontalHeaderLabels({"AFE", "Cell", "Samples", "Min (V)", "Max (V)", "Mean (V)", "Std (mV)", "Window (s)"});
+    tableStats->verticalHeader()->setVisible(false);
+    tableStats->setEditTriggers(QAbstractItemView::NoEditTriggers);
+
+    QHBoxLayout *bar = new QHBoxLayout;
+    bar->addWidget(new QLabel("Window", page));
+    bar->addWidget(comboStatsWindow);
+    bar->addWidget(btnExport);
+    bar->addWidget(btnClear);
+    bar->addWidget(labelMemory);
+    bar->addStretch();
+    QVBoxLayout *layout = new QVBoxLayout(page);
+    layout->addLayout(bar);
+    layout->addWidget(tableStats, 1);
+    ui->tabWidget->addTab(page, "Cell Stats");
+
+    connect(comboStatsWindow, QOverload<int>::of(&QComboBox::currentIndexChanged), this, [this](int) {
+        statsGeneration = 0;
+        refreshStatsTable();
+    });
+    connect(btnExport, &QPushButton::clicked, this, &MainWindow::exportStats);
+    connect(btnClear, &QPushButton::clicked, this, [this]() {
+        statsStore.clear();
+        statsGeneration = 0;
+        refreshStatsTable();
+    });
+    connect(&statsTimer, &QTimer::timeout, this, &MainWindow::refreshStatsTable);
+    statsTimer.start(1000);
+}
 
-        if (!repeatEnable || (repeatCount > 0 && iteration >= repeatCount)) break;
+void MainWindow::refreshStatsTable()
+{
+    if (!tableStats->isVisible()) return;
+    if (statsStore.generation() == statsGeneration) return;
+    statsGeneration = statsStore.generation();
+
+    const qint64 span = comboStatsWindow->currentData().toLongLong();
+    const int rows = statsStore.trackCount() * ADBMS6832_CELL_COUNT;
+    if (tableStats->rowCount() != rows) {
+        tableStats->setRowCount(rows);
+        for (int r = 0; r < rows; ++r) {
+            for (int c = 0; c < tableStats->columnCount(); ++c) tableStats->setItem(r, c, new QTableWidgetItem);
+            tableStats->item(r, 0)->setText(statsStore.trackName(r / ADBMS6832_CELL_COUNT));
+            tableStats->item(r, 1)->setText(QString::number(r % ADBMS6832_CELL_COUNT + 1));
+        }
+    }
 
-        QCoreApplication::processEvents();
-        if (!ui->chkWriteRepeatEnable->isChecked()) break;
-        QThread::msleep(repeatInterval);
+    for (int r = 0; r < rows; ++r) {
+        const CellStatsStore::Stats st = statsStore.recent(r / ADBMS6832_CELL_COUNT, r % ADBMS6832_CELL_COUNT, span);
+        const bool any = st.count > 0;
+        tableStats->item(r, 2)->setText(QString::number(st.count));
+        tableStats->item(r, 3)->setText(any ? QString::number(st.minUv / 1e6, 'f', 4) : "--");
+        tableStats->item(r, 4)->setText(any ? QString::number(st.maxUv / 1e6, 'f', 4) : "--");
+        tableStats->item(r, 5)->setText(any ? QString::number(st.meanUv / 1e6, 'f', 4) : "--");
+        tableStats->item(r, 6)->setText(any ? QString::number(st.stddevUv / 1e3, 'f', 3) : "--");
+        tableStats->item(r, 7)->setText(any ? QString::number((st.toNs - st.fromNs) / 1e9, 'f', 0) : "--");
     }
 }
 
-void MainWindow::on_btnClearResult_clicked()
+// 全部 AFE x cell 的最近 1 分鐘/1 小時/1 天, 存在執行檔目錄
+void MainWindow::exportStats()
 {
-    ui->textSpiReadResult->clear();
+    const QString path = QCoreApplication::applicationDirPath() + "/cell_stats_"
+                       + QDateTime::currentDateTime().toString("yyyyMMdd_HHmmss") + ".csv";
+    QString err;
+    if (!statsStore.writeCsv(path, {CELL_STATS_MINUTE_NS, CELL_STATS_HOUR_NS, CELL_STATS_DAY_NS}, &err)) {
+        QMessageBox::warning(this, "錯誤", err);
+        return;
+    }
+    ui->statusbar->showMessage(QString("Cell stats: %1 (%2 AFEs)").arg(path).arg(statsStore.trackCount()));
 }
 
-bool MainWindow::parseHexString(const QString& input, QByteArray& output)
+/* 列: Cell 1..16, AUX 1..15, PEC err, CC; 欄: 每台 USB2UIS 的 AFE 1..N 依序排列 */
+void MainWindow::refreshAfeTable()
 {
-    output.clear();
-    QStringList tokens = input.trimmed().split(QRegExp("\\s+"), QString::SkipEmptyParts);
-    for (const QString &token : tokens)
-    {
-        bool ok;
-        QString hex = token;
-        if (hex.startsWith("0x", Qt::CaseInsensitive))
-            hex = hex.mid(2);
-        if (hex.length() > 2)
-            return false;
-        BYTE byte = hex.toUShort(&ok, 16);
-        if (!ok) return false;
-        output.append(byte);
+    if (!afeDirty) return;
+    afeDirty = false;
+    const qint64 t0 = PrecisionTimer::nowNs();
+
+    const bool multi = afeLatest.size() > 1;
+    QStringList hLabels;
+    for (const AfeChainSample &s : afeLatest)
+        for (int d = 0; d < s.devices.size(); ++d)
+            hLabels << (multi ? QString("U%1 AFE %2").arg(s.adapter).arg(d + 1) : QString("AFE %1").arg(d + 1));
+
+    const int columns = hLabels.size();
+    const int rows = ADBMS6832_CELL_COUNT + ADBMS6832_AUX_COUNT + 2;
+    QTableWidget *t = ui->tableAfe;
+
+    if (t->rowCount() != rows || t->property("hLabels").toStringList() != hLabels) {
+        t->setRowCount(rows);
+        t->setColumnCount(columns);
+        t->setProperty("hLabels", hLabels);
+
+        QStringList vLabels;
+        for (int i = 0; i < ADBMS6832_CELL_COUNT; ++i) vLabels << QString("Cell %1").arg(i + 1);
+        for (int i = 0; i < ADBMS6832_AUX_COUNT; ++i)  vLabels << QString("AUX %1").arg(i + 1);
+        vLabels << "PEC err" << "CC";
+        t->setVerticalHeaderLabels(vLabels);
+        t->setHorizontalHeaderLabels(hLabels);
+
+        for (int r = 0; r < rows; ++r)
+            for (int c = 0; c < columns; ++c)
+                t->setItem(r, c, new QTableWidgetItem);
     }
-    return true;
+
+    int c = 0;
+    quint32 framesOk = 0, framesBad = 0, groupsSeen = 0;
+    QStringList sets;
+    for (const AfeChainSample &s : afeLatest) {
+        for (const AfeDeviceSample &dev : s.devices) {
+            int r = 0;
+            for (int i = 0; i < ADBMS6832_CELL_COUNT; ++i, ++r)
+                t->item(r, c)->setText((dev.cellValid >> i) & 1 ? QString::number(dev.cellUv[i] / 1e6, 'f', 4) : "--");
+            for (int i = 0; i < ADBMS6832_AUX_COUNT; ++i, ++r)
+                t->item(r, c)->setText((dev.auxValid >> i) & 1 ? QString::number(dev.auxUv[i] / 1e6, 'f', 4) : "--");
+            t->item(r++, c)->setText(QString::number(dev.pecErrors));
+            t->item(r++, c)->setText(QString::number(dev.cmdCounter));
+            ++c;
+        }
+        framesOk   += s.framesOk;
+        framesBad  += s.framesBad;
+        groupsSeen |= s.groupsSeen;
+        if (!sets.contains(QString::number(s.setId))) sets << QString::number(s.setId);
+    }
+
+    QStringList groups;
+    for (int g = 1; g < ADBMS_GROUP_COUNT; ++g)
+        if (groupsSeen & (1u << g)) groups << Adbms6832Decoder::groupName(g);
+
+    ui->labelAfeStatus->setText(QString("SET %1   USB: %2   Devices: %3   Frames OK: %4   PEC errors: %5   Groups: %6")
+                                .arg(sets.join(',')).arg(afeLatest.size()).arg(columns).arg(framesOk)
+                                .arg(framesBad).arg(groups.join(' ')));
+    SpiTrace::record(SPI_PHASE_UI_FORMAT, SPI_TRACE_UI_THREAD, t0, PrecisionTimer::nowNs());
 }
 
-void MainWindow::delayBlockingMs(int ms)
+/* ListView 指示目前執行第幾條 (同時執行多台時只跟隨第一台); 擷取中隨 afeTimer 更新 */
+void MainWindow::refreshReadSetStep()
 {
-    QEventLoop loop;
-    QTimer::singleShot(ms, &loop, &QEventLoop::quit);
-    loop.exec();
+    if (!acquisitionRunning || !cmdListModel) return;
+    const int cmdIndex = devices.readSetStep(qMax(0, targetSlot()));
+    if (cmdIndex < 0 || cmdIndex == ui->listViewReadCmds->currentIndex().row()) return;
+    ui->listViewReadCmds->setCurrentIndex(cmdListModel->index(cmdIndex));
 }
 
+void MainWindow::on_btnClearResult_clicked()
+{
+    logSink.clear();
+    logModel->refresh();
+}
 
-
-// 阻塞延遲（以微秒為單位）
-void MainWindow::delayBlockingUs(int usec)
+// 最近 USB2UIS_TRACE_EXPORT_SECONDS 秒的 phase 時間軸, 以 chrome://tracing 或 ui.perfetto.dev 開啟
+void MainWindow::on_btnExportTrace_clicked()
 {
-    QElapsedTimer timer;
-    timer.start();
-    while (timer.nsecsElapsed() < usec * 1000) {
-        // busy wait
+    const QString path = QCoreApplication::applicationDirPath() + "/trace_"
+                       + QDateTime::currentDateTime().toString("yyyyMMdd_HHmmss") + ".json";
+    const int events = SpiTrace::exportChromeTrace(path, USB2UIS_TRACE_EXPORT_SECONDS);
+    if (events < 0) {
+        QMessageBox::warning(this, "錯誤", "無法建立 trace 檔: " + path);
+        return;
     }
+    ui->statusbar->showMessage(QString("Trace: %1 (%2 events)").arg(path).arg(events));
 }
 
 /* --------- ① 讀取 READ-CMD 清單按鈕 ---------- */
 void MainWindow::on_btnLoadReadCmdList_clicked()
 {
-    ui->comboReadCmdList->clear();
-    ui->comboReadCmdList->setProperty("hexList", QVariant());   // 清旗標
-
-    auto list = loadCmdFile("SPI_READ_ONE_CMD_LIST.txt");
-    QVariantList hexList;
-    for (const auto &p : list) {
-        ui->comboReadCmdList->addItem(p.first);
-        hexList << p.second;
-    }
-    ui->comboReadCmdList->setProperty("hexList", hexList);
-    ui->comboReadCmdList->setCurrentIndex(-1);
-
-    if (!list.isEmpty()) {
-        ui->comboReadCmdList->setCurrentIndex(0);
-        ui->lineReadCmd->setText(list[0].second);
-    }
+    loadCmdLibrary();
+    const QString hex = fillCmdCombo(ui->comboReadCmdList, cmdLibrary, CMD_FILE_READ_ONE);
+    if (!hex.isEmpty()) ui->lineReadCmd->setText(hex);
 }
 
 /* Combo 被選中 → 將 HEX 填入 lineReadCmd */
-void MainWindow::onReadCmdChosen(const QString &text)
+void MainWindow::onReadCmdChosen(const QString &)
 {
-    auto hexList = ui->comboReadCmdList->property("hexList").toList();
-    int idx = ui->comboReadCmdList->currentIndex();
-    if (idx >= 0 && idx < hexList.size()) {
-        ui->lineReadCmd->clear();
-        ui->lineReadCmd->setText(hexList[idx].toString());
-    }
+    const QString hex = ui->comboReadCmdList->currentData().toString();
+    if (!hex.isEmpty()) ui->lineReadCmd->setText(hex);
 }
 
 /* --------- ② 讀取 WRITE-CMD 清單按鈕 ---------- */
 void MainWindow::on_btnLoadWriteCmdList_clicked()
 {
-    ui->comboWriteCmdList->clear();
-    QVariantList hexList;
-
-    auto list = loadCmdFile("SPI_WRITE_CMD_LIST.txt");
-    for (const auto &p : list) {
-        ui->comboWriteCmdList->addItem(p.first);
-        hexList << p.second;
-    }
-    ui->comboWriteCmdList->setProperty("hexList", hexList);
-    ui->comboWriteCmdList->setCurrentIndex(-1);
-
-    if (!list.isEmpty()) {
-        ui->comboWriteCmdList->setCurrentIndex(0);
-        ui->lineWriteCmd->setText(list[0].second);
-    }
+    loadCmdLibrary();
+    const QString hex = fillCmdCombo(ui->comboWriteCmdList, cmdLibrary, CMD_FILE_WRITE_CMD);
+    if (!hex.isEmpty()) ui->lineWriteCmd->setText(hex);
 }
 
 /* Combo 被選中 → 將 HEX 填入 lineWriteCmd */
 void MainWindow::onWriteCmdChosen(const QString &)
 {
-    auto hexList = ui->comboWriteCmdList->property("hexList").toList();
-    int idx = ui->comboWriteCmdList->currentIndex();
-    if (idx >= 0 && idx < hexList.size()) {
-        ui->lineWriteCmd->clear();
-        ui->lineWriteCmd->setText(hexList[idx].toString());
-    }
-
+    const QString hex = ui->comboWriteCmdList->currentData().toString();
+    if (!hex.isEmpty()) ui->lineWriteCmd->setText(hex);
 }
 
 /* --------- ③ 讀取 WRITE-DATA 清單按鈕 ---------- */
 void MainWindow::on_btnLoadWriteDataList_clicked()
 {
-    ui->comboWriteDataList->clear();
-    QVariantList hexList;
-
-    auto list = loadCmdFile("SPI_WRITE_DATA_LIST.txt");
-    for (const auto &p : list) {
-        ui->comboWriteDataList->addItem(p.first);
-        hexList << p.second;
-    }
-    ui->comboWriteDataList->setProperty("hexList", hexList);
-    ui->comboWriteDataList->setCurrentIndex(-1);
-
-
-    if (!list.isEmpty()) {
-        ui->comboWriteDataList->setCurrentIndex(0);
-        ui->textWriteData->setPlainText(list[0].second);
-    }
+    loadCmdLibrary();
+    const QString hex = fillCmdCombo(ui->comboWriteDataList, cmdLibrary, CMD_FILE_WRITE_DATA);
+    if (!hex.isEmpty()) ui->textWriteData->setPlainText(hex);
 }
 
 /* Combo 被選中 → 將 HEX 填入 textWriteData (多行元件) */
 void MainWindow::onWriteDataChosen(const QString &)
 {
-    auto hexList = ui->comboWriteDataList->property("hexList").toList();
-    int idx = ui->comboWriteDataList->currentIndex();
-    if (idx >= 0 && idx < hexList.size()) {
-        ui->textWriteData->clear();
-        ui->textWriteData->setPlainText(hexList[idx].toString());
-    }
+    const QString hex = ui->comboWriteDataList->currentData().toString();
+    if (!hex.isEmpty()) ui->textWriteData->setPlainText(hex);
 }
 
 void MainWindow::on_btnLoadReadCmdSet_clicked()
 {
     loadReadCmdSet();
-    loadReadCmdList();
 
     // ⚠️ 若成功載入至少一筆 SET，就選第一筆（index = 0）
     if (ui->comboReadCmdSet->count() > 0) {
         ui->comboReadCmdSet->setCurrentIndex(0);     // 會自動觸發 on_comboReadCmdSet_currentIndexChanged
     } else {
         ui->comboReadCmdSet->setCurrentIndex(-1);    // 沒資料就清空
-        ui->listViewReadCmds->setModel(nullptr);
+        showReadSetCmds(-1);
     }
 }
 
@@ -715,18 +1203,30 @@ void MainWindow::on_comboReadCmdSet_currentIndexChanged(int index)
 {
     if (index < 0) return;
 
-    int setId = ui->comboReadCmdSet->itemData(index).toInt();
-    QStringList cmdList;
+    showReadSetCmds(ui->comboReadCmdSet->itemData(index).toInt());
+}
 
-    for (const auto& pair : listSetCmdsOrdered) {
-        if (pair.first == setId) {
-            cmdList << pair.second;
-        }
+void MainWindow::onCaptureToggled(bool checked)
+{
+    if (!checked) {
+        if (!capture.isOpen()) return;
+        const CaptureWriter::Stats st = capture.stats();
+        capture.close();
+        ui->statusbar->showMessage(QString("Capture closed: %1 (%2 records, %3 KB)")
+                                   .arg(capture.fileName()).arg(st.records).arg(st.fileBytes / 1024));
+        return;
     }
 
-    if (cmdListModel) delete cmdListModel;
-    cmdListModel = new QStringListModel(cmdList, this);
-    ui->listViewReadCmds->setModel(cmdListModel);
+    const QString path = QCoreApplication::applicationDirPath() + "/capture_"
+                       + QDateTime::currentDateTime().toString("yyyyMMdd_HHmmss") + ".u2cap";
+    QString err;
+    if (!capture.open(path, &err)) {
+        QMessageBox::warning(this, "錯誤", "無法建立擷取檔: " + err);
+        QSignalBlocker block(ui->chkCapture);
+        ui->chkCapture->setChecked(false);
+        return;
+    }
+    ui->statusbar->showMessage("Capture: " + path);
 }
 
 void MainWindow::on_rdoNorth_clicked()
@@ -6,27 +6,29 @@
 #include <QEventLoop>
 #include <QTimer>
 #include <QElapsedTimer>
+#include <QFileSystemWatcher>
 #include <QList>
 #include <QMap>
+#include <QLabel>
 #include <QStringListModel>
+#include <QThread>
 #include "usb2uis_interface.h"
+#include "acquisition_worker.h"
+#include "device_manager.h"
+#include "cmd_library.h"
+#include "spi_log.h"
+#include "cell_plot_store.h"
+#include "cell_stats_store.h"
+#include "sequencer.h"
+
+class CellPlotWidget;
+class QComboBox;
+class QTableWidget;
 
 QT_BEGIN_NAMESPACE
 namespace Ui { class MainWindow; }
 QT_END_NAMESPACE
 
-
-typedef  enum{
-    USB2UIS_GPIO_IO1 = 0,
-    USB2UIS_GPIO_IO2,
-    USB2UIS_GPIO_IO3,
-    USB2UIS_GPIO_IO4,
-    USB2UIS_GPIO_IO5,
-    USB2UIS_GPIO_IO6,
-    USB2UIS_GPIO_IO7,
-    USB2UIS_GPIO_IO8,
-}eTypeGPIO_IO_PORT;
-
 class MainWindow : public QMainWindow
 {
     Q_OBJECT
@@ -38,10 +40,14 @@ public:
 private slots:
     void on_btnConnect_clicked();
     void on_btnApplyConfig_clicked();
+    void on_btnAutoTune_clicked();
     void on_btnSpiRead_clicked();
     void on_btnSpiRead2_clicked();
     void on_btnSpiWrite_clicked();
+    void on_btnLoadSeq_clicked();
+    void on_btnRunSeq_clicked();
     void on_btnClearResult_clicked();
+    void on_btnExportTrace_clicked();
     // 按鈕
     void on_btnLoadReadCmdList_clicked();
     void on_btnLoadWriteCmdList_clicked();
@@ -57,24 +63,89 @@ private slots:
     void on_rdoNorth_clicked();
     void on_rdoSouth_clicked();
 
+    void on_btnSpiStop_clicked();
+    void on_btnSpiPause_toggled(bool checked);
+    void onCaptureToggled(bool checked);
+
+    // DeviceManager 回報 (queued)
+    void onConfigApplied(int slot, bool gpioOk, bool spiOk);
+    void onAcquisitionStarted();
+    void onAcquisitionFinished(int iterations);
+    void onAcquisitionError(int slot, const QString &msg);
+    void refreshReadSetStep();
+    void onPlanStats(int usbCallsPerCycle, int planOps);
+    void onAfeSample(const AfeChainSample &sample);
+    void onRateTuneStep(int slot, const SpiRateTuneStep &step);
+    void onRateTuneFinished(int slot, const SpiRateTuneResult &result);
+    void refreshAfeTable();
+    void onDeviceChosen(int index);
+    void reloadCmdLists();
+
 private:
     Ui::MainWindow *ui;
 
     bool deviceConnected = false;
-    BYTE deviceIndex = 0xFF;
     bool bDirNorth = true;
 
-    bool parseHexString(const QString& input, QByteArray& output);
-    void delayBlockingMs(int ms);
-    void delayBlockingUs(int usec);
+    bool acquisitionRunning = false;
+    int  usbCallsPerCycle = 0;
+    quint64 shadowSkippedAtStart = 0;             // Usb2UisInterface shadow 略過的寫入 (開始時)
+    QString lastAcquisitionError;                 // 擷取中最後一個錯誤, 結束時顯示
+
+    DeviceManager      devices;                   // 每台 USB2UIS 一個 worker 執行緒
+    int                configPending = 0;         // 等待 configApplied 的台數
+    QStringList        configFailures;
+
+    SpiLogSink         logSink;                   // 固定容量, worker 直接寫入
+    SpiLogModel       *logModel = nullptr;
+    bool               logFollowTail = true;      // 在最底部時自動捲動
+
+    CaptureWriter      capture;                   // READ 結果的二進位擷取檔
+
+    QMap<int, AfeChainSample> afeLatest;          // 各 USB2UIS 最新的解碼結果, 由 afeTimer 更新畫面
+    bool               afeDirty = false;
+    QTimer             afeTimer;
+
+    CellPlotStore      plotStore;                 // Cell Plot 分頁的 min/max pyramid (記憶體固定)
+    CellPlotWidget    *plotWidget = nullptr;
+    QComboBox         *comboPlotTrack = nullptr;
+    QTimer             plotTimer;
+
+    CellStatsStore     statsStore;                // Cell Stats 分頁: 最近 1 分鐘/1 小時/1 天 (記憶體固定)
+    QComboBox         *comboStatsWindow = nullptr;
+    QTableWidget      *tableStats = nullptr;
+    quint64            statsGeneration = 0;        // 表格對應的 statsStore.generation()
+    QTimer             statsTimer;
+
+    QLabel            *labelPhaseStats = nullptr;  // 狀態列: 各 phase p50/p99/max
+    QLabel            *labelCycleStats = nullptr;  // 狀態列: 速率與 deadline miss
+    QTimer             phaseStatsTimer;
+
+    int  targetSlot() const;                      // comboDevice 選擇, DEVICE_ALL = 全部
+    qint64  fixedRatePeriodNs() const;
+    QString cycleStatsText() const;
+    QString rateTuneKey(int slot) const;          // SpiRateTuner 儲存的 adapter + chain 設定
+    void updateDeviceCombo();
+    void setupPlotTab();
+    void updatePlotTracks();
+    void setupStatsTab();
+    void refreshStatsTable();
+    void exportStats();
+
+    bool loadCmdLibrary();
     void loadReadCmdSet();
-    void loadReadCmdList();
-    void GpioSet(eTypeGPIO_IO_PORT eGpio);
-    void GpioClear(eTypeGPIO_IO_PORT eGpio);
-    void SpiDirectionHighLow(bool bDirNorth, bool bHigh);
+    void watchCmdLists();
+    int  showReadSetCmds(int setId);
+    QList<QByteArray> readSetCmds(int setId) const;
+    void loadSeqScripts(bool compile);
+    bool compileSeqScript();
 
-    QMap<int, QString> mapSetDescription;             // SET編號 → 註解
-    QList<QPair<int, QString>> listSetCmdsOrdered;    // 保留原始順序, SET編號 → HEX字串
+    CmdLibrary cmdLibrary;                            // 5 個清單檔, 已解析成 bytes + 索引
+    int        cmdWarnGeneration = 0;
     QStringListModel *cmdListModel = nullptr;         // ListView 模型
+    QFileSystemWatcher cmdWatcher;                    // 清單檔被編輯時自動重新載入
+    QTimer     cmdReloadTimer;
+    int        runningSetId = -1;                     // 執行中的 READ SET, 重新載入時換成新命令
+    SeqProgram  seqProgram;                           // 目前選擇的 .seq 腳本 (已編譯)
 };
 #endif // MAINWINDOW_H
@@ -0,0 +1,188 @@
+#include "precision_timer.h"
+
+#include <QElapsedTimer>
+#include <QThread>
+#include <QMutex>
+#include <QVector>
+#include <algorithm>
+
+#ifdef Q_OS_WIN
+#include <windows.h>
+#include <timeapi.h>
+#endif
+
+// 剩餘時間小於此值時不再 sleep, 直接 spin
+#define PRECISION_TIMER_MIN_SLEEP_NS        50000
+// 未校正前的保守 overshoot
+#define PRECISION_TIMER_DEFAULT_OVERSHOOT   1200000
+
+std::atomic<qint64> PrecisionTimer::m_overshootNs(PRECISION_TIMER_DEFAULT_OVERSHOOT);
+
+#ifdef Q_OS_WIN
+/* timeBeginPeriod 只呼叫一次, 程式結束 (static 解構) 時以 timeEndPeriod 還原系統 timer 解析度 */
+struct TimerPeriodGuard {
+    bool active = false;
+
+    void begin()
+    {
+        if (active) return;
+        active = (timeBeginPeriod(1) == TIMERR_NOERROR);
+    }
+    ~TimerPeriodGuard()
+    {
+        if (active) timeEndPeriod(1);
+    }
+};
+static TimerPeriodGuard s_timerPeriod;
+#endif
+
+static QMutex &siteRegistryLock()
+{
+    static QMutex lock;
+    return lock;
+}
+
+static QVector<PrecisionWaitSite*> &siteRegistry()
+{
+    static QVector<PrecisionWaitSite*> sites;
+    return sites;
+}
+
+PrecisionWaitSite::PrecisionWaitSite(const char *name)
+    : m_name(name), m_count(0), m_sumNs(0), m_maxNs(0), m_lastNs(0)
+{
+    QMutexLocker lock(&siteRegistryLock());
+    siteRegistry().append(this);
+}
+
+/* 多個執行緒同時寫入時只保留最大值 */
+static void raiseMax(std::atomic<qint64> &max, qint64 value)
+{
+    qint64 prev = max.load(std::memory_order_relaxed);
+    while (value > prev && !max.compare_exchange_weak(prev, value, std::memory_order_relaxed)) {
+    }
+}
+
+void PrecisionWaitSite::record(qint64 jitterNs)
+{
+    m_count.fetch_add(1, std::memory_order_relaxed);
+    m_sumNs.fetch_add(jitterNs, std::memory_order_relaxed);
+    m_lastNs.store(jitterNs, std::memory_order_relaxed);
+    raiseMax(m_maxNs, jitterNs);
+}
+
+void PrecisionWaitSite::reset()
+{
+    m_count.store(0);
+    m_sumNs.store(0);
+    m_maxNs.store(0);
+    m_lastNs.store(0);
+}
+
+PrecisionWaitSite::Stats PrecisionWaitSite::stats() const
+{
+    Stats s;
+    s.name   = QString::fromLatin1(m_name);
+    s.count  = m_count.load(std::memory_order_relaxed);
+    s.meanNs = s.count ? m_sumNs.load(std::memory_order_relaxed) / s.count : 0;
+    s.maxNs  = m_maxNs.load(std::memory_order_relaxed);
+    s.lastNs = m_lastNs.load(std::memory_order_relaxed);
+    return s;
+}
+
+qint64 PrecisionTimer::nowNs()
+{
+    static QElapsedTimer clock;
+    static bool started = (clock.start(), true);
+    Q_UNUSED(started);
+    return clock.nsecsElapsed();
+}
+
+/*
+ * 量測平台 sleep 的 overshoot (要求時間 vs 實際時間),
+ * 取各長度中第 90 百分位的最大值當作 sleep 提前量.
+ */
+void PrecisionTimer::calibrate()
+{
+#ifdef Q_OS_WIN
+    s_timerPeriod.begin();  // Windows 預設 sleep 粒度 15.6ms
+#endif
+
+    static const int kRequestUs[] = { 100, 200, 500, 1000 };
+    const int samples = 15;
+    qint64 worst = 0;
+
+    for (int req : kRequestUs) {
+        QVector<qint64> over;
+        over.reserve(samples);
+        for (int i = 0; i < samples; ++i) {
+            qint64 t0 = nowNs();
+            QThread::usleep(req);
+            over.append(nowNs() - t0 - qint64(req) * 1000);
+        }
+        std::sort(over.begin(), over.end());
+        worst = qMax(worst, over[samples * 9 / 10]);
+    }
+
+    m_overshootNs.store(qMax<qint64>(worst, 0) + 20000);    // 20us 保留量
+}
+
+qint64 PrecisionTimer::sleepOvershootNs()
+{
+    return m_overshootNs.load(std::memory_order_relaxed);
+}
+
+void PrecisionTimer::waitUntilNs(qint64 deadlineNs, PrecisionWaitSite *site)
+{
+    qint64 remaining = deadlineNs - nowNs();
+    const qint64 overshoot = sleepOvershootNs();
+
+    // Sleep 階段: 留下 overshoot 給 spin 補足
+    if (remaining > overshoot + PRECISION_TIMER_MIN_SLEEP_NS)
+        QThread::usleep(quint64((remaining - overshoot) / 1000));
+
+    // Spin 階段
+    qint64 now = nowNs();
+    while (now < deadlineNs)
+        now = nowNs();
+
+    if (site) site->record(now - deadlineNs);
+}
+
+void PrecisionTimer::waitUs(qint64 usec, PrecisionWaitSite *site)
+{
+    waitUntilNs(nowNs() + usec * 1000, site);
+}
+
+void PrecisionTimer::waitMs(qint64 ms, PrecisionWaitSite *site)
+{
+    waitUntilNs(nowNs() + ms * 1000000, site);
+}
+
+QList<PrecisionWaitSite::Stats> PrecisionTimer::siteStats()
+{
+    QList<PrecisionWaitSite::Stats> list;
+
+    QMutexLocker lock(&siteRegistryLock());
+    for (PrecisionWaitSite *site : siteRegistry())
+        list.append(site->stats());
+    return list;
+}
+
+void PrecisionTimer::resetSiteStats()
+{
+    QMutexLocker lock(&siteRegistryLock());
+    for (PrecisionWaitSite *site : siteRegistry())
+        site->reset();
+}
+
+/* 狀態列顯示用: "wake-hold 3/12us ..." (平均/最大 jitter) */
+QString PrecisionTimer::siteStatsText()
+{
+    QString text;
+    for (const PrecisionWaitSite::Stats &s : siteStats()) {
+        if (s.count == 0) continue;
+        text += QString("%1 %2/%3us  ").arg(s.name).arg(s.meanNs / 1000).arg(s.maxNs / 1000);
+    }
+    return text.trimmed();
+}
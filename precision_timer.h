@@ -0,0 +1,67 @@
+#ifndef PRECISION_TIMER_H
+#define PRECISION_TIMER_H
+
+#include <QString>
+#include <QList>
+#include <atomic>
+
+/*
+ * PrecisionWaitSite
+ *  一個等待點 (例如 "wake-hold") 的 jitter 統計.
+ *  jitter = 實際醒來時間 - deadline (ns). 以 static 物件宣告, 建構時自動註冊;
+ *  同一個等待點由所有 AcquisitionWorker 執行緒 (每台 USB2UIS 一個) 與 replay backend 共用,
+ *  count/sum 以 fetch_add 累加, max 以 CAS 更新, last 為最後寫入的一筆; UI 可隨時讀取.
+ */
+class PrecisionWaitSite
+{
+public:
+    explicit PrecisionWaitSite(const char *name);
+
+    struct Stats {
+        QString name;
+        qint64  count;
+        qint64  meanNs;
+        qint64  maxNs;
+        qint64  lastNs;
+    };
+
+    const char *name() const { return m_name; }
+    void record(qint64 jitterNs);
+    void reset();
+    Stats stats() const;
+
+private:
+    const char *m_name;
+    std::atomic<qint64> m_count;
+    std::atomic<qint64> m_sumNs;
+    std::atomic<qint64> m_maxNs;
+    std::atomic<qint64> m_lastNs;
+};
+
+/*
+ * PrecisionTimer
+ *  Hybrid sleep-then-spin 等待: 先 sleep 到 deadline 前 (扣除校正過的 sleep overshoot),
+ *  最後一小段 busy-spin. 以絕對 deadline 計時, 連續延遲不會累積誤差.
+ *  不建立 QEventLoop, 不會在 CS LOW 期間 re-enter 其他 slot.
+ */
+class PrecisionTimer
+{
+public:
+    static qint64 nowNs();                      // monotonic clock
+
+    static void calibrate();                    // 程式啟動時呼叫一次 (Windows: 1 ms timer 解析度至程式結束)
+    static qint64 sleepOvershootNs();
+
+    static void waitUntilNs(qint64 deadlineNs, PrecisionWaitSite *site = nullptr);
+    static void waitUs(qint64 usec, PrecisionWaitSite *site = nullptr);
+    static void waitMs(qint64 ms, PrecisionWaitSite *site = nullptr);
+
+    static QList<PrecisionWaitSite::Stats> siteStats();
+    static void resetSiteStats();
+    static QString siteStatsText();
+
+private:
+    static std::atomic<qint64> m_overshootNs;
+};
+
+#endif // PRECISION_TIMER_H
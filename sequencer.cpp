@@ -0,0 +1,732 @@
+#include "sequencer.h"
+#include "precision_timer.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <climits>
+#include <cmath>
+#include <cstdlib>
+
+static const char *seqOpName(BYTE op)
+{
+    switch (op) {
+    case SEQ_OP_END:       return "END";
+    case SEQ_OP_PLAN:      return "PLAN";
+    case SEQ_OP_WAIT:      return "WAIT";
+    case SEQ_OP_LOOP_SET:  return "LOOP_SET";
+    case SEQ_OP_LOOP_NEXT: return "LOOP_NEXT";
+    case SEQ_OP_JUMP:      return "JUMP";
+    case SEQ_OP_BRANCH:    return "BRANCH";
+    case SEQ_OP_EMIT:      return "EMIT";
+    case SEQ_OP_FAIL:      return "FAIL";
+    default:               return "?";
+    }
+}
+
+QString SeqProgram::dump() const
+{
+    QString text;
+    for (int i = 0; i < code.size(); ++i) {
+        const SeqInsn &in = code[i];
+        text += QString("%1 %2 a=%3 target=%4 value=%5\n")
+                .arg(i).arg(seqOpName(in.op)).arg(in.a).arg(in.target).arg(in.value);
+    }
+    return text;
+}
+
+/* ----------------------------- Compiler ----------------------------- */
+
+namespace {
+
+/* 一行中的 token: 以空白分隔, "..." 內可有空白 (包含引號) */
+struct SeqToken {
+    const char *p;
+    int         n;
+};
+
+typedef enum{
+    SEQ_BLOCK_REPEAT = 0,
+    SEQ_BLOCK_LOOP,
+    SEQ_BLOCK_IF,
+}eTypeSeqBlock;
+
+struct SeqBlock {
+    BYTE         kind;
+    int          line;
+    int          start;         // REPEAT/LOOP: body 第一條指令; IF: BRANCH 指令
+    int          elseJump;      // IF 的 else 前的 JUMP, -1 = 沒有 else
+    int          counter;       // REPEAT 的 counter index
+    QVector<int> breaks;        // 待填入結束位置的 JUMP
+};
+
+inline bool isBlank(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '\v' || c == '\f';
+}
+
+inline char lower(char c)
+{
+    return (c >= 'A' && c <= 'Z') ? char(c | 0x20) : c;
+}
+
+bool tokenIs(const SeqToken &t, const char *word)
+{
+    int i = 0;
+    for (; i < t.n; ++i)
+        if (word[i] == 0 || lower(t.p[i]) != word[i]) return false;
+    return word[i] == 0;
+}
+
+bool isQuoted(const SeqToken &t)
+{
+    return t.n >= 2 && t.p[0] == '"' && t.p[t.n - 1] == '"';
+}
+
+void tokenize(const char *p, const char *end, QVector<SeqToken> &out)
+{
+    out.resize(0);
+    while (true) {
+        while (p < end && isBlank(*p)) ++p;
+        if (p >= end || *p == '#') break;
+
+        const char *tok = p;
+        if (*p == '"') {
+            ++p;
+            while (p < end && *p != '"') ++p;
+            if (p < end) ++p;
+        } else {
+            while (p < end && !isBlank(*p) && *p != '#') ++p;
+        }
+        out.append(SeqToken{tok, int(p - tok)});
+    }
+}
+
+/* 數字 + 單位, 單位可接在數字後或為下一個 token; 回傳使用的 token 數 (0 = 錯誤, 含 nan/inf) */
+int parseScaled(const SeqToken *t, int count, const char *const *units, const double *scales, int unitCount,
+                double defaultScale, double *out)
+{
+    if (count < 1) return 0;
+    const QByteArray text(t[0].p, t[0].n);
+    char *rest = nullptr;
+    const double v = strtod(text.constData(), &rest);
+    if (rest == text.constData() || !std::isfinite(v)) return 0;
+
+    SeqToken unit{t[0].p + (rest - text.constData()), int(text.constData() + text.size() - rest)};
+    int used = 1;
+    if (unit.n == 0 && count > 1) {
+        for (int u = 0; u < unitCount; ++u) {
+            if (tokenIs(t[1], units[u])) {
+                unit = t[1];
+                used = 2;
+                break;
+            }
+        }
+    }
+    if (unit.n == 0) {
+        if (defaultScale <= 0) return 0;
+        *out = v * defaultScale;
+        return used;
+    }
+    for (int u = 0; u < unitCount; ++u) {
+        if (tokenIs(unit, units[u])) {
+            *out = v * scales[u];
+            return used;
+        }
+    }
+    return 0;
+}
+
+int parseTimeNs(const SeqToken *t, int count, qint64 *ns)
+{
+    static const char *const units[] = {"us", "ms", "s"};
+    static const double scales[] = {1e3, 1e6, 1e9};
+    double v = 0;
+    const int used = parseScaled(t, count, units, scales, 3, 0, &v);
+    if (!used || !(v >= 0 && v <= double(SEQ_MAX_WAIT_NS))) return 0;
+    *ns = qint64(v + 0.5);
+    return used;
+}
+
+int parseVoltUv(const SeqToken *t, int count, qint64 *uv)
+{
+    static const char *const units[] = {"uv", "mv", "v"};
+    static const double scales[] = {1, 1e3, 1e6};
+    double v = 0;
+    const int used = parseScaled(t, count, units, scales, 3, 1e6, &v);
+    if (!used || !(std::fabs(v) <= double(SEQ_MAX_VOLT_UV))) return 0;
+    *uv = qint64(v < 0 ? v - 0.5 : v + 0.5);
+    return used;
+}
+
+bool parseInt(const SeqToken &t, int lo, int hi, int *out)
+{
+    const QByteArray text(t.p, t.n);
+    char *rest = nullptr;
+    const long v = strtol(text.constData(), &rest, 0);
+    if (rest == text.constData() || *rest != 0 || v < lo || v > hi) return false;
+    *out = int(v);
+    return true;
+}
+
+class SeqParser
+{
+public:
+    SeqParser(const CmdLibrary &lib, SeqProgram &program) : m_lib(lib), m_prog(program) {}
+
+    bool parse(const QByteArray &text);
+    QString error() const { return m_error; }
+
+private:
+    const CmdLibrary   &m_lib;
+    SeqProgram         &m_prog;
+    QVector<SeqBlock>   m_blocks;
+    QVector<SeqToken>   m_tok;
+    int                 m_line = 0;
+    int                 m_counters = 0;     // 目前開啟的 repeat 數
+    int                 m_openStep = -1;    // 可合併後續 read 的 step (最後一條指令為其 PLAN)
+    QString             m_error;
+
+    bool fail(const QString &why);
+    int  add(BYTE op, int a = 0, qint64 value = 0, int target = -1);
+    bool statement();
+    bool stepStatement(BYTE kind);
+    bool readSetStatement();
+    bool ifStatement();
+    bool endStatement();
+    bool takeDelay(int *count, int *delayMs);
+    bool resolve(const SeqToken *t, int count, const int *files, int fileCount, QByteArray &out, const char *what);
+    int  addStep(const SeqStep &step, bool mergeable);
+};
+
+bool SeqParser::fail(const QString &why)
+{
+    m_error = QString("line %1: %2").arg(m_line).arg(why);
+    return false;
+}
+
+int SeqParser::add(BYTE op, int a, qint64 value, int target)
+{
+    SeqInsn in;
+    in.op = op;
+    in.reserved = 0;
+    in.a = WORD(a);
+    in.target = target;
+    in.value = value;
+    m_prog.code.append(in);
+    m_openStep = -1;
+    return m_prog.code.size() - 1;
+}
+
+bool SeqParser::parse(const QByteArray &text)
+{
+    const char *p = text.constData();
+    const char *end = p + text.size();
+
+    while (p < end) {
+        const char *eol = p;
+        while (eol < end && *eol != '\n') ++eol;
+        ++m_line;
+        tokenize(p, eol, m_tok);
+        p = eol + 1;
+
+        if (!m_tok.isEmpty() && !statement()) return false;
+    }
+
+    if (!m_blocks.isEmpty()) {
+        m_line = m_blocks.last().line;
+        return fail("missing end");
+    }
+    add(SEQ_OP_END);
+    return true;
+}
+
+bool SeqParser::statement()
+{
+    const SeqToken &k = m_tok[0];
+    const int n = m_tok.size();
+
+    if (tokenIs(k, "read"))    return stepStatement(SEQ_STEP_READ);
+    if (tokenIs(k, "cmd"))     return stepStatement(SEQ_STEP_CMD);
+    if (tokenIs(k, "write"))   return stepStatement(SEQ_STEP_WRITE);
+    if (tokenIs(k, "readset")) return readSetStatement();
+    if (tokenIs(k, "if"))      return ifStatement();
+    if (tokenIs(k, "end"))     return endStatement();
+
+    if (tokenIs(k, "wait")) {
+        qint64 ns = 0;
+        if (n < 2 || parseTimeNs(m_tok.constData() + 1, n - 1, &ns) != n - 1) return fail("wait needs <n>us|ms|s (at most 24 h)");
+        add(SEQ_OP_WAIT, 0, ns);
+        return true;
+    }
+
+    if (tokenIs(k, "repeat")) {
+        int count = 0;
+        if (n != 2 || !parseInt(m_tok[1], 0, INT_MAX, &count)) return fail("repeat needs a count");
+        if (m_blocks.size() >= SEQ_MAX_DEPTH) return fail("nested too deep");
+        SeqBlock b{SEQ_BLOCK_REPEAT, m_line, 0, -1, m_counters++, {}};
+        b.breaks.append(add(SEQ_OP_LOOP_SET, b.counter, count));
+        b.start = m_prog.code.size();
+        m_blocks.append(b);
+        return true;
+    }
+
+    if (tokenIs(k, "loop")) {
+        if (n != 1) return fail("loop takes no arguments");
+        if (m_blocks.size() >= SEQ_MAX_DEPTH) return fail("nested too deep");
+        m_blocks.append(SeqBlock{SEQ_BLOCK_LOOP, m_line, m_prog.code.size(), -1, -1, {}});
+        m_openStep = -1;
+        return true;
+    }
+
+    if (tokenIs(k, "break")) {
+        for (int i = m_blocks.size() - 1; i >= 0; --i) {
+            if (m_blocks[i].kind == SEQ_BLOCK_IF) continue;
+            m_blocks[i].breaks.append(add(SEQ_OP_JUMP));
+            return true;
+        }
+        return fail("break outside repeat/loop");
+    }
+
+    if (tokenIs(k, "else")) {
+        if (n != 1) return fail("else takes no arguments");
+        if (m_blocks.isEmpty() || m_blocks.last().kind != SEQ_BLOCK_IF || m_blocks.last().elseJump >= 0)
+            return fail("else without if");
+        SeqBlock &b = m_blocks.last();
+        b.elseJump = add(SEQ_OP_JUMP);
+        m_prog.code[b.start].target = m_prog.code.size();
+        return true;
+    }
+
+    if (tokenIs(k, "emit") || tokenIs(k, "stop")) {
+        if (n != 1) return fail(QString("%1 takes no arguments").arg(QString::fromLatin1(k.p, k.n)));
+        add(tokenIs(k, "emit") ? SEQ_OP_EMIT : SEQ_OP_END);
+        return true;
+    }
+
+    if (tokenIs(k, "fail")) {
+        QString msg = n > 1 ? QString::fromUtf8(m_tok[1].p, int(m_tok[n - 1].p + m_tok[n - 1].n - m_tok[1].p))
+                            : QString("fail");
+        if (n == 2 && isQuoted(m_tok[1])) msg = QString::fromUtf8(m_tok[1].p + 1, m_tok[1].n - 2);
+        m_prog.messages << QString("line %1: %2").arg(m_line).arg(msg);
+        add(SEQ_OP_FAIL, m_prog.messages.size() - 1);
+        return true;
+    }
+
+    return fail(QString("unknown statement '%1'").arg(QString::fromLatin1(k.p, k.n)));
+}
+
+/* 行尾的 "delay <t>", 移除後 *count 為剩餘 token 數 */
+bool SeqParser::takeDelay(int *count, int *delayMs)
+{
+    *delayMs = 0;
+    for (int i = 1; i < *count; ++i) {
+        if (!tokenIs(m_tok[i], "delay")) continue;
+        qint64 ns = 0;
+        if (i + 1 >= *count || parseTimeNs(m_tok.constData() + i + 1, *count - i - 1, &ns) != *count - i - 1)
+            return fail("delay needs <n>us|ms|s (at most 24 h)");
+        *delayMs = int((ns + 999999) / 1000000);     // plan 的命令延遲以 ms 為單位
+        *count = i;
+        break;
+    }
+    return true;
+}
+
+/* "label" 只查清單檔; 未加引號時先查 label 再當作命令文字 */
+bool SeqParser::resolve(const SeqToken *t, int count, const int *files, int fileCount, QByteArray &out, const char *what)
+{
+    if (count < 1) return fail(QString("missing %1").arg(what));
+
+    const char *begin = t[0].p;
+    const char *end = t[count - 1].p + t[count - 1].n;
+    const bool quoted = count == 1 && isQuoted(t[0]);
+    const QString label = quoted ? QString::fromUtf8(begin + 1, int(end - begin) - 2)
+                                 : QString::fromUtf8(begin, int(end - begin));
+
+    for (int f = 0; f < fileCount; ++f) {
+        const int i = m_lib.findLabel(files[f], label);
+        if (i >= 0) {
+            out = m_lib.bytes(m_lib.entry(files[f], i));
+            return true;
+        }
+    }
+    if (quoted) return fail(QString("unknown label \"%1\"").arg(label));
+
+    QString why;
+    if (!CmdLibrary::parseCmdText(begin, int(end - begin), out, &why) || out.isEmpty())
+        return fail(QString("invalid %1: %2").arg(what).arg(why.isEmpty() ? label : why));
+    return true;
+}
+
+/* 連續的 READ (延遲相同) 併入同一個 step/plan, 只產生一條 PLAN 指令 */
+int SeqParser::addStep(const SeqStep &step, bool mergeable)
+{
+    if (mergeable && m_openStep >= 0) {
+        SeqStep &open = m_prog.steps[m_openStep];
+        if (open.kind == SEQ_STEP_READ && open.delayMs == step.delayMs) {
+            open.cmds += step.cmds;
+            return m_openStep;
+        }
+    }
+
+    if (m_prog.steps.size() >= SEQ_MAX_STEPS) {
+        fail("too many steps");
+        return -1;
+    }
+    m_prog.steps.append(step);
+    const int index = m_prog.steps.size() - 1;
+    add(SEQ_OP_PLAN, index);
+    if (mergeable) m_openStep = index;
+    return index;
+}
+
+bool SeqParser::stepStatement(BYTE kind)
+{
+    static const int readFiles[]  = {CMD_FILE_READ_ONE, CMD_FILE_READ_LIST};
+    static const int cmdFiles[]   = {CMD_FILE_READ_ONE, CMD_FILE_WRITE_CMD};
+    static const int writeFiles[] = {CMD_FILE_WRITE_CMD};
+    static const int dataFiles[]  = {CMD_FILE_WRITE_DATA};
+
+    int count = m_tok.size();
+    SeqStep step;
+    step.kind = kind;
+    step.line = m_line;
+    if (!takeDelay(&count, &step.delayMs)) return false;
+
+    QByteArray cmd;
+    if (kind == SEQ_STEP_WRITE) {
+        int split = 1;
+        while (split < count && !tokenIs(m_tok[split], "data") && !tokenIs(m_tok[split], "each")) ++split;
+        if (split >= count) return fail("write needs data|each <data>");
+        step.replicate = tokenIs(m_tok[split], "each");
+        if (!resolve(m_tok.constData() + 1, split - 1, writeFiles, 1, cmd, "command")) return false;
+        if (!resolve(m_tok.constData() + split + 1, count - split - 1, dataFiles, 1, step.data, "data")) return false;
+        if (step.replicate && step.data.size() < ADBMS6832_REG_GROUP_SIZE)
+            return fail("write each needs at least 6 data bytes");
+    } else if (!resolve(m_tok.constData() + 1, count - 1, kind == SEQ_STEP_READ ? readFiles : cmdFiles, 2,
+                        cmd, "command")) {
+        return false;
+    }
+    step.cmds << cmd;
+
+    return addStep(step, kind == SEQ_STEP_READ) >= 0;
+}
+
+bool SeqParser::readSetStatement()
+{
+    int count = m_tok.size();
+    SeqStep step;
+    step.kind = SEQ_STEP_READ;
+    step.line = m_line;
+    if (!takeDelay(&count, &step.delayMs)) return false;
+    if (count < 2) return fail("readset needs <id|\"desc\">");
+
+    const SeqToken &first = m_tok[1];
+    const char *end = m_tok[count - 1].p + m_tok[count - 1].n;
+    const bool quoted = count == 2 && isQuoted(first);
+    const QString desc = quoted ? QString::fromUtf8(first.p + 1, first.n - 2)
+                                : QString::fromUtf8(first.p, int(end - first.p));
+    int id = -1;
+    const bool numeric = !quoted && count == 2 && parseInt(first, 0, INT_MAX, &id);
+
+    int setId = -1;
+    for (const auto &set : m_lib.sets()) {
+        if ((numeric && set.first == id) || (!numeric && set.second == desc)) {
+            setId = set.first;
+            break;
+        }
+    }
+    int firstCmd = 0, n = 0;
+    if (setId < 0 || !m_lib.setRange(setId, &firstCmd, &n) || n == 0)
+        return fail(QString("unknown or empty READ SET %1").arg(desc));
+
+    for (int i = firstCmd; i < firstCmd + n; ++i)
+        step.cmds << m_lib.bytes(m_lib.entry(CMD_FILE_READ_LIST, i));
+    return addStep(step, true) >= 0;
+}
+
+bool SeqParser::ifStatement()
+{
+    const int n = m_tok.size();
+    SeqCond c;
+    int i = 1;
+
+    auto indexArg = [&](int limit, int *out) {
+        return i < n && parseInt(m_tok[i++], 1, limit, out);
+    };
+
+    if (i < n && (tokenIs(m_tok[i], "cell") || tokenIs(m_tok[i], "aux"))) {
+        const bool cell = tokenIs(m_tok[i++], "cell");
+        int afe = 0, index = 0;
+        if (!indexArg(0xFFFF, &afe) || !indexArg(cell ? ADBMS6832_CELL_COUNT : ADBMS6832_AUX_COUNT, &index))
+            return fail(QString("%1 needs <afe> <n> (1..%2)").arg(cell ? "cell" : "aux")
+                        .arg(cell ? ADBMS6832_CELL_COUNT : ADBMS6832_AUX_COUNT));
+        c.value = cell ? SEQ_VALUE_CELL : SEQ_VALUE_AUX;
+        c.device = WORD(afe - 1);
+        c.index = BYTE(index - 1);
+    } else if (i < n && tokenIs(m_tok[i], "cellmax")) {
+        c.value = SEQ_VALUE_CELL_MAX;
+        ++i;
+    } else if (i < n && tokenIs(m_tok[i], "cellmin")) {
+        c.value = SEQ_VALUE_CELL_MIN;
+        ++i;
+    } else if (i < n && tokenIs(m_tok[i], "celldelta")) {
+        c.value = SEQ_VALUE_CELL_DELTA;
+        ++i;
+    } else if (i < n && tokenIs(m_tok[i], "pecerr")) {
+        c.value = SEQ_VALUE_PEC_ERRORS;
+        ++i;
+    } else {
+        return fail("if needs cell|aux|cellmax|cellmin|celldelta|pecerr");
+    }
+
+    static const char *const ops[] = {"<", "<=", ">", ">=", "==", "!="};
+    if (i >= n) return fail("if needs a comparison");
+    int cmp = 0;
+    while (cmp < 6 && !tokenIs(m_tok[i], ops[cmp])) ++cmp;
+    if (cmp == 6) return fail(QString("unknown comparison '%1'").arg(QString::fromLatin1(m_tok[i].p, m_tok[i].n)));
+    c.cmp = BYTE(cmp);
+    ++i;
+
+    if (c.value == SEQ_VALUE_PEC_ERRORS) {
+        int errors = 0;
+        if (n != i + 1 || !parseInt(m_tok[i], 0, INT_MAX, &errors)) return fail("pecerr compares with a count");
+        c.threshold = errors;
+    } else if (i >= n || parseVoltUv(m_tok.constData() + i, n - i, &c.threshold) != n - i) {
+        return fail("if needs a voltage (V, mV or uV, at most 100 V)");
+    }
+
+    if (m_blocks.size() >= SEQ_MAX_DEPTH) return fail("nested too deep");
+    m_prog.conds.append(c);
+    m_blocks.append(SeqBlock{SEQ_BLOCK_IF, m_line, add(SEQ_OP_BRANCH, m_prog.conds.size() - 1), -1, -1, {}});
+    return true;
+}
+
+bool SeqParser::endStatement()
+{
+    if (m_tok.size() != 1) return fail("end takes no arguments");
+    if (m_blocks.isEmpty()) return fail("end without repeat/loop/if");
+
+    const SeqBlock b = m_blocks.takeLast();
+    switch (b.kind) {
+    case SEQ_BLOCK_REPEAT:
+        add(SEQ_OP_LOOP_NEXT, b.counter, 0, b.start);
+        --m_counters;
+        break;
+    case SEQ_BLOCK_LOOP:
+        add(SEQ_OP_JUMP, 0, 0, b.start);
+        break;
+    case SEQ_BLOCK_IF:
+        m_prog.code[b.elseJump >= 0 ? b.elseJump : b.start].target = m_prog.code.size();
+        break;
+    }
+    for (int j : b.breaks) m_prog.code[j].target = m_prog.code.size();
+    m_openStep = -1;
+    return true;
+}
+
+} // namespace
+
+bool SeqCompiler::compile(const QByteArray &text, const CmdLibrary &lib, SeqProgram &program, QString *error)
+{
+    program = SeqProgram();
+    SeqParser parser(lib, program);
+    if (parser.parse(text)) return true;
+
+    if (error) *error = parser.error();
+    program = SeqProgram();
+    return false;
+}
+
+bool SeqCompiler::compileFile(const QString &path, const CmdLibrary &lib, SeqProgram &program, QString *error)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        if (error) *error = QString("cannot open %1").arg(path);
+        return false;
+    }
+    if (!compile(file.readAll(), lib, program, error)) return false;
+    program.name = QFileInfo(path).fileName();
+    return true;
+}
+
+/* ----------------------------- Interpreter ----------------------------- */
+
+SeqInterpreter::SeqInterpreter(SpiPlanExecutor &executor)
+    : m_executor(executor)
+{
+    for (qint64 &c : m_counters) c = 0;
+
+    // 只建立一次; 目前的 step 由 m_step 指定
+    m_onResult = [this](const SpiOp &op, const BYTE *data, int size) {
+        const SeqStep &step = m_program.steps.at(m_step);
+        if (step.kind == SEQ_STEP_READ) {
+            const QByteArray &cmd = step.cmds.at(op.cmdIndex);
+            Adbms6832Decoder::decode((const BYTE*)cmd.constData(), cmd.size(), data, size, m_dirNorth, m_sample);
+        }
+        return !m_hooks->onResult || m_hooks->onResult(m_step, op.cmdIndex, data, size);
+    };
+}
+
+void SeqInterpreter::link(const SeqProgram &program, const SpiPlanOptions &opt, int chainLength)
+{
+    m_program = program;
+    m_dirNorth = opt.dirNorth;
+    m_plans.resize(program.steps.size());
+
+    for (int i = 0; i < program.steps.size(); ++i) {
+        const SeqStep &s = program.steps[i];
+        SpiPlanOptions o = opt;
+        o.cmdDelayMs = s.delayMs;
+
+        if (s.kind == SEQ_STEP_WRITE) {
+            QByteArray data = s.data;
+            if (s.replicate) {
+                data.resize(adbmsChainBytes(chainLength));
+                adbmsBuildChainWrite((BYTE*)data.data(), (const BYTE*)s.data.constData(), chainLength);
+            }
+            m_plans[i] = SpiPlanCompiler::compileWrite(s.cmds.first(), data, o);
+        } else {
+            if (s.kind == SEQ_STEP_CMD) o.readSize = 0;
+            m_plans[i] = SpiPlanCompiler::compileRead(s.cmds, o);
+        }
+    }
+}
+
+int SeqInterpreter::planOps() const
+{
+    int ops = 0;
+    for (const SpiTransactionPlan &p : m_plans) ops += p.ops.size();
+    return ops;
+}
+
+bool SeqInterpreter::test(const SeqCond &c) const
+{
+    qint64 v;
+    switch (c.value) {
+    case SEQ_VALUE_CELL:
+    case SEQ_VALUE_AUX: {
+        if (c.device >= m_sample.devices.size()) return false;
+        const AfeDeviceSample &d = m_sample.devices[c.device];
+        const bool cell = c.value == SEQ_VALUE_CELL;
+        if (!((cell ? d.cellValid : d.auxValid) & (1u << c.index))) return false;
+        v = cell ? d.cellUv[c.index] : d.auxUv[c.index];
+        break;
+    }
+    case SEQ_VALUE_PEC_ERRORS:
+        v = m_sample.framesBad;
+        break;
+    default: {
+        qint32 lo = 0, hi = 0;
+        bool any = false;
+        for (const AfeDeviceSample &d : m_sample.devices) {
+            for (int i = 0; i < ADBMS6832_CELL_COUNT; ++i) {
+                if (!(d.cellValid & (1u << i))) continue;
+                if (!any || d.cellUv[i] < lo) lo = d.cellUv[i];
+                if (!any || d.cellUv[i] > hi) hi = d.cellUv[i];
+                any = true;
+            }
+        }
+        if (!any) return false;
+        v = c.value == SEQ_VALUE_CELL_MAX ? hi : c.value == SEQ_VALUE_CELL_MIN ? lo : hi - lo;
+        break;
+    }
+    }
+
+    switch (c.cmp) {
+    case SEQ_CMP_LT: return v <  c.threshold;
+    case SEQ_CMP_LE: return v <= c.threshold;
+    case SEQ_CMP_GT: return v >  c.threshold;
+    case SEQ_CMP_GE: return v >= c.threshold;
+    case SEQ_CMP_EQ: return v == c.threshold;
+    default:         return v != c.threshold;
+    }
+}
+
+void SeqInterpreter::emitSample()
+{
+    if (m_sample.groupsSeen && m_hooks->onEmit) {
+        m_hooks->onEmit(m_sample);
+        ++m_emitted;
+    }
+    m_sample.clear();
+}
+
+eTypeSeqResult SeqInterpreter::run(const SeqHooks &hooks)
+{
+    m_hooks = &hooks;
+    m_usbCalls = 0;
+    m_emitted = 0;
+    m_error.clear();
+    m_sample.clear();
+
+    const SeqInsn *code = m_program.code.constData();
+    const int size = m_program.code.size();
+    eTypeSeqResult result = SEQ_RESULT_DONE;
+
+    for (int pc = 0; pc < size; ) {
+        const SeqInsn &in = code[pc++];
+        switch (in.op) {
+        case SEQ_OP_END:
+            pc = size;
+            break;
+
+        case SEQ_OP_PLAN: {
+            if (hooks.keepRunning && !hooks.keepRunning()) return SEQ_RESULT_STOPPED;
+            m_step = in.a;
+            const eTypeSpiPlanResult r = m_executor.runCycle(m_plans.at(in.a), m_onResult);
+            m_usbCalls += m_executor.lastUsbCalls();
+            if (r == SPI_PLAN_STOPPED) return SEQ_RESULT_STOPPED;
+            if (r == SPI_PLAN_ERROR) {
+                m_error = QString("line %1: %2").arg(m_program.steps.at(in.a).line).arg(m_executor.lastError());
+                return SEQ_RESULT_ERROR;
+            }
+            break;
+        }
+
+        case SEQ_OP_WAIT:
+            if (hooks.keepRunning && !hooks.keepRunning()) return SEQ_RESULT_STOPPED;
+            if (hooks.waitUntil) {
+                if (!hooks.waitUntil(PrecisionTimer::nowNs() + in.value)) return SEQ_RESULT_STOPPED;
+            } else {
+                PrecisionTimer::waitUntilNs(PrecisionTimer::nowNs() + in.value);
+            }
+            break;
+
+        case SEQ_OP_LOOP_SET:
+            m_counters[in.a] = in.value;
+            if (in.value <= 0) pc = in.target;
+            break;
+
+        case SEQ_OP_LOOP_NEXT:
+            if (--m_counters[in.a] > 0) {
+                // 與 JUMP 相同: 往回跳時檢查停止
+                if (hooks.keepRunning && !hooks.keepRunning()) return SEQ_RESULT_STOPPED;
+                pc = in.target;
+            }
+            break;
+
+        case SEQ_OP_JUMP:
+            // 往回跳 (loop) 時檢查停止, 沒有 PLAN/WAIT 的迴圈也能結束
+            if (in.target < pc && hooks.keepRunning && !hooks.keepRunning()) return SEQ_RESULT_STOPPED;
+            pc = in.target;
+            break;
+
+        case SEQ_OP_BRANCH:
+            if (!test(m_program.conds.at(in.a))) pc = in.target;
+            break;
+
+        case SEQ_OP_EMIT:
+            emitSample();
+            break;
+
+        case SEQ_OP_FAIL:
+            m_error = m_program.messages.value(in.a);
+            result = SEQ_RESULT_FAILED;
+            pc = size;
+            break;
+        }
+    }
+
+    emitSample();
+    return result;
+}
@@ -0,0 +1,173 @@
+#ifndef SEQUENCER_H
+#define SEQUENCER_H
+
+#include <QByteArray>
+#include <QList>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <functional>
+#include "adbms6832_decoder.h"
+#include "cmd_library.h"
+#include "spi_transaction_plan.h"
+
+#define SEQ_MAX_DEPTH           8           // repeat/loop/if 巢狀層數
+#define SEQ_MAX_STEPS           0xFFFF      // SeqInsn.a 為 16 bits
+#define SEQ_MAX_WAIT_NS         86400000000000LL    // wait/delay 上限 1 天
+#define SEQ_MAX_VOLT_UV         100000000LL         // if 的電壓門檻上限 ±100 V
+
+typedef enum{
+    SEQ_OP_END = 0,         // 程式結束 (stop / 最後一行)
+    SEQ_OP_PLAN,            // 執行 step a 的 plan 一次
+    SEQ_OP_WAIT,            // 等待 value ns (可被 cancel/pause 中斷)
+    SEQ_OP_LOOP_SET,        // counter[a] = value; <= 0 時跳到 target
+    SEQ_OP_LOOP_NEXT,       // --counter[a] > 0 時跳到 target
+    SEQ_OP_JUMP,
+    SEQ_OP_BRANCH,          // cond[a] 不成立時跳到 target
+    SEQ_OP_EMIT,            // 送出目前的 AfeChainSample, 開始新的 cycle
+    SEQ_OP_FAIL,            // 結束並回報 messages[a]
+}eTypeSeqOp;
+
+typedef enum{
+    SEQ_STEP_READ = 0,      // 命令 + 讀回 chain 資料, 結果解碼到目前的樣本
+    SEQ_STEP_CMD,           // 只送命令 (ADCV, CLRCELL ...)
+    SEQ_STEP_WRITE,         // 命令 + 寫入資料
+}eTypeSeqStep;
+
+typedef enum{
+    SEQ_VALUE_CELL = 0,     // cell <afe> <n>
+    SEQ_VALUE_AUX,          // aux <afe> <n>
+    SEQ_VALUE_CELL_MAX,     // 所有有效 cell 的最大值
+    SEQ_VALUE_CELL_MIN,
+    SEQ_VALUE_CELL_DELTA,   // max - min
+    SEQ_VALUE_PEC_ERRORS,   // 目前樣本 PEC 錯誤的 frame 數
+}eTypeSeqValue;
+
+typedef enum{
+    SEQ_CMP_LT = 0,
+    SEQ_CMP_LE,
+    SEQ_CMP_GT,
+    SEQ_CMP_GE,
+    SEQ_CMP_EQ,
+    SEQ_CMP_NE,
+}eTypeSeqCmp;
+
+/* 16 Bytes 指令, 執行時不做任何字串或配置 */
+struct SeqInsn {
+    BYTE   op;
+    BYTE   reserved;
+    WORD   a;                   // step / counter / cond / message index
+    qint32 target;              // 跳躍目的 (指令 index)
+    qint64 value;               // WAIT ns / LOOP_SET 次數
+};
+
+struct SeqStep {
+    BYTE              kind = SEQ_STEP_READ;
+    int               line = 0;         // 來源行號, 錯誤訊息用
+    int               delayMs = 0;      // 每條命令後的延遲 (delay 選項)
+    bool              replicate = false;    // write ... each: 6 Bytes 範本複製到每顆 AFE
+    QList<QByteArray> cmds;             // READ 可有多條 (連續的 read 行合併)
+    QByteArray        data;
+};
+
+/* 值不存在 (cell 無效, AFE 不在 chain 上) 時條件不成立 */
+struct SeqCond {
+    BYTE   value = SEQ_VALUE_CELL;
+    BYTE   cmp = SEQ_CMP_LT;
+    WORD   device = 0;          // AFE index (chain 順序, 0 起)
+    BYTE   index = 0;           // cell/aux index (0 起)
+    qint64 threshold = 0;       // uV 或次數
+};
+
+struct SeqProgram {
+    QString          name;
+    QVector<SeqInsn> code;
+    QVector<SeqStep> steps;
+    QVector<SeqCond> conds;
+    QStringList      messages;
+
+    bool    isEmpty() const { return code.isEmpty(); }
+    QString dump() const;       // 除錯用文字
+};
+
+/*
+ * SeqCompiler
+ *  將 .seq 文字編譯成 SeqProgram. 一行一個敘述, # 之後為註解, 關鍵字不分大小寫:
+ *    read <cmd> [delay <t>]          命令 + 讀回; 連續的 read/readset 合併成同一個 plan
+ *    readset <id|"desc"> [delay <t>] SPI_READ_CMD_SET 的整個 SET
+ *    cmd <cmd> [delay <t>]           只送命令 (不讀回)
+ *    write <cmd> data|each <data>    寫入; each = 資料前 6 Bytes 複製到 chain 上每顆 AFE
+ *    wait <t>                        t = 數字 + us/ms/s
+ *    repeat <n> ... end / loop ... end / break
+ *    if <value> <op> <x> ... [else ...] end
+ *        value: cell <afe> <n> | aux <afe> <n> | cellmax | cellmin | celldelta | pecerr
+ *        op: < <= > >= == !=;  x: 電壓 (V, 可加 mV/uV) 或 pecerr 的次數;  afe/n 由 1 起算
+ *    emit                            送出目前的樣本 (結束時自動送出剩餘的)
+ *    stop / fail "message"
+ *  <cmd>/<data>: "label" (清單檔) 或 label 或命令文字 (見 CmdLibrary::parseCmdText)
+ */
+class SeqCompiler
+{
+public:
+    static bool compile(const QByteArray &text, const CmdLibrary &lib, SeqProgram &program, QString *error = nullptr);
+    static bool compileFile(const QString &path, const CmdLibrary &lib, SeqProgram &program, QString *error = nullptr);
+};
+
+typedef enum{
+    SEQ_RESULT_DONE = 0,
+    SEQ_RESULT_STOPPED,     // keepRunning / onResult / waitUntil 要求停止
+    SEQ_RESULT_FAILED,      // fail 敘述, 見 lastError()
+    SEQ_RESULT_ERROR,       // USB 呼叫失敗, 見 lastError()
+}eTypeSeqResult;
+
+/* 由呼叫端 (AcquisitionWorker / CLI) 提供的動作; 回傳 false → 停止 */
+struct SeqHooks {
+    std::function<bool(int step, int cmdIndex, const BYTE *data, int size)> onResult;
+    std::function<void(AfeChainSample &sample)> onEmit;
+    std::function<bool(qint64 deadlineNs)> waitUntil;
+    std::function<bool()> keepRunning;      // 每個 PLAN/WAIT 前檢查
+};
+
+/*
+ * SeqInterpreter
+ *  link() 時把每個 step 編譯成 SpiTransactionPlan (write each 的資料也在此展開);
+ *  run() 以 switch 逐條執行 SeqInsn, 每個 step 只是一次 runCycle, 不產生 QString/QByteArray.
+ */
+class SeqInterpreter
+{
+public:
+    explicit SeqInterpreter(SpiPlanExecutor &executor);
+
+    // opt.readSize 為 chain 的讀取長度; 各 step 的 delay 覆蓋 opt.cmdDelayMs
+    void link(const SeqProgram &program, const SpiPlanOptions &opt, int chainLength);
+
+    eTypeSeqResult run(const SeqHooks &hooks);
+
+    const SeqProgram &program() const   { return m_program; }
+    const SpiTransactionPlan &plan(int step) const { return m_plans.at(step); }
+    int     planOps() const;                    // 所有 step 的 op 總數
+    int     usbCalls() const    { return m_usbCalls; }     // 最近一次 run
+    int     emitted() const     { return m_emitted; }
+    QString lastError() const   { return m_error; }
+
+private:
+    SpiPlanExecutor           &m_executor;
+    SeqProgram                 m_program;
+    QVector<SpiTransactionPlan> m_plans;
+    bool                       m_dirNorth = true;
+
+    const SeqHooks            *m_hooks = nullptr;
+    int                        m_step = 0;
+    AfeChainSample             m_sample;
+    SpiPlanExecutor::ResultFn  m_onResult;
+    qint64                     m_counters[SEQ_MAX_DEPTH];
+
+    int     m_usbCalls = 0;
+    int     m_emitted = 0;
+    QString m_error;
+
+    bool test(const SeqCond &c) const;
+    void emitSample();
+};
+
+#endif // SEQUENCER_H
@@ -0,0 +1,257 @@
+#include "spi_log.h"
+#include "precision_timer.h"
+#include "spi_trace.h"
+
+#include <QTime>
+#include <cstring>
+
+static quint64 roundUpPow2(int n)
+{
+    quint64 v = 1;
+    while (v < quint64(n > 0 ? n : 1)) v <<= 1;
+    return v;
+}
+
+SpiLogSink::SpiLogSink(int recordCapacity, int byteCapacity)
+{
+    const quint64 records = roundUpPow2(recordCapacity);
+    const quint64 bytes   = roundUpPow2(byteCapacity);
+
+    m_records.resize(int(records));
+    m_bytes.resize(int(bytes));
+    m_recordMask = records - 1;
+    m_byteMask   = bytes - 1;
+
+    m_baseNs      = PrecisionTimer::nowNs();
+    m_baseMsOfDay = QTime::currentTime().msecsSinceStartOfDay();
+}
+
+void SpiLogSink::append(eTypeSpiLogKind kind, const BYTE *data, int size, WORD cmdIndex, BYTE adapter)
+{
+    const qint64 now = PrecisionTimer::nowNs();
+    const quint64 byteCap = m_byteMask + 1;
+    if (size < 0) size = 0;
+    if (quint64(size) > byteCap) size = int(byteCap);
+
+    QMutexLocker lock(&m_mutex);
+
+    SpiLogRecord &rec = m_records[int(m_end & m_recordMask)];
+    rec.timeNs   = now;
+    rec.dataPos  = m_bytePos;
+    rec.size     = quint32(size);
+    rec.kind     = BYTE(kind);
+    rec.adapter  = adapter;
+    rec.cmdIndex = cmdIndex;
+
+    // 資料區環繞時分兩段複製
+    const quint64 at   = m_bytePos & m_byteMask;
+    const quint64 tail = byteCap - at;
+    char *dst = m_bytes.data();
+    if (quint64(size) <= tail) {
+        memcpy(dst + at, data, size_t(size));
+    } else {
+        memcpy(dst + at, data, size_t(tail));
+        memcpy(dst, data + tail, size_t(quint64(size) - tail));
+    }
+    m_bytePos += quint64(size);
+    ++m_end;
+
+    // 淘汰: 紀錄槽被覆蓋, 或資料已被新資料蓋掉
+    const quint64 recordCap = m_recordMask + 1;
+    while (m_first < m_end) {
+        const SpiLogRecord &old = m_records[int(m_first & m_recordMask)];
+        if (m_end - m_first > recordCap || old.dataPos + byteCap < m_bytePos) {
+            ++m_first;
+            ++m_dropped;
+        } else {
+            break;
+        }
+    }
+}
+
+void SpiLogSink::clear()
+{
+    QMutexLocker lock(&m_mutex);
+    m_first = m_end;
+}
+
+void SpiLogSink::range(quint64 *first, quint64 *end) const
+{
+    QMutexLocker lock(&m_mutex);
+    if (first) *first = m_first;
+    if (end)   *end   = m_end;
+}
+
+bool SpiLogSink::read(quint64 seq, SpiLogRecord *rec, QByteArray *data) const
+{
+    QMutexLocker lock(&m_mutex);
+    if (seq < m_first || seq >= m_end) return false;
+
+    const SpiLogRecord &r = m_records[int(seq & m_recordMask)];
+    if (rec) *rec = r;
+    if (data) {
+        const quint64 byteCap = m_byteMask + 1;
+        const quint64 at   = r.dataPos & m_byteMask;
+        const quint64 tail = byteCap - at;
+        data->resize(int(r.size));
+        char *dst = data->data();
+        if (r.size <= tail) {
+            memcpy(dst, m_bytes.constData() + at, r.size);
+        } else {
+            memcpy(dst, m_bytes.constData() + at, size_t(tail));
+            memcpy(dst + tail, m_bytes.constData(), size_t(r.size - tail));
+        }
+    }
+    return true;
+}
+
+quint64 SpiLogSink::dropped() const
+{
+    QMutexLocker lock(&m_mutex);
+    return m_dropped;
+}
+
+int SpiLogSink::wallMsOfDay(qint64 timeNs) const
+{
+    const qint64 ms = m_baseMsOfDay + (timeNs - m_baseNs) / 1000000;
+    return int(((ms % 86400000) + 86400000) % 86400000);
+}
+
+/* ---------------- Model ---------------- */
+
+SpiLogModel::SpiLogModel(SpiLogSink *sink, QObject *parent)
+    : QAbstractListModel(parent)
+    , m_sink(sink)
+{
+    m_sink->range(&m_first, &m_end);
+
+    connect(&m_timer, &QTimer::timeout, this, &SpiLogModel::refresh);
+    m_timer.start(50);
+}
+
+void SpiLogModel::setRefreshIntervalMs(int ms)
+{
+    m_timer.start(ms > 0 ? ms : 50);
+}
+
+void SpiLogModel::setShowAdapter(bool show)
+{
+    if (m_showAdapter == show) return;
+    m_showAdapter = show;
+    if (m_end > m_first) emit dataChanged(index(0), index(int(m_end - m_first) - 1));
+}
+
+int SpiLogModel::rowCount(const QModelIndex &parent) const
+{
+    if (parent.isValid()) return 0;
+    return int(m_end - m_first);
+}
+
+/* 同一次 refresh 內: 先移除被覆蓋/清除的前段, 再一次插入新增的尾段 */
+void SpiLogModel::refresh()
+{
+    quint64 first, end;
+    m_sink->range(&first, &end);
+    if (first == m_first && end == m_end) return;
+
+    if (first >= m_end) {
+        // 現有的列全部失效
+        if (m_end > m_first) {
+            beginRemoveRows(QModelIndex(), 0, int(m_end - m_first) - 1);
+            m_first = m_end;
+            endRemoveRows();
+        }
+        m_first = m_end = first;
+    } else if (first > m_first) {
+        beginRemoveRows(QModelIndex(), 0, int(first - m_first) - 1);
+        m_first = first;
+        endRemoveRows();
+    }
+
+    if (end > m_end) {
+        const int row = int(m_end - m_first);
+        beginInsertRows(QModelIndex(), row, row + int(end - m_end) - 1);
+        m_end = end;
+        endInsertRows();
+    }
+}
+
+/* 256 個 "0xHH" 字串, 格式化時直接複製 */
+struct HexByteTable {
+    char text[256][4];
+    HexByteTable() {
+        static const char digits[] = "0123456789ABCDEF";
+        for (int i = 0; i < 256; ++i) {
+            text[i][0] = '0';
+            text[i][1] = 'x';
+            text[i][2] = digits[i >> 4];
+            text[i][3] = digits[i & 0x0F];
+        }
+    }
+};
+static const HexByteTable kHexTable;
+
+QString SpiLogModel::formatRecord(const SpiLogRecord &rec, const BYTE *data, int size, int msOfDay,
+                                  bool showAdapter)
+{
+    // "[HH:mm:ss.zzz] Read : 0x00 0x01", showAdapter 時 "[HH:mm:ss.zzz] U1 Read : ..."; 錯誤為 "Error: <訊息>"
+    QByteArray line(28 + size * 5, ' ');
+    char *o = line.data();
+
+    const int h  = msOfDay / 3600000;
+    const int m  = (msOfDay / 60000) % 60;
+    const int s  = (msOfDay / 1000) % 60;
+    const int ms = msOfDay % 1000;
+
+    *o++ = '[';
+    *o++ = char('0' + h / 10);  *o++ = char('0' + h % 10);  *o++ = ':';
+    *o++ = char('0' + m / 10);  *o++ = char('0' + m % 10);  *o++ = ':';
+    *o++ = char('0' + s / 10);  *o++ = char('0' + s % 10);  *o++ = '.';
+    *o++ = char('0' + ms / 100); *o++ = char('0' + (ms / 10) % 10); *o++ = char('0' + ms % 10);
+    *o++ = ']';
+    *o++ = ' ';
+
+    if (showAdapter) {
+        *o++ = 'U';
+        if (rec.adapter >= 10) *o++ = char('0' + rec.adapter / 10 % 10);
+        *o++ = char('0' + rec.adapter % 10);
+        *o++ = ' ';
+    }
+
+    if (rec.kind == SPI_LOG_ERROR) {
+        memcpy(o, "Error: ", 7);
+        o += 7;
+        line.resize(int(o - line.constData()));
+        return QString::fromLatin1(line) + QString::fromUtf8((const char*)data, size);
+    }
+
+    const char *tag = (rec.kind == SPI_LOG_WRITE) ? "Wrote:" : "Read :";
+    memcpy(o, tag, 6);
+    o += 6;
+
+    for (int i = 0; i < size; ++i) {
+        *o++ = ' ';
+        memcpy(o, kHexTable.text[data[i]], 4);
+        o += 4;
+    }
+
+    line.resize(int(o - line.constData()));
+    return QString::fromLatin1(line);
+}
+
+QVariant SpiLogModel::data(const QModelIndex &index, int role) const
+{
+    if (role != Qt::DisplayRole || !index.isValid()) return QVariant();
+
+    const quint64 seq = m_first + quint64(index.row());
+    SpiLogRecord rec;
+    QByteArray bytes;
+    if (!m_sink->read(seq, &rec, &bytes))
+        return QStringLiteral("[overwritten]");
+
+    const qint64 t0 = PrecisionTimer::nowNs();
+    const QString text = formatRecord(rec, (const BYTE*)bytes.constData(), bytes.size(),
+                                      m_sink->wallMsOfDay(rec.timeNs), m_showAdapter);
+    SpiTrace::record(SPI_PHASE_UI_FORMAT, SPI_TRACE_UI_THREAD, t0, PrecisionTimer::nowNs());
+    return text;
+}
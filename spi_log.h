@@ -0,0 +1,95 @@
+#ifndef SPI_LOG_H
+#define SPI_LOG_H
+
+#include <QAbstractListModel>
+#include <QByteArray>
+#include <QMutex>
+#include <QTimer>
+#include <QVector>
+#include "usb2uis_backend.h"
+
+typedef enum{
+    SPI_LOG_READ = 0,
+    SPI_LOG_WRITE,
+    SPI_LOG_ERROR,          // data 為錯誤訊息 (UTF-8), 重試用完仍失敗的命令
+}eTypeSpiLogKind;
+
+/* 一筆原始紀錄, bytes 存放在 sink 的環形資料區 */
+struct SpiLogRecord {
+    qint64  timeNs   = 0;       // PrecisionTimer::nowNs()
+    quint64 dataPos  = 0;       // 資料區的累計位置
+    quint32 size     = 0;
+    BYTE    kind     = SPI_LOG_READ;
+    BYTE    adapter  = 0;       // DeviceManager 的裝置編號
+    WORD    cmdIndex = 0;
+};
+
+/*
+ * SpiLogSink
+ *  固定容量的紀錄環形緩衝; acquisition 執行緒只做 memcpy, 不做任何格式化.
+ *  紀錄數或資料量超過容量時覆蓋最舊的紀錄, 記憶體用量固定.
+ *  序號 seq 單調遞增, 有效範圍 [firstSeq, endSeq).
+ */
+class SpiLogSink
+{
+public:
+    // 容量會進位成 2 的次方
+    explicit SpiLogSink(int recordCapacity = 65536, int byteCapacity = 4 * 1024 * 1024);
+
+    void append(eTypeSpiLogKind kind, const BYTE *data, int size, WORD cmdIndex = 0, BYTE adapter = 0);
+    void clear();                   // 丟棄現有紀錄, 序號不歸零
+
+    void    range(quint64 *first, quint64 *end) const;
+    bool    read(quint64 seq, SpiLogRecord *rec, QByteArray *data) const;
+    quint64 dropped() const;        // 被覆蓋 (未被清除) 的紀錄數
+
+    int     wallMsOfDay(qint64 timeNs) const;   // 轉成當日毫秒, 顯示用
+
+private:
+    mutable QMutex        m_mutex;
+    QVector<SpiLogRecord> m_records;
+    QByteArray            m_bytes;
+    quint64               m_recordMask;
+    quint64               m_byteMask;
+
+    quint64 m_first   = 0;
+    quint64 m_end     = 0;
+    quint64 m_bytePos = 0;
+    quint64 m_dropped = 0;
+
+    qint64  m_baseNs;
+    int     m_baseMsOfDay;
+};
+
+/*
+ * SpiLogModel
+ *  虛擬化的 list model: 只保存 seq 範圍, 畫面需要的列才格式化 HEX.
+ *  以固定週期 (預設 50ms) 檢查 sink, 將新增/覆蓋合併成一次 rows 變更.
+ */
+class SpiLogModel : public QAbstractListModel
+{
+    Q_OBJECT
+
+public:
+    explicit SpiLogModel(SpiLogSink *sink, QObject *parent = nullptr);
+
+    int      rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+
+    void setRefreshIntervalMs(int ms);
+    void setShowAdapter(bool show);     // 多台 USB2UIS 時每列加上 "U<n>"
+    static QString formatRecord(const SpiLogRecord &rec, const BYTE *data, int size, int msOfDay,
+                                bool showAdapter = false);
+
+public slots:
+    void refresh();
+
+private:
+    SpiLogSink *m_sink;
+    QTimer      m_timer;
+    quint64     m_first = 0;
+    quint64     m_end   = 0;
+    bool        m_showAdapter = false;
+};
+
+#endif // SPI_LOG_H
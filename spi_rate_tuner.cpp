@@ -0,0 +1,170 @@
+#include "spi_rate_tuner.h"
+#include "adbms6832_decoder.h"
+#include "precision_timer.h"
+#include "spi_trace.h"
+#include "usb2uis_interface.h"
+
+#include <QSettings>
+
+const SpiRateTuneStep *SpiRateTuneResult::step(int rate) const
+{
+    for (const SpiRateTuneStep &s : steps)
+        if (s.rate == rate) return &s;
+    return nullptr;
+}
+
+SpiRateTuneResult SpiRateTuner::run(SpiPlanExecutor &executor, BYTE index, const SpiRateTuneParams &p,
+                                    const SpiRateTuneHooks &hooks)
+{
+    SpiRateTuneResult result;
+    result.time = QDateTime::currentDateTime();
+
+    // 錯誤要計數而不是中止, 失敗的呼叫由 lastFailedCalls 統計
+    SpiPlanOptions opt = p.plan;
+    opt.abortOnError = false;
+    const SpiTransactionPlan plan = SpiPlanCompiler::compileRead(p.cmds, opt);
+
+    // 量測原始的錯誤率: 掃描期間不重試
+    const SpiRetryPolicy policy = executor.retryPolicy();
+    SpiRetryPolicy raw;
+    raw.verifyPec = false;
+    executor.setRetryPolicy(raw);
+
+    const int lo = qBound(0, p.minRate, USB2UIS_SPI_RATE_COUNT - 1);
+    const int hi = qBound(lo, p.maxRate, USB2UIS_SPI_RATE_COUNT - 1);
+    for (int rate = lo; rate <= hi; ++rate) {
+        SpiRateTuneStep step;
+        step.rate = BYTE(rate);
+        step.kHz  = usb2uisSpiRateKHz(rate);
+        step.configOk = Usb2UisInterface::USBIO_SPISetConfig(index, BYTE((p.mode << 4) | rate), p.timeout);
+        executor.reset();
+
+        bool stopped = false;
+        if (step.configOk) measure(executor, plan, p, hooks, step, &stopped);
+        if (stopped) {
+            result.cancelled = true;
+            break;
+        }
+
+        step.qualified = step.configOk && step.cycles > 0 && step.transferFailures == 0
+                      && step.errorRate() * p.margin <= p.errorBudget;
+        result.steps.append(step);
+        if (hooks.onStep) hooks.onStep(step);
+        if (!step.qualified) break;
+    }
+
+    if (!result.cancelled) result.chosen = choose(result.steps, p.minGain);
+
+    const BYTE rate = result.chosen >= 0 ? BYTE(result.chosen) : p.restoreRate;
+    Usb2UisInterface::USBIO_SPISetConfig(index, BYTE((p.mode << 4) | (rate & 0x0F)), p.timeout);
+    executor.reset();
+    executor.setRetryPolicy(policy);
+    return result;
+}
+
+/* 一個不計入的 cycle (wake-up, 線路初始化) 之後量測 p.cycles 次 */
+void SpiRateTuner::measure(SpiPlanExecutor &executor, const SpiTransactionPlan &plan, const SpiRateTuneParams &p,
+                           const SpiRateTuneHooks &hooks, SpiRateTuneStep &step, bool *stopped)
+{
+    AfeChainSample sample;
+    quint64 frames = 0, pecErrors = 0;
+    const SpiPlanExecutor::ResultFn onResult = [&](const SpiOp &op, const BYTE *data, int size) {
+        const QByteArray &cmd = p.cmds.at(op.cmdIndex);
+        const int pec = Adbms6832Decoder::decode((const BYTE*)cmd.constData(), cmd.size(), data, size,
+                                                 p.plan.dirNorth, sample);
+        if (pec >= 0) {
+            frames    += quint64(size / ADBMS6832_FRAME_SIZE);
+            pecErrors += quint64(pec);
+        }
+        return true;
+    };
+
+    executor.runCycle(plan, onResult);
+
+    SpiPhaseHistogram cycleTime;
+    frames = pecErrors = 0;
+    for (int i = 0; i < p.cycles; ++i) {
+        if (hooks.keepRunning && !hooks.keepRunning()) {
+            *stopped = true;
+            return;
+        }
+        sample.clear();
+        const qint64 t0 = PrecisionTimer::nowNs();
+        executor.runCycle(plan, onResult);
+        cycleTime.record(PrecisionTimer::nowNs() - t0);
+        step.transferFailures += quint64(executor.lastFailedCalls());
+        ++step.cycles;
+    }
+
+    const SpiPhaseHistogram::Stats st = cycleTime.stats();
+    step.frames      = frames;
+    step.pecErrors   = pecErrors;
+    step.cycleMeanNs = st.meanNs;
+    step.cycleP99Ns  = st.p99Ns;
+}
+
+/* 合格的 rate 都在 steps 的開頭 (第一個不合格即停止); steps 由慢到快, 第一個 cycle 時間在最佳值 x (1 + minGain) 以內者即為最慢者 */
+int SpiRateTuner::choose(const QVector<SpiRateTuneStep> &steps, double minGain)
+{
+    qint64 best = 0;
+    for (const SpiRateTuneStep &s : steps)
+        if (s.qualified && (best == 0 || s.cycleMeanNs < best)) best = s.cycleMeanNs;
+    if (best == 0) return -1;
+
+    for (const SpiRateTuneStep &s : steps)
+        if (s.qualified && double(s.cycleMeanNs) <= double(best) * (1.0 + minGain)) return s.rate;
+    return -1;
+}
+
+QString SpiRateTuner::stepText(const SpiRateTuneStep &step)
+{
+    if (!step.configOk) return QString("%1 kHz: set config failed").arg(step.kHz);
+    return QString("%1 kHz: pec %2/%3, usb fail %4, cycle %5 us (p99 %6 us)%7")
+            .arg(step.kHz).arg(step.pecErrors).arg(step.frames).arg(step.transferFailures)
+            .arg(step.cycleMeanNs / 1000).arg(step.cycleP99Ns / 1000)
+            .arg(step.qualified ? "" : " - fail");
+}
+
+QString SpiRateTuner::summary(const SpiRateTuneResult &result)
+{
+    if (result.cancelled) return "Auto tune cancelled";
+    if (result.chosen < 0) return "Auto tune: no rate meets the error budget";
+
+    const SpiRateTuneStep *s = result.step(result.chosen);
+    return QString("Auto tune: %1 kHz, cycle %2 us, %3 rates tested")
+            .arg(s->kHz).arg(s->cycleMeanNs / 1000).arg(result.steps.size());
+}
+
+QString SpiRateTuner::settingsKey(const QString &adapter, int chainLength, BYTE mode, bool dirNorth)
+{
+    return QString("%1_chain%2_mode%3_%4").arg(adapter).arg(chainLength).arg(int(mode & 0x03))
+            .arg(dirNorth ? "north" : "south");
+}
+
+void SpiRateTuner::save(QSettings &settings, const QString &key, const SpiRateTuneResult &result)
+{
+    if (result.chosen < 0) return;
+    const SpiRateTuneStep *s = result.step(result.chosen);
+
+    settings.beginGroup("SpiRateTune");
+    settings.beginGroup(key);
+    settings.setValue("rate",      result.chosen);
+    settings.setValue("kHz",       s->kHz);
+    settings.setValue("cycleUs",   s->cycleMeanNs / 1000);
+    settings.setValue("errorRate", s->errorRate());
+    settings.setValue("time",      result.time.toString(Qt::ISODate));
+    settings.endGroup();
+    settings.endGroup();
+}
+
+int SpiRateTuner::load(QSettings &settings, const QString &key, QDateTime *time)
+{
+    settings.beginGroup("SpiRateTune");
+    settings.beginGroup(key);
+    bool ok = false;
+    const int rate = settings.value("rate").toInt(&ok);
+    if (time) *time = QDateTime::fromString(settings.value("time").toString(), Qt::ISODate);
+    settings.endGroup();
+    settings.endGroup();
+    return (ok && rate >= 0 && rate < USB2UIS_SPI_RATE_COUNT) ? rate : -1;
+}
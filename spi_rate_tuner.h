@@ -0,0 +1,100 @@
+#ifndef SPI_RATE_TUNER_H
+#define SPI_RATE_TUNER_H
+
+#include <QByteArray>
+#include <QDateTime>
+#include <QList>
+#include <QMetaType>
+#include <QString>
+#include <QVector>
+#include <functional>
+#include "spi_transaction_plan.h"
+
+class QSettings;
+
+#define SPI_RATE_TUNE_CYCLES        200     // 每個 rate 的量測 cycle 數
+#define SPI_RATE_TUNE_BUDGET        1e-3    // 容許的 PEC 錯誤 frame 比例
+#define SPI_RATE_TUNE_MARGIN        10.0    // 量測值需低於 budget / margin
+#define SPI_RATE_TUNE_MIN_GAIN      0.03    // 較快的 clock 需縮短 cycle 時間至少 3% 才採用
+#define SPI_RATE_TUNE_SETTINGS      "usb2uis_tune.ini"     // 執行檔目錄, App 與 CLI 共用
+
+/* 掃描設定; cmds 為量測用的 READ SET (RDxx), plan 的 readSize/方向/分段與實際擷取相同 */
+struct SpiRateTuneParams {
+    QList<QByteArray> cmds;
+    quint16        setId       = 0;
+    SpiPlanOptions plan;
+    BYTE           mode        = 0;     // SPI mode (config byte bit5~4)
+    DWORD          timeout     = (100 << 16) | 100;
+    BYTE           restoreRate = 0;     // 沒有合格的 rate 時恢復的設定
+    int            minRate     = 0;
+    int            maxRate     = 8;     // USB2UIS_SPI_RATE_COUNT - 1
+    int            cycles      = SPI_RATE_TUNE_CYCLES;
+    double         errorBudget = SPI_RATE_TUNE_BUDGET;
+    double         margin      = SPI_RATE_TUNE_MARGIN;
+    double         minGain     = SPI_RATE_TUNE_MIN_GAIN;
+};
+
+/* 單一 rate 的量測結果 */
+struct SpiRateTuneStep {
+    BYTE    rate = 0;
+    int     kHz = 0;
+    bool    configOk = false;       // USBIO_SPISetConfig
+    int     cycles = 0;
+    quint64 frames = 0;             // 讀回的 frame 數 (每顆 AFE 每個 RDxx 一個)
+    quint64 pecErrors = 0;          // PEC 錯誤的 frame 數
+    quint64 transferFailures = 0;   // 失敗的 USB 呼叫
+    qint64  cycleMeanNs = 0;
+    qint64  cycleP99Ns = 0;
+    bool    qualified = false;
+
+    double errorRate() const { return frames ? double(pecErrors) / double(frames) : 1.0; }
+};
+
+struct SpiRateTuneResult {
+    QVector<SpiRateTuneStep> steps;     // 依 rate 由慢到快
+    int       chosen = -1;              // 選定的 rate, -1 = 沒有合格的 rate
+    bool      cancelled = false;
+    QDateTime time;
+
+    const SpiRateTuneStep *step(int rate) const;
+};
+
+Q_DECLARE_METATYPE(SpiRateTuneParams)
+Q_DECLARE_METATYPE(SpiRateTuneStep)
+Q_DECLARE_METATYPE(SpiRateTuneResult)
+
+struct SpiRateTuneHooks {
+    std::function<void(const SpiRateTuneStep &step)> onStep;
+    std::function<bool()> keepRunning;      // 每個 cycle 前檢查, false → 中止 (恢復 restoreRate)
+};
+
+/*
+ * SpiRateTuner
+ *  由慢到快逐一以 USBIO_SPISetConfig 設定 rate, 每個 rate 先跑一個不計入的 cycle (wake-up),
+ *  再執行 cycles 次 READ SET, 統計 PEC 錯誤 frame, USB 呼叫失敗與 cycle 時間.
+ *  合格: 沒有 USB 呼叫失敗, 且 PEC 錯誤比例 x margin <= errorBudget.
+ *  第一個不合格的 rate 之後不再往上掃 (之上的結果不可信).
+ *  選定: 合格的 rate 中 cycle 時間最短者; 較快的 clock 若未縮短 minGain 以上則取較慢者 (多留邊際).
+ *  結束時裝置設定為選定的 rate (沒有時為 restoreRate).
+ */
+class SpiRateTuner
+{
+public:
+    static SpiRateTuneResult run(SpiPlanExecutor &executor, BYTE index, const SpiRateTuneParams &p,
+                                 const SpiRateTuneHooks &hooks);
+
+    static QString summary(const SpiRateTuneResult &result);
+    static QString stepText(const SpiRateTuneStep &step);
+
+    // 儲存/讀取: 每個 adapter + chain 設定一筆 (群組 SpiRateTune)
+    static QString settingsKey(const QString &adapter, int chainLength, BYTE mode, bool dirNorth);
+    static void save(QSettings &settings, const QString &key, const SpiRateTuneResult &result);
+    static int  load(QSettings &settings, const QString &key, QDateTime *time = nullptr);     // -1 = 沒有紀錄
+
+private:
+    static void measure(SpiPlanExecutor &executor, const SpiTransactionPlan &plan, const SpiRateTuneParams &p,
+                        const SpiRateTuneHooks &hooks, SpiRateTuneStep &step, bool *stopped);
+    static int  choose(const QVector<SpiRateTuneStep> &steps, double minGain);
+};
+
+#endif // SPI_RATE_TUNER_H
@@ -0,0 +1,263 @@
+#include "spi_trace.h"
+#include "precision_timer.h"
+
+#include <QFile>
+#include <QByteArray>
+#include <QtAlgorithms>
+#include <climits>
+
+std::atomic<bool> SpiTrace::s_enabled(true);
+
+/* ----------------------------- Histogram ----------------------------- */
+
+SpiPhaseHistogram::SpiPhaseHistogram()
+    : m_count(0), m_sumNs(0), m_maxNs(0)
+{
+    for (std::atomic<quint32> &b : m_buckets) b.store(0, std::memory_order_relaxed);
+}
+
+/*
+ * ns < 8 直接對應 bucket 0~7;
+ * 其餘以 floor(log2) 為 exponent, 再取次高 3 bits 為 sub-bucket.
+ */
+int SpiPhaseHistogram::bucketOf(qint64 ns)
+{
+    if (ns < (1 << SPI_HIST_SUB_BITS)) return ns < 0 ? 0 : int(ns);
+
+    const quint64 v = qMin(quint64(ns), (quint64(1) << (SPI_HIST_MAX_EXP + 1)) - 1);
+    const int exp = 63 - qCountLeadingZeroBits(v);
+    const int sub = int(v >> (exp - SPI_HIST_SUB_BITS)) & ((1 << SPI_HIST_SUB_BITS) - 1);
+    return ((exp - SPI_HIST_SUB_BITS + 1) << SPI_HIST_SUB_BITS) + sub;
+}
+
+qint64 SpiPhaseHistogram::bucketLowNs(int bucket)
+{
+    if (bucket < (1 << SPI_HIST_SUB_BITS)) return bucket;
+
+    const int exp = (bucket >> SPI_HIST_SUB_BITS) + SPI_HIST_SUB_BITS - 1;
+    const int sub = bucket & ((1 << SPI_HIST_SUB_BITS) - 1);
+    return qint64((1 << SPI_HIST_SUB_BITS) + sub) << (exp - SPI_HIST_SUB_BITS);
+}
+
+void SpiPhaseHistogram::record(qint64 ns)
+{
+    m_buckets[bucketOf(ns)].fetch_add(1, std::memory_order_relaxed);
+    m_count.fetch_add(1, std::memory_order_relaxed);
+    m_sumNs.fetch_add(ns, std::memory_order_relaxed);
+
+    qint64 prev = m_maxNs.load(std::memory_order_relaxed);
+    while (ns > prev && !m_maxNs.compare_exchange_weak(prev, ns, std::memory_order_relaxed)) {
+    }
+}
+
+void SpiPhaseHistogram::reset()
+{
+    for (std::atomic<quint32> &b : m_buckets) b.store(0, std::memory_order_relaxed);
+    m_count.store(0);
+    m_sumNs.store(0);
+    m_maxNs.store(0);
+}
+
+/* 百分位取 bucket 中點, 不超過實際最大值; 讀取期間仍在寫入時為近似值 */
+SpiPhaseHistogram::Stats SpiPhaseHistogram::stats() const
+{
+    quint32 counts[SPI_HIST_BUCKETS];
+    qint64 total = 0;
+    for (int i = 0; i < SPI_HIST_BUCKETS; ++i) {
+        counts[i] = m_buckets[i].load(std::memory_order_relaxed);
+        total += counts[i];
+    }
+
+    Stats s;
+    s.count  = total;
+    s.maxNs  = m_maxNs.load(std::memory_order_relaxed);
+    const qint64 n = m_count.load(std::memory_order_relaxed);
+    s.meanNs = n ? m_sumNs.load(std::memory_order_relaxed) / n : 0;
+    s.p50Ns  = 0;
+    s.p99Ns  = 0;
+    if (total == 0) return s;
+
+    const qint64 rank50 = (total * 50 + 99) / 100;
+    const qint64 rank99 = (total * 99 + 99) / 100;
+    qint64 seen = 0;
+    for (int i = 0; i < SPI_HIST_BUCKETS; ++i) {
+        if (counts[i] == 0) continue;
+        const qint64 before = seen;
+        seen += counts[i];
+        const qint64 lo  = bucketLowNs(i);
+        const qint64 hi  = i + 1 < SPI_HIST_BUCKETS ? bucketLowNs(i + 1) : lo * 2;
+        const qint64 mid = qMin(lo + (hi - lo) / 2, s.maxNs);
+        if (before < rank50 && seen >= rank50) s.p50Ns = mid;
+        if (before < rank99 && seen >= rank99) { s.p99Ns = mid; break; }
+    }
+    return s;
+}
+
+/* ----------------------------- Trace ring ----------------------------- */
+
+/*
+ * 每筆 slot 以 seq 驗證: 寫入前清 0, 寫完存 index+1 (release).
+ * 匯出時 seq 前後一致才採用, 被覆寫中的 slot 直接略過.
+ * packed: durNs (32 bits, 飽和) | phase << 32 | adapter << 40 | cmdIndex << 48
+ */
+struct SpiTraceSlot {
+    std::atomic<quint64> seq;
+    std::atomic<qint64>  startNs;
+    std::atomic<quint64> packed;
+};
+
+static SpiTraceSlot      s_ring[SPI_TRACE_RING_SIZE];
+static std::atomic<quint64> s_head(0);
+static SpiPhaseHistogram s_hist[SPI_PHASE_COUNT];
+
+void SpiTrace::record(eTypeSpiPhase phase, BYTE adapter, qint64 startNs, qint64 endNs, WORD cmdIndex)
+{
+    if (!s_enabled.load(std::memory_order_relaxed)) return;
+
+    const qint64 durNs = qMax<qint64>(endNs - startNs, 0);
+    s_hist[phase].record(durNs);
+
+    const quint64 i = s_head.fetch_add(1, std::memory_order_relaxed);
+    SpiTraceSlot &slot = s_ring[i & (SPI_TRACE_RING_SIZE - 1)];
+    slot.seq.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.startNs.store(startNs, std::memory_order_relaxed);
+    slot.packed.store(quint64(qMin<qint64>(durNs, 0xFFFFFFFFLL))
+                      | (quint64(phase) << 32) | (quint64(adapter) << 40) | (quint64(cmdIndex) << 48),
+                      std::memory_order_relaxed);
+    slot.seq.store(i + 1, std::memory_order_release);
+}
+
+const char *SpiTrace::phaseName(eTypeSpiPhase phase)
+{
+    switch (phase) {
+    case SPI_PHASE_LINE_INIT:        return "line-init";
+    case SPI_PHASE_CS_CE:            return "cs-ce";
+    case SPI_PHASE_CS_GPIO:          return "cs-gpio";
+    case SPI_PHASE_WAKE_DUMMY:       return "wake-dummy";
+    case SPI_PHASE_WRITE:            return "spi-write";
+    case SPI_PHASE_READ:             return "spi-read";
+    case SPI_PHASE_WAIT_WAKE_HOLD:   return "wake-hold";
+    case SPI_PHASE_WAIT_WAKE_GAP:    return "wake-gap";
+    case SPI_PHASE_WAIT_CMD_HOLD:    return "cmd-hold";
+    case SPI_PHASE_WAIT_WRITE_SETUP: return "write-setup";
+    case SPI_PHASE_WAIT_WRITE_HOLD:  return "write-hold";
+    case SPI_PHASE_ADC_CELL:         return "adc-cell";
+    case SPI_PHASE_ADC_AUX:          return "adc-aux";
+    case SPI_PHASE_RESULT:           return "result";
+    case SPI_PHASE_RETRY_BACKOFF:    return "retry-wait";
+    case SPI_PHASE_CYCLE:            return "cycle";
+    case SPI_PHASE_UI_FORMAT:        return "ui-format";
+    case SPI_PHASE_UI_PLOT:          return "ui-plot";
+    default:                         return "?";
+    }
+}
+
+SpiPhaseHistogram::Stats SpiTrace::phaseStats(eTypeSpiPhase phase)
+{
+    return s_hist[phase].stats();
+}
+
+void SpiTrace::resetStats()
+{
+    for (SpiPhaseHistogram &h : s_hist) h.reset();
+}
+
+static QString usText(qint64 ns)
+{
+    return ns < 10000 ? QString::number(ns / 1000.0, 'f', 1) : QString::number(ns / 1000);
+}
+
+QString SpiTrace::statsText()
+{
+    QString text;
+    for (int p = 0; p < SPI_PHASE_COUNT; ++p) {
+        const SpiPhaseHistogram::Stats s = s_hist[p].stats();
+        if (s.count == 0) continue;
+        text += QString("%1 n=%2 mean=%3 p50=%4 p99=%5 max=%6 us\n")
+                .arg(phaseName(eTypeSpiPhase(p)), -12).arg(s.count)
+                .arg(usText(s.meanNs)).arg(usText(s.p50Ns)).arg(usText(s.p99Ns)).arg(usText(s.maxNs));
+    }
+    return text;
+}
+
+/* p50/p99/max (us), 只列出有資料的 phase */
+QString SpiTrace::statusText()
+{
+    QString text;
+    for (int p = 0; p < SPI_PHASE_COUNT; ++p) {
+        const SpiPhaseHistogram::Stats s = s_hist[p].stats();
+        if (s.count == 0) continue;
+        text += QString("%1 %2/%3/%4  ").arg(phaseName(eTypeSpiPhase(p)))
+                .arg(usText(s.p50Ns)).arg(usText(s.p99Ns)).arg(usText(s.maxNs));
+    }
+    return text.trimmed();
+}
+
+/* ----------------------------- Export ----------------------------- */
+
+static void appendThreadName(QByteArray &out, int tid, const QByteArray &name)
+{
+    out += "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" + QByteArray::number(tid)
+         + ",\"args\":{\"name\":\"" + name + "\"}},\n";
+}
+
+/*
+ * Chrome trace event format: 每個 phase 一個 complete event ("ph":"X"),
+ * tid = adapter (UI 執行緒為 255), ts/dur 單位 us.
+ */
+int SpiTrace::exportChromeTrace(const QString &path, double seconds)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) return -1;
+
+    const quint64 head = s_head.load(std::memory_order_acquire);
+    const quint64 first = head > SPI_TRACE_RING_SIZE ? head - SPI_TRACE_RING_SIZE : 0;
+    const qint64 fromNs = seconds > 0 ? PrecisionTimer::nowNs() - qint64(seconds * 1e9) : LLONG_MIN;
+
+    QByteArray out;
+    out.reserve(int(qMin<quint64>(head - first, 1 << 16)) * 110);
+    out += "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+
+    bool seen[256] = {};
+    int events = 0;
+    for (quint64 i = first; i < head; ++i) {
+        SpiTraceSlot &slot = s_ring[i & (SPI_TRACE_RING_SIZE - 1)];
+        if (slot.seq.load(std::memory_order_acquire) != i + 1) continue;
+        const qint64  startNs = slot.startNs.load(std::memory_order_relaxed);
+        const quint64 packed  = slot.packed.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.seq.load(std::memory_order_relaxed) != i + 1) continue;    // 讀取中被覆寫
+        if (startNs < fromNs) continue;
+
+        const qint64 durNs  = qint64(packed & 0xFFFFFFFFULL);
+        const int    phase  = int((packed >> 32) & 0xFF);
+        const int    tid    = int((packed >> 40) & 0xFF);
+        const int    cmd    = int(packed >> 48);
+        if (phase >= SPI_PHASE_COUNT) continue;
+
+        if (!seen[tid]) {
+            seen[tid] = true;
+            appendThreadName(out, tid, tid == SPI_TRACE_UI_THREAD ? QByteArray("UI")
+                                                                  : "U" + QByteArray::number(tid));
+        }
+
+        out += "{\"name\":\"";
+        out += phaseName(eTypeSpiPhase(phase));
+        out += "\",\"ph\":\"X\",\"pid\":1,\"tid\":" + QByteArray::number(tid)
+             + ",\"ts\":" + QByteArray::number(startNs / 1000.0, 'f', 3)
+             + ",\"dur\":" + QByteArray::number(durNs / 1000.0, 'f', 3);
+        if (cmd != 0xFFFF) out += ",\"args\":{\"cmd\":" + QByteArray::number(cmd) + "}";
+        out += "},\n";
+        ++events;
+
+        if (out.size() > (1 << 20)) {
+            if (file.write(out) != out.size()) return -1;
+            out.clear();
+        }
+    }
+
+    out += "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"USB2UIS\"}}\n]}\n";
+    if (file.write(out) != out.size()) return -1;
+    return events;
+}
@@ -0,0 +1,104 @@
+#ifndef SPI_TRACE_H
+#define SPI_TRACE_H
+
+#include <QString>
+#include <QList>
+#include <atomic>
+#include "usb2uis_interface.h"
+
+// 每個 phase 的耗時分類 (順序即狀態列與 trace 的顯示名稱順序)
+typedef enum{
+    SPI_PHASE_LINE_INIT = 0,    // 切換方向時的 GPIO/CE 初始化
+    SPI_PHASE_CS_CE,            // North CS edge (USBIO_SetCE)
+    SPI_PHASE_CS_GPIO,          // South CS edge (USBIO_GPIOWrite)
+    SPI_PHASE_WAKE_DUMMY,       // Wake-up dummy bytes (USBIO_SPIWrite)
+    SPI_PHASE_WRITE,            // 命令/資料寫入 (USBIO_SPIWrite)
+    SPI_PHASE_READ,             // USBIO_SPIRead
+    SPI_PHASE_WAIT_WAKE_HOLD,   // 對應 eTypeSpiWaitSite
+    SPI_PHASE_WAIT_WAKE_GAP,
+    SPI_PHASE_WAIT_CMD_HOLD,    // lineSpiDelayMs
+    SPI_PHASE_WAIT_WRITE_SETUP,
+    SPI_PHASE_WAIT_WRITE_HOLD,
+    SPI_PHASE_ADC_CELL,         // ADCV 寫入 → PLCADC 讀到完成
+    SPI_PHASE_ADC_AUX,          // ADAX 寫入 → PLAUX 讀到完成
+    SPI_PHASE_RESULT,           // 結果回呼 (log, capture, 解碼)
+    SPI_PHASE_RETRY_BACKOFF,    // 命令失敗後重送前的等待
+    SPI_PHASE_CYCLE,            // 整個 runCycle
+    SPI_PHASE_UI_FORMAT,        // UI 執行緒格式化 log / AFE 表格
+    SPI_PHASE_UI_PLOT,          // UI 執行緒繪製 cell 電壓圖
+    SPI_PHASE_COUNT
+}eTypeSpiPhase;
+
+#define SPI_TRACE_UI_THREAD         0xFF        // trace 的 adapter 欄位: UI 執行緒
+
+// Histogram: 每個 2 的次方再分 8 格 (誤差 < 12.5%), 範圍 0 ~ 2^41 ns (約 36 分鐘)
+#define SPI_HIST_SUB_BITS           3
+#define SPI_HIST_MAX_EXP            40
+#define SPI_HIST_BUCKETS            ((SPI_HIST_MAX_EXP - 1) << SPI_HIST_SUB_BITS)
+
+// Trace ring: 2^18 筆 (約 6 MB), 以每 cycle 數十個 phase 計約可保留數十秒
+#define SPI_TRACE_RING_BITS         18
+#define SPI_TRACE_RING_SIZE         (1 << SPI_TRACE_RING_BITS)
+
+/*
+ * SpiPhaseHistogram
+ *  Log-linear latency histogram, 所有欄位為 relaxed atomic:
+ *  多個 acquisition 執行緒可同時 record, UI 隨時讀取, 不需 lock.
+ */
+class SpiPhaseHistogram
+{
+public:
+    SpiPhaseHistogram();
+
+    struct Stats {
+        qint64 count;
+        qint64 meanNs;
+        qint64 p50Ns;
+        qint64 p99Ns;
+        qint64 maxNs;
+    };
+
+    void record(qint64 ns);
+    void reset();
+    Stats stats() const;
+
+    static int    bucketOf(qint64 ns);
+    static qint64 bucketLowNs(int bucket);
+
+private:
+    std::atomic<quint32> m_buckets[SPI_HIST_BUCKETS];
+    std::atomic<qint64>  m_count;
+    std::atomic<qint64>  m_sumNs;
+    std::atomic<qint64>  m_maxNs;
+};
+
+/*
+ * SpiTrace
+ *  每個 phase 呼叫 record(phase, adapter, startNs, endNs):
+ *   - 累計到該 phase 的 histogram
+ *   - 寫入全域 trace ring (覆寫最舊的一筆)
+ *  成本約為兩次 nowNs() 加數個 atomic 運算, 與一次 USB transfer 相比可忽略, 預設開啟.
+ *  exportChromeTrace() 將最近 N 秒輸出為 Chrome trace / Perfetto 可開啟的 JSON.
+ */
+class SpiTrace
+{
+public:
+    static void setEnabled(bool on)     { s_enabled.store(on, std::memory_order_relaxed); }
+    static bool isEnabled()             { return s_enabled.load(std::memory_order_relaxed); }
+
+    static void record(eTypeSpiPhase phase, BYTE adapter, qint64 startNs, qint64 endNs, WORD cmdIndex = 0xFFFF);
+
+    static const char *phaseName(eTypeSpiPhase phase);
+    static SpiPhaseHistogram::Stats phaseStats(eTypeSpiPhase phase);
+    static void resetStats();                   // 只清 histogram, trace ring 保留
+    static QString statsText();                 // 每個有資料的 phase 一行
+    static QString statusText();                // 狀態列用的精簡版
+
+    // seconds <= 0: ring 內全部; 回傳寫出的事件數, 失敗回傳 -1
+    static int exportChromeTrace(const QString &path, double seconds);
+
+private:
+    static std::atomic<bool> s_enabled;
+};
+
+#endif // SPI_TRACE_H
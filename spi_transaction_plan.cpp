@@ -0,0 +1,798 @@
+#include "spi_transaction_plan.h"
+#include "precision_timer.h"
+#include "spi_trace.h"
+#include "adbms6832.h"
+
+#include <algorithm>
+
+// 各等待點的 jitter 統計
+static PrecisionWaitSite siteWakeHold   ("wake-hold");      // Dummy 後保持 CS LOW
+static PrecisionWaitSite siteWakeGap    ("wake-gap");       // Wake-up 後到命令前
+static PrecisionWaitSite siteCmdHold    ("cmd-hold");       // 命令後延遲 (lineSpiDelayMs)
+static PrecisionWaitSite siteWriteSetup ("write-setup");    // 寫入前的 setup 時間
+static PrecisionWaitSite siteWriteHold  ("write-hold");     // 寫入後保持 CS LOW
+static PrecisionWaitSite siteRetry      ("retry-wait");     // 重送前的 backoff
+
+// 順序對應 eTypeSpiWaitSite
+static PrecisionWaitSite *const s_waitSites[SPI_WAIT_SITE_COUNT] = {
+    &siteWakeHold, &siteWakeGap, &siteCmdHold, &siteWriteSetup, &siteWriteHold,
+};
+
+// 等待點對應的 trace phase, 順序同上
+static const eTypeSpiPhase s_waitPhases[SPI_WAIT_SITE_COUNT] = {
+    SPI_PHASE_WAIT_WAKE_HOLD, SPI_PHASE_WAIT_WAKE_GAP, SPI_PHASE_WAIT_CMD_HOLD,
+    SPI_PHASE_WAIT_WRITE_SETUP, SPI_PHASE_WAIT_WRITE_HOLD,
+};
+
+static const char *opName(BYTE type)
+{
+    switch (type) {
+    case SPI_OP_LINE_INIT: return "LINE_INIT";
+    case SPI_OP_WAKE:      return "WAKE";
+    case SPI_OP_CS_LOW:    return "CS_LOW";
+    case SPI_OP_CS_HIGH:   return "CS_HIGH";
+    case SPI_OP_WRITE:     return "WRITE";
+    case SPI_OP_READ:      return "READ";
+    case SPI_OP_WAIT:      return "WAIT";
+    case SPI_OP_RESULT:    return "RESULT";
+    case SPI_OP_POLL:      return "POLL";
+    default:               return "?";
+    }
+}
+
+QString SpiTransactionPlan::dump() const
+{
+    QString text;
+    for (const SpiOp &op : ops) {
+        text += QString("%1 cmd=%2 tx=%3 rx=%4 ns=%5\n")
+                .arg(opName(op.type)).arg(op.cmdIndex).arg(op.txSize).arg(op.rxSize).arg(op.ns);
+    }
+    return text;
+}
+
+/* ----------------------------- Compiler ----------------------------- */
+
+int SpiPlanCompiler::appendTx(SpiTransactionPlan &plan, const QByteArray &bytes)
+{
+    int offset = plan.txBytes.size();
+    plan.txBytes.append(bytes);
+    return offset;
+}
+
+void SpiPlanCompiler::appendWake(SpiTransactionPlan &plan, const SpiPlanOptions &opt)
+{
+    SpiOp op;
+    op.type     = SPI_OP_WAKE;
+    op.txOffset = appendTx(plan, QByteArray(qMax(opt.dummyCount, 0), char(0xFF)));
+    op.txSize   = qMax(opt.dummyCount, 0);
+    op.ns       = qint64(opt.wakeHoldUs) * 1000;
+    op.ns2      = qint64(opt.wakeGapUs) * 1000;
+    op.skipNs   = qint64(opt.wakeSkipUs) * 1000;
+    plan.ops.append(op);
+}
+
+/*
+ * adcPoll 時的 ADCV/ADAX:
+ *   WAKE → CS_LOW → WRITE(cmd) → CS_HIGH → CS_LOW → POLL(PLCADC/PLAUX) → CS_HIGH → RESULT(poll byte)
+ * 不是 ADC 命令時回傳 false
+ */
+bool SpiPlanCompiler::appendAdcPoll(SpiTransactionPlan &plan, const QByteArray &cmd, WORD idx, const SpiPlanOptions &opt)
+{
+    if (!opt.adcPoll || cmd.size() < 2) return false;
+
+    const WORD code = WORD(((BYTE(cmd[0]) << 8) | BYTE(cmd[1])) & 0x07FF);
+    WORD pollCode;
+    if (adbmsIsAdcv(code))      pollCode = ADBMS6832_CMD_PLCADC;
+    else if (adbmsIsAdax(code)) pollCode = ADBMS6832_CMD_PLAUX;
+    else return false;
+
+    BYTE poll[ADBMS6832_CMD_SIZE];
+    adbmsBuildCmd(poll, pollCode);
+
+    appendWake(plan, opt);
+
+    SpiOp op;
+    op.type = SPI_OP_CS_LOW;
+    op.cmdIndex = idx;
+    plan.ops.append(op);
+
+    op = SpiOp();
+    op.type = SPI_OP_WRITE;
+    op.cmdIndex = idx;
+    op.txOffset = appendTx(plan, cmd);
+    op.txSize = cmd.size();
+    plan.ops.append(op);
+
+    op = SpiOp();
+    op.type = SPI_OP_CS_HIGH;
+    op.cmdIndex = idx;
+    plan.ops.append(op);
+
+    op = SpiOp();
+    op.type = SPI_OP_CS_LOW;
+    op.cmdIndex = idx;
+    plan.ops.append(op);
+
+    op = SpiOp();
+    op.type = SPI_OP_POLL;
+    op.cmdIndex = idx;
+    op.txOffset = appendTx(plan, QByteArray((const char*)poll, sizeof(poll)));
+    op.txSize = sizeof(poll);
+    op.rxOffset = plan.rxBytes;
+    op.rxSize = 1;
+    op.ns = qint64(qMax(opt.adcTimeoutUs, 0)) * 1000;
+    plan.ops.append(op);
+
+    op = SpiOp();
+    op.type = SPI_OP_CS_HIGH;
+    op.cmdIndex = idx;
+    plan.ops.append(op);
+
+    op = SpiOp();
+    op.type = SPI_OP_RESULT;
+    op.site = SPI_CHECK_NONE;
+    op.cmdIndex = idx;
+    op.rxOffset = plan.rxBytes;
+    op.rxSize = 1;
+    plan.ops.append(op);
+
+    plan.rxBytes += 1;
+    return true;
+}
+
+/* RDxx 且 readSize 為整數個 frame: 回報前可檢查 PEC10 */
+static bool isPecRead(const QByteArray &cmd, int readSize)
+{
+    if (cmd.size() < 2 || readSize <= 0 || readSize % ADBMS6832_FRAME_SIZE) return false;
+    return adbmsIsRegisterRead(WORD((BYTE(cmd[0]) << 8) | BYTE(cmd[1])));
+}
+
+/*
+ * READ: 每條命令
+ *   WAKE → CS_LOW → WRITE(cmd) → [WAIT delay] → READ(n) → CS_HIGH → RESULT
+ * optimize() 之後, 無延遲時 WRITE+READ 合併為一次 USBIO_SPIRead(cmd, n)
+ * readSize = 0: 只送命令 (ADCV, CLRCELL ...), 不讀回
+ */
+SpiTransactionPlan SpiPlanCompiler::compileRead(const QList<QByteArray> &cmds, const SpiPlanOptions &opt)
+{
+    SpiTransactionPlan plan;
+    plan.dirNorth = opt.dirNorth;
+    plan.cmdCount = cmds.size();
+    plan.abortOnError = opt.abortOnError;
+
+    SpiOp op;
+    op.type = SPI_OP_LINE_INIT;
+    plan.ops.append(op);
+
+    for (int i = 0; i < cmds.size(); ++i) {
+        const WORD idx = WORD(i);
+
+        if (appendAdcPoll(plan, cmds[i], idx, opt)) continue;
+
+        appendWake(plan, opt);
+
+        op = SpiOp();
+        op.type = SPI_OP_CS_LOW;
+        op.cmdIndex = idx;
+        plan.ops.append(op);
+
+        op = SpiOp();
+        op.type = SPI_OP_WRITE;
+        op.cmdIndex = idx;
+        op.txOffset = appendTx(plan, cmds[i]);
+        op.txSize = cmds[i].size();
+        plan.ops.append(op);
+        const int cmdOffset = op.txOffset;
+
+        op = SpiOp();
+        op.type = SPI_OP_WAIT;
+        op.site = SPI_WAIT_SITE_CMD_HOLD;
+        op.cmdIndex = idx;
+        op.ns = qint64(qMax(opt.cmdDelayMs, 0)) * 1000000;
+        plan.ops.append(op);
+
+        if (opt.readSize > 0) {
+            op = SpiOp();
+            op.type = SPI_OP_READ;
+            op.cmdIndex = idx;
+            op.rxOffset = plan.rxBytes;
+            op.rxSize = opt.readSize;
+            plan.ops.append(op);
+        }
+
+        op = SpiOp();
+        op.type = SPI_OP_CS_HIGH;
+        op.cmdIndex = idx;
+        plan.ops.append(op);
+
+        op = SpiOp();
+        op.type = SPI_OP_RESULT;
+        op.site = isPecRead(cmds[i], opt.readSize) ? SPI_CHECK_PEC10 : SPI_CHECK_NONE;
+        op.cmdIndex = idx;
+        op.rxOffset = plan.rxBytes;
+        op.rxSize = opt.readSize;
+        if (opt.readSize == 0) {    // 只送命令時回報命令本身
+            op.txOffset = cmdOffset;
+            op.txSize = cmds[i].size();
+        }
+        plan.ops.append(op);
+
+        plan.rxBytes += opt.readSize;
+    }
+
+    optimize(plan, opt.mergeCmdRead);
+    splitChunks(plan, opt.chunkBytes);
+    return plan;
+}
+
+/*
+ * WRITE: WAKE → CS_LOW → WAIT 500us → WRITE(cmd) → WAIT 1ms+delay → WRITE(data) → WAIT 2ms → CS_HIGH → RESULT
+ * AFE 時序需要命令與資料間的延遲, 因此不合併
+ */
+SpiTransactionPlan SpiPlanCompiler::compileWrite(const QByteArray &cmd, const QByteArray &data, const SpiPlanOptions &opt)
+{
+    SpiTransactionPlan plan;
+    plan.dirNorth = opt.dirNorth;
+    plan.cmdCount = 1;
+    plan.abortOnError = opt.abortOnError;
+
+    SpiOp op;
+    op.type = SPI_OP_LINE_INIT;
+    plan.ops.append(op);
+
+    appendWake(plan, opt);
+
+    op = SpiOp();
+    op.type = SPI_OP_CS_LOW;
+    plan.ops.append(op);
+
+    op = SpiOp();
+    op.type = SPI_OP_WAIT;
+    op.site = SPI_WAIT_SITE_WRITE_SETUP;
+    op.ns = 500000;
+    plan.ops.append(op);
+
+    op = SpiOp();
+    op.type = SPI_OP_WRITE;
+    op.txOffset = appendTx(plan, cmd);
+    op.txSize = cmd.size();
+    plan.ops.append(op);
+
+    op = SpiOp();
+    op.type = SPI_OP_WAIT;
+    op.site = SPI_WAIT_SITE_CMD_HOLD;
+    op.ns = 1000000 + qint64(qMax(opt.cmdDelayMs, 0)) * 1000000;   //必須先阻塞時間， 傳送時序問題延遲500us以上
+    plan.ops.append(op);
+
+    const int dataOffset = appendTx(plan, data);
+
+    op = SpiOp();
+    op.type = SPI_OP_WRITE;
+    op.txOffset = dataOffset;
+    op.txSize = data.size();
+    plan.ops.append(op);
+
+    op = SpiOp();
+    op.type = SPI_OP_WAIT;
+    op.site = SPI_WAIT_SITE_WRITE_HOLD;
+    op.ns = 2000000;    //注意~~~MUST 必須先阻塞時間(寫入資料太多時，請加長時間)
+    plan.ops.append(op);
+
+    op = SpiOp();
+    op.type = SPI_OP_CS_HIGH;
+    plan.ops.append(op);
+
+    op = SpiOp();
+    op.type = SPI_OP_RESULT;
+    op.site = SPI_CHECK_NONE;
+    op.txOffset = dataOffset;
+    op.txSize = data.size();
+    plan.ops.append(op);
+
+    optimize(plan, false);
+    splitChunks(plan, opt.chunkBytes);
+    return plan;
+}
+
+/*
+ * 1. 移除 0 長度的 WAIT
+ * 2. WRITE 後緊接 READ (同一個 CS frame) → READ 帶 cmd (mergeCmdRead)
+ * 3. 連續相同的 CS 邊緣只保留一個
+ */
+void SpiPlanCompiler::optimize(SpiTransactionPlan &plan, bool mergeCmdRead)
+{
+    QVector<SpiOp> out;
+    out.reserve(plan.ops.size());
+
+    for (const SpiOp &op : plan.ops) {
+        if (op.type == SPI_OP_WAIT && op.ns <= 0) continue;
+
+        if (!out.isEmpty()) {
+            SpiOp &prev = out.last();
+
+            if (mergeCmdRead && op.type == SPI_OP_READ && op.txSize == 0 &&
+                prev.type == SPI_OP_WRITE && prev.txSize > 0 && prev.txSize <= 0xFF) {
+                SpiOp merged = op;
+                merged.txOffset = prev.txOffset;
+                merged.txSize = prev.txSize;
+                prev = merged;
+                continue;
+            }
+
+            if ((op.type == SPI_OP_CS_LOW || op.type == SPI_OP_CS_HIGH) && prev.type == op.type)
+                continue;
+        }
+        out.append(op);
+    }
+
+    plan.ops = out;
+}
+
+/*
+ * 長 chain 的 READ/WRITE 分成多次 USB 傳輸, 每次 (cmd + data) 不超過 chunkBytes:
+ * 第一段帶 cmd, 之後的段落不帶 cmd, 接續同一個 CS frame 的時脈; rx 依序寫入相同的 buffer,
+ * RESULT 仍回報完整資料. AFE 只看 CS 與 SCK, 分段間的空檔不影響 frame.
+ */
+void SpiPlanCompiler::splitChunks(SpiTransactionPlan &plan, int chunkBytes)
+{
+    if (chunkBytes <= 0) return;
+
+    QVector<SpiOp> out;
+    out.reserve(plan.ops.size());
+
+    for (const SpiOp &op : plan.ops) {
+        if (op.type == SPI_OP_READ && op.rxSize > 0 && op.txSize + op.rxSize > chunkBytes) {
+            SpiOp part = op;
+            int done = 0;
+            while (done < op.rxSize) {
+                part.rxOffset = op.rxOffset + done;
+                part.rxSize = qMin(op.rxSize - done, qMax(chunkBytes - part.txSize, 1));
+                out.append(part);
+                done += part.rxSize;
+                part.txOffset = 0;
+                part.txSize = 0;
+            }
+            continue;
+        }
+
+        if (op.type == SPI_OP_WRITE && op.txSize > chunkBytes) {
+            SpiOp part = op;
+            for (int done = 0; done < op.txSize; done += part.txSize) {
+                part.txOffset = op.txOffset + done;
+                part.txSize = qMin(op.txSize - done, chunkBytes);
+                out.append(part);
+            }
+            continue;
+        }
+
+        out.append(op);
+    }
+
+    plan.ops = out;
+}
+
+/* ----------------------------- Recovery stats ----------------------------- */
+
+SpiRecoveryStats::SpiRecoveryStats()
+{
+    reset();
+}
+
+void SpiRecoveryStats::count(int cmdIndex, eTypeField field)
+{
+    m_total.v[field].fetch_add(1, std::memory_order_relaxed);
+    if (cmdIndex < 0 || cmdIndex >= SPI_RECOVERY_MAX_CMDS) return;
+
+    m_cmds[cmdIndex].v[field].fetch_add(1, std::memory_order_relaxed);
+    int prev = m_cmdCount.load(std::memory_order_relaxed);
+    while (cmdIndex >= prev && !m_cmdCount.compare_exchange_weak(prev, cmdIndex + 1, std::memory_order_relaxed)) {
+    }
+}
+
+void SpiRecoveryStats::reset()
+{
+    for (Counters &c : m_cmds)
+        for (std::atomic<quint64> &v : c.v) v.store(0, std::memory_order_relaxed);
+    for (std::atomic<quint64> &v : m_total.v) v.store(0, std::memory_order_relaxed);
+    m_cmdCount.store(0, std::memory_order_relaxed);
+    m_wakes.store(0, std::memory_order_relaxed);
+    m_failovers.store(0, std::memory_order_relaxed);
+    m_budgetOut.store(0, std::memory_order_relaxed);
+}
+
+SpiCmdErrorCounts SpiRecoveryStats::load(const Counters &c)
+{
+    SpiCmdErrorCounts n;
+    n.transferErrors = c.v[TRANSFER_ERROR].load(std::memory_order_relaxed);
+    n.pecErrors      = c.v[PEC_ERROR].load(std::memory_order_relaxed);
+    n.retries        = c.v[RETRY].load(std::memory_order_relaxed);
+    n.recovered      = c.v[RECOVERED].load(std::memory_order_relaxed);
+    n.failed         = c.v[FAILED].load(std::memory_order_relaxed);
+    return n;
+}
+
+SpiCmdErrorCounts SpiRecoveryStats::cmd(int cmdIndex) const
+{
+    if (cmdIndex < 0 || cmdIndex >= SPI_RECOVERY_MAX_CMDS) return SpiCmdErrorCounts();
+    return load(m_cmds[cmdIndex]);
+}
+
+SpiCmdErrorCounts SpiRecoveryStats::total() const
+{
+    return load(m_total);
+}
+
+QString SpiRecoveryStats::text(int maxCmds) const
+{
+    QList<int> order;
+    for (int i = 0; i < cmdCount(); ++i)
+        if (cmd(i).errors() > 0) order.append(i);
+    std::stable_sort(order.begin(), order.end(), [this](int a, int b) { return cmd(a).errors() > cmd(b).errors(); });
+
+    QString text;
+    for (int k = 0; k < order.size() && k < maxCmds; ++k) {
+        const SpiCmdErrorCounts c = cmd(order[k]);
+        if (!text.isEmpty()) text += ", ";
+        text += QString("#%1 pec %2 usb %3 retry %4 ok %5 fail %6").arg(order[k]).arg(c.pecErrors)
+                .arg(c.transferErrors).arg(c.retries).arg(c.recovered).arg(c.failed);
+    }
+    return text;
+}
+
+/* ----------------------------- Executor ----------------------------- */
+
+SpiPlanExecutor::SpiPlanExecutor(BYTE deviceIndex)
+    : m_index(deviceIndex)
+{
+}
+
+void SpiPlanExecutor::setDevice(BYTE deviceIndex)
+{
+    m_index = deviceIndex;
+    reset();
+}
+
+void SpiPlanExecutor::reset()
+{
+    m_lineReady = false;
+    m_csLevel = -1;
+    m_lastActivityNs = 0;
+    m_dirSwap = false;
+}
+
+void SpiPlanExecutor::setRetryPolicy(const SpiRetryPolicy &policy)
+{
+    m_policy = policy;
+    m_dirSwap = false;
+}
+
+bool SpiPlanExecutor::check(bool ok, const char *what)
+{
+    ++m_calls;
+    if (!ok) {
+        ++m_failed;
+        if (m_error.isEmpty()) m_error = QString("%1 失敗").arg(what);
+    }
+    return ok;
+}
+
+/* North: IO1 固定 High, CE 當 CS;  South: CE 固定 High, IO1 當 CS */
+bool SpiPlanExecutor::lineInit(bool north)
+{
+    if (m_lineReady && m_lineNorth == north) return true;
+
+    const qint64 t0 = PrecisionTimer::nowNs();
+    bool ok;
+    if (north) {
+        ok = check(Usb2UisInterface::USBIO_GPIOWrite(m_index, 0x01, 0xFE), "GPIO");
+        ok = check(Usb2UisInterface::USBIO_SetCE(m_index, true), "CE") && ok;
+    } else {
+        ok = check(Usb2UisInterface::USBIO_SetCE(m_index, true), "CE");
+        ok = check(Usb2UisInterface::USBIO_GPIOWrite(m_index, 0x01, 0xFE), "GPIO") && ok;
+    }
+    SpiTrace::record(SPI_PHASE_LINE_INIT, m_index, t0, PrecisionTimer::nowNs());
+
+    m_lineReady = ok;
+    m_lineNorth = north;
+    m_csLevel = ok ? 1 : -1;
+    return ok;
+}
+
+bool SpiPlanExecutor::csEdge(bool north, bool high)
+{
+    if (m_csLevel == (high ? 1 : 0)) return true;
+
+    const qint64 t0 = PrecisionTimer::nowNs();
+    bool ok;
+    if (north)
+        ok = check(Usb2UisInterface::USBIO_SetCE(m_index, high), "CE");
+    else
+        ok = check(Usb2UisInterface::USBIO_GPIOWrite(m_index, high ? 0x01 : 0x00, 0xFE), "GPIO");
+
+    m_csLevel = ok ? (high ? 1 : 0) : -1;
+    m_lastActivityNs = PrecisionTimer::nowNs();
+    SpiTrace::record(north ? SPI_PHASE_CS_CE : SPI_PHASE_CS_GPIO, m_index, t0, m_lastActivityNs, m_cmdIndex);
+    return ok;
+}
+
+void SpiPlanExecutor::waitUntil(qint64 deadlineNs, int site)
+{
+    const qint64 t0 = PrecisionTimer::nowNs();
+    PrecisionTimer::waitUntilNs(deadlineNs, s_waitSites[site]);
+    SpiTrace::record(s_waitPhases[site], m_index, t0, PrecisionTimer::nowNs(), m_cmdIndex);
+}
+
+/*
+ * 轉換中 SDO 保持 Low (讀到 0x00), 完成後為 High.
+ * 第一次讀取帶 poll 命令, 之後同一個 CS frame 內每次多讀 1 Byte; 一次 USB 往返即為 poll 間隔.
+ * 轉換時間 (命令寫入結束 → 讀到完成) 記錄到 SPI_PHASE_ADC_CELL / SPI_PHASE_ADC_AUX.
+ */
+bool SpiPlanExecutor::poll(const SpiOp &op, BYTE *cmd, BYTE *status)
+{
+    const qint64 deadline = PrecisionTimer::nowNs() + op.ns;
+
+    *status = 0x00;
+    bool ok = check(Usb2UisInterface::USBIO_SPIRead(m_index, cmd, BYTE(op.txSize), status, 1), "ADC Poll");
+    while (ok && *status == 0x00 && PrecisionTimer::nowNs() < deadline)
+        ok = check(Usb2UisInterface::USBIO_SPIRead(m_index, nullptr, 0, status, 1), "ADC Poll");
+
+    m_lastActivityNs = PrecisionTimer::nowNs();
+    if (!ok) return false;
+
+    if (*status == 0x00) {
+        ++m_failed;
+        if (m_error.isEmpty()) m_error = QString("ADC 轉換逾時 (%1 us)").arg(op.ns / 1000);
+        return false;
+    }
+
+    const bool aux = op.txSize >= 2 && WORD(((cmd[0] << 8) | cmd[1]) & 0x07FF) == ADBMS6832_CMD_PLAUX;
+    SpiTrace::record(aux ? SPI_PHASE_ADC_AUX : SPI_PHASE_ADC_CELL, m_index, m_lastWriteNs, m_lastActivityNs, m_cmdIndex);
+    return true;
+}
+
+eTypeSpiPlanResult SpiPlanExecutor::runCycle(const SpiTransactionPlan &plan, const ResultFn &onResult)
+{
+    m_calls = 0;
+    m_failed = 0;
+    m_wakeSkipped = 0;
+    m_shadowSkipped = 0;
+    m_retries = 0;
+    m_dropped = 0;
+    m_retryNs = 0;
+    m_error.clear();
+
+    const qint64 tCycle = PrecisionTimer::nowNs();
+    const quint64 skipped = Usb2UisInterface::shadowStats(m_index).skipped();
+    const eTypeSpiPlanResult result = execute(plan, onResult);
+    // 被 GPIO/CE shadow 略過的呼叫沒有送到 USB
+    m_shadowSkipped = int(Usb2UisInterface::shadowStats(m_index).skipped() - skipped);
+    m_calls -= m_shadowSkipped;
+    m_cmdIndex = 0xFFFF;
+    SpiTrace::record(SPI_PHASE_CYCLE, m_index, tCycle, PrecisionTimer::nowNs());
+    return result;
+}
+
+/* 執行 RESULT 以外的 op; LINE_INIT 由 execute 處理 */
+bool SpiPlanExecutor::runOp(const SpiOp &op, bool north, BYTE *tx, BYTE *rx)
+{
+    bool ok = true;
+    qint64 t0;
+
+    switch (op.type) {
+    case SPI_OP_WAKE: {
+        // chain 在 tIDLE 內有活動, 不需要再 wake
+        if (op.skipNs > 0 && m_lastActivityNs > 0 &&
+            PrecisionTimer::nowNs() - m_lastActivityNs < op.skipNs) {
+            ++m_wakeSkipped;
+            break;
+        }
+
+        ok = csEdge(north, false);
+        const qint64 tEdge = PrecisionTimer::nowNs();
+        if (op.txSize > 0) {
+            ok = check(Usb2UisInterface::USBIO_SPIWrite(m_index, nullptr, 0, tx + op.txOffset, WORD(op.txSize)),
+                       "Dummy Bytes 傳送") && ok;
+            SpiTrace::record(SPI_PHASE_WAKE_DUMMY, m_index, tEdge, PrecisionTimer::nowNs(), m_cmdIndex);
+        }
+        waitUntil(tEdge + op.ns, SPI_WAIT_SITE_WAKE_HOLD);
+        ok = csEdge(north, true) && ok;
+        waitUntil(PrecisionTimer::nowNs() + op.ns2, SPI_WAIT_SITE_WAKE_GAP);
+        break;
+    }
+
+    case SPI_OP_CS_LOW:
+        ok = csEdge(north, false);
+        break;
+
+    case SPI_OP_CS_HIGH:
+        ok = csEdge(north, true);
+        break;
+
+    case SPI_OP_WRITE:
+        t0 = PrecisionTimer::nowNs();
+        ok = check(Usb2UisInterface::USBIO_SPIWrite(m_index, nullptr, 0, tx + op.txOffset, WORD(op.txSize)),
+                   "SPI資料寫入");
+        m_lastWriteNs = PrecisionTimer::nowNs();
+        SpiTrace::record(SPI_PHASE_WRITE, m_index, t0, m_lastWriteNs, m_cmdIndex);
+        break;
+
+    case SPI_OP_READ:
+        t0 = PrecisionTimer::nowNs();
+        ok = check(Usb2UisInterface::USBIO_SPIRead(m_index,
+                                                   op.txSize ? tx + op.txOffset : nullptr, BYTE(op.txSize),
+                                                   rx + op.rxOffset, WORD(op.rxSize)),
+                   "SPI讀取");
+        m_lastActivityNs = PrecisionTimer::nowNs();
+        SpiTrace::record(SPI_PHASE_READ, m_index, t0, m_lastActivityNs, m_cmdIndex);
+        break;
+
+    case SPI_OP_WAIT:
+        waitUntil(PrecisionTimer::nowNs() + op.ns, op.site);
+        break;
+
+    case SPI_OP_POLL:
+        ok = poll(op, tx + op.txOffset, rx + op.rxOffset);
+        break;
+    }
+
+    return ok;
+}
+
+/* i 所屬命令的 RESULT op; 沒有時為 ops.size() */
+int SpiPlanExecutor::resultOf(const SpiTransactionPlan &plan, int i)
+{
+    while (i < plan.ops.size() && plan.ops[i].type != SPI_OP_RESULT) ++i;
+    return i;
+}
+
+static qint64 backoffNs(const SpiRetryPolicy &policy, int attempt)
+{
+    const qint64 us = qint64(qMax(policy.backoffUs, 0)) << qMin(attempt, 16);
+    return qMin(us, qint64(qMax(policy.backoffMaxUs, 0))) * 1000;
+}
+
+/* 再試一次 (backoff + 與上一次相同的執行時間) 不超過 cycle 的重試預算與 deadline */
+bool SpiPlanExecutor::retryAllowed(int attempt, qint64 attemptNs)
+{
+    if (attempt >= m_policy.maxRetries) return false;
+
+    const qint64 costNs = backoffNs(m_policy, attempt) + attemptNs;
+    const bool inBudget = m_retryNs + costNs <= qint64(m_policy.budgetUs) * 1000;
+    const bool inDeadline = m_deadlineNs <= 0 || PrecisionTimer::nowNs() + costNs <= m_deadlineNs;
+    if (inBudget && inDeadline) return true;
+
+    m_stats.countBudgetOut();
+    return false;
+}
+
+/* 不符 PEC10 的 frame 數 */
+static int badFrames(const BYTE *rx, int size)
+{
+    int bad = 0;
+    for (int i = 0; i + ADBMS6832_FRAME_SIZE <= size; i += ADBMS6832_FRAME_SIZE)
+        if (!adbmsCheckFrame(rx + i)) ++bad;
+    return bad;
+}
+
+/* 反方向讀取時 chain 的 frame 順序相反, 轉回 plan 的方向 */
+static void reverseFrames(BYTE *rx, int size)
+{
+    for (int i = 0, j = size / ADBMS6832_FRAME_SIZE - 1; i < j; ++i, --j)
+        std::swap_ranges(rx + i * ADBMS6832_FRAME_SIZE, rx + (i + 1) * ADBMS6832_FRAME_SIZE,
+                         rx + j * ADBMS6832_FRAME_SIZE);
+}
+
+/*
+ * 每條命令 (WAKE ... RESULT) 為一段: 段內任一 op 失敗即跳到 RESULT,
+ * 在 RESULT 決定重送該段 (見 SpiRetryPolicy) 或回報.
+ */
+eTypeSpiPlanResult SpiPlanExecutor::execute(const SpiTransactionPlan &plan, const ResultFn &onResult)
+{
+    if (m_rx.size() < plan.rxBytes) m_rx.resize(plan.rxBytes);
+
+    BYTE *tx = (BYTE*)plan.txBytes.constData();
+    BYTE *rx = (BYTE*)m_rx.data();
+    const int count = plan.ops.size();
+
+    int    segStart = 0;            // 目前命令的第一個 op
+    int    segEnd = -1;             // 目前命令的 RESULT
+    int    attempt = 0;
+    bool   failed = false;
+    bool   failover = false;        // 本次嘗試是否由反方向讀取
+    bool   north = plan.dirNorth;
+    qint64 segT0 = 0;
+
+    for (int i = 0; i < count; ++i) {
+        const SpiOp &op = plan.ops[i];
+        m_cmdIndex = op.cmdIndex;
+
+        if (op.type == SPI_OP_LINE_INIT) {
+            if (!lineInit(plan.dirNorth) && plan.abortOnError) {
+                csEdge(plan.dirNorth, true);
+                return SPI_PLAN_ERROR;
+            }
+            continue;
+        }
+
+        if (i > segEnd) {
+            segStart = i;
+            segEnd = resultOf(plan, i);
+            attempt = 0;
+            failover = false;
+            north = plan.dirNorth != (m_dirSwap && segEnd < count && plan.ops[segEnd].site == SPI_CHECK_PEC10);
+            failed = m_lineReady && m_lineNorth != north && !lineInit(north);
+            segT0 = PrecisionTimer::nowNs();
+        }
+
+        if (op.type != SPI_OP_RESULT) {
+            if (!failed && !runOp(op, north, tx, rx)) failed = true;
+            if (failed) i = segEnd - 1;     // 段內其餘的 op 不執行
+            continue;
+        }
+
+        BYTE *data = op.rxSize > 0 ? rx + op.rxOffset : tx + op.txOffset;
+        const int size = op.rxSize > 0 ? op.rxSize : op.txSize;
+        const bool pecRead = op.site == SPI_CHECK_PEC10;
+        const bool pecBad = !failed && pecRead && m_policy.verifyPec && badFrames(data, size) > 0;
+
+        const qint64 attemptNs = PrecisionTimer::nowNs() - segT0;
+        if (attempt > 0) m_retryNs += attemptNs;
+
+        if (failed || pecBad) {
+            m_stats.count(op.cmdIndex, failed ? SpiRecoveryStats::TRANSFER_ERROR : SpiRecoveryStats::PEC_ERROR);
+            csEdge(north, true);    // 失敗時 CS 可能停在 LOW
+
+            // 重送會 wake 時, 預估時間加上 wake 的 hold + gap
+            const SpiOp &wake = plan.ops[segStart];
+            const qint64 wakeNs = (wake.type == SPI_OP_WAKE && (failed || attempt >= 1)) ? wake.ns + wake.ns2 : 0;
+            if (retryAllowed(attempt, attemptNs + wakeNs)) {
+                segT0 = PrecisionTimer::nowNs();
+                PrecisionTimer::waitUntilNs(segT0 + backoffNs(m_policy, attempt), &siteRetry);
+                SpiTrace::record(SPI_PHASE_RETRY_BACKOFF, m_index, segT0, PrecisionTimer::nowNs(), m_cmdIndex);
+                ++attempt;
+                ++m_retries;
+                m_stats.count(op.cmdIndex, SpiRecoveryStats::RETRY);
+
+                // USB 失敗後 CS 線路狀態未知; 第 2 次起或 USB 失敗時一律 wake
+                if (failed) m_lineReady = false;
+                if (failed || attempt >= 2) {
+                    m_lastActivityNs = 0;
+                    m_stats.countWake();
+                }
+                if (m_policy.failover && pecRead && attempt == m_policy.maxRetries) {
+                    failover = true;
+                    m_dirSwap = !m_dirSwap;
+                    m_lastActivityNs = 0;
+                    m_stats.countFailover();
+                }
+                north = plan.dirNorth != (m_dirSwap && pecRead);
+                failed = !lineInit(north);
+                i = segStart - 1;
+                continue;
+            }
+
+            m_stats.count(op.cmdIndex, SpiRecoveryStats::FAILED);
+            if (failover) m_dirSwap = !m_dirSwap;   // 反方向也失敗, 恢復原方向
+            if (m_error.isEmpty()) m_error = QString("PEC 錯誤 (cmd %1)").arg(op.cmdIndex);
+
+            if (failed) {
+                if (plan.abortOnError) return SPI_PLAN_ERROR;
+                ++m_dropped;
+                continue;
+            }
+        } else if (attempt > 0) {
+            m_stats.count(op.cmdIndex, SpiRecoveryStats::RECOVERED);
+        }
+
+        if (north != plan.dirNorth && pecRead) reverseFrames(data, size);
+
+        if (onResult) {
+            const qint64 t0 = PrecisionTimer::nowNs();
+            const bool cont = onResult(op, data, size);
+            SpiTrace::record(SPI_PHASE_RESULT, m_index, t0, PrecisionTimer::nowNs(), m_cmdIndex);
+            if (!cont) return SPI_PLAN_STOPPED;
+        }
+    }
+
+    return SPI_PLAN_OK;
+}
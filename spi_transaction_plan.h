@@ -0,0 +1,250 @@
+#ifndef SPI_TRANSACTION_PLAN_H
+#define SPI_TRANSACTION_PLAN_H
+
+#include <QByteArray>
+#include <QList>
+#include <QString>
+#include <QVector>
+#include <atomic>
+#include <functional>
+#include "usb2uis_interface.h"
+
+typedef enum{
+    SPI_OP_LINE_INIT = 0,   // 設定 CS idle 電平 (North: IO1 High; South: CE High), 只做一次
+    SPI_OP_WAKE,            // CS LOW + Dummy + hold + CS HIGH + gap; chain 仍醒著時整段略過
+    SPI_OP_CS_LOW,
+    SPI_OP_CS_HIGH,
+    SPI_OP_WRITE,           // USBIO_SPIWrite(tx)
+    SPI_OP_READ,            // USBIO_SPIRead(cmd=tx, rx), tx 可為空
+    SPI_OP_WAIT,            // 相對於前一個 op 結束的等待
+    SPI_OP_RESULT,          // 一條命令完成 (CS 已 HIGH), 回報 rx 或 tx 內容
+    SPI_OP_POLL,            // 送出 poll 命令後每次讀 1 Byte, 直到 SDO High (ADC 完成) 或 ns 逾時
+}eTypeSpiOp;
+
+typedef enum{
+    SPI_WAIT_SITE_WAKE_HOLD = 0,
+    SPI_WAIT_SITE_WAKE_GAP,
+    SPI_WAIT_SITE_CMD_HOLD,
+    SPI_WAIT_SITE_WRITE_SETUP,
+    SPI_WAIT_SITE_WRITE_HOLD,
+    SPI_WAIT_SITE_COUNT,
+}eTypeSpiWaitSite;
+
+/* RESULT op 的 site 欄位: 回報前可做的檢查 */
+typedef enum{
+    SPI_CHECK_NONE = 0,
+    SPI_CHECK_PEC10,        // rx 為 8 Bytes frame (6 data + PEC10) x chain 長度 (RDxx)
+}eTypeSpiResultCheck;
+
+/* 扁平 op, 所有 byte 資料以 offset 指向 plan.txBytes / 每個 cycle 的 rx buffer */
+struct SpiOp {
+    BYTE   type      = SPI_OP_WAIT;
+    BYTE   site      = SPI_WAIT_SITE_CMD_HOLD;
+    WORD   cmdIndex  = 0;
+    int    txOffset  = 0;
+    int    txSize    = 0;
+    int    rxOffset  = 0;
+    int    rxSize    = 0;
+    qint64 ns        = 0;       // WAIT 時間 / WAKE hold (以 CS 下降緣為基準)
+    qint64 ns2       = 0;       // WAKE gap (CS HIGH 之後)
+    qint64 skipNs    = 0;       // WAKE: chain 在此時間內有活動則略過, 0 = 每次都 wake
+};
+
+struct SpiTransactionPlan {
+    QVector<SpiOp> ops;
+    QByteArray     txBytes;         // 所有命令/資料/Dummy 連續存放
+    int            rxBytes  = 0;    // 每個 cycle 需要的 rx buffer 大小
+    int            cmdCount = 0;
+    bool           dirNorth = true;
+    bool           abortOnError = false;
+
+    QString dump() const;           // 除錯用文字
+};
+
+/* 編譯參數, 對應 UI 的設定值 */
+struct SpiPlanOptions {
+    int   dummyCount    = 2;
+    int   wakeHoldUs    = 500;      // Dummy 後保持 CS LOW
+    int   wakeGapUs     = 500;      // Wake-up 後到命令前
+    int   wakeSkipUs    = 2000;     // chain 在此時間內有活動則不需再 wake (tIDLE 4.3ms 以內), 0=每次都 wake
+    int   cmdDelayMs    = 0;        // 命令後延遲 (lineSpiDelayMs)
+    WORD  readSize      = 8;
+    bool  dirNorth      = true;
+    bool  mergeCmdRead  = true;     // 命令經由 USBIO_SPIRead 的 cmd/cmdSize 送出
+    bool  abortOnError  = false;
+    bool  adcPoll       = false;    // ADCV/ADAX 之後以 PLCADC/PLAUX 等待完成, 取代 cmdDelayMs
+    int   adcTimeoutUs  = 10000;    // poll 上限
+    int   chunkBytes    = 0;        // > 0: 單次 USB 傳輸 (cmd + data) 超過此大小時, 於同一個 CS frame 內分段
+};
+
+class SpiPlanCompiler
+{
+public:
+    static SpiTransactionPlan compileRead(const QList<QByteArray> &cmds, const SpiPlanOptions &opt);
+    static SpiTransactionPlan compileWrite(const QByteArray &cmd, const QByteArray &data, const SpiPlanOptions &opt);
+
+private:
+    static int  appendTx(SpiTransactionPlan &plan, const QByteArray &bytes);
+    static void appendWake(SpiTransactionPlan &plan, const SpiPlanOptions &opt);
+    static bool appendAdcPoll(SpiTransactionPlan &plan, const QByteArray &cmd, WORD idx, const SpiPlanOptions &opt);
+    static void optimize(SpiTransactionPlan &plan, bool mergeCmdRead);
+    static void splitChunks(SpiTransactionPlan &plan, int chunkBytes);
+};
+
+typedef enum{
+    SPI_PLAN_OK = 0,
+    SPI_PLAN_STOPPED,       // onResult 回傳 false
+    SPI_PLAN_ERROR,         // abortOnError 且 USB 呼叫失敗 (重試用完)
+}eTypeSpiPlanResult;
+
+/*
+ * 命令失敗時的恢復策略 (預設 maxRetries = 0: 不重試).
+ *  失敗 = 該命令的任一 USB 呼叫失敗, 或 verifyPec 時 RDxx 讀回的 PEC10 錯誤.
+ *  只重送失敗的那一條命令 (從它的 WAKE 開始), 已完成的命令不重做:
+ *    第 1 次重試    PEC 錯誤時 chain 仍醒著則不 wake; USB 失敗時重設 CS 線路並 wake
+ *    第 2 次起      一律 wake
+ *    最後一次       failover 時 RDxx 改由另一個方向 (North ↔ South) 讀取, frame 順序轉回原方向;
+ *                   成功後之後的 RDxx 維持新方向, 直到 reset() / setRetryPolicy(); 寫入與其他命令不換方向
+ *  重試前等待 backoffUs, 每次加倍 (上限 backoffMaxUs); 一個 cycle 內重試 (含等待) 的總時間
+ *  不超過 budgetUs, 且不超過 setDeadline() 的時間, 預估會超過時放棄.
+ *  重試用完仍失敗: abortOnError 的 plan 回傳 SPI_PLAN_ERROR; 否則 USB 失敗的命令不回報 (資料不可信),
+ *  PEC 錯誤的資料仍回報 (由 decoder 標示無效), 繼續下一條命令.
+ */
+struct SpiRetryPolicy {
+    int   maxRetries    = 0;
+    int   backoffUs     = 200;
+    int   backoffMaxUs  = 5000;
+    int   budgetUs      = 20000;
+    bool  verifyPec     = true;
+    bool  failover      = false;
+    int   maxFailedCycles = 10;     // 連續這麼多個 cycle 有命令因 USB 失敗未回報 → 停止擷取 (0 = 不停止)
+};
+
+#define SPI_RECOVERY_MAX_CMDS       256     // 個別統計的命令數 (cmdIndex), 之後的只計入總數
+
+struct SpiCmdErrorCounts {
+    quint64 transferErrors = 0;     // USB 呼叫失敗的嘗試
+    quint64 pecErrors = 0;          // PEC10 錯誤的嘗試
+    quint64 retries = 0;
+    quint64 recovered = 0;          // 重試後成功
+    quint64 failed = 0;             // 重試用完 (或不允許重試) 仍失敗
+
+    quint64 errors() const { return transferErrors + pecErrors; }
+};
+
+/* 每條命令的錯誤/重試計數, acquisition 執行緒更新, 任何執行緒可讀取 (relaxed atomic) */
+class SpiRecoveryStats
+{
+public:
+    typedef enum{
+        TRANSFER_ERROR = 0,
+        PEC_ERROR,
+        RETRY,
+        RECOVERED,
+        FAILED,
+        FIELD_COUNT,
+    }eTypeField;
+
+    SpiRecoveryStats();
+
+    void count(int cmdIndex, eTypeField field);
+    void countWake()        { m_wakes.fetch_add(1, std::memory_order_relaxed); }
+    void countFailover()    { m_failovers.fetch_add(1, std::memory_order_relaxed); }
+    void countBudgetOut()   { m_budgetOut.fetch_add(1, std::memory_order_relaxed); }
+    void reset();
+
+    SpiCmdErrorCounts cmd(int cmdIndex) const;
+    SpiCmdErrorCounts total() const;
+    int     cmdCount() const    { return m_cmdCount.load(std::memory_order_relaxed); }   // 最大 cmdIndex + 1
+    quint64 forcedWakes() const { return m_wakes.load(std::memory_order_relaxed); }
+    quint64 failovers() const   { return m_failovers.load(std::memory_order_relaxed); }
+    quint64 budgetOut() const   { return m_budgetOut.load(std::memory_order_relaxed); }    // 因時間預算放棄的重試
+
+    // 例: "#2 pec 3 usb 0 retry 3 ok 3 fail 0", 錯誤最多的 maxCmds 條
+    QString text(int maxCmds) const;
+
+private:
+    struct Counters {
+        std::atomic<quint64> v[FIELD_COUNT];
+    };
+
+    Counters             m_cmds[SPI_RECOVERY_MAX_CMDS];
+    Counters             m_total;
+    std::atomic<int>     m_cmdCount;
+    std::atomic<quint64> m_wakes;
+    std::atomic<quint64> m_failovers;
+    std::atomic<quint64> m_budgetOut;
+
+    static SpiCmdErrorCounts load(const Counters &c);
+};
+
+/*
+ * SpiPlanExecutor
+ *  在 acquisition 執行緒上執行 plan; 記住 CS 電平與最後活動時間,
+ *  略過不改變電平的 CE/GPIO 寫入與不必要的 wake-up, 並統計每個 cycle 的 USB 呼叫次數.
+ *  每個 USB 呼叫與等待都以 SpiTrace 記錄耗時 (phase histogram + trace ring).
+ */
+class SpiPlanExecutor
+{
+public:
+    // return false → 停止 (只在 CS HIGH 時呼叫)
+    typedef std::function<bool(const SpiOp &op, const BYTE *data, int size)> ResultFn;
+
+    explicit SpiPlanExecutor(BYTE deviceIndex = 0xFF);
+
+    void setDevice(BYTE deviceIndex);
+    void reset();                   // 線路狀態未知 (重新連線或套用設定後)
+
+    void setRetryPolicy(const SpiRetryPolicy &policy);
+    const SpiRetryPolicy &retryPolicy() const  { return m_policy; }
+    void setDeadline(qint64 deadlineNs)         { m_deadlineNs = deadlineNs; }     // 重試不超過此時間, 0 = 只看 budgetUs
+    const SpiRecoveryStats &recoveryStats() const { return m_stats; }
+    SpiRecoveryStats &recoveryStats()           { return m_stats; }
+
+    eTypeSpiPlanResult runCycle(const SpiTransactionPlan &plan, const ResultFn &onResult);
+
+    int     lastUsbCalls() const    { return m_calls; }
+    int     lastFailedCalls() const { return m_failed; }
+    int     lastWakeSkipped() const { return m_wakeSkipped; }
+    int     lastShadowSkipped() const { return m_shadowSkipped; }    // Usb2UisInterface shadow 略過的 GPIO/CE 寫入
+    int     lastRetries() const     { return m_retries; }
+    int     lastDropped() const     { return m_dropped; }          // USB 失敗且重試用完, 未回報的命令數
+    QString lastError() const       { return m_error; }
+
+private:
+    BYTE       m_index;
+    bool       m_lineReady = false;
+    bool       m_lineNorth = true;
+    int        m_csLevel = -1;      // -1 未知, 0 LOW, 1 HIGH
+    qint64     m_lastActivityNs = 0;
+    qint64     m_lastWriteNs = 0;       // 最後一次 WRITE 結束, ADC 轉換時間的起點
+    QByteArray m_rx;
+
+    WORD       m_cmdIndex = 0xFFFF;     // 目前的命令, 只用於 trace
+
+    int        m_calls = 0;
+    int        m_failed = 0;
+    int        m_wakeSkipped = 0;
+    int        m_shadowSkipped = 0;
+    int        m_retries = 0;
+    int        m_dropped = 0;
+    QString    m_error;
+
+    SpiRetryPolicy   m_policy;
+    SpiRecoveryStats m_stats;
+    qint64     m_deadlineNs = 0;
+    qint64     m_retryNs = 0;           // 本 cycle 重試已用的時間
+    bool       m_dirSwap = false;       // failover: RDxx 以 plan 的反方向讀取
+
+    bool lineInit(bool north);
+    bool csEdge(bool north, bool high);
+    bool check(bool ok, const char *what);
+    void waitUntil(qint64 deadlineNs, int site);
+    bool poll(const SpiOp &op, BYTE *cmd, BYTE *status);
+    bool runOp(const SpiOp &op, bool north, BYTE *tx, BYTE *rx);
+    bool retryAllowed(int attempt, qint64 attemptNs);
+    static int resultOf(const SpiTransactionPlan &plan, int i);
+    eTypeSpiPlanResult execute(const SpiTransactionPlan &plan, const ResultFn &onResult);
+};
+
+#endif // SPI_TRANSACTION_PLAN_H
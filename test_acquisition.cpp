@@ -0,0 +1,977 @@
+/*
+ * Usb2uisTest
+ *  擷取核心的功能測試: 每個 case 的輸入固定 (模擬器不加入隨機錯誤), 結果可完全重現.
+ *  效能量測放在 Usb2uisBench (bench_acquisition.cpp), 這裡只驗證行為.
+ */
+#include <QtTest>
+#include <QTemporaryDir>
+
+#include "usb2uis_interface.h"
+#include "acquisition_worker.h"
+#include "adbms6832.h"
+#include "adbms6832_decoder.h"
+#include "adbms6832_sim_backend.h"
+#include "cell_stats_store.h"
+#include "cmd_library.h"
+#include "sequencer.h"
+#include "spi_log.h"
+#include "spi_transaction_plan.h"
+#include "usb2uis_record_backend.h"
+#include "usb2uis_submit_queue.h"
+
+#include <climits>
+#include <cmath>
+#include <thread>
+
+#define TEST_DEVICES    4       // 模擬 chain 上的 AFE 數量
+
+/* 程式中 op 的出現次數 */
+static int countOps(const SeqProgram &program, BYTE op)
+{
+    int n = 0;
+    for (const SeqInsn &in : program.code)
+        if (in.op == op) ++n;
+    return n;
+}
+
+static QByteArray cmdBytes(WORD code)
+{
+    BYTE cmd[4];
+    adbmsBuildCmd(cmd, code);
+    return QByteArray((const char*)cmd, 4);
+}
+
+/* 第一個 READ SET (RDCFGA..RDAUXE) 的命令 */
+static QList<QByteArray> readSetCmds()
+{
+    static const WORD kCodes[] = {
+        ADBMS6832_CMD_RDCFGA, ADBMS6832_CMD_RDCFGB,
+        ADBMS6832_CMD_RDCVA, ADBMS6832_CMD_RDCVB, ADBMS6832_CMD_RDCVC,
+        ADBMS6832_CMD_RDCVD, ADBMS6832_CMD_RDCVE, ADBMS6832_CMD_RDCVF,
+        ADBMS6832_CMD_RDAUXA, ADBMS6832_CMD_RDAUXB, ADBMS6832_CMD_RDAUXC,
+        ADBMS6832_CMD_RDAUXD, ADBMS6832_CMD_RDAUXE,
+    };
+    QList<QByteArray> cmds;
+    for (WORD code : kCodes) cmds << cmdBytes(code);
+    return cmds;
+}
+
+/* READ SET 的 plan; 每次都 wake, 呼叫順序與執行速度無關 */
+static SpiTransactionPlan readSetPlan()
+{
+    SpiPlanOptions opt;
+    opt.readSize   = 8 * TEST_DEVICES;
+    opt.wakeSkipUs = 0;
+    return SpiPlanCompiler::compileRead(readSetCmds(), opt);
+}
+
+/*
+ * 排定的錯誤: 指定命令接下來 n 次 SPIRead 回傳失敗 (未送到 chain), 或讀回的第一個 frame 翻轉 1 bit (PEC10 不符).
+ * 其餘呼叫直接轉給 inner (取得 ownership); 與亂數無關, 每次執行結果相同.
+ */
+class ScriptedFaultBackend : public Usb2UisBackend
+{
+public:
+    explicit ScriptedFaultBackend(Usb2UisBackend *inner) : m_inner(inner) {}
+    ~ScriptedFaultBackend() override { delete m_inner; }
+
+    void failReads(WORD code, int n)    { m_failCmd = cmdBytes(code); m_failLeft = n; }
+    void corruptReads(WORD code, int n) { m_corruptCmd = cmdBytes(code); m_corruptLeft = n; }
+
+    QString name() const override { return m_inner->name() + "+fault"; }
+
+    BYTE openDevice() override                  { return m_inner->openDevice(); }
+    bool closeDevice(BYTE index) override       { return m_inner->closeDevice(index); }
+    bool spiSetConfig(BYTE index, BYTE rate, DWORD timeout) override { return m_inner->spiSetConfig(index, rate, timeout); }
+    bool spiWrite(BYTE index, BYTE* cmd, BYTE cmdSize, BYTE* buffer, WORD size) override
+    {
+        return m_inner->spiWrite(index, cmd, cmdSize, buffer, size);
+    }
+    bool setCE(BYTE index, bool high) override  { return m_inner->setCE(index, high); }
+
+    bool spiRead(BYTE index, BYTE* cmd, BYTE cmdSize, BYTE* buffer, WORD size) override
+    {
+        if (m_failLeft > 0 && isCmd(m_failCmd, cmd, cmdSize)) {
+            --m_failLeft;
+            return false;
+        }
+        const bool ok = m_inner->spiRead(index, cmd, cmdSize, buffer, size);
+        if (ok && size > 0 && m_corruptLeft > 0 && isCmd(m_corruptCmd, cmd, cmdSize)) {
+            --m_corruptLeft;
+            buffer[0] ^= 0x01;
+        }
+        return ok;
+    }
+
+    bool getGPIOConfig(BYTE index, BYTE *dirByte) override  { return m_inner->getGPIOConfig(index, dirByte); }
+    bool setGPIOConfig(BYTE index, BYTE dirByte) override   { return m_inner->setGPIOConfig(index, dirByte); }
+    bool gpioRead(BYTE index, BYTE *valueByte) override     { return m_inner->gpioRead(index, valueByte); }
+    bool gpioWrite(BYTE index, BYTE valueByte, BYTE maskByte) override
+    {
+        return m_inner->gpioWrite(index, valueByte, maskByte);
+    }
+
+private:
+    Usb2UisBackend *m_inner;
+    QByteArray m_failCmd;
+    QByteArray m_corruptCmd;
+    int m_failLeft = 0;
+    int m_corruptLeft = 0;
+
+    static bool isCmd(const QByteArray &want, const BYTE *cmd, BYTE cmdSize)
+    {
+        return cmd && cmdSize == want.size() && memcmp(cmd, want.constData(), cmdSize) == 0;
+    }
+};
+
+/* backend 換成 backend 並開啟, 設定與 AcquisitionWorker::applyConfig 相同 (12MHz) */
+static BYTE openBackend(Usb2UisBackend *backend)
+{
+    Usb2UisInterface::setBackend(backend);
+    const BYTE index = Usb2UisInterface::USBIO_OpenDevice();
+    if (index == 0xFF) return index;
+    Usb2UisInterface::USBIO_SetGPIOConfig(index, 0x00);
+    Usb2UisInterface::USBIO_SPISetConfig(index, 0x08, (100 << 16) | 100);
+    return index;
+}
+
+static BYTE openSim()
+{
+    Adbms6832SimConfig cfg;
+    cfg.deviceCount = TEST_DEVICES;
+    return openBackend(new Adbms6832SimBackend(cfg));
+}
+
+/* 模擬 chain 的 isoSPI 閒置時間放寬到 1 s, wake 是否略過只取決於 plan (不受執行速度影響) */
+static ScriptedFaultBackend *openFaultSim(BYTE *index)
+{
+    Adbms6832SimConfig cfg;
+    cfg.deviceCount   = TEST_DEVICES;
+    cfg.idleTimeoutUs = 1000000;
+    ScriptedFaultBackend *backend = new ScriptedFaultBackend(new Adbms6832SimBackend(cfg));
+    *index = openBackend(backend);
+    return backend;
+}
+
+/* 連續模式的 cell ADC, poll 到第一次轉換完成; 之後 RDCVx 讀到有效的電壓 */
+static bool startCellAdc(BYTE index)
+{
+    SpiPlanOptions opt;
+    opt.adcPoll = true;
+    const SpiTransactionPlan plan = SpiPlanCompiler::compileRead(
+            QList<QByteArray>() << cmdBytes(ADBMS6832_CMD_ADCV | ADBMS6832_ADCV_CONT | ADBMS6832_ADCV_RD), opt);
+    SpiPlanExecutor executor(index);
+    return executor.runCycle(plan, SpiPlanExecutor::ResultFn()) == SPI_PLAN_OK;
+}
+
+static void closeSim(BYTE index)
+{
+    Usb2UisInterface::USBIO_CloseDevice(index);
+    Usb2UisInterface::setBackend(nullptr);
+}
+
+/* plan 方向 (North) 的每顆 AFE 解碼結果與模擬值相差 1 mV 以內; 方向相反時差 10 mV 以上 */
+static bool cellsMatchModel(const AfeChainSample &sample, int firstCell, int cells)
+{
+    if (sample.devices.size() != TEST_DEVICES) return false;
+    for (int d = 0; d < TEST_DEVICES; ++d) {
+        for (int c = firstCell; c < firstCell + cells; ++c) {
+            if (!((sample.devices[d].cellValid >> c) & 1)) return false;
+            // 模擬值: 3.6 V + 10 mV x AFE + 2 mV x cell, 漂移 ±0.5 mV
+            const qint32 nominal = 3600000 + d * 10000 + c * 2000;
+            if (qAbs(sample.devices[d].cellUv[c] - nominal) > 1000) return false;
+        }
+    }
+    return true;
+}
+
+/* 一個 READ SET cycle, 結果解碼 (plan 方向); 回傳 PEC 錯誤的 frame 數 */
+static int runDecoded(SpiPlanExecutor &executor, const SpiTransactionPlan &plan, AfeChainSample &sample)
+{
+    const QList<QByteArray> cmds = readSetCmds();
+    int bad = 0;
+    sample.clear();
+    executor.runCycle(plan, [&](const SpiOp &op, const BYTE *data, int size) {
+        const QByteArray &cmd = cmds.at(op.cmdIndex);
+        bad += qMax(0, Adbms6832Decoder::decode((const BYTE*)cmd.constData(), cmd.size(), data, size, true, sample));
+        return true;
+    });
+    return bad;
+}
+
+/* 執行 cycles 次, 回傳所有讀回的資料 (依序串接) */
+static QByteArray runReadSet(BYTE index, const SpiTransactionPlan &plan, int cycles)
+{
+    QByteArray out;
+    SpiPlanExecutor executor(index);
+    for (int i = 0; i < cycles; ++i) {
+        executor.runCycle(plan, [&out](const SpiOp &, const BYTE *data, int size) {
+            out.append((const char*)data, size);
+            return true;
+        });
+    }
+    return out;
+}
+
+class AcquisitionTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void seqCompileNesting();
+    void seqCompileBreak();
+    void seqCompileElse();
+    void seqCompileErrors();
+    void seqCompileReadMerge();
+    void seqLoopStops();
+
+    void recordReplay();
+
+    void submitQueueRing();
+    void submitQueueProducers();
+
+    void retryUsbFailure();
+    void retryPecOnly();
+    void retryExhausted();
+    void retryFailover();
+
+    void statsWindows();
+    void statsRetention();
+
+private:
+    CmdLibrary m_lib;       // 未載入清單檔: 命令以文字 (RDCVA, ADCV CONT RD ...) 給定
+
+    bool compile(const char *text, SeqProgram &program, QString *error = nullptr);
+};
+
+bool AcquisitionTest::compile(const char *text, SeqProgram &program, QString *error)
+{
+    QString err;
+    const bool ok = SeqCompiler::compile(QByteArray(text), m_lib, program, &err);
+    if (error) *error = err;
+    return ok;
+}
+
+/* repeat > loop > if 巢狀; 每個跳躍目的與 counter 編號 */
+void AcquisitionTest::seqCompileNesting()
+{
+    SeqProgram p;
+    QString err;
+    QVERIFY2(compile("repeat 3\n"              // 0 LOOP_SET c0
+                     "    loop\n"
+                     "        read RDCVA\n"    // 1 PLAN
+                     "        if cellmin < 2.5\n"  // 2 BRANCH
+                     "            break\n"     // 3 JUMP → loop 之後
+                     "        end\n"
+                     "        wait 1ms\n"      // 4 WAIT
+                     "    end\n"               // 5 JUMP → 1
+                     "    emit\n"              // 6 EMIT
+                     "end\n",                  // 7 LOOP_NEXT c0 → 1
+                     p, &err), qPrintable(err));
+
+    QCOMPARE(p.code.size(), 9);
+    QCOMPARE(int(p.code[0].op), int(SEQ_OP_LOOP_SET));
+    QCOMPARE(p.code[0].value, qint64(3));
+    QCOMPARE(p.code[0].target, 8);             // 次數 <= 0 時跳過整個 repeat
+    QCOMPARE(int(p.code[2].op), int(SEQ_OP_BRANCH));
+    QCOMPARE(p.code[2].target, 4);
+    QCOMPARE(int(p.code[3].op), int(SEQ_OP_JUMP));
+    QCOMPARE(p.code[3].target, 6);
+    QCOMPARE(int(p.code[5].op), int(SEQ_OP_JUMP));
+    QCOMPARE(p.code[5].target, 1);
+    QCOMPARE(int(p.code[7].op), int(SEQ_OP_LOOP_NEXT));
+    QCOMPARE(int(p.code[7].a), 0);
+    QCOMPARE(p.code[7].target, 1);
+    QCOMPARE(int(p.code[8].op), int(SEQ_OP_END));
+
+    // 巢狀 repeat 使用不同的 counter, 結束後 counter 可重用
+    QVERIFY2(compile("repeat 2\n"              // 0 LOOP_SET c0
+                     "    repeat 3\n"          // 1 LOOP_SET c1
+                     "        emit\n"          // 2
+                     "    end\n"               // 3 LOOP_NEXT c1 → 2
+                     "end\n"                   // 4 LOOP_NEXT c0 → 1
+                     "repeat 4\n"              // 5 LOOP_SET c0
+                     "    emit\n"              // 6
+                     "end\n",                  // 7 LOOP_NEXT c0 → 6
+                     p, &err), qPrintable(err));
+    QCOMPARE(p.code.size(), 9);
+    QCOMPARE(int(p.code[1].a), 1);
+    QCOMPARE(p.code[1].target, 4);
+    QCOMPARE(int(p.code[3].a), 1);
+    QCOMPARE(p.code[3].target, 2);
+    QCOMPARE(int(p.code[4].a), 0);
+    QCOMPARE(p.code[4].target, 1);
+    QCOMPARE(p.code[0].target, 5);
+    QCOMPARE(int(p.code[5].a), 0);
+    QCOMPARE(p.code[7].target, 6);
+}
+
+/* break 跳到最內層 repeat/loop 的結尾, 中間的 if 不算 */
+void AcquisitionTest::seqCompileBreak()
+{
+    SeqProgram p;
+    QString err;
+    QVERIFY2(compile("repeat 5\n"              // 0 LOOP_SET
+                     "    loop\n"
+                     "        break\n"         // 1 JUMP → 3 (loop 之後)
+                     "    end\n"               // 2 JUMP → 1
+                     "    if pecerr > 0\n"     // 3 BRANCH → 5
+                     "        break\n"         // 4 JUMP → 6 (repeat 之後)
+                     "    end\n"
+                     "end\n"                   // 5 LOOP_NEXT → 1
+                     "emit\n",                 // 6
+                     p, &err), qPrintable(err));
+
+    QCOMPARE(p.code.size(), 8);
+    QCOMPARE(int(p.code[1].op), int(SEQ_OP_JUMP));
+    QCOMPARE(p.code[1].target, 3);
+    QCOMPARE(p.code[2].target, 1);
+    QCOMPARE(p.code[3].target, 5);
+    QCOMPARE(int(p.code[4].op), int(SEQ_OP_JUMP));
+    QCOMPARE(p.code[4].target, 6);
+    QCOMPARE(p.code[0].target, 6);
+    QCOMPARE(int(p.code[6].op), int(SEQ_OP_EMIT));
+
+    QVERIFY(!compile("emit\nif pecerr > 0\n    break\nend\n", p, &err));
+    QCOMPARE(err, QString("line 3: break outside repeat/loop"));
+}
+
+/* if/else: BRANCH 指向 else 之後, else 前的 JUMP 指向 end 之後 */
+void AcquisitionTest::seqCompileElse()
+{
+    SeqProgram p;
+    QString err;
+    QVERIFY2(compile("if cell 1 3 >= 3.3\n"    // 0 BRANCH → 3
+                     "    emit\n"              // 1
+                     "else\n"                  // 2 JUMP → 4
+                     "    stop\n"              // 3 END
+                     "end\n"
+                     "wait 2ms\n"              // 4
+                     "if celldelta > 50mV\n"   // 5 BRANCH → 7 (沒有 else)
+                     "    emit\n"              // 6
+                     "end\n",
+                     p, &err), qPrintable(err));
+
+    QCOMPARE(p.code.size(), 8);
+    QCOMPARE(int(p.code[0].op), int(SEQ_OP_BRANCH));
+    QCOMPARE(p.code[0].target, 3);
+    QCOMPARE(int(p.code[2].op), int(SEQ_OP_JUMP));
+    QCOMPARE(p.code[2].target, 4);
+    QCOMPARE(int(p.code[4].op), int(SEQ_OP_WAIT));
+    QCOMPARE(p.code[4].value, qint64(2000000));
+    QCOMPARE(p.code[5].target, 7);
+
+    QCOMPARE(p.conds.size(), 2);
+    QCOMPARE(int(p.conds[0].value), int(SEQ_VALUE_CELL));
+    QCOMPARE(int(p.conds[0].cmp), int(SEQ_CMP_GE));
+    QCOMPARE(int(p.conds[0].device), 0);
+    QCOMPARE(int(p.conds[0].index), 2);
+    QCOMPARE(p.conds[0].threshold, qint64(3300000));
+    QCOMPARE(int(p.conds[1].value), int(SEQ_VALUE_CELL_DELTA));
+    QCOMPARE(p.conds[1].threshold, qint64(50000));
+
+    QVERIFY(!compile("if pecerr > 0\n    emit\nelse\n    emit\nelse\nend\n", p, &err));
+    QCOMPARE(err, QString("line 5: else without if"));
+}
+
+/* 錯誤訊息的行號: missing end 指向最內層未結束的區塊 */
+void AcquisitionTest::seqCompileErrors()
+{
+    SeqProgram p;
+    QString err;
+
+    QVERIFY(!compile("emit\nrepeat 2\n    loop\n        emit\n    end\n", p, &err));
+    QCOMPARE(err, QString("line 2: missing end"));
+    QVERIFY(p.isEmpty());
+
+    QVERIFY(!compile("repeat 2\n    emit\n    loop\n\n    # comment\n", p, &err));
+    QCOMPARE(err, QString("line 3: missing end"));
+
+    QVERIFY(!compile("emit\nend\n", p, &err));
+    QCOMPARE(err, QString("line 2: end without repeat/loop/if"));
+
+    QVERIFY(!compile("# header\n\nfrobnicate 3\n", p, &err));
+    QCOMPARE(err, QString("line 3: unknown statement 'frobnicate'"));
+
+    // 非有限值或超出範圍的時間/電壓
+    QVERIFY(!compile("wait nanms\n", p, &err));
+    QVERIFY(err.startsWith("line 1: wait needs"));
+    QVERIFY(!compile("emit\nwait infs\n", p, &err));
+    QVERIFY(err.startsWith("line 2: wait needs"));
+    QVERIFY(!compile("wait 1e30s\n", p, &err));
+    QVERIFY(!compile("wait -1ms\n", p, &err));
+    QVERIFY(!compile("read RDCVA delay 1e300s\n", p, &err));
+    QVERIFY(err.startsWith("line 1: delay needs"));
+    QVERIFY(!compile("if cellmin < 1e300\nend\n", p, &err));
+    QVERIFY(!compile("if cellmin < nan\nend\n", p, &err));
+    QVERIFY(!compile("wait 24h\n", p, &err));
+    QVERIFY2(compile("wait 86400s\n", p, &err), qPrintable(err));
+    QCOMPARE(p.code[0].value, qint64(SEQ_MAX_WAIT_NS));
+}
+
+/* 連續且 delay 相同的 read 合併成一個 step; 其他敘述 (wait/cmd/if) 之後重新開始 */
+void AcquisitionTest::seqCompileReadMerge()
+{
+    SeqProgram p;
+    QString err;
+    QVERIFY2(compile("read RDCVA\n"
+                     "read RDCVB\n"            // step 0
+                     "read RDCVC delay 2ms\n"  // step 1 (delay 不同)
+                     "read RDCVD delay 2ms\n"
+                     "wait 1ms\n"
+                     "read RDCVE\n"            // step 2
+                     "cmd ADCV CONT RD\n"      // step 3
+                     "read RDCVF\n"            // step 4
+                     "if pecerr > 0\n"
+                     "end\n"
+                     "read RDAUXA\n",          // step 5
+                     p, &err), qPrintable(err));
+
+    QCOMPARE(p.steps.size(), 6);
+    QCOMPARE(countOps(p, SEQ_OP_PLAN), 6);
+
+    QCOMPARE(int(p.steps[0].kind), int(SEQ_STEP_READ));
+    QCOMPARE(p.steps[0].cmds.size(), 2);
+    QCOMPARE(p.steps[0].cmds[0], cmdBytes(ADBMS6832_CMD_RDCVA));
+    QCOMPARE(p.steps[0].cmds[1], cmdBytes(ADBMS6832_CMD_RDCVB));
+    QCOMPARE(p.steps[0].line, 1);
+
+    QCOMPARE(p.steps[1].cmds.size(), 2);
+    QCOMPARE(p.steps[1].delayMs, 2);
+    QCOMPARE(p.steps[1].cmds[1], cmdBytes(ADBMS6832_CMD_RDCVD));
+    QCOMPARE(p.steps[1].line, 3);
+
+    QCOMPARE(p.steps[2].cmds.size(), 1);
+    QCOMPARE(int(p.steps[3].kind), int(SEQ_STEP_CMD));
+    QCOMPARE(p.steps[4].cmds.size(), 1);
+    QCOMPARE(p.steps[5].cmds.size(), 1);
+    QCOMPARE(p.steps[5].cmds[0], cmdBytes(ADBMS6832_CMD_RDAUXA));
+}
+
+/* 沒有 PLAN/WAIT 的 repeat 也能由 keepRunning 停止 */
+void AcquisitionTest::seqLoopStops()
+{
+    SeqProgram p;
+    QString err;
+    QVERIFY2(compile("repeat 2000000000\n    emit\nend\n", p, &err), qPrintable(err));
+
+    SpiPlanExecutor executor(0);
+    SeqInterpreter seq(executor);
+    seq.link(p, SpiPlanOptions(), 1);
+
+    int checks = 0;
+    SeqHooks hooks;
+    hooks.keepRunning = [&checks]() { return ++checks < 1000; };
+    QCOMPARE(seq.run(hooks), SEQ_RESULT_STOPPED);
+    QCOMPARE(checks, 1000);
+}
+
+/*
+ * 模擬 chain 的 READ SET 紀錄後重播: 讀回的資料相同, 並檢查 Stats 的 matched/skipped/missing/writeMismatch.
+ * 中間一筆 64 KB 讀取 (cmd + 資料超過 16 bits) 之後的紀錄也必須能重播.
+ */
+void AcquisitionTest::recordReplay()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QString path = dir.filePath("sim.u2rec");
+    const SpiTransactionPlan plan = readSetPlan();
+    QByteArray rdcva = cmdBytes(ADBMS6832_CMD_RDCVA);
+    QByteArray wrcfga = cmdBytes(ADBMS6832_CMD_WRCFGA);
+    QByteArray cfg(6 * TEST_DEVICES, char(0x81));
+    QByteArray big(0xFFFF, 0);
+
+    Adbms6832SimConfig simCfg;
+    simCfg.deviceCount = TEST_DEVICES;
+    Usb2UisRecordBackend *rec = new Usb2UisRecordBackend(new Adbms6832SimBackend(simCfg));
+    QString err;
+    QVERIFY2(rec->open(path, &err), qPrintable(err));
+    const BYTE index = openBackend(rec);
+    QVERIFY(index != 0xFF);
+
+    QByteArray recorded = runReadSet(index, plan, 3);
+    QVERIFY(Usb2UisInterface::USBIO_SPIRead(index, (BYTE*)rdcva.data(), 4, (BYTE*)big.data(), WORD(big.size())));
+    recorded += big;
+    QVERIFY(Usb2UisInterface::USBIO_SPIWrite(index, (BYTE*)wrcfga.data(), 4, (BYTE*)cfg.data(), WORD(cfg.size())));
+    QVERIFY(Usb2UisInterface::USBIO_SPIWrite(index, (BYTE*)wrcfga.data(), 4, (BYTE*)cfg.data(), WORD(cfg.size())));
+    recorded += runReadSet(index, plan, 2);
+    Usb2UisInterface::USBIO_CloseDevice(index);
+    const quint64 records = rec->records();
+    Usb2UisInterface::setBackend(nullptr);
+
+    Usb2UisReplayBackend *replay = new Usb2UisReplayBackend;
+    QVERIFY2(replay->open(path, &err), qPrintable(err));
+    QCOMPARE(quint64(replay->recordCount()), records);
+    replay->setSpeed(0);
+    Usb2UisInterface::setBackend(replay);
+
+    // 不做 GPIO/SPI 設定: 第一個 SPI 讀取略過這 2 筆紀錄
+    QCOMPARE(Usb2UisInterface::USBIO_OpenDevice(), index);
+    QByteArray replayed = runReadSet(index, plan, 3);
+    big.fill(0);
+    QVERIFY(Usb2UisInterface::USBIO_SPIRead(index, (BYTE*)rdcva.data(), 4, (BYTE*)big.data(), WORD(big.size())));
+    replayed += big;
+    QVERIFY(Usb2UisInterface::USBIO_SPIWrite(index, (BYTE*)wrcfga.data(), 4, (BYTE*)cfg.data(), WORD(cfg.size())));
+    cfg[0] = char(0x80);
+    QVERIFY(Usb2UisInterface::USBIO_SPIWrite(index, (BYTE*)wrcfga.data(), 4, (BYTE*)cfg.data(), WORD(cfg.size())));
+    replayed += runReadSet(index, plan, 2);
+    QCOMPARE(replayed.size(), recorded.size());
+    QVERIFY(replayed == recorded);
+
+    // 沒有紀錄的命令: 失敗並回傳 0xFF
+    QByteArray rdsid = cmdBytes(ADBMS6832_CMD_RDSID);
+    QByteArray id(8 * TEST_DEVICES, 0);
+    QVERIFY(!Usb2UisInterface::USBIO_SPIRead(index, (BYTE*)rdsid.data(), 4, (BYTE*)id.data(), WORD(id.size())));
+    QVERIFY(id == QByteArray(id.size(), char(0xFF)));
+    Usb2UisInterface::USBIO_CloseDevice(index);
+
+    const Usb2UisReplayBackend::Stats st = replay->stats();
+    QCOMPARE(st.skipped, quint64(2));
+    QCOMPARE(st.matched, records - 1 - 2);      // OPEN 不經過比對
+    QCOMPARE(st.missing, quint64(1));
+    QCOMPARE(st.writeMismatch, quint64(1));
+    Usb2UisInterface::setBackend(nullptr);
+}
+
+/* 單一執行緒: 容量 8 的 ring 繞行多次, 已滿時拒絕, 每次 drain 之前只通知一次 */
+void AcquisitionTest::submitQueueRing()
+{
+    const BYTE index = openSim();
+    QVERIFY(index != 0xFF);
+    SpiPlanOptions opt;
+    opt.readSize = 8 * TEST_DEVICES;
+    const SpiTransactionPlan plan = SpiPlanCompiler::compileRead(QList<QByteArray>() << cmdBytes(ADBMS6832_CMD_RDCVA), opt);
+
+    SpiPlanExecutor executor(index);
+    Usb2UisSubmitQueue queue(5);            // 進位到 8
+    int notified = 0;
+    queue.setNotify([&notified]() { ++notified; });
+
+    QList<int> done;
+    int next = 0;
+    for (int round = 0; round < 5; ++round) {
+        const int notifiedBefore = notified;
+        for (int i = 0; i < 8; ++i) {
+            const int tag = next++;
+            QVERIFY(queue.submit(plan, [&done, tag](const UsbTransactionResult &r) {
+                done << (r.result == USB_TXN_OK && r.data.size() == 1 ? tag : -1);
+            }));
+        }
+        QCOMPARE(queue.depth(), 8);
+        QCOMPARE(notified, notifiedBefore + 1);
+
+        // 已滿: callback 不會被呼叫, future 立即就緒
+        QVERIFY(!queue.submit(plan, [&done](const UsbTransactionResult &) { done << -2; }));
+        std::future<UsbTransactionResult> f = queue.submit(plan);
+        QCOMPARE(f.wait_for(std::chrono::seconds(0)), std::future_status::ready);
+        QCOMPARE(int(f.get().result), int(USB_TXN_REJECTED));
+
+        QCOMPARE(queue.drain(executor, 3), 3);
+        QCOMPARE(notified, notifiedBefore + 2);     // 剩餘的交易再排一次
+        QCOMPARE(queue.drain(executor), 5);
+        QCOMPARE(queue.depth(), 0);
+        QCOMPARE(notified, notifiedBefore + 2);
+    }
+
+    QCOMPARE(done.size(), 40);
+    for (int i = 0; i < done.size(); ++i) QCOMPARE(done[i], i);
+
+    // 取消: callback 收到 USB_TXN_CANCELLED
+    int cancelled = 0;
+    for (int i = 0; i < 3; ++i)
+        queue.submit(plan, [&cancelled](const UsbTransactionResult &r) { cancelled += r.result == USB_TXN_CANCELLED; });
+    queue.cancelAll("closed");
+    QCOMPARE(cancelled, 3);
+
+    const Usb2UisSubmitQueue::Stats st = queue.stats();
+    QCOMPARE(st.submitted, quint64(43));
+    QCOMPARE(st.completed, quint64(40));
+    QCOMPARE(st.rejected, quint64(10));
+    QCOMPARE(st.cancelled, quint64(3));
+    QCOMPARE(st.maxDepth, 8);
+    closeSim(index);
+}
+
+/* 4 個 producer 執行緒同時送出, 擁有裝置的執行緒 drain: 每筆恰好執行一次, 同一 producer 依序 */
+void AcquisitionTest::submitQueueProducers()
+{
+    const int kProducers = 4;
+    const int kPerProducer = 2000;
+    const BYTE index = openSim();
+    QVERIFY(index != 0xFF);
+    SpiPlanOptions opt;
+    opt.readSize = 8 * TEST_DEVICES;
+    const SpiTransactionPlan plan = SpiPlanCompiler::compileRead(QList<QByteArray>() << cmdBytes(ADBMS6832_CMD_RDCVA), opt);
+
+    SpiPlanExecutor executor(index);
+    Usb2UisSubmitQueue queue(16);
+    std::atomic<int> notified{0};
+    queue.setNotify([&notified]() { notified.fetch_add(1); });
+
+    QVector<int> last(kProducers, -1);      // 只由 drain 的執行緒 (callback) 存取
+    int outOfOrder = 0;
+    int failed = 0;
+    std::atomic<quint64> rejected{0};
+
+    std::vector<std::thread> producers;
+    for (int p = 0; p < kProducers; ++p) {
+        producers.emplace_back([&, p]() {
+            for (int i = 0; i < kPerProducer; ++i) {
+                const UsbTransactionCallback done = [&, p, i](const UsbTransactionResult &r) {
+                    if (r.result != USB_TXN_OK) ++failed;
+                    if (last[p] + 1 != i) ++outOfOrder;
+                    last[p] = i;
+                };
+                while (!queue.submit(plan, done)) {
+                    rejected.fetch_add(1);
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+
+    const quint64 total = quint64(kProducers) * kPerProducer;
+    int drains = 0;
+    while (queue.stats().completed < total) {
+        ++drains;
+        if (queue.drain(executor, 5) == 0) std::this_thread::yield();
+    }
+    for (std::thread &t : producers) t.join();
+
+    QCOMPARE(outOfOrder, 0);
+    QCOMPARE(failed, 0);
+    for (int p = 0; p < kProducers; ++p) QCOMPARE(last[p], kPerProducer - 1);
+
+    const Usb2UisSubmitQueue::Stats st = queue.stats();
+    QCOMPARE(st.submitted, total);
+    QCOMPARE(st.completed, total);
+    QCOMPARE(st.rejected, rejected.load());
+    QCOMPARE(queue.depth(), 0);
+    QVERIFY(st.maxDepth <= 16);
+    // 通知之後旗標只由 drain 清除: 每次 drain 之間最多一次
+    QVERIFY(notified.load() >= 1 && notified.load() <= drains + 1);
+    closeSim(index);
+}
+
+/* RDCVB (cmdIndex 3) 在 READ SET 中的位置 */
+#define TEST_RDCVB_INDEX    3
+
+static SpiTransactionPlan recoveryPlan()
+{
+    SpiPlanOptions opt;
+    opt.readSize   = 8 * TEST_DEVICES;
+    opt.wakeSkipUs = 500000;
+    return SpiPlanCompiler::compileRead(readSetCmds(), opt);
+}
+
+static SpiRetryPolicy recoveryPolicy(int maxRetries, bool failover = false)
+{
+    SpiRetryPolicy policy;
+    policy.maxRetries = maxRetries;
+    policy.backoffUs  = 0;
+    policy.budgetUs   = 1000000;
+    policy.failover   = failover;
+    return policy;
+}
+
+/* USB 呼叫失敗一次: 重試一次即恢復, 重試前強制 wake */
+void AcquisitionTest::retryUsbFailure()
+{
+    BYTE index = 0xFF;
+    ScriptedFaultBackend *backend = openFaultSim(&index);
+    QVERIFY(index != 0xFF);
+    QVERIFY(startCellAdc(index));
+    const SpiTransactionPlan plan = recoveryPlan();
+    SpiPlanExecutor executor(index);
+    executor.setRetryPolicy(recoveryPolicy(2));
+    AfeChainSample sample;
+
+    backend->failReads(ADBMS6832_CMD_RDCVB, 1);
+    QCOMPARE(runDecoded(executor, plan, sample), 0);
+    QVERIFY(cellsMatchModel(sample, 0, 16));
+    QCOMPARE(executor.lastRetries(), 1);
+    QCOMPARE(executor.lastDropped(), 0);
+    QCOMPARE(executor.lastWakeSkipped(), 12);      // 第一條命令與重試需要 wake, 其餘 12 條略過
+
+    const SpiCmdErrorCounts rdcvb = executor.recoveryStats().cmd(TEST_RDCVB_INDEX);
+    QCOMPARE(rdcvb.transferErrors, quint64(1));
+    QCOMPARE(rdcvb.pecErrors, quint64(0));
+    QCOMPARE(rdcvb.retries, quint64(1));
+    QCOMPARE(rdcvb.recovered, quint64(1));
+    QCOMPARE(rdcvb.failed, quint64(0));
+    QCOMPARE(executor.recoveryStats().total().errors(), quint64(1));
+    QCOMPARE(executor.recoveryStats().forcedWakes(), quint64(1));
+    closeSim(index);
+}
+
+/* 只有 PEC10 不符: 重試一次即恢復, chain 仍在 tIDLE 內所以不 wake */
+void AcquisitionTest::retryPecOnly()
+{
+    BYTE index = 0xFF;
+    ScriptedFaultBackend *backend = openFaultSim(&index);
+    QVERIFY(index != 0xFF);
+    QVERIFY(startCellAdc(index));
+    const SpiTransactionPlan plan = recoveryPlan();
+    SpiPlanExecutor executor(index);
+    executor.setRetryPolicy(recoveryPolicy(2));
+    AfeChainSample sample;
+
+    backend->corruptReads(ADBMS6832_CMD_RDCVB, 1);
+    QCOMPARE(runDecoded(executor, plan, sample), 0);
+    QVERIFY(cellsMatchModel(sample, 0, 16));
+    QCOMPARE(executor.lastRetries(), 1);
+    QCOMPARE(executor.lastWakeSkipped(), 13);      // 12 條命令 + 重試
+
+    const SpiCmdErrorCounts rdcvb = executor.recoveryStats().cmd(TEST_RDCVB_INDEX);
+    QCOMPARE(rdcvb.transferErrors, quint64(0));
+    QCOMPARE(rdcvb.pecErrors, quint64(1));
+    QCOMPARE(rdcvb.retries, quint64(1));
+    QCOMPARE(rdcvb.recovered, quint64(1));
+    QCOMPARE(executor.recoveryStats().forcedWakes(), quint64(0));
+    QCOMPARE(executor.recoveryStats().failovers(), quint64(0));
+    closeSim(index);
+}
+
+/* USB 失敗超過重試次數: 該命令不回報, 其餘照常; worker 將錯誤寫入 log (SPI_LOG_ERROR) */
+void AcquisitionTest::retryExhausted()
+{
+    BYTE index = 0xFF;
+    ScriptedFaultBackend *backend = openFaultSim(&index);
+    QVERIFY(index != 0xFF);
+    Usb2UisInterface::USBIO_CloseDevice(index);     // 由 worker 開啟
+
+    SpiLogSink log;
+    AcquisitionWorker worker;
+    worker.setLogSink(&log);
+    worker.setTransferConfig(TEST_DEVICES, 0);
+    worker.setRetryPolicy(recoveryPolicy(2));
+    QVERIFY(worker.openDevice());
+    worker.applyConfig(0x08, (100 << 16) | 100);
+
+    SpiReadSetParams p;
+    p.cmds  = readSetCmds();
+    p.setId = 1;
+    backend->failReads(ADBMS6832_CMD_RDCVB, 3);
+    worker.runSpiReadSet(p);
+
+    const SpiCmdErrorCounts rdcvb = worker.recoveryStats().cmd(TEST_RDCVB_INDEX);
+    QCOMPARE(rdcvb.transferErrors, quint64(3));
+    QCOMPARE(rdcvb.retries, quint64(2));
+    QCOMPARE(rdcvb.recovered, quint64(0));
+    QCOMPARE(rdcvb.failed, quint64(1));
+    QCOMPARE(worker.recoveryStats().total().failed, quint64(1));
+
+    quint64 first = 0, end = 0;
+    log.range(&first, &end);
+    int reads = 0, errors = 0;
+    bool rdcvbLogged = false;
+    for (quint64 seq = first; seq < end; ++seq) {
+        SpiLogRecord rec;
+        QByteArray data;
+        QVERIFY(log.read(seq, &rec, &data));
+        if (rec.kind == SPI_LOG_READ) {
+            ++reads;
+            rdcvbLogged = rdcvbLogged || rec.cmdIndex == TEST_RDCVB_INDEX;
+        } else if (rec.kind == SPI_LOG_ERROR) {
+            ++errors;
+        }
+    }
+    QCOMPARE(reads, p.cmds.size() - 1);
+    QVERIFY(!rdcvbLogged);
+    QCOMPARE(errors, 1);
+
+    worker.closeDevice();
+    Usb2UisInterface::setBackend(nullptr);
+}
+
+/* 最後一次重試由 chain 的另一端 (South) 讀取: frame 順序轉回 plan 的方向, 之後的命令維持 South */
+void AcquisitionTest::retryFailover()
+{
+    BYTE index = 0xFF;
+    ScriptedFaultBackend *backend = openFaultSim(&index);
+    QVERIFY(index != 0xFF);
+    QVERIFY(startCellAdc(index));
+    const SpiTransactionPlan plan = recoveryPlan();
+    SpiPlanExecutor executor(index);
+    executor.setRetryPolicy(recoveryPolicy(1, true));
+    AfeChainSample sample;
+
+    QCOMPARE(runDecoded(executor, plan, sample), 0);
+    QVERIFY(cellsMatchModel(sample, 0, 16));
+
+    backend->corruptReads(ADBMS6832_CMD_RDCVB, 1);
+    QCOMPARE(runDecoded(executor, plan, sample), 0);
+    QVERIFY(cellsMatchModel(sample, 0, 16));
+    QCOMPARE(executor.lastRetries(), 1);
+    QCOMPARE(executor.recoveryStats().failovers(), quint64(1));
+    QCOMPARE(executor.recoveryStats().cmd(TEST_RDCVB_INDEX).recovered, quint64(1));
+
+    // 下一個 cycle 仍由 South 讀取, 結果同樣轉回 plan 的方向
+    QCOMPARE(runDecoded(executor, plan, sample), 0);
+    QVERIFY(cellsMatchModel(sample, 0, 16));
+    QCOMPARE(executor.recoveryStats().failovers(), quint64(1));
+    closeSim(index);
+}
+
+/* 逐筆計算 [fromNs, toNs] 內的統計, 與 CellStatsStore 的結果比較 */
+struct StatsRef {
+    qint64  timeNs;
+    quint32 valid;
+    qint32  cellUv[ADBMS6832_CELL_COUNT];
+};
+
+static QString compareStats(const QVector<StatsRef> &all, int cell, const CellStatsStore::Stats &st)
+{
+    quint64 n = 0;
+    double sum = 0, sumSq = 0;
+    qint32 lowest = INT_MAX, highest = INT_MIN;
+    for (const StatsRef &r : all) {
+        if (r.timeNs < st.fromNs || r.timeNs > st.toNs || !((r.valid >> cell) & 1)) continue;
+        const qint32 v = r.cellUv[cell];
+        ++n;
+        sum += v;
+        sumSq += double(v) * v;
+        lowest = qMin(lowest, v);
+        highest = qMax(highest, v);
+    }
+    if (n != st.count) return QString("count %1, expected %2").arg(st.count).arg(n);
+    if (n == 0) return QString();
+
+    const double mean = sum / double(n);
+    const double stddev = std::sqrt(qMax(0.0, sumSq / double(n) - mean * mean));
+    if (st.minUv != lowest || st.maxUv != highest)
+        return QString("min/max %1/%2, expected %3/%4").arg(st.minUv).arg(st.maxUv).arg(lowest).arg(highest);
+    if (std::fabs(st.meanUv - mean) > 0.01 || std::fabs(st.stddevUv - stddev) > 0.1)
+        return QString("mean/stddev %1/%2, expected %3/%4").arg(st.meanUv).arg(st.stddevUv).arg(mean).arg(stddev);
+    return QString();
+}
+
+/*
+ * 約 5 小時不規則間隔 (含數分鐘的中斷) 的樣本, 部分 cell 無效;
+ * 每 20000 筆以最近 1 分鐘/37 秒/1 小時/1 天, 以及起點/終點超出 1 s 或 10 s 層保留範圍的 [t0, t1] 查詢並逐筆比對.
+ */
+void AcquisitionTest::statsWindows()
+{
+    CellStatsStore store;
+    QVector<StatsRef> all;
+    AfeChainSample sample;
+    sample.devices.resize(1);
+    AfeDeviceSample &dev = sample.devices[0];
+
+    quint32 noise = 0x2545F491;     // xorshift32, 固定種子
+    auto next = [&noise]() {
+        noise ^= noise << 13;
+        noise ^= noise >> 17;
+        noise ^= noise << 5;
+        return noise;
+    };
+
+    const int kCells[] = {0, 7, 15};
+    qint64 t = 5000000000LL;
+    int checks = 0;
+    for (int i = 0; i < 100000; ++i) {
+        t += (next() % 500 == 0) ? qint64(next() % 300) * 1000000000LL : qint64(next() % 300) * 1000000LL + 1;
+        sample.timeNs = t;
+        dev.cellValid = (i % 7 == 0) ? quint16(next()) : 0xFFFF;
+        StatsRef ref;
+        ref.timeNs = t;
+        ref.valid = dev.cellValid;
+        for (int c = 0; c < ADBMS6832_CELL_COUNT; ++c) {
+            dev.cellUv[c] = ADBMS6832_CV_OFFSET_UV + qint32(20000 + c * 100 + next() % 2000) * ADBMS6832_CV_LSB_UV;
+            ref.cellUv[c] = dev.cellUv[c];
+        }
+        store.append(sample);
+        all.append(ref);
+
+        if (i % 20000 != 19999) continue;
+        for (int c : kCells) {
+            for (qint64 span : {CELL_STATS_MINUTE_NS, 37000000000LL, CELL_STATS_HOUR_NS, CELL_STATS_DAY_NS}) {
+                const CellStatsStore::Stats st = store.recent(0, c, span);
+                const QString why = compareStats(all, c, st);
+                QVERIFY2(why.isEmpty(), qPrintable(QString("sample %1 cell %2 %3: %4")
+                                                   .arg(i).arg(c).arg(CellStatsStore::spanName(span)).arg(why)));
+                QVERIFY(st.toNs == t);
+                ++checks;
+            }
+
+            // 起點/終點比 1 s 層 (4 分鐘) 或 10 s 層 (42 分鐘) 的保留範圍更舊: 兩端各自對齊到仍保留的最細層級
+            struct {
+                qint64 t0Ago, t1Ago, fromTierNs, toTierNs;
+            } const kWindows[] = {
+                { 30 * CELL_STATS_MINUTE_NS, CELL_STATS_MINUTE_NS,      10000000000LL, 1000000000LL },
+                { 30 * CELL_STATS_MINUTE_NS, 10 * CELL_STATS_MINUTE_NS, 10000000000LL, 10000000000LL },
+                { 3 * CELL_STATS_HOUR_NS,    50 * CELL_STATS_MINUTE_NS, CELL_STATS_MINUTE_NS, CELL_STATS_MINUTE_NS },
+            };
+            for (const auto &w : kWindows) {
+                const qint64 t0 = t - w.t0Ago;
+                const qint64 t1 = t - w.t1Ago;
+                const CellStatsStore::Stats st = store.stats(0, c, t0, t1);
+                const QString why = compareStats(all, c, st);
+                QVERIFY2(why.isEmpty(), qPrintable(QString("sample %1 cell %2 [-%3, -%4]: %5").arg(i).arg(c)
+                                                   .arg(CellStatsStore::spanName(w.t0Ago))
+                                                   .arg(CellStatsStore::spanName(w.t1Ago)).arg(why)));
+                QVERIFY(st.fromNs == all.first().timeNs
+                        || (st.fromNs <= t0 && t0 - st.fromNs < w.fromTierNs && st.fromNs % w.fromTierNs == 0));
+                QVERIFY(st.toNs >= t1 && st.toNs - t1 < w.toTierNs && (st.toNs + 1) % w.toTierNs == 0);
+                ++checks;
+            }
+        }
+    }
+    QCOMPARE(checks, 5 * 3 * (4 + 3));
+    QVERIFY(t - all.first().timeNs > 4 * CELL_STATS_HOUR_NS);   // 1 小時視窗已超出 1 s/10 s 層
+}
+
+/* 30 天每約 10 分鐘一筆: 超出 1 h 層 (10 天) 的部分由 1 d 層提供, 比 1 d 層 (16 天) 更舊的捨棄 */
+void AcquisitionTest::statsRetention()
+{
+    CellStatsStore store;
+    QVector<StatsRef> all;
+    AfeChainSample sample;
+    sample.devices.resize(1);
+    AfeDeviceSample &dev = sample.devices[0];
+    dev.cellValid = 0xFFFF;
+
+    quint32 noise = 0x9E3779B9;     // xorshift32, 固定種子
+    auto next = [&noise]() {
+        noise ^= noise << 13;
+        noise ^= noise >> 17;
+        noise ^= noise << 5;
+        return noise;
+    };
+
+    qint64 t = 0;
+    while (t < 30 * CELL_STATS_DAY_NS) {
+        t += 10 * CELL_STATS_MINUTE_NS + qint64(next() % 60000) * 1000000LL;
+        sample.timeNs = t;
+        StatsRef ref;
+        ref.timeNs = t;
+        ref.valid = dev.cellValid;
+        for (int c = 0; c < ADBMS6832_CELL_COUNT; ++c) {
+            dev.cellUv[c] = ADBMS6832_CV_OFFSET_UV + qint32(20000 + next() % 2000) * ADBMS6832_CV_LSB_UV;
+            ref.cellUv[c] = dev.cellUv[c];
+        }
+        store.append(sample);
+        all.append(ref);
+    }
+
+    const qint64 oldestNs = (t / CELL_STATS_DAY_NS - CELL_STATS_TOP_SLOTS + 1) * CELL_STATS_DAY_NS;
+    for (qint64 span : {3 * CELL_STATS_DAY_NS, 12 * CELL_STATS_DAY_NS, 40 * CELL_STATS_DAY_NS}) {
+        const CellStatsStore::Stats st = store.recent(0, 3, span);
+        const QString why = compareStats(all, 3, st);
+        QVERIFY2(why.isEmpty(), qPrintable(QString("%1: %2").arg(CellStatsStore::spanName(span)).arg(why)));
+        QVERIFY(st.fromNs >= oldestNs && st.toNs == t);
+    }
+    QCOMPARE(store.recent(0, 3, 40 * CELL_STATS_DAY_NS).fromNs, oldestNs);
+
+    // 終點在 1 h 層的保留範圍之外: 對齊到 1 d
+    const CellStatsStore::Stats st = store.stats(0, 3, t - 20 * CELL_STATS_DAY_NS, t - 11 * CELL_STATS_DAY_NS);
+    const QString why = compareStats(all, 3, st);
+    QVERIFY2(why.isEmpty(), qPrintable(why));
+    QVERIFY(st.count > 0 && st.fromNs == oldestNs && (st.toNs + 1) % CELL_STATS_DAY_NS == 0);
+
+    QCOMPARE(store.stats(0, 3, t - 25 * CELL_STATS_DAY_NS, t - 20 * CELL_STATS_DAY_NS).count, quint64(0));
+}
+
+QTEST_GUILESS_MAIN(AcquisitionTest)
+
+#include "test_acquisition.moc"
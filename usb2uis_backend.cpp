@@ -0,0 +1,80 @@
+#include "usb2uis_backend.h"
+#include "adbms6832_sim_backend.h"
+#include "usb2uis_dll_backend.h"
+#include "usb2uis_record_backend.h"
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QtGlobal>
+
+/* 取得 "--name value" 或 "--name=value" 形式的參數 */
+static QString argValue(const QStringList &args, const QString &name, const QString &def = QString())
+{
+    for (int i = 0; i < args.size(); ++i) {
+        const QString &a = args[i];
+        if (a == name && i + 1 < args.size()) return args[i + 1];
+        if (a.startsWith(name + "=")) return a.mid(name.size() + 1);
+    }
+    return def;
+}
+
+static Usb2UisBackend *createBackend(const QStringList &args, const QString &backend, bool record, QString *errorMsg)
+{
+    if (backend.isEmpty() || backend == "dll") {
+        if (!record) return nullptr;
+
+        // 紀錄 DLL 的呼叫時由這裡載入, 否則由 Usb2UisInterface::init 載入
+        Usb2UisDllBackend *dll = new Usb2UisDllBackend;
+        if (!dll->load(QDir(QCoreApplication::applicationDirPath()).filePath("usb2uis.dll"))) {
+            delete dll;
+            if (errorMsg) *errorMsg = "Cannot load usb2uis.dll";
+            return nullptr;
+        }
+        return dll;
+    }
+
+    if (backend == "sim") {
+        Adbms6832SimConfig cfg;
+        cfg.deviceCount   = argValue(args, "--sim-devices",    "1").toInt();
+        cfg.adapterCount  = argValue(args, "--sim-adapters",   "1").toInt();
+        cfg.callLatencyUs = argValue(args, "--sim-latency-us", "0").toInt();
+        cfg.errorAboveKHz = argValue(args, "--sim-error-khz",  "0").toInt();
+        cfg.byteErrorRate = argValue(args, "--sim-byte-error", "1e-3").toDouble();
+        cfg.callFailRate  = argValue(args, "--sim-call-fail",  "0").toDouble();
+        return new Adbms6832SimBackend(cfg);
+    }
+
+    if (backend == "replay") {
+        const QString path = argValue(args, "--replay-file");
+        if (path.isEmpty()) {
+            if (errorMsg) *errorMsg = "--backend replay requires --replay-file";
+            return nullptr;
+        }
+        Usb2UisReplayBackend *replay = new Usb2UisReplayBackend;
+        if (!replay->open(path, errorMsg)) {
+            delete replay;
+            return nullptr;
+        }
+        replay->setSpeed(argValue(args, "--replay-speed", "1").toDouble());
+        return replay;
+    }
+
+    if (errorMsg) *errorMsg = QString("Unknown backend: %1").arg(backend);
+    return nullptr;
+}
+
+Usb2UisBackend *Usb2UisBackend::fromArguments(const QStringList &args, QString *errorMsg)
+{
+    const QString backend = argValue(args, "--backend", qEnvironmentVariable("USB2UIS_BACKEND"));
+    const QString recordPath = argValue(args, "--record");
+
+    Usb2UisBackend *inner = createBackend(args, backend, !recordPath.isEmpty(), errorMsg);
+    if (!inner || recordPath.isEmpty()) return inner;
+
+    Usb2UisRecordBackend *rec = new Usb2UisRecordBackend(inner);
+    if (!rec->open(recordPath, errorMsg)) {
+        delete rec;
+        return nullptr;
+    }
+    return rec;
+}
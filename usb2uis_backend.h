@@ -0,0 +1,61 @@
+#ifndef USB2UIS_BACKEND_H
+#define USB2UIS_BACKEND_H
+
+#include <QString>
+#include <QStringList>
+
+typedef unsigned char BYTE;
+typedef unsigned short WORD;
+typedef unsigned int long DWORD;
+
+#define USB2UIS_SPI_RATE_COUNT      9       // SPI speed index 0..8 (config byte bit3~0)
+
+/* SPI speed index (comboSpiSpeed 順序) → kHz */
+inline int usb2uisSpiRateKHz(int rate)
+{
+    static const int kRateKHz[USB2UIS_SPI_RATE_COUNT] = { 200, 400, 600, 800, 1000, 2000, 4000, 6000, 12000 };
+    return kRateKHz[rate < 0 ? 0 : rate >= USB2UIS_SPI_RATE_COUNT ? USB2UIS_SPI_RATE_COUNT - 1 : rate];
+}
+
+/*
+ * Usb2UisBackend
+ *  USB2UIS 十個 entry point 的傳輸後端介面.
+ *  DLL (實機) 與模擬 AFE chain 都實作此介面, Usb2UisInterface 只做轉呼叫.
+ *  同一個 index 的呼叫由單一執行緒發出; 不同 index 可並行.
+ */
+class Usb2UisBackend
+{
+public:
+    virtual ~Usb2UisBackend() {}
+
+    virtual QString name() const = 0;
+
+    virtual BYTE openDevice() = 0;
+    virtual bool closeDevice(BYTE index) = 0;
+    virtual bool spiSetConfig(BYTE index, BYTE rate, DWORD timeout) = 0;
+    virtual bool spiRead(BYTE index, BYTE* cmd, BYTE cmdSize, BYTE* buffer, WORD size) = 0;
+    virtual bool spiWrite(BYTE index, BYTE* cmd, BYTE cmdSize, BYTE* buffer, WORD size) = 0;
+    virtual bool setCE(BYTE index, bool high) = 0;
+
+    virtual bool getGPIOConfig(BYTE index, BYTE *dirByte) = 0;
+    virtual bool setGPIOConfig(BYTE index, BYTE  dirByte) = 0;
+    virtual bool gpioRead     (BYTE index, BYTE *valueByte) = 0;
+    virtual bool gpioWrite    (BYTE index, BYTE  valueByte, BYTE  maskByte) = 0;
+
+    /*
+     * 依命令列參數建立後端, 未指定時回傳 nullptr (使用 DLL).
+     *   --backend sim|dll|replay
+     *   --sim-devices N        chain 上的 AFE 數量
+     *   --sim-adapters N       模擬的 USB2UIS 數量
+     *   --sim-latency-us N     每次 DLL 呼叫的額外延遲
+     *   --sim-error-khz N      SPI clock 高於 N kHz 時讀回資料出現 bit error
+     *   --sim-byte-error X     在 2 x N kHz 時每個讀回 Byte 的錯誤機率 (預設 1e-3)
+     *   --sim-call-fail X      每次 SPI 讀寫呼叫失敗的機率 (USB 傳輸錯誤)
+     *   --replay-file F        replay 的紀錄檔 (*.u2rec)
+     *   --replay-speed X       1 = 原本的時間, 2 = 兩倍速, 0 = 不等待
+     *   --record F             所有呼叫另存紀錄檔 (任何後端, 包含 DLL)
+     */
+    static Usb2UisBackend *fromArguments(const QStringList &args, QString *errorMsg = nullptr);
+};
+
+#endif // USB2UIS_BACKEND_H
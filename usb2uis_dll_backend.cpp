@@ -0,0 +1,63 @@
+#include "usb2uis_dll_backend.h"
+
+bool Usb2UisDllBackend::load(const QString &dllPath)
+{
+    m_lib.setFileName(dllPath);
+    if (!m_lib.load()) return false;
+
+    pOpenDevice   = (BYTE (__stdcall*)()) m_lib.resolve("USBIO_OpenDevice");
+    pCloseDevice  = (bool (__stdcall*)(BYTE)) m_lib.resolve("USBIO_CloseDevice");
+    pSPISetConfig = (bool (__stdcall*)(BYTE, BYTE, DWORD)) m_lib.resolve("USBIO_SPISetConfig");
+    pSPIRead      = (bool (__stdcall*)(BYTE, BYTE*, BYTE, BYTE*, WORD)) m_lib.resolve("USBIO_SPIRead");
+    pSPIWrite     = (bool (__stdcall*)(BYTE, BYTE*, BYTE, BYTE*, WORD)) m_lib.resolve("USBIO_SPIWrite");
+
+    pSetCE = (bool (__stdcall*)(BYTE, bool)) m_lib.resolve("USBIO_SetCE");
+
+    pGetGPIOCfg    = (bool (__stdcall*)(BYTE,BYTE*))          m_lib.resolve("USBIO_GetGPIOConfig");
+    pSetGPIOCfg    = (bool (__stdcall*)(BYTE,BYTE))           m_lib.resolve("USBIO_SetGPIOConfig");
+    pGPIORead      = (bool (__stdcall*)(BYTE,BYTE*))          m_lib.resolve("USBIO_GPIORead");
+    pGPIOWrite     = (bool (__stdcall*)(BYTE,BYTE,BYTE))      m_lib.resolve("USBIO_GPIOWrite");
+
+    return(pOpenDevice && pCloseDevice && pSPISetConfig && pSPIRead && pSPIWrite && pSetCE &&
+           pGetGPIOCfg && pSetGPIOCfg && pGPIORead && pGPIOWrite);
+}
+
+BYTE Usb2UisDllBackend::openDevice() {
+    return pOpenDevice ? pOpenDevice() : 0xFF;
+}
+
+bool Usb2UisDllBackend::closeDevice(BYTE index) {
+    return pCloseDevice && pCloseDevice(index);
+}
+
+bool Usb2UisDllBackend::spiSetConfig(BYTE index, BYTE rate, DWORD timeout) {
+    return pSPISetConfig && pSPISetConfig(index, rate, timeout);
+}
+
+bool Usb2UisDllBackend::spiRead(BYTE index, BYTE* cmd, BYTE cmdSize, BYTE* buffer, WORD size) {
+    return pSPIRead && pSPIRead(index, cmd, cmdSize, buffer, size);
+}
+
+bool Usb2UisDllBackend::spiWrite(BYTE index, BYTE* cmd, BYTE cmdSize, BYTE* buffer, WORD size) {
+    return pSPIWrite && pSPIWrite(index, cmd, cmdSize, buffer, size);
+}
+
+bool Usb2UisDllBackend::setCE(BYTE index, bool high) {
+    return pSetCE && pSetCE(index, high);
+}
+
+bool Usb2UisDllBackend::getGPIOConfig(BYTE i,BYTE *d){
+    return pGetGPIOCfg && pGetGPIOCfg(i,d);
+}
+
+bool Usb2UisDllBackend::setGPIOConfig(BYTE i,BYTE  d){
+    return pSetGPIOCfg && pSetGPIOCfg(i,d);
+}
+
+bool Usb2UisDllBackend::gpioRead(BYTE i,BYTE *v){
+    return pGPIORead   && pGPIORead(i,v);
+}
+
+bool Usb2UisDllBackend::gpioWrite(BYTE i,BYTE  v,BYTE m){
+    return pGPIOWrite  && pGPIOWrite(i,v,m);
+}
@@ -0,0 +1,47 @@
+#ifndef USB2UIS_DLL_BACKEND_H
+#define USB2UIS_DLL_BACKEND_H
+
+#include <QLibrary>
+#include "usb2uis_backend.h"
+
+#ifndef _WIN32
+#define __stdcall
+#endif
+
+/* 實機後端: QLibrary 載入 usb2uis.dll */
+class Usb2UisDllBackend : public Usb2UisBackend
+{
+public:
+    bool load(const QString &dllPath);
+
+    QString name() const override { return "dll"; }
+
+    BYTE openDevice() override;
+    bool closeDevice(BYTE index) override;
+    bool spiSetConfig(BYTE index, BYTE rate, DWORD timeout) override;
+    bool spiRead(BYTE index, BYTE* cmd, BYTE cmdSize, BYTE* buffer, WORD size) override;
+    bool spiWrite(BYTE index, BYTE* cmd, BYTE cmdSize, BYTE* buffer, WORD size) override;
+    bool setCE(BYTE index, bool high) override;
+
+    bool getGPIOConfig(BYTE index, BYTE *dirByte) override;
+    bool setGPIOConfig(BYTE index, BYTE  dirByte) override;
+    bool gpioRead     (BYTE index, BYTE *valueByte) override;
+    bool gpioWrite    (BYTE index, BYTE  valueByte, BYTE  maskByte) override;
+
+private:
+    QLibrary m_lib;
+
+    BYTE (__stdcall *pOpenDevice)(void) = nullptr;
+    bool (__stdcall *pCloseDevice)(BYTE) = nullptr;
+    bool (__stdcall *pSPISetConfig)(BYTE, BYTE, DWORD) = nullptr;
+    bool (__stdcall *pSPIRead)(BYTE, BYTE*, BYTE, BYTE*, WORD) = nullptr;
+    bool (__stdcall *pSPIWrite)(BYTE, BYTE*, BYTE, BYTE*, WORD) = nullptr;
+    bool (__stdcall *pSetCE)(BYTE, bool) = nullptr;
+
+    bool (__stdcall *pGetGPIOCfg)    (BYTE,BYTE*) = nullptr;
+    bool (__stdcall *pSetGPIOCfg)    (BYTE,BYTE) = nullptr;
+    bool (__stdcall *pGPIORead)      (BYTE,BYTE*) = nullptr;
+    bool (__stdcall *pGPIOWrite)     (BYTE,BYTE,BYTE) = nullptr;
+};
+
+#endif // USB2UIS_DLL_BACKEND_H
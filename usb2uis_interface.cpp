@@ -1,77 +1,177 @@
 #include "usb2uis_interface.h"
+#include "usb2uis_dll_backend.h"
 
-QLibrary Usb2UisInterface::m_lib;
+Usb2UisBackend *Usb2UisInterface::m_backend = nullptr;
 
-BYTE (__stdcall *Usb2UisInterface::pOpenDevice)(void) = nullptr;
-bool (__stdcall *Usb2UisInterface::pCloseDevice)(BYTE) = nullptr;
-bool (__stdcall *Usb2UisInterface::pSPISetConfig)(BYTE, BYTE, DWORD) = nullptr;
-bool (__stdcall *Usb2UisInterface::pSPIRead)(BYTE, BYTE*, BYTE, BYTE*, WORD) = nullptr;
-bool (__stdcall *Usb2UisInterface::pSPIWrite)(BYTE, BYTE*, BYTE, BYTE*, WORD) = nullptr;
-bool (__stdcall *Usb2UisInterface::pSetCE)(BYTE, bool) = nullptr;
+/* 每個 index 一份; 狀態欄位只由該 index 的執行緒存取, 統計為 atomic */
+struct Usb2UisShadow {
+    int  dir   = -1;            // GPIO 方向, -1 = 未知
+    BYTE known = 0;             // 輸出電平已知的腳位
+    BYTE level = 0;
+    int  ce    = -1;            // -1 未知, 0 LOW, 1 HIGH
 
-bool  (__stdcall *Usb2UisInterface::pGetGPIOCfg)   (BYTE,BYTE*)           = nullptr;
-bool  (__stdcall *Usb2UisInterface::pSetGPIOCfg)   (BYTE,BYTE)            = nullptr;
-bool  (__stdcall *Usb2UisInterface::pGPIORead)     (BYTE,BYTE*)           = nullptr;
-bool  (__stdcall *Usb2UisInterface::pGPIOWrite)    (BYTE,BYTE,BYTE)       = nullptr;
+    std::atomic<quint64> gpioIssued{0};
+    std::atomic<quint64> gpioSkipped{0};
+    std::atomic<quint64> ceIssued{0};
+    std::atomic<quint64> ceSkipped{0};
+    std::atomic<quint64> dirSkipped{0};
 
-bool Usb2UisInterface::init(const QString &dllPath)
-{
-    m_lib.setFileName(dllPath);
-    if (!m_lib.load()) return false;
+    void invalidate() { dir = -1; known = 0; ce = -1; }
+};
 
-    pOpenDevice   = (BYTE (__stdcall*)()) m_lib.resolve("USBIO_OpenDevice");
-    pCloseDevice  = (bool (__stdcall*)(BYTE)) m_lib.resolve("USBIO_CloseDevice");
-    pSPISetConfig = (bool (__stdcall*)(BYTE, BYTE, DWORD)) m_lib.resolve("USBIO_SPISetConfig");
-    pSPIRead      = (bool (__stdcall*)(BYTE, BYTE*, BYTE, BYTE*, WORD)) m_lib.resolve("USBIO_SPIRead");
-    pSPIWrite     = (bool (__stdcall*)(BYTE, BYTE*, BYTE, BYTE*, WORD)) m_lib.resolve("USBIO_SPIWrite");
+static Usb2UisShadow     s_shadow[256];
+static std::atomic<bool> s_shadowEnabled(true);
 
-    pSetCE = (bool (__stdcall*)(BYTE, bool)) m_lib.resolve("USBIO_SetCE");
+static inline void bump(std::atomic<quint64> &counter)
+{
+    counter.fetch_add(1, std::memory_order_relaxed);
+}
 
-    pGetGPIOCfg    = (bool (__stdcall*)(BYTE,BYTE*))          m_lib.resolve("USBIO_GetGPIOConfig");
-    pSetGPIOCfg    = (bool (__stdcall*)(BYTE,BYTE))           m_lib.resolve("USBIO_SetGPIOConfig");
-    pGPIORead      = (bool (__stdcall*)(BYTE,BYTE*))          m_lib.resolve("USBIO_GPIORead");
-    pGPIOWrite     = (bool (__stdcall*)(BYTE,BYTE,BYTE))      m_lib.resolve("USBIO_GPIOWrite");
+bool Usb2UisInterface::init(const QString &dllPath)
+{
+    Usb2UisDllBackend *dll = new Usb2UisDllBackend;
+    bool ok = dll->load(dllPath);
+    setBackend(dll);
+    return ok;
+}
 
-    return(pOpenDevice && pCloseDevice && pSPISetConfig && pSPIRead && pSPIWrite && pSetCE &&
-           pGetGPIOCfg && pSetGPIOCfg && pGPIORead && pGPIOWrite);
+void Usb2UisInterface::setBackend(Usb2UisBackend *backend)
+{
+    if (m_backend == backend) return;
+    delete m_backend;
+    m_backend = backend;
+}
+
+Usb2UisBackend *Usb2UisInterface::backend()
+{
+    return m_backend;
 }
 
 BYTE Usb2UisInterface::USBIO_OpenDevice() {
-    return pOpenDevice ? pOpenDevice() : 0xFF;
+    const BYTE index = m_backend ? m_backend->openDevice() : 0xFF;
+    if (index != 0xFF) s_shadow[index].invalidate();
+    return index;
 }
 
 bool Usb2UisInterface::USBIO_CloseDevice(BYTE index) {
-    return pCloseDevice && pCloseDevice(index);
+    s_shadow[index].invalidate();
+    return m_backend && m_backend->closeDevice(index);
 }
 
 bool Usb2UisInterface::USBIO_SPISetConfig(BYTE index, BYTE rate, DWORD timeout) {
-    return pSPISetConfig && pSPISetConfig(index, rate, timeout);
+    return m_backend && m_backend->spiSetConfig(index, rate, timeout);
 }
 
 bool Usb2UisInterface::USBIO_SPIRead(BYTE index, BYTE* cmd, BYTE cmdSize, BYTE* buffer, WORD size) {
-    return pSPIRead && pSPIRead(index, cmd, cmdSize, buffer, size);
+    return m_backend && m_backend->spiRead(index, cmd, cmdSize, buffer, size);
 }
 
 bool Usb2UisInterface::USBIO_SPIWrite(BYTE index, BYTE* cmd, BYTE cmdSize, BYTE* buffer, WORD size) {
-    return pSPIWrite && pSPIWrite(index, cmd, cmdSize, buffer, size);
+    return m_backend && m_backend->spiWrite(index, cmd, cmdSize, buffer, size);
 }
 
 bool Usb2UisInterface::USBIO_SetCE(BYTE index, bool high) {
-    return pSetCE && pSetCE(index, high);
+    Usb2UisShadow &sh = s_shadow[index];
+    if (sh.ce == int(high) && shadowEnabled()) {
+        bump(sh.ceSkipped);
+        return true;
+    }
+
+    bump(sh.ceIssued);
+    const bool ok = m_backend && m_backend->setCE(index, high);
+    sh.ce = ok ? int(high) : -1;
+    return ok;
 }
 
 bool Usb2UisInterface::USBIO_GetGPIOConfig(BYTE i,BYTE *d){
-    return pGetGPIOCfg && pGetGPIOCfg(i,d);
+    return m_backend && m_backend->getGPIOConfig(i,d);
 }
 
 bool Usb2UisInterface::USBIO_SetGPIOConfig(BYTE i,BYTE  d){
-    return pSetGPIOCfg && pSetGPIOCfg(i,d);
+    Usb2UisShadow &sh = s_shadow[i];
+    if (sh.dir == int(d) && shadowEnabled()) {
+        bump(sh.dirSkipped);
+        return true;
+    }
+
+    // 改變方向的腳位電平視為未知
+    sh.known &= (sh.dir < 0) ? BYTE(0) : BYTE(~(sh.dir ^ d));
+    const bool ok = m_backend && m_backend->setGPIOConfig(i,d);
+    sh.dir = ok ? int(d) : -1;
+    if (!ok) sh.known = 0;
+    return ok;
 }
 
 bool Usb2UisInterface::USBIO_GPIORead(BYTE i,BYTE *v){
-    return pGPIORead   && pGPIORead(i,v);
+    return m_backend && m_backend->gpioRead(i,v);
 }
 
+/* 只送出電平會改變 (或未知) 的腳位, 其餘腳位以 mask 保護 */
 bool Usb2UisInterface::USBIO_GPIOWrite(BYTE i,BYTE  v,BYTE m){
-    return pGPIOWrite  && pGPIOWrite(i,v,m);
+    Usb2UisShadow &sh = s_shadow[i];
+    const BYTE pins = BYTE(~m);
+    BYTE changed = pins;
+    if (shadowEnabled()) {
+        changed = pins & BYTE(~sh.known | (sh.level ^ v));
+        if (changed == 0) {
+            bump(sh.gpioSkipped);
+            return true;
+        }
+    }
+
+    bump(sh.gpioIssued);
+    const bool ok = m_backend && m_backend->gpioWrite(i, v, BYTE(~changed));
+    if (ok) {
+        sh.level = (sh.level & m) | (v & pins);
+        sh.known |= pins;
+    } else {
+        sh.known &= m;
+    }
+    return ok;
+}
+
+bool Usb2UisInterface::GPIOUpdate(BYTE index, BYTE setBits, BYTE clearBits)
+{
+    return USBIO_GPIOWrite(index, setBits, BYTE(~(setBits | clearBits)));
+}
+
+void Usb2UisInterface::setShadowEnabled(bool on)
+{
+    s_shadowEnabled.store(on, std::memory_order_relaxed);
+}
+
+bool Usb2UisInterface::shadowEnabled()
+{
+    return s_shadowEnabled.load(std::memory_order_relaxed);
+}
+
+void Usb2UisInterface::invalidateShadow(BYTE index)
+{
+    s_shadow[index].invalidate();
+}
+
+Usb2UisShadowStats Usb2UisInterface::shadowStats(BYTE index)
+{
+    const Usb2UisShadow &sh = s_shadow[index];
+    Usb2UisShadowStats st;
+    st.gpioIssued  = sh.gpioIssued.load(std::memory_order_relaxed);
+    st.gpioSkipped = sh.gpioSkipped.load(std::memory_order_relaxed);
+    st.ceIssued    = sh.ceIssued.load(std::memory_order_relaxed);
+    st.ceSkipped   = sh.ceSkipped.load(std::memory_order_relaxed);
+    st.dirSkipped  = sh.dirSkipped.load(std::memory_order_relaxed);
+    return st;
+}
+
+Usb2UisShadowStats Usb2UisInterface::shadowStatsTotal()
+{
+    Usb2UisShadowStats total;
+    for (int i = 0; i < 0xFF; ++i) {
+        const Usb2UisShadowStats st = shadowStats(BYTE(i));
+        total.gpioIssued  += st.gpioIssued;
+        total.gpioSkipped += st.gpioSkipped;
+        total.ceIssued    += st.ceIssued;
+        total.ceSkipped   += st.ceSkipped;
+        total.dirSkipped  += st.dirSkipped;
+    }
+    return total;
 }
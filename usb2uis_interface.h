@@ -1,17 +1,36 @@
 #ifndef USB2UIS_INTERFACE_H
 #define USB2UIS_INTERFACE_H
 
-#include <QLibrary>
 #include <QString>
+#include <atomic>
+#include "usb2uis_backend.h"
 
-typedef unsigned char BYTE;
-typedef unsigned short WORD;
-typedef unsigned int long DWORD;
+/* GPIO/CE shadow 的累計次數 (issued = 實際送出的 USB 呼叫) */
+struct Usb2UisShadowStats {
+    quint64 gpioIssued  = 0;
+    quint64 gpioSkipped = 0;
+    quint64 ceIssued    = 0;
+    quint64 ceSkipped   = 0;
+    quint64 dirSkipped  = 0;
 
+    quint64 skipped() const { return gpioSkipped + ceSkipped + dirSkipped; }
+};
+
+/*
+ * Usb2UisInterface
+ *  轉呼叫到目前的 Usb2UisBackend.
+ *  每個 index 保留 GPIO 方向, GPIO 輸出電平與 CE 的 shadow: 不改變狀態的 SetGPIOConfig / GPIOWrite / SetCE
+ *  直接回傳成功, 不送 USB. Shadow 在 Open/Close 與寫入失敗時失效; 與 backend 相同,
+ *  同一個 index 只由單一執行緒呼叫, 統計值可由任何執行緒讀取.
+ */
 class Usb2UisInterface {
 public:
     static bool init(const QString &dllPath = "usb2uis.dll");
 
+    // 指定傳輸後端 (取得 ownership), 例如 Adbms6832SimBackend
+    static void setBackend(Usb2UisBackend *backend);
+    static Usb2UisBackend *backend();
+
     static BYTE USBIO_OpenDevice();
     static bool USBIO_CloseDevice(BYTE index);
     static bool USBIO_SPISetConfig(BYTE index, BYTE rate, DWORD timeout);
@@ -30,20 +49,18 @@ public:
     static bool USBIO_GPIORead     (BYTE index, BYTE *valueByte);
     static bool USBIO_GPIOWrite    (BYTE index, BYTE  valueByte, BYTE  maskByte);
 
+    // 一次 USBIO_GPIOWrite 設定多個腳位: setBits 設 High, clearBits 設 Low, 其餘不變
+    static bool GPIOUpdate(BYTE index, BYTE setBits, BYTE clearBits);
+
+    // 關閉時每次呼叫都送出 (外部電路會改變腳位時使用)
+    static void setShadowEnabled(bool on);
+    static bool shadowEnabled();
+    static void invalidateShadow(BYTE index);       // 狀態未知, 下一次寫入一定送出
+    static Usb2UisShadowStats shadowStats(BYTE index);
+    static Usb2UisShadowStats shadowStatsTotal();
+
 private:
-    static QLibrary m_lib;
-
-    static BYTE (__stdcall *pOpenDevice)(void);
-    static bool (__stdcall *pCloseDevice)(BYTE);
-    static bool (__stdcall *pSPISetConfig)(BYTE, BYTE, DWORD);
-    static bool (__stdcall *pSPIRead)(BYTE, BYTE*, BYTE, BYTE*, WORD);
-    static bool (__stdcall *pSPIWrite)(BYTE, BYTE*, BYTE, BYTE*, WORD);
-    static bool (__stdcall *pSetCE)(BYTE, bool);
-
-    static bool (__stdcall *pGetGPIOCfg)    (BYTE,BYTE*);
-    static bool (__stdcall *pSetGPIOCfg)    (BYTE,BYTE);
-    static bool (__stdcall *pGPIORead)      (BYTE,BYTE*);
-    static bool (__stdcall *pGPIOWrite)     (BYTE,BYTE,BYTE);
+    static Usb2UisBackend *m_backend;
 };
 
 #endif // USB2UIS_INTERFACE_H
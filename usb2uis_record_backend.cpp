@@ -0,0 +1,376 @@
+#include "usb2uis_record_backend.h"
+#include "precision_timer.h"
+
+#include <QDateTime>
+#include <QDebug>
+#include <cstring>
+
+#define USB2UIS_REC_FLUSH_BYTES     (64 * 1024)
+
+static PrecisionWaitSite s_replaySite("replay");
+
+static inline int paddedSize(int n)
+{
+    return (n + 7) & ~7;
+}
+
+/* ---------------- Record ---------------- */
+
+Usb2UisRecordBackend::Usb2UisRecordBackend(Usb2UisBackend *inner)
+    : m_inner(inner)
+{
+}
+
+Usb2UisRecordBackend::~Usb2UisRecordBackend()
+{
+    flush();
+    m_file.close();
+    delete m_inner;
+}
+
+bool Usb2UisRecordBackend::open(const QString &path, QString *errorMsg)
+{
+    QMutexLocker lock(&m_mutex);
+    m_file.setFileName(path);
+    if (!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        if (errorMsg) *errorMsg = QString("Cannot create %1: %2").arg(path, m_file.errorString());
+        return false;
+    }
+
+    Usb2UisRecFileHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, USB2UIS_REC_FILE_MAGIC, sizeof(h.magic));
+    h.version     = USB2UIS_REC_FILE_VERSION;
+    h.headerSize  = sizeof(h);
+    h.startWallMs = QDateTime::currentMSecsSinceEpoch();
+    h.startNs     = PrecisionTimer::nowNs();
+    m_startNs     = h.startNs;
+
+    m_out.clear();
+    m_out.reserve(USB2UIS_REC_FLUSH_BYTES * 2);
+    m_out.append((const char*)&h, sizeof(h));
+    flushLocked();
+    return true;
+}
+
+void Usb2UisRecordBackend::flush()
+{
+    QMutexLocker lock(&m_mutex);
+    flushLocked();
+}
+
+void Usb2UisRecordBackend::flushLocked()
+{
+    if (!m_file.isOpen() || m_out.isEmpty()) return;
+    if (m_file.write(m_out) != m_out.size())
+        qDebug() << "[WARN] Cannot write USB record file:" << m_file.fileName();
+    m_file.flush();
+    m_out.clear();
+}
+
+void Usb2UisRecordBackend::append(eTypeUsb2UisCall call, BYTE index, bool ok, qint64 t0, qint64 t1,
+                                  BYTE arg, quint32 arg32, quint32 size,
+                                  const BYTE *d0, int n0, const BYTE *d1, int n1)
+{
+    Usb2UisRecord r;
+    r.timeNs   = t0 - m_startNs;
+    r.durNs    = quint32(qBound<qint64>(0, t1 - t0, 0xFFFFFFFFLL));
+    r.call     = quint8(call);
+    r.index    = index;
+    r.ok       = ok ? 1 : 0;
+    r.arg      = arg;
+    r.arg32    = arg32;
+    r.size     = size;
+    r.dataSize = quint32(n0 + n1);
+    r.reserved = 0;
+
+    static const char zeros[8] = {};
+    QMutexLocker lock(&m_mutex);
+    if (!m_file.isOpen()) return;
+    m_out.append((const char*)&r, sizeof(r));
+    if (n0) m_out.append((const char*)d0, n0);
+    if (n1) m_out.append((const char*)d1, n1);
+    m_out.append(zeros, paddedSize(n0 + n1) - (n0 + n1));
+    m_records.fetch_add(1, std::memory_order_relaxed);
+    if (m_out.size() >= USB2UIS_REC_FLUSH_BYTES) flushLocked();
+}
+
+BYTE Usb2UisRecordBackend::openDevice()
+{
+    const qint64 t0 = PrecisionTimer::nowNs();
+    const BYTE index = m_inner->openDevice();
+    append(USB2UIS_CALL_OPEN, index, index != 0xFF, t0, PrecisionTimer::nowNs());
+    return index;
+}
+
+bool Usb2UisRecordBackend::closeDevice(BYTE index)
+{
+    const qint64 t0 = PrecisionTimer::nowNs();
+    const bool ok = m_inner->closeDevice(index);
+    append(USB2UIS_CALL_CLOSE, index, ok, t0, PrecisionTimer::nowNs());
+    flush();
+    return ok;
+}
+
+bool Usb2UisRecordBackend::spiSetConfig(BYTE index, BYTE rate, DWORD timeout)
+{
+    const qint64 t0 = PrecisionTimer::nowNs();
+    const bool ok = m_inner->spiSetConfig(index, rate, timeout);
+    append(USB2UIS_CALL_SPI_SET_CONFIG, index, ok, t0, PrecisionTimer::nowNs(), rate, quint32(timeout));
+    return ok;
+}
+
+bool Usb2UisRecordBackend::spiRead(BYTE index, BYTE* cmd, BYTE cmdSize, BYTE* buffer, WORD size)
+{
+    const qint64 t0 = PrecisionTimer::nowNs();
+    const bool ok = m_inner->spiRead(index, cmd, cmdSize, buffer, size);
+    append(USB2UIS_CALL_SPI_READ, index, ok, t0, PrecisionTimer::nowNs(), cmdSize, 0, size,
+           cmd, cmdSize, buffer, size);
+    return ok;
+}
+
+bool Usb2UisRecordBackend::spiWrite(BYTE index, BYTE* cmd, BYTE cmdSize, BYTE* buffer, WORD size)
+{
+    const qint64 t0 = PrecisionTimer::nowNs();
+    const bool ok = m_inner->spiWrite(index, cmd, cmdSize, buffer, size);
+    append(USB2UIS_CALL_SPI_WRITE, index, ok, t0, PrecisionTimer::nowNs(), cmdSize, 0, size,
+           cmd, cmdSize, buffer, size);
+    return ok;
+}
+
+bool Usb2UisRecordBackend::setCE(BYTE index, bool high)
+{
+    const qint64 t0 = PrecisionTimer::nowNs();
+    const bool ok = m_inner->setCE(index, high);
+    append(USB2UIS_CALL_SET_CE, index, ok, t0, PrecisionTimer::nowNs(), high ? 1 : 0);
+    return ok;
+}
+
+bool Usb2UisRecordBackend::getGPIOConfig(BYTE index, BYTE *dirByte)
+{
+    const qint64 t0 = PrecisionTimer::nowNs();
+    const bool ok = m_inner->getGPIOConfig(index, dirByte);
+    append(USB2UIS_CALL_GET_GPIO_CONFIG, index, ok, t0, PrecisionTimer::nowNs(), ok ? *dirByte : 0);
+    return ok;
+}
+
+bool Usb2UisRecordBackend::setGPIOConfig(BYTE index, BYTE dirByte)
+{
+    const qint64 t0 = PrecisionTimer::nowNs();
+    const bool ok = m_inner->setGPIOConfig(index, dirByte);
+    append(USB2UIS_CALL_SET_GPIO_CONFIG, index, ok, t0, PrecisionTimer::nowNs(), dirByte);
+    return ok;
+}
+
+bool Usb2UisRecordBackend::gpioRead(BYTE index, BYTE *valueByte)
+{
+    const qint64 t0 = PrecisionTimer::nowNs();
+    const bool ok = m_inner->gpioRead(index, valueByte);
+    append(USB2UIS_CALL_GPIO_READ, index, ok, t0, PrecisionTimer::nowNs(), ok ? *valueByte : 0);
+    return ok;
+}
+
+bool Usb2UisRecordBackend::gpioWrite(BYTE index, BYTE valueByte, BYTE maskByte)
+{
+    const qint64 t0 = PrecisionTimer::nowNs();
+    const bool ok = m_inner->gpioWrite(index, valueByte, maskByte);
+    append(USB2UIS_CALL_GPIO_WRITE, index, ok, t0, PrecisionTimer::nowNs(), valueByte, 0, maskByte);
+    return ok;
+}
+
+/* ---------------- Replay ---------------- */
+
+Usb2UisReplayBackend::Usb2UisReplayBackend()
+{
+}
+
+Usb2UisReplayBackend::~Usb2UisReplayBackend()
+{
+    if (m_map) m_file.unmap(const_cast<uchar*>(m_map));
+    m_file.close();
+}
+
+/* 建立每個 index 的紀錄清單; 檔尾不完整的紀錄 (程式中斷) 直接忽略 */
+bool Usb2UisReplayBackend::open(const QString &path, QString *errorMsg)
+{
+    m_file.setFileName(path);
+    if (!m_file.open(QIODevice::ReadOnly)) {
+        if (errorMsg) *errorMsg = QString("Cannot open %1: %2").arg(path, m_file.errorString());
+        return false;
+    }
+
+    const qint64 size = m_file.size();
+    m_map = size > 0 ? m_file.map(0, size) : nullptr;
+    if (m_map) {
+        m_base = m_map;
+    } else {
+        m_data = m_file.readAll();
+        m_base = (const uchar*)m_data.constData();
+    }
+
+    Usb2UisRecFileHeader h;
+    if (size < qint64(sizeof(h))) {
+        if (errorMsg) *errorMsg = QString("%1: not a USB record file").arg(path);
+        return false;
+    }
+    memcpy(&h, m_base, sizeof(h));
+    if (memcmp(h.magic, USB2UIS_REC_FILE_MAGIC, sizeof(h.magic)) != 0
+        || h.headerSize < sizeof(h) || (h.headerSize & 7)) {
+        if (errorMsg) *errorMsg = QString("%1: not a USB record file").arg(path);
+        return false;
+    }
+    if (h.version != USB2UIS_REC_FILE_VERSION) {
+        if (errorMsg) *errorMsg = QString("%1: unsupported USB record file version %2").arg(path).arg(h.version);
+        return false;
+    }
+
+    qint64 pos = h.headerSize;
+    while (pos + qint64(sizeof(Usb2UisRecord)) <= size) {
+        const Usb2UisRecord *r = (const Usb2UisRecord*)(m_base + pos);
+        const qint64 next = pos + qint64(sizeof(Usb2UisRecord)) + paddedSize(r->dataSize);
+        if (next > size) break;
+        if ((r->call == USB2UIS_CALL_SPI_READ || r->call == USB2UIS_CALL_SPI_WRITE)
+            && quint64(r->arg) + r->size > r->dataSize) break;      // 資料損毀
+
+        if (r->call == USB2UIS_CALL_OPEN) {
+            if (r->ok) m_opens.append(r->index);
+        } else {
+            m_streams[r->index].records.append(pos);
+        }
+        ++m_recordCount;
+        pos = next;
+    }
+    return true;
+}
+
+Usb2UisReplayBackend::Stats Usb2UisReplayBackend::stats() const
+{
+    Stats st;
+    st.matched       = m_matched.load(std::memory_order_relaxed);
+    st.skipped       = m_skipped.load(std::memory_order_relaxed);
+    st.missing       = m_missing.load(std::memory_order_relaxed);
+    st.writeMismatch = m_writeMismatch.load(std::memory_order_relaxed);
+    return st;
+}
+
+/* 取下一筆相同種類的紀錄 (SPI 另需相同命令), 中間的紀錄略過 */
+const Usb2UisRecord *Usb2UisReplayBackend::take(BYTE index, eTypeUsb2UisCall call, const BYTE *cmd, BYTE cmdSize)
+{
+    Stream &s = m_streams[index];
+    const int end = qMin(s.records.size(), s.cursor + USB2UIS_REPLAY_LOOKAHEAD);
+    for (int i = s.cursor; i < end; ++i) {
+        const Usb2UisRecord *r = (const Usb2UisRecord*)(m_base + s.records.at(i));
+        if (r->call != call) continue;
+        if (cmd && (r->arg != cmdSize || memcmp(dataOf(r), cmd, cmdSize) != 0)) continue;
+
+        m_skipped.fetch_add(quint64(i - s.cursor), std::memory_order_relaxed);
+        m_matched.fetch_add(1, std::memory_order_relaxed);
+        s.cursor = i + 1;
+        waitFor(r);
+        return r;
+    }
+    m_missing.fetch_add(1, std::memory_order_relaxed);
+    return nullptr;
+}
+
+/*
+ * 第一筆對應的紀錄作為時間基準; 之後每次呼叫在原本結束的時間 (依 speed 縮放) 才返回.
+ * 呼叫端比原本慢時不等待, 不會追趕.
+ */
+void Usb2UisReplayBackend::waitFor(const Usb2UisRecord *r)
+{
+    if (m_speed <= 0) return;
+
+    const qint64 endRecNs = r->timeNs + r->durNs;
+    if (!m_anchored.load(std::memory_order_acquire)) {
+        QMutexLocker lock(&m_mutex);
+        if (!m_anchored.load(std::memory_order_relaxed)) {
+            m_anchorNs    = PrecisionTimer::nowNs();
+            m_anchorRecNs = r->timeNs;
+            m_anchored.store(true, std::memory_order_release);
+        }
+    }
+    PrecisionTimer::waitUntilNs(m_anchorNs + qint64((endRecNs - m_anchorRecNs) / m_speed), &s_replaySite);
+}
+
+BYTE Usb2UisReplayBackend::openDevice()
+{
+    QMutexLocker lock(&m_mutex);
+    if (m_openCursor >= m_opens.size()) return 0xFF;
+    return m_opens.at(m_openCursor++);
+}
+
+bool Usb2UisReplayBackend::closeDevice(BYTE index)
+{
+    const Usb2UisRecord *r = take(index, USB2UIS_CALL_CLOSE);
+    return r ? r->ok != 0 : true;
+}
+
+bool Usb2UisReplayBackend::spiSetConfig(BYTE index, BYTE rate, DWORD timeout)
+{
+    Q_UNUSED(rate);
+    Q_UNUSED(timeout);
+    const Usb2UisRecord *r = take(index, USB2UIS_CALL_SPI_SET_CONFIG);
+    return r ? r->ok != 0 : true;
+}
+
+bool Usb2UisReplayBackend::spiRead(BYTE index, BYTE* cmd, BYTE cmdSize, BYTE* buffer, WORD size)
+{
+    const Usb2UisRecord *r = take(index, USB2UIS_CALL_SPI_READ, cmd, cmdSize);
+    if (!r) {
+        memset(buffer, 0xFF, size);
+        return false;
+    }
+
+    // 讀取長度不同時只回傳重疊的部分, 其餘補 0xFF (與沒有回應的 isoSPI 相同)
+    const int n = qMin<int>(size, r->size);
+    memcpy(buffer, dataOf(r) + r->arg, size_t(n));
+    if (n < size) memset(buffer + n, 0xFF, size_t(size - n));
+    return r->ok != 0;
+}
+
+bool Usb2UisReplayBackend::spiWrite(BYTE index, BYTE* cmd, BYTE cmdSize, BYTE* buffer, WORD size)
+{
+    const Usb2UisRecord *r = take(index, USB2UIS_CALL_SPI_WRITE, cmd, cmdSize);
+    if (!r) return false;
+
+    if (r->size != size || (size && memcmp(dataOf(r) + r->arg, buffer, size) != 0))
+        m_writeMismatch.fetch_add(1, std::memory_order_relaxed);
+    return r->ok != 0;
+}
+
+bool Usb2UisReplayBackend::setCE(BYTE index, bool high)
+{
+    Q_UNUSED(high);
+    const Usb2UisRecord *r = take(index, USB2UIS_CALL_SET_CE);
+    return r ? r->ok != 0 : true;
+}
+
+bool Usb2UisReplayBackend::getGPIOConfig(BYTE index, BYTE *dirByte)
+{
+    const Usb2UisRecord *r = take(index, USB2UIS_CALL_GET_GPIO_CONFIG);
+    *dirByte = r ? r->arg : 0xFF;
+    return r ? r->ok != 0 : true;
+}
+
+bool Usb2UisReplayBackend::setGPIOConfig(BYTE index, BYTE dirByte)
+{
+    Q_UNUSED(dirByte);
+    const Usb2UisRecord *r = take(index, USB2UIS_CALL_SET_GPIO_CONFIG);
+    return r ? r->ok != 0 : true;
+}
+
+bool Usb2UisReplayBackend::gpioRead(BYTE index, BYTE *valueByte)
+{
+    const Usb2UisRecord *r = take(index, USB2UIS_CALL_GPIO_READ);
+    *valueByte = r ? r->arg : 0xFF;
+    return r ? r->ok != 0 : true;
+}
+
+bool Usb2UisReplayBackend::gpioWrite(BYTE index, BYTE valueByte, BYTE maskByte)
+{
+    Q_UNUSED(valueByte);
+    Q_UNUSED(maskByte);
+    const Usb2UisRecord *r = take(index, USB2UIS_CALL_GPIO_WRITE);
+    return r ? r->ok != 0 : true;
+}
@@ -0,0 +1,189 @@
+#ifndef USB2UIS_RECORD_BACKEND_H
+#define USB2UIS_RECORD_BACKEND_H
+
+#include <QByteArray>
+#include <QFile>
+#include <QMutex>
+#include <QString>
+#include <QVector>
+#include <atomic>
+#include "usb2uis_backend.h"
+
+/*
+ * USB 呼叫紀錄檔 (*.u2rec, little-endian, append-only)
+ *
+ *   Usb2UisRecFileHeader
+ *   { Usb2UisRecord, data[dataSize] } ...
+ *
+ *  data 補齊到 8 Bytes 邊界, 紀錄可直接由 map 的位址存取.
+ *  每筆紀錄一次 backend 呼叫 (Usb2UisInterface shadow 略過的呼叫不會到 backend, 因此也不紀錄).
+ *  timeNs 為呼叫開始時間 (相對 header.startNs), durNs 為呼叫耗時.
+ *    OPEN           index = 回傳的 index
+ *    SPI_SET_CONFIG arg = rate, arg32 = timeout
+ *    SPI_READ       arg = cmdSize, size = 讀取大小; data = cmd + 讀回的資料
+ *    SPI_WRITE      arg = cmdSize, size = 寫入大小; data = cmd + 寫入的資料
+ *    SET_CE         arg = high
+ *    GET_GPIO_CONFIG / GPIO_READ   arg = 讀回的值
+ *    SET_GPIO_CONFIG               arg = dirByte
+ *    GPIO_WRITE     arg = valueByte, size = maskByte
+ */
+
+#define USB2UIS_REC_FILE_MAGIC      "U2UREC01"
+#define USB2UIS_REC_FILE_VERSION    2       // 2: size/dataSize 為 32 bits
+
+typedef enum{
+    USB2UIS_CALL_OPEN = 1,
+    USB2UIS_CALL_CLOSE,
+    USB2UIS_CALL_SPI_SET_CONFIG,
+    USB2UIS_CALL_SPI_READ,
+    USB2UIS_CALL_SPI_WRITE,
+    USB2UIS_CALL_SET_CE,
+    USB2UIS_CALL_GET_GPIO_CONFIG,
+    USB2UIS_CALL_SET_GPIO_CONFIG,
+    USB2UIS_CALL_GPIO_READ,
+    USB2UIS_CALL_GPIO_WRITE,
+}eTypeUsb2UisCall;
+
+struct Usb2UisRecFileHeader {
+    char    magic[8];
+    quint32 version;
+    quint32 headerSize;
+    qint64  startWallMs;        // ms since epoch (UTC)
+    qint64  startNs;            // PrecisionTimer::nowNs() 基準
+};
+
+struct Usb2UisRecord {
+    qint64  timeNs;
+    quint32 durNs;              // 飽和於 0xFFFFFFFF
+    quint8  call;               // eTypeUsb2UisCall
+    quint8  index;
+    quint8  ok;                 // 回傳值
+    quint8  arg;
+    quint32 arg32;
+    quint32 size;
+    quint32 dataSize;           // cmd + 資料 (最多 255 + 65535 Bytes)
+    quint32 reserved;
+};
+
+static_assert(sizeof(Usb2UisRecFileHeader) == 32, "record file header layout");
+static_assert(sizeof(Usb2UisRecord) == 32, "record layout");
+
+/*
+ * Usb2UisRecordBackend
+ *  轉呼叫到 inner (取得 ownership), 並紀錄每次呼叫的參數, 回傳資料與時間.
+ *  紀錄先放在記憶體緩衝, 超過 64 KB 或 closeDevice 時才寫檔, 計時不包含寫檔.
+ */
+class Usb2UisRecordBackend : public Usb2UisBackend
+{
+public:
+    explicit Usb2UisRecordBackend(Usb2UisBackend *inner);
+    ~Usb2UisRecordBackend() override;
+
+    bool open(const QString &path, QString *errorMsg = nullptr);
+    void flush();
+    quint64 records() const { return m_records.load(std::memory_order_relaxed); }
+
+    QString name() const override { return m_inner->name() + "+rec"; }
+
+    BYTE openDevice() override;
+    bool closeDevice(BYTE index) override;
+    bool spiSetConfig(BYTE index, BYTE rate, DWORD timeout) override;
+    bool spiRead(BYTE index, BYTE* cmd, BYTE cmdSize, BYTE* buffer, WORD size) override;
+    bool spiWrite(BYTE index, BYTE* cmd, BYTE cmdSize, BYTE* buffer, WORD size) override;
+    bool setCE(BYTE index, bool high) override;
+
+    bool getGPIOConfig(BYTE index, BYTE *dirByte) override;
+    bool setGPIOConfig(BYTE index, BYTE  dirByte) override;
+    bool gpioRead     (BYTE index, BYTE *valueByte) override;
+    bool gpioWrite    (BYTE index, BYTE  valueByte, BYTE  maskByte) override;
+
+private:
+    Usb2UisBackend *m_inner;
+    QMutex      m_mutex;
+    QFile       m_file;
+    QByteArray  m_out;
+    qint64      m_startNs = 0;
+    std::atomic<quint64> m_records{0};
+
+    void append(eTypeUsb2UisCall call, BYTE index, bool ok, qint64 t0, qint64 t1,
+                BYTE arg = 0, quint32 arg32 = 0, quint32 size = 0,
+                const BYTE *d0 = nullptr, int n0 = 0, const BYTE *d1 = nullptr, int n1 = 0);
+    void flushLocked();
+};
+
+/*
+ * Usb2UisReplayBackend
+ *  以紀錄檔回應呼叫, 不需要實機. 每個 index 依序比對: 取下一筆相同種類 (SPI 為相同命令) 的紀錄,
+ *  中間不符的紀錄略過 (例如 shadow 設定不同); 在 USB2UIS_REPLAY_LOOKAHEAD 筆內找不到時為 missing:
+ *  SPI 呼叫回傳失敗, 其他呼叫回傳成功.
+ *  speed > 0 時依原本的時間回應 (呼叫在 原結束時間 / speed 才返回), 0 = 不等待.
+ *  回應的資料只取決於紀錄檔與呼叫順序, 與執行速度無關.
+ */
+#define USB2UIS_REPLAY_LOOKAHEAD    256
+
+class Usb2UisReplayBackend : public Usb2UisBackend
+{
+public:
+    struct Stats {
+        quint64 matched = 0;
+        quint64 skipped = 0;        // 被略過的紀錄
+        quint64 missing = 0;        // 找不到對應紀錄的呼叫
+        quint64 writeMismatch = 0;  // SPI 寫入資料與紀錄不同
+    };
+
+    Usb2UisReplayBackend();
+    ~Usb2UisReplayBackend() override;
+
+    bool open(const QString &path, QString *errorMsg = nullptr);
+    void setSpeed(double speed) { m_speed = speed; }
+    Stats stats() const;
+    int   recordCount() const   { return m_recordCount; }
+
+    QString name() const override { return "replay"; }
+
+    BYTE openDevice() override;
+    bool closeDevice(BYTE index) override;
+    bool spiSetConfig(BYTE index, BYTE rate, DWORD timeout) override;
+    bool spiRead(BYTE index, BYTE* cmd, BYTE cmdSize, BYTE* buffer, WORD size) override;
+    bool spiWrite(BYTE index, BYTE* cmd, BYTE cmdSize, BYTE* buffer, WORD size) override;
+    bool setCE(BYTE index, bool high) override;
+
+    bool getGPIOConfig(BYTE index, BYTE *dirByte) override;
+    bool setGPIOConfig(BYTE index, BYTE  dirByte) override;
+    bool gpioRead     (BYTE index, BYTE *valueByte) override;
+    bool gpioWrite    (BYTE index, BYTE  valueByte, BYTE  maskByte) override;
+
+private:
+    // 每個 index 的紀錄 (檔案 offset) 與目前位置, 只由該 index 的執行緒存取
+    struct Stream {
+        QVector<qint64> records;
+        int cursor = 0;
+    };
+
+    QFile        m_file;
+    const uchar *m_map = nullptr;
+    QByteArray   m_data;            // map 失敗時讀入記憶體
+    const uchar *m_base = nullptr;
+    int          m_recordCount = 0;
+    double       m_speed = 1.0;
+
+    Stream       m_streams[256];
+    QVector<BYTE> m_opens;          // OPEN 紀錄回傳的 index, 依序
+    int          m_openCursor = 0;
+
+    QMutex       m_mutex;           // m_openCursor, 時間基準
+    std::atomic<bool>   m_anchored{false};
+    qint64       m_anchorNs = 0;
+    qint64       m_anchorRecNs = 0;
+
+    std::atomic<quint64> m_matched{0};
+    std::atomic<quint64> m_skipped{0};
+    std::atomic<quint64> m_missing{0};
+    std::atomic<quint64> m_writeMismatch{0};
+
+    const Usb2UisRecord *take(BYTE index, eTypeUsb2UisCall call, const BYTE *cmd = nullptr, BYTE cmdSize = 0);
+    const BYTE *dataOf(const Usb2UisRecord *r) const { return (const BYTE*)(r + 1); }
+    void waitFor(const Usb2UisRecord *r);
+};
+
+#endif // USB2UIS_RECORD_BACKEND_H
@@ -0,0 +1,172 @@
+#include "usb2uis_submit_queue.h"
+#include "precision_timer.h"
+
+#include <memory>
+
+/*
+ * Bounded MPSC ring (D. Vyukov):
+ *  cell.seq == pos      → 空, producer 以 CAS 取得 tail = pos 後寫入, 完成時 seq = pos + 1
+ *  cell.seq == pos + 1  → 有資料, consumer 取出後 seq = pos + capacity (下一輪可寫)
+ *  producer 之間只競爭 tail 的 CAS; consumer 不需要任何 atomic RMW.
+ */
+Usb2UisSubmitQueue::Usb2UisSubmitQueue(int capacity)
+{
+    int n = 2;
+    while (n < capacity) n <<= 1;
+    m_cells = new Cell[n];
+    m_mask  = quint64(n - 1);
+    for (int i = 0; i < n; ++i) m_cells[i].seq.store(quint64(i), std::memory_order_relaxed);
+}
+
+Usb2UisSubmitQueue::~Usb2UisSubmitQueue()
+{
+    delete[] m_cells;
+}
+
+static void raiseMax(std::atomic<int> &max, int value)
+{
+    int prev = max.load(std::memory_order_relaxed);
+    while (value > prev && !max.compare_exchange_weak(prev, value, std::memory_order_relaxed)) {
+    }
+}
+
+bool Usb2UisSubmitQueue::submit(const SpiTransactionPlan &plan, UsbTransactionCallback done)
+{
+    quint64 pos = m_tail.load(std::memory_order_relaxed);
+    Cell *cell;
+    while (true) {
+        cell = &m_cells[pos & m_mask];
+        const qint64 diff = qint64(cell->seq.load(std::memory_order_acquire)) - qint64(pos);
+        if (diff == 0) {
+            if (m_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+        } else if (diff < 0) {
+            m_rejected.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        } else {
+            pos = m_tail.load(std::memory_order_relaxed);
+        }
+    }
+
+    cell->req.plan     = plan;
+    cell->req.done     = std::move(done);
+    cell->req.submitNs = PrecisionTimer::nowNs();
+    cell->seq.store(pos + 1, std::memory_order_release);
+
+    m_submitted.fetch_add(1, std::memory_order_relaxed);
+    const qint64 depthNow = qint64(pos + 1) - qint64(m_head.load(std::memory_order_relaxed));
+    if (depthNow > 0) raiseMax(m_maxDepth, int(depthNow));
+
+    // 寫完才檢查: drain 清掉旗標之後送出的交易一定會再通知一次
+    if (m_notify && !m_scheduled.exchange(true, std::memory_order_acq_rel)) m_notify();
+    return true;
+}
+
+std::future<UsbTransactionResult> Usb2UisSubmitQueue::submit(const SpiTransactionPlan &plan)
+{
+    std::shared_ptr<std::promise<UsbTransactionResult>> promise = std::make_shared<std::promise<UsbTransactionResult>>();
+    std::future<UsbTransactionResult> future = promise->get_future();
+    if (!submit(plan, [promise](const UsbTransactionResult &r) { promise->set_value(r); })) {
+        UsbTransactionResult r;
+        r.result = USB_TXN_REJECTED;
+        r.error  = "Submit queue full";
+        promise->set_value(r);
+    }
+    return future;
+}
+
+bool Usb2UisSubmitQueue::pop(Request &req)
+{
+    const quint64 pos = m_head.load(std::memory_order_relaxed);
+    Cell &cell = m_cells[pos & m_mask];
+    if (cell.seq.load(std::memory_order_acquire) != pos + 1) return false;     // 空, 或 producer 尚未寫完
+
+    req = std::move(cell.req);
+    cell.req = Request();
+    cell.seq.store(pos + m_mask + 1, std::memory_order_release);
+    m_head.store(pos + 1, std::memory_order_relaxed);
+    return true;
+}
+
+int Usb2UisSubmitQueue::drain(SpiPlanExecutor &executor, int maxBatch)
+{
+    m_scheduled.store(false, std::memory_order_release);
+
+    int n = 0;
+    Request req;
+    while ((maxBatch <= 0 || n < maxBatch) && pop(req)) {
+        UsbTransactionResult r;
+        const qint64 startNs = PrecisionTimer::nowNs();
+        r.waitNs = startNs - req.submitNs;
+        m_wait.record(r.waitNs);
+
+        const eTypeSpiPlanResult pr = executor.runCycle(req.plan, [&r](const SpiOp &, const BYTE *data, int size) {
+            r.data << QByteArray((const char*)data, size);
+            return true;
+        });
+        r.result = pr == SPI_PLAN_OK ? USB_TXN_OK : pr == SPI_PLAN_STOPPED ? USB_TXN_STOPPED : USB_TXN_ERROR;
+        if (pr == SPI_PLAN_ERROR) r.error = executor.lastError();
+        r.execNs = PrecisionTimer::nowNs() - startNs;
+
+        if (req.done) req.done(r);
+        m_completed.fetch_add(1, std::memory_order_relaxed);
+        ++n;
+    }
+
+    if (n) {
+        m_batches.fetch_add(1, std::memory_order_relaxed);
+        raiseMax(m_maxBatch, n);
+    }
+
+    // maxBatch 用完仍有剩餘 → 再排一次
+    if (depth() > 0 && m_notify && !m_scheduled.exchange(true, std::memory_order_acq_rel)) m_notify();
+    return n;
+}
+
+void Usb2UisSubmitQueue::cancelAll(const QString &reason)
+{
+    m_scheduled.store(false, std::memory_order_release);
+
+    Request req;
+    while (pop(req)) {
+        UsbTransactionResult r;
+        r.result = USB_TXN_CANCELLED;
+        r.error  = reason;
+        r.waitNs = PrecisionTimer::nowNs() - req.submitNs;
+        if (req.done) req.done(r);
+        m_cancelled.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+int Usb2UisSubmitQueue::depth() const
+{
+    const quint64 head = m_head.load(std::memory_order_relaxed);
+    const quint64 tail = m_tail.load(std::memory_order_relaxed);
+    return tail > head ? int(tail - head) : 0;
+}
+
+Usb2UisSubmitQueue::Stats Usb2UisSubmitQueue::stats() const
+{
+    Stats st;
+    st.submitted = m_submitted.load(std::memory_order_relaxed);
+    st.completed = m_completed.load(std::memory_order_relaxed);
+    st.rejected  = m_rejected.load(std::memory_order_relaxed);
+    st.cancelled = m_cancelled.load(std::memory_order_relaxed);
+    st.batches   = m_batches.load(std::memory_order_relaxed);
+    st.maxBatch  = m_maxBatch.load(std::memory_order_relaxed);
+    st.depth     = depth();
+    st.maxDepth  = m_maxDepth.load(std::memory_order_relaxed);
+    st.wait      = m_wait.stats();
+    return st;
+}
+
+void Usb2UisSubmitQueue::resetStats()
+{
+    m_submitted.store(0);
+    m_completed.store(0);
+    m_rejected.store(0);
+    m_cancelled.store(0);
+    m_batches.store(0);
+    m_maxBatch.store(0);
+    m_maxDepth.store(0);
+    m_wait.reset();
+}
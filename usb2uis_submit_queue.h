@@ -0,0 +1,105 @@
+#ifndef USB2UIS_SUBMIT_QUEUE_H
+#define USB2UIS_SUBMIT_QUEUE_H
+
+#include <QByteArray>
+#include <QList>
+#include <QString>
+#include <QVector>
+#include <atomic>
+#include <functional>
+#include <future>
+#include "spi_trace.h"
+#include "spi_transaction_plan.h"
+
+#define USB2UIS_SUBMIT_CAPACITY     256     // 2 的次方
+
+typedef enum{
+    USB_TXN_OK = 0,
+    USB_TXN_STOPPED,        // SPI_PLAN_STOPPED
+    USB_TXN_ERROR,          // abortOnError 且 USB 呼叫失敗, 見 error
+    USB_TXN_REJECTED,       // 佇列已滿, 未執行
+    USB_TXN_CANCELLED,      // 裝置未連線或已關閉, 未執行
+}eTypeUsbTxnResult;
+
+struct UsbTransactionResult {
+    BYTE              result = USB_TXN_OK;
+    QList<QByteArray> data;             // 每個 RESULT 一筆: READ 為讀回資料, 只送命令/WRITE 為送出的 bytes
+    QString           error;
+    qint64            waitNs = 0;       // submit → 開始執行
+    qint64            execNs = 0;
+};
+
+typedef std::function<void(const UsbTransactionResult &result)> UsbTransactionCallback;
+
+/*
+ * Usb2UisSubmitQueue
+ *  多個 producer (UI, 自動化, 其他執行緒) 送出 SpiTransactionPlan, 由擁有裝置的執行緒 drain() 依序執行.
+ *  固定容量的 lock-free MPSC ring (每個 cell 以 sequence 同步), submit 不會阻塞; 已滿時直接拒絕.
+ *  callback 在擁有裝置的執行緒呼叫, 需要更新 UI 時自行 queued 回 UI 執行緒.
+ *  同一次 drain 的交易連續執行, SpiPlanExecutor 記住 CS 電平與 chain 活動時間, 後續交易不需再 wake-up.
+ */
+class Usb2UisSubmitQueue
+{
+public:
+    struct Stats {
+        quint64 submitted = 0;
+        quint64 completed = 0;
+        quint64 rejected  = 0;
+        quint64 cancelled = 0;
+        quint64 batches   = 0;      // 有執行交易的 drain 次數
+        int     maxBatch  = 0;
+        int     depth     = 0;
+        int     maxDepth  = 0;
+        SpiPhaseHistogram::Stats wait = {}; // submit → 開始執行
+    };
+
+    explicit Usb2UisSubmitQueue(int capacity = USB2UIS_SUBMIT_CAPACITY);
+    ~Usb2UisSubmitQueue();
+
+    // 任何執行緒; false = 佇列已滿 (done 不會被呼叫)
+    bool submit(const SpiTransactionPlan &plan, UsbTransactionCallback done);
+    // 佇列已滿時 future 立即就緒 (USB_TXN_REJECTED)
+    std::future<UsbTransactionResult> submit(const SpiTransactionPlan &plan);
+
+    // 佇列由空變為有資料時, 由 submit 的執行緒呼叫一次 (例如 queued invoke 到擁有裝置的執行緒)
+    void setNotify(std::function<void()> notify) { m_notify = notify; }
+
+    // 擁有裝置的執行緒; maxBatch <= 0 = 全部. 回傳執行的交易數
+    int  drain(SpiPlanExecutor &executor, int maxBatch = 0);
+    void cancelAll(const QString &reason);
+
+    int   depth() const;
+    Stats stats() const;
+    void  resetStats();
+
+private:
+    struct Request {
+        SpiTransactionPlan     plan;
+        UsbTransactionCallback done;
+        qint64                 submitNs = 0;
+    };
+    struct Cell {
+        std::atomic<quint64> seq;
+        Request              req;
+    };
+
+    Cell      *m_cells;
+    quint64    m_mask;
+    alignas(64) std::atomic<quint64> m_tail{0};     // producers
+    alignas(64) std::atomic<quint64> m_head{0};     // consumer
+    std::atomic<bool> m_scheduled{false};
+    std::function<void()> m_notify;
+
+    std::atomic<quint64> m_submitted{0};
+    std::atomic<quint64> m_completed{0};
+    std::atomic<quint64> m_rejected{0};
+    std::atomic<quint64> m_cancelled{0};
+    std::atomic<quint64> m_batches{0};
+    std::atomic<int>     m_maxBatch{0};
+    std::atomic<int>     m_maxDepth{0};
+    SpiPhaseHistogram    m_wait;
+
+    bool pop(Request &req);
+};
+
+#endif // USB2UIS_SUBMIT_QUEUE_H